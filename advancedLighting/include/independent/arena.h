@@ -0,0 +1,183 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+/**
+\file arena.h
+*/
+#include <vector>
+#include <mutex>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+
+/**
+\class Arena
+\brief A monotonic allocator for transient data, such as a model load's scratch buffers, which is all released in one shot.
+
+Allocations bump a pointer through large blocks and are never freed individually, so scratch buffers cost no bookkeeping and can't
+fragment the heap. Allocating is thread safe, so jobs working on the same load can share one arena.
+*/
+class Arena
+{
+private:
+	//! A block allocations are carved from.
+	struct Block
+	{
+		unsigned char* data;	//!< Start of the block.
+		size_t size;			//!< Bytes in the block.
+	};
+
+	std::vector<Block> m_blocks;	//!< Blocks allocated so far, the last of which is being filled.
+	size_t m_used;					//!< Bytes of the last block handed out.
+	size_t m_blockSize;				//!< Smallest block to allocate.
+	size_t m_bytesAllocated;		//!< Bytes handed out since the arena was created or reset.
+	size_t m_peakBytes;				//!< Most bytes the blocks have held at once.
+	std::mutex m_mutex;				//!< Guards the blocks.
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+public:
+	static const size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024; //!< Default smallest block, large enough for most meshes' scratch buffers.
+
+	//! Constructor
+	/**
+	\param blockSize Smallest block to allocate. Larger allocations get a block of their own size.
+	*/
+	explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE) : m_used(0), m_blockSize(blockSize), m_bytesAllocated(0), m_peakBytes(0) {};
+
+	//! Destructor, which releases every block.
+	~Arena() { reset(); }
+
+	//! Allocates memory, which stays valid until the arena is reset or destroyed.
+	/**
+	\param bytes Bytes to allocate.
+	\param alignment Alignment of the memory, a power of two no larger than the heap's.
+	\return The memory.
+	*/
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t offset = (m_used + alignment - 1) & ~(alignment - 1);
+		if (m_blocks.empty() || offset + bytes > m_blocks.back().size)
+		{
+			Block block;
+			block.size = std::max(m_blockSize, bytes);
+			block.data = (unsigned char*)std::malloc(block.size);
+			if (!block.data)
+			{
+				throw std::bad_alloc();
+			}
+			m_blocks.push_back(block);
+			offset = 0;
+
+			size_t held = 0;
+			for (std::vector<Block>::const_iterator it = m_blocks.begin(); m_blocks.end() != it; ++it)
+			{
+				held += it->size;
+			}
+			m_peakBytes = std::max(m_peakBytes, held);
+		}
+		m_used = offset + bytes;
+		m_bytesAllocated += bytes;
+		return m_blocks.back().data + offset;
+	}
+
+	//! Releases every block at once. Nothing allocated from the arena may be used afterwards.
+	void reset()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (std::vector<Block>::const_iterator it = m_blocks.begin(); m_blocks.end() != it; ++it)
+		{
+			std::free(it->data);
+		}
+		m_blocks.clear();
+		m_used = 0;
+		m_bytesAllocated = 0;
+	}
+
+	//! Returns the bytes handed out since the arena was created or reset.
+	size_t getBytesAllocated() const { return m_bytesAllocated; }
+	//! Returns the most memory the arena's blocks have held at once.
+	size_t getPeakBytes() const { return m_peakBytes; }
+};
+
+/**
+\class ArenaAllocator
+\brief A standard library allocator which takes memory from an Arena, or from the heap if it has none, so containers of scratch data can
+use an arena when one is given.
+*/
+template <class T>
+class ArenaAllocator
+{
+	template <class U> friend class ArenaAllocator;
+private:
+	Arena* m_arena; //!< Arena to allocate from, or NULL for the heap.
+
+public:
+	typedef T value_type; //!< Type allocated.
+
+	//! Constructor
+	/**
+	\param arena Arena to allocate from, or NULL for the heap.
+	*/
+	ArenaAllocator(Arena* arena = NULL) : m_arena(arena) {};
+	//! Converting constructor, for containers which allocate their own node types.
+	template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {};
+
+	//! Allocates space for a number of elements.
+	T* allocate(size_t count)
+	{
+		return m_arena ? (T*)m_arena->allocate(count * sizeof(T), alignof(T)) : (T*)::operator new(count * sizeof(T));
+	}
+	//! Frees space from the heap. Arena memory is only released with the arena.
+	void deallocate(T* pointer, size_t)
+	{
+		if (!m_arena)
+		{
+			::operator delete(pointer);
+		}
+	}
+
+	template <class U> bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; } //!< Whether memory from one can be freed by the other.
+	template <class U> bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; } //!< Whether memory from one can't be freed by the other.
+};
+
+//! A vector of scratch data, allocated from an Arena when it's given one.
+template <class T> using ScratchVector = std::vector<T, ArenaAllocator<T> >;
+
+/**
+\class Span
+\brief A view of contiguous elements owned by something else, such as a vector of either allocator or part of a mapped file, passed
+instead of copying them.
+*/
+template <class T>
+class Span
+{
+private:
+	T* m_data;		//!< First element.
+	size_t m_size;	//!< Number of elements.
+
+public:
+	//! Constructor for an empty span.
+	Span() : m_data(NULL), m_size(0) {};
+	//! Constructor
+	/**
+	\param data First element.
+	\param size Number of elements.
+	*/
+	Span(T* data, size_t size) : m_data(data), m_size(size) {};
+	//! Constructor for a view of a whole vector.
+	template <class U, class Allocator> Span(std::vector<U, Allocator>& elements) : m_data(elements.empty() ? NULL : &elements[0]), m_size(elements.size()) {};
+	//! Constructor for a view of a whole vector, when the span's elements are const.
+	template <class U, class Allocator> Span(const std::vector<U, Allocator>& elements) : m_data(elements.empty() ? NULL : &elements[0]), m_size(elements.size()) {};
+
+	T* data() const { return m_data; }						//!< Returns the first element.
+	size_t size() const { return m_size; }					//!< Returns the number of elements.
+	bool empty() const { return m_size == 0; }				//!< Returns whether there are no elements.
+	T& operator[](size_t index) const { return m_data[index]; } //!< Returns an element.
+	T* begin() const { return m_data; }						//!< Returns the first element, for iterating.
+	T* end() const { return m_data + m_size; }				//!< Returns one past the last element, for iterating.
+};
+
+#endif
@@ -0,0 +1,468 @@
+#ifndef _BLOCK_COMPRESSION_H_
+#define _BLOCK_COMPRESSION_H_
+/**
+\file blockCompression.h
+*/
+#include <GLEW/glew.h>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include "simd.h"
+#include "jobSystem.h"
+#include "texture.h"
+
+/**
+\class BlockCompressor
+\brief Encodes RGBA8 images as BC1 (opaque colour), BC3 (colour with alpha) or BC5 (two channel normal maps), with their mip chains.
+
+Each 4x4 block is encoded independently: colour endpoints are fitted along the block's principal axis then refined by least squares,
+and every texel picks its nearest palette entry, four at a time with SSE2 where it's available. The blocks of each level are spread
+over the job system.
+*/
+class BlockCompressor
+{
+private:
+	//! Expands a 5:6:5 colour to 8 bits a channel, as the decoder does.
+	static void expand565(unsigned short colour, int rgb[3])
+	{
+		int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	//! Rounds a colour to 5:6:5.
+	static unsigned short quantise565(const float rgb[3])
+	{
+		int r = (int)(std::min(std::max(rgb[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		int g = (int)(std::min(std::max(rgb[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+		int b = (int)(std::min(std::max(rgb[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		return (unsigned short)((r << 11) | (g << 5) | b);
+	}
+
+	//! Picks the nearest of four palette colours for each texel of a block.
+	/**
+	\param block The block's texels, as RGBA8. Alpha is ignored.
+	\param palette The palette, as RGBA8 with alpha 0.
+	\param indices Where to store each texel's palette index.
+	\return The summed squared error of the block.
+	*/
+	static unsigned selectColourIndices(const unsigned char block[64], const unsigned char palette[16], unsigned char indices[16])
+	{
+		unsigned error = 0;
+#if SHADERS_SIMD_SSE
+		//Four texels at a time: widen to 16 bits, subtract each palette colour and square and pair up the channels with madd.
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i colourMask = _mm_set1_epi32(0x00ffffff);
+		for (int group = 0; group < 4; ++group)
+		{
+			__m128i texels = _mm_and_si128(_mm_loadu_si128((const __m128i*)(block + group * 16)), colourMask);
+			__m128i low = _mm_unpacklo_epi8(texels, zero), high = _mm_unpackhi_epi8(texels, zero);
+			__m128i best = _mm_set1_epi32(0x7fffffff), bestIndex = zero;
+			for (int entry = 0; entry < 4; ++entry)
+			{
+				int packed;
+				std::memcpy(&packed, palette + entry * 4, 4);
+				__m128i colour = _mm_unpacklo_epi8(_mm_set1_epi32(packed), zero);
+				__m128i lowDiff = _mm_sub_epi16(low, colour), highDiff = _mm_sub_epi16(high, colour);
+				__m128 lowPairs = _mm_castsi128_ps(_mm_madd_epi16(lowDiff, lowDiff));
+				__m128 highPairs = _mm_castsi128_ps(_mm_madd_epi16(highDiff, highDiff));
+				__m128i distance = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(lowPairs, highPairs, _MM_SHUFFLE(2, 0, 2, 0))),
+					_mm_castps_si128(_mm_shuffle_ps(lowPairs, highPairs, _MM_SHUFFLE(3, 1, 3, 1))));
+				__m128i closer = _mm_cmplt_epi32(distance, best);
+				best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+				bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(entry)), _mm_andnot_si128(closer, bestIndex));
+			}
+			SIMD_ALIGN(16) int distances[4], chosen[4];
+			_mm_store_si128((__m128i*)distances, best);
+			_mm_store_si128((__m128i*)chosen, bestIndex);
+			for (int i = 0; i < 4; ++i)
+			{
+				indices[group * 4 + i] = (unsigned char)chosen[i];
+				error += (unsigned)distances[i];
+			}
+		}
+#else
+		for (int i = 0; i < 16; ++i)
+		{
+			unsigned best = 0xffffffffu;
+			for (int entry = 0; entry < 4; ++entry)
+			{
+				int dr = block[i * 4] - palette[entry * 4], dg = block[i * 4 + 1] - palette[entry * 4 + 1], db = block[i * 4 + 2] - palette[entry * 4 + 2];
+				unsigned distance = (unsigned)(dr * dr + dg * dg + db * db);
+				if (distance < best)
+				{
+					best = distance;
+					indices[i] = (unsigned char)entry;
+				}
+			}
+			error += best;
+		}
+#endif
+		return error;
+	}
+
+	//! Builds the four colour palette of a pair of 5:6:5 endpoints, as RGBA8 with alpha 0.
+	static void buildPalette(unsigned short colour0, unsigned short colour1, unsigned char palette[16])
+	{
+		int c0[3], c1[3];
+		expand565(colour0, c0);
+		expand565(colour1, c1);
+		for (int i = 0; i < 3; ++i)
+		{
+			palette[i] = (unsigned char)c0[i];
+			palette[4 + i] = (unsigned char)c1[i];
+			palette[8 + i] = (unsigned char)((2 * c0[i] + c1[i]) / 3);
+			palette[12 + i] = (unsigned char)((c0[i] + 2 * c1[i]) / 3);
+		}
+		palette[3] = palette[7] = palette[11] = palette[15] = 0;
+	}
+
+	//! Encodes a pair of endpoints and their indices, ordered so the decoder uses four colours.
+	/**
+	\param colour0 First endpoint.
+	\param colour1 Second endpoint.
+	\param indices Each texel's index into the palette of colour0 and colour1.
+	\param out Where to write the 8 byte block.
+	*/
+	static void writeColourBlock(unsigned short colour0, unsigned short colour1, const unsigned char indices[16], unsigned char out[8])
+	{
+		//Swapping the endpoints swaps indices 0 with 1 and 2 with 3.
+		const bool swap = colour0 < colour1;
+		if (swap) std::swap(colour0, colour1);
+		unsigned bits = 0;
+		for (int i = 15; i >= 0; --i)
+		{
+			unsigned index = colour0 == colour1 ? 0 : (swap ? indices[i] ^ 1 : indices[i]);
+			bits = (bits << 2) | index;
+		}
+		out[0] = (unsigned char)(colour0 & 0xff);
+		out[1] = (unsigned char)(colour0 >> 8);
+		out[2] = (unsigned char)(colour1 & 0xff);
+		out[3] = (unsigned char)(colour1 >> 8);
+		out[4] = (unsigned char)(bits & 0xff);
+		out[5] = (unsigned char)((bits >> 8) & 0xff);
+		out[6] = (unsigned char)((bits >> 16) & 0xff);
+		out[7] = (unsigned char)(bits >> 24);
+	}
+
+	//! Refits a block's endpoints by least squares to the texels assigned to each palette entry.
+	/**
+	\param block The block's texels, as RGBA8.
+	\param indices Each texel's palette index.
+	\param colour0 Where to store the first endpoint.
+	\param colour1 Where to store the second endpoint.
+	\return Whether the fit was solvable, which it isn't when every texel has the same weight.
+	*/
+	static bool refineEndpoints(const unsigned char block[64], const unsigned char indices[16], unsigned short& colour0, unsigned short& colour1)
+	{
+		//Index 0 is all of endpoint 0, 1 all of endpoint 1, and 2 and 3 two thirds and one third of endpoint 0.
+		static const float WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; ++i)
+		{
+			float a = WEIGHTS[indices[i]], b = 1.0f - a;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			for (int c = 0; c < 3; ++c)
+			{
+				ax[c] += a * block[i * 4 + c];
+				bx[c] += b * block[i * 4 + c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+		{
+			return false;
+		}
+		float end0[3], end1[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+			end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+		}
+		colour0 = quantise565(end0);
+		colour1 = quantise565(end1);
+		return true;
+	}
+
+public:
+	//! Encodes a 4x4 block as BC1, ignoring alpha.
+	/**
+	\param block The block's texels, as RGBA8 in rows.
+	\param out Where to write the 8 byte block.
+	*/
+	static void encodeColourBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		//Fit a line through the colours along their principal axis, found by power iteration from the bounding box's diagonal.
+		float mean[3] = { 0.0f, 0.0f, 0.0f }, low[3] = { 255.0f, 255.0f, 255.0f }, high[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				float value = block[i * 4 + c];
+				mean[c] += value;
+				low[c] = std::min(low[c], value);
+				high[c] = std::max(high[c], value);
+			}
+		}
+		for (int c = 0; c < 3; ++c) mean[c] /= 16.0f;
+		float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; ++i)
+		{
+			float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+			covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+			covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+		}
+		float axis[3] = { high[0] - low[0], high[1] - low[1], high[2] - low[2] };
+		for (int iteration = 0; iteration < 4; ++iteration)
+		{
+			float x = axis[0] * covariance[0] + axis[1] * covariance[1] + axis[2] * covariance[2];
+			float y = axis[0] * covariance[1] + axis[1] * covariance[3] + axis[2] * covariance[4];
+			float z = axis[0] * covariance[2] + axis[1] * covariance[4] + axis[2] * covariance[5];
+			float largest = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+			if (largest < 1e-6f) break;
+			axis[0] = x / largest; axis[1] = y / largest; axis[2] = z / largest;
+		}
+		float lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		float end0[3] = { mean[0], mean[1], mean[2] }, end1[3] = { mean[0], mean[1], mean[2] };
+		if (lengthSquared > 1e-6f)
+		{
+			float lowest = 0.0f, highest = 0.0f;
+			for (int i = 0; i < 16; ++i)
+			{
+				float t = ((block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2]) / lengthSquared;
+				lowest = std::min(lowest, t);
+				highest = std::max(highest, t);
+			}
+			//Inset the ends slightly, as the extremes are rarely worth a palette entry of their own.
+			float inset = (highest - lowest) / 16.0f;
+			for (int c = 0; c < 3; ++c)
+			{
+				end0[c] = mean[c] + axis[c] * (highest - inset);
+				end1[c] = mean[c] + axis[c] * (lowest + inset);
+			}
+		}
+		unsigned short colour0 = quantise565(end0), colour1 = quantise565(end1);
+		unsigned char palette[16], indices[16];
+		buildPalette(colour0, colour1, palette);
+		unsigned error = selectColourIndices(block, palette, indices);
+
+		//One least squares pass, kept only if it lowers the error.
+		unsigned short refined0, refined1;
+		if (error > 0 && refineEndpoints(block, indices, refined0, refined1))
+		{
+			unsigned char refinedPalette[16], refinedIndices[16];
+			buildPalette(refined0, refined1, refinedPalette);
+			if (selectColourIndices(block, refinedPalette, refinedIndices) < error)
+			{
+				colour0 = refined0;
+				colour1 = refined1;
+				std::memcpy(indices, refinedIndices, 16);
+			}
+		}
+		writeColourBlock(colour0, colour1, indices, out);
+	}
+
+	//! Encodes one channel of a 4x4 block as BC4, the format of BC3's alpha and each of BC5's two channels.
+	/**
+	\param block The block's texels, as RGBA8 in rows.
+	\param channel Which channel to encode.
+	\param out Where to write the 8 byte block.
+	*/
+	static void encodeChannelBlock(const unsigned char block[64], int channel, unsigned char out[8])
+	{
+		int low = 255, high = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			low = std::min(low, (int)block[i * 4 + channel]);
+			high = std::max(high, (int)block[i * 4 + channel]);
+		}
+		//With the first endpoint greater, the decoder interpolates six values between them.
+		out[0] = (unsigned char)high;
+		out[1] = (unsigned char)low;
+		uint64_t bits = 0;
+		if (high > low)
+		{
+			int palette[8] = { high, low };
+			for (int i = 1; i < 7; ++i)
+			{
+				palette[i + 1] = ((7 - i) * high + i * low + 3) / 7;
+			}
+			for (int i = 15; i >= 0; --i)
+			{
+				int value = block[i * 4 + channel], best = 0, bestDistance = 256;
+				for (int entry = 0; entry < 8; ++entry)
+				{
+					int distance = std::abs(value - palette[entry]);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = entry;
+					}
+				}
+				bits = (bits << 3) | (uint64_t)best;
+			}
+		}
+		for (int i = 0; i < 6; ++i)
+		{
+			out[2 + i] = (unsigned char)((bits >> (8 * i)) & 0xff);
+		}
+	}
+
+	//! Encodes a 4x4 block in a compressed format.
+	/**
+	\param block The block's texels, as RGBA8 in rows.
+	\param format GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT or GL_COMPRESSED_RG_RGTC2.
+	\param out Where to write the 8 or 16 byte block.
+	*/
+	static void encodeBlock(const unsigned char block[64], GLenum format, unsigned char* out)
+	{
+		switch (format)
+		{
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			encodeChannelBlock(block, 3, out);
+			encodeColourBlock(block, out + 8);
+			break;
+		case GL_COMPRESSED_RG_RGTC2:
+			encodeChannelBlock(block, 0, out);
+			encodeChannelBlock(block, 1, out + 8);
+			break;
+		default:
+			encodeColourBlock(block, out);
+			break;
+		}
+	}
+
+	//! Picks the format for an image: BC5 for normal maps, BC3 if any texel is translucent, and BC1 otherwise.
+	/**
+	\param rgba The image, as RGBA8.
+	\param width Width in pixels.
+	\param height Height in pixels.
+	\param normalMap Whether the image is a tangent space normal map, whose Z is rebuilt in the shaders.
+	*/
+	static GLenum chooseFormat(const unsigned char* rgba, int width, int height, bool normalMap)
+	{
+		if (normalMap)
+		{
+			return GL_COMPRESSED_RG_RGTC2;
+		}
+		const size_t texels = (size_t)width * height;
+		for (size_t i = 0; i < texels; ++i)
+		{
+			if (rgba[i * 4 + 3] != 255)
+			{
+				return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			}
+		}
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	}
+
+	//! Encodes one level of an image, its rows of blocks spread over the job system.
+	/**
+	\param rgba The level, as RGBA8.
+	\param width Width in pixels.
+	\param height Height in pixels.
+	\param format The compressed format.
+	\param out Where to write the blocks, in rows.
+	*/
+	static void compressLevel(const unsigned char* rgba, int width, int height, GLenum format, unsigned char* out)
+	{
+		const int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+		const size_t blockBytes = TextureHelper::compressedBlockBytes(format);
+		JobSystem::instance().parallelFor(0, (size_t)blocksHigh, [&](size_t blockY)
+		{
+			SIMD_ALIGN(16) unsigned char block[64];
+			for (int blockX = 0; blockX < blocksWide; ++blockX)
+			{
+				//Blocks past the edge repeat its texels, so they don't pull the endpoints away from the real ones.
+				for (int y = 0; y < 4; ++y)
+				{
+					int sourceY = std::min((int)blockY * 4 + y, height - 1);
+					for (int x = 0; x < 4; ++x)
+					{
+						int sourceX = std::min(blockX * 4 + x, width - 1);
+						std::memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+					}
+				}
+				encodeBlock(block, format, out + (blockY * blocksWide + blockX) * blockBytes);
+			}
+		}, 4);
+	}
+
+	//! Halves an image on each axis with a box filter, keeping odd edges.
+	/**
+	\param rgba The image, as RGBA8.
+	\param width Width in pixels.
+	\param height Height in pixels.
+	\param out Where to store the smaller image.
+	*/
+	static void downsample(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out)
+	{
+		const int outWidth = std::max(width / 2, 1), outHeight = std::max(height / 2, 1);
+		out.resize((size_t)outWidth * outHeight * 4);
+		for (int y = 0; y < outHeight; ++y)
+		{
+			const int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < outWidth; ++x)
+			{
+				const int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+				for (int c = 0; c < 4; ++c)
+				{
+					int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+						+ rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+					out[((size_t)y * outWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+
+	//! Encodes an image and a full mip chain, as compressed formats can't have their mips generated by the driver.
+	/**
+	\param rgba The image, as RGBA8.
+	\param width Width in pixels.
+	\param height Height in pixels.
+	\param format The compressed format, usually from chooseFormat.
+	\param image Where to store the compressed levels.
+	\return Whether the image was encoded.
+	*/
+	static bool compress(const unsigned char* rgba, int width, int height, GLenum format, TextureHelper::CompressedImage& image)
+	{
+		image = TextureHelper::CompressedImage();
+		if (rgba == NULL || width <= 0 || height <= 0)
+		{
+			return false;
+		}
+		image.internalFormat = format;
+		image.width = width;
+		image.height = height;
+		image.data.resize(TextureHelper::textureBytes(format, width, height, 1, 0));
+
+		std::vector<unsigned char> level, nextLevel;
+		const unsigned char* source = rgba;
+		size_t offset = 0;
+		for (;;)
+		{
+			const size_t levelBytes = TextureHelper::textureBytes(format, width, height);
+			compressLevel(source, width, height, format, &image.data[offset]);
+			image.levelSizes.push_back(levelBytes);
+			offset += levelBytes;
+			if (width == 1 && height == 1)
+			{
+				break;
+			}
+			downsample(source, width, height, nextLevel);
+			level.swap(nextLevel);
+			source = level.data();
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		return true;
+	}
+};
+
+#endif
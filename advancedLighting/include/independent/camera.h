@@ -11,6 +11,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <iomanip>    
+#include <cmath>
 
 /**
 \enum Camera_Movement
@@ -43,6 +44,8 @@ private:
 	const GLfloat MOUSE_ZOOM_MIN = 1.0f;					//!< Maximum zoom in.
 	const GLfloat MOUSE_ZOOM_MAX = 80.0f;					//!< Maximum zoom out.
 	const float PITCH_ANGLE_MAX = 89.0f;					//!< Maximum pitch rotation.
+	const GLfloat NEAR_PLANE = 1.0f;						//!< Distance to the projection's near clipping plane.
+	const GLfloat FAR_PLANE = 100.0f;						//!< Distance to the projection's far clipping plane.
 
 	//Camera's Vector Property Values:
 	glm::vec3 m_position;		//!< Instance's world position.
@@ -74,6 +77,14 @@ public:
 	const inline glm::vec3 getPosition() { return m_position; };
 	//! Returns the camera's forward view.
 	const inline glm::mat4 getViewMatrix() { return glm::lookAt(m_position, m_position + m_forward, m_viewUp); };
+	//! Returns the camera's perspective projection for a viewport's aspect ratio, using the zoom as the field of view.
+	const inline glm::mat4 getProjectionMatrix(GLfloat aspect) { return glm::perspective(glm::radians(m_mouseZoom), aspect, NEAR_PLANE, FAR_PLANE); };
+	//! Returns the distance to the near clipping plane.
+	const inline GLfloat getNearPlane() { return NEAR_PLANE; };
+	//! Returns the distance to the far clipping plane.
+	const inline GLfloat getFarPlane() { return FAR_PLANE; };
+	//! Returns how many pixels an object one unit across covers at a distance of one unit, for a viewport's height in pixels.
+	const inline GLfloat getProjectionScale(GLfloat screenHeight) { return screenHeight / (2.0f * std::tan(glm::radians(m_mouseZoom) * 0.5f)); };
 
 	void handleKeyPress(Camera_Movement direction, GLfloat deltaTime); //!< Defines how the camera should respond to specified input movement enumarators.
 	void handleMouseMove(GLfloat xoffset, GLfloat yoffset);			   //!< Defines how the camera should respond to mouse movement input.
@@ -0,0 +1,179 @@
+#ifndef _COMMANDLIST_H_
+#define _COMMANDLIST_H_
+/**
+\file commandList.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include "mesh.h"
+
+/**
+\struct DrawPacket
+\brief Everything needed to issue one mesh's draw, recorded without making OpenGL calls.
+*/
+struct DrawPacket
+{
+	GLuint64 sortKey;		//!< Order the packet is replayed in, see CommandList::makeSortKey.
+	const Mesh* mesh;		//!< Mesh whose vertex array and textures are bound.
+	glm::mat4 transform;	//!< The mesh's transformation into world space, set as the model uniform.
+	GLuint firstRange;		//!< First of the packet's index ranges in its command list.
+	GLuint rangeCount;		//!< Number of index ranges drawn, with one multi-draw if more than one.
+};
+
+/**
+\class CommandList
+\brief A linear buffer of draw packets, recorded on any thread then sorted and replayed on the OpenGL thread.
+
+Each recording thread fills its own list, so recording needs no synchronisation. merge then gathers them into one list, sorted so
+meshes sharing state are drawn together and nearer meshes first.
+*/
+class CommandList
+{
+private:
+	std::vector<DrawPacket> m_packets;	//!< Recorded draws.
+	std::vector<IndexRange> m_ranges;	//!< Index ranges of every packet, one after another.
+
+	//! Orders packets by their sort key.
+	static bool comparePackets(const DrawPacket& first, const DrawPacket& second) { return first.sortKey < second.sortKey; }
+public:
+	//! Builds a sort key which groups packets by their textures, then by their vertex array, then orders them front to back.
+	/**
+	\param materialId Identifies the textures the packet needs bound, see Mesh::getMaterialId.
+	\param stateId Identifies the vertex array the packet needs bound.
+	\param viewDepth Distance from the camera, which must not be negative.
+	*/
+	static GLuint64 makeSortKey(GLuint materialId, GLuint stateId, float viewDepth)
+	{
+		//Non-negative floats order the same as their bit patterns, so the top 24 bits (sign, exponent and 15 mantissa bits) still order by depth.
+		GLuint depthBits = 0;
+		viewDepth = std::max(viewDepth, 0.0f);
+		std::memcpy(&depthBits, &viewDepth, sizeof(depthBits));
+		return ((GLuint64)(materialId & 0xFFFFF) << 44) | ((GLuint64)(stateId & 0xFFFFF) << 24) | (depthBits >> 8);
+	}
+
+	//! Removes every packet, keeping the memory for the next recording.
+	void clear()
+	{
+		m_packets.clear();
+		m_ranges.clear();
+	}
+
+	//! Records a draw of a mesh's index ranges.
+	/**
+	\param mesh The mesh to draw.
+	\param transform The mesh's transformation into world space.
+	\param sortKey Order to replay the draw in.
+	\param ranges The index ranges to draw.
+	\param rangeCount Number of index ranges.
+	*/
+	void addDraw(const Mesh* mesh, const glm::mat4& transform, GLuint64 sortKey, const IndexRange* ranges, size_t rangeCount)
+	{
+		if (rangeCount == 0)
+		{
+			return;
+		}
+		DrawPacket packet = { sortKey, mesh, transform, (GLuint)m_ranges.size(), (GLuint)rangeCount };
+		m_ranges.insert(m_ranges.end(), ranges, ranges + rangeCount);
+		m_packets.push_back(packet);
+	}
+
+	//! Appends another list's packets.
+	/**
+	\param other The list to append.
+	*/
+	void append(const CommandList& other)
+	{
+		const GLuint rangeBase = (GLuint)m_ranges.size();
+		m_ranges.insert(m_ranges.end(), other.m_ranges.begin(), other.m_ranges.end());
+		for (std::vector<DrawPacket>::const_iterator it = other.m_packets.begin(); other.m_packets.end() != it; ++it)
+		{
+			m_packets.push_back(*it);
+			m_packets.back().firstRange += rangeBase;
+		}
+	}
+
+	//! Sorts the packets by their sort keys.
+	void sort()
+	{
+		std::sort(m_packets.begin(), m_packets.end(), comparePackets);
+	}
+
+	//! Gathers several lists (such as one per recording thread) into one sorted list.
+	/**
+	\param lists The lists to gather.
+	\param merged Where to store the sorted packets. Its previous packets are removed.
+	*/
+	static void merge(const std::vector<CommandList>& lists, CommandList& merged)
+	{
+		merged.clear();
+		for (std::vector<CommandList>::const_iterator it = lists.begin(); lists.end() != it; ++it)
+		{
+			merged.append(*it);
+		}
+		merged.sort();
+	}
+
+	//! Issues the recorded draws, only rebinding a mesh's state or the model uniform when it changes. Must be called on the OpenGL thread.
+	/**
+	\param shader The shader to draw with. Must be in use.
+	*/
+	void replay(const Shader& shader) const
+	{
+		const GLint modelLocation = glGetUniformLocation(shader.programId, "model");
+		const Mesh* boundMesh = NULL;
+		int texUnitCnt = 0;
+		glm::mat4 boundTransform;
+		bool transformSet = false;
+		std::vector<GLsizei> counts;
+		std::vector<const GLvoid*> offsets;
+		for (std::vector<DrawPacket>::const_iterator it = m_packets.begin(); m_packets.end() != it; ++it)
+		{
+			if (it->mesh != boundMesh)
+			{
+				//Meshes sorted next to each other often share their textures, which then stay bound.
+				const bool sameTextures = boundMesh && boundMesh->hasSameTextures(*it->mesh);
+				if (boundMesh && !sameTextures) boundMesh->unBindTextures(texUnitCnt);
+				boundMesh = it->mesh;
+				glBindVertexArray(boundMesh->getVAOId());
+				if (!sameTextures) texUnitCnt = boundMesh->bindTextures(shader);
+			}
+			if (!transformSet || it->transform != boundTransform)
+			{
+				glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(it->transform));
+				boundTransform = it->transform;
+				transformSet = true;
+			}
+
+			const IndexRange* ranges = &m_ranges[it->firstRange];
+			if (it->rangeCount == 1)
+			{
+				glDrawElements(GL_TRIANGLES, ranges->indexCount, GL_UNSIGNED_INT, (GLvoid*)(ranges->indexOffset * sizeof(GLuint)));
+				continue;
+			}
+			counts.resize(it->rangeCount);
+			offsets.resize(it->rangeCount);
+			for (GLuint r = 0; r < it->rangeCount; ++r)
+			{
+				counts[r] = ranges[r].indexCount;
+				offsets[r] = (const GLvoid*)(ranges[r].indexOffset * sizeof(GLuint));
+			}
+			glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT, &offsets[0], (GLsizei)it->rangeCount);
+		}
+		if (boundMesh)
+		{
+			glBindVertexArray(0);
+			boundMesh->unBindTextures(texUnitCnt);
+		}
+	}
+
+	//! Returns the number of recorded draws.
+	size_t size() const { return m_packets.size(); }
+	//! Returns whether no draws are recorded.
+	bool empty() const { return m_packets.empty(); }
+};
+
+#endif
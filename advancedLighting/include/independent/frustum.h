@@ -0,0 +1,150 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+/**
+\file frustum.h
+*/
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cmath>
+
+/**
+\struct BoundingBox
+\brief An axis aligned bounding box.
+*/
+struct BoundingBox
+{
+	glm::vec3 min; //!< Smallest corner of the box.
+	glm::vec3 max; //!< Largest corner of the box.
+
+	//! Default constructor for an empty box, which grows to fit the first point added to it.
+	BoundingBox() : min(FLT_MAX), max(-FLT_MAX) {};
+
+	//! Constructor to set the box's corners.
+	/**
+	\param boxMin Smallest corner of the box.
+	\param boxMax Largest corner of the box.
+	*/
+	BoundingBox(glm::vec3 boxMin, glm::vec3 boxMax) : min(boxMin), max(boxMax) {};
+
+	//! Returns whether no points have been added to the box.
+	bool isEmpty() const { return min.x > max.x; }
+	//! Returns the centre of the box.
+	glm::vec3 getCentre() const { return (min + max) * 0.5f; }
+	//! Returns half of the box's size on each axis.
+	glm::vec3 getExtent() const { return (max - min) * 0.5f; }
+
+	//! Grows the box to contain a point.
+	void expand(const glm::vec3& point) { min = glm::min(min, point); max = glm::max(max, point); }
+	//! Grows the box to contain another box.
+	void expand(const BoundingBox& box) { if (!box.isEmpty()) { min = glm::min(min, box.min); max = glm::max(max, box.max); } }
+
+	//! Returns the box which bounds this box after it has been transformed by a matrix.
+	/**
+	\param transform The transformation to apply.
+	*/
+	BoundingBox transformed(const glm::mat4& transform) const
+	{
+		if (isEmpty())
+		{
+			return *this;
+		}
+
+		//Transform the centre, and project the extent onto each axis of the transformation.
+		glm::vec3 centre = glm::vec3(transform * glm::vec4(getCentre(), 1.0f));
+		glm::vec3 extent = getExtent();
+		glm::vec3 newExtent;
+		for (int i = 0; i < 3; ++i)
+		{
+			newExtent[i] = std::abs(transform[0][i]) * extent.x + std::abs(transform[1][i]) * extent.y + std::abs(transform[2][i]) * extent.z;
+		}
+		return BoundingBox(centre - newExtent, centre + newExtent);
+	}
+};
+
+/**
+\class Frustum
+\brief The six clipping planes of a view-projection matrix, used to cull bounding boxes on the CPU.
+*/
+class Frustum
+{
+private:
+	glm::vec4 m_planes[6]; //!< Plane normals (xyz) and distances (w), pointing into the frustum.
+
+public:
+	//! Default constructor for a frustum which contains everything.
+	Frustum()
+	{
+		for (int i = 0; i < 6; ++i) m_planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	//! Constructor to extract the planes from a view-projection matrix.
+	/**
+	\param viewProjection The combined projection and view matrix.
+	*/
+	explicit Frustum(const glm::mat4& viewProjection)
+	{
+		//Rows of the matrix (GLM stores columns).
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		}
+
+		//Left, right, bottom, top, near and far planes.
+		m_planes[0] = rows[3] + rows[0];
+		m_planes[1] = rows[3] - rows[0];
+		m_planes[2] = rows[3] + rows[1];
+		m_planes[3] = rows[3] - rows[1];
+		m_planes[4] = rows[3] + rows[2];
+		m_planes[5] = rows[3] - rows[2];
+		for (int i = 0; i < 6; ++i)
+		{
+			m_planes[i] /= glm::length(glm::vec3(m_planes[i]));
+		}
+	}
+
+	//! Returns whether a box is at least partially inside the frustum.
+	/**
+	\param box The box to test, in the same space as the frustum.
+	*/
+	bool intersects(const BoundingBox& box) const
+	{
+		if (box.isEmpty())
+		{
+			return false;
+		}
+		for (int i = 0; i < 6; ++i)
+		{
+			//Only the corner furthest along the plane's normal needs testing.
+			glm::vec3 normal = glm::vec3(m_planes[i]);
+			glm::vec3 corner(normal.x >= 0.0f ? box.max.x : box.min.x, normal.y >= 0.0f ? box.max.y : box.min.y, normal.z >= 0.0f ? box.max.z : box.min.z);
+			if (glm::dot(normal, corner) + m_planes[i].w < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//! Returns whether a sphere is at least partially inside the frustum.
+	/**
+	\param centre Centre of the sphere.
+	\param radius Radius of the sphere.
+	*/
+	bool intersects(const glm::vec3& centre, float radius) const
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			if (glm::dot(glm::vec3(m_planes[i]), centre) + m_planes[i].w < -radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//! Returns one of the frustum's planes (left, right, bottom, top, near, far).
+	const glm::vec4& getPlane(int index) const { return m_planes[index]; }
+};
+
+#endif
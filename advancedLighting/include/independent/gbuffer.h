@@ -0,0 +1,122 @@
+#ifndef _GBUFFER_H_
+#define _GBUFFER_H_
+/**
+\file gbuffer.h
+*/
+#include <GLEW/glew.h>
+#include <iostream>
+#include "shader.h"
+#include "texture.h"
+#include "gpuResources.h"
+
+/**
+\class GBuffer
+\brief A compact geometry buffer for deferred shading: octahedral encoded normals (RG16), albedo (RGBA8) and depth.
+*/
+class GBuffer
+{
+private:
+	GpuFramebuffer m_fbo;	 //!< Frame buffer the geometry pass renders into.
+	GpuTexture m_normalTex;	 //!< World space normals, octahedral encoded into two 16 bit channels.
+	GpuTexture m_albedoTex;	 //!< Surface colour, with alpha marking which pixels were covered by geometry.
+	GpuTexture m_depthTex;	 //!< Depth and stencil of the geometry pass.
+	GLsizei m_width;	 //!< Width of the attachments.
+	GLsizei m_height;	 //!< Height of the attachments.
+
+public:
+	//! Default constructor. The attachments are created by setup.
+	GBuffer() : m_width(0), m_height(0) {};
+
+	//! Creates the frame buffer and its attachment textures.
+	/**
+	\param width Width of the attachments.
+	\param height Height of the attachments.
+	*/
+	bool setup(GLsizei width, GLsizei height)
+	{
+		m_width = width;
+		m_height = height;
+		m_normalTex.reset(TextureHelper::makeAttachmentTexture(0, GL_RG16, width, height, GL_RG, GL_UNSIGNED_SHORT),
+			TextureHelper::textureBytes(GL_RG16, width, height), GPU_MEMORY_RENDER_TARGET, "G-buffer normals");
+		m_albedoTex.reset(TextureHelper::makeAttachmentTexture(0, GL_RGBA8, width, height, GL_RGBA, GL_UNSIGNED_BYTE),
+			TextureHelper::textureBytes(GL_RGBA8, width, height), GPU_MEMORY_RENDER_TARGET, "G-buffer albedo");
+		m_depthTex.reset(TextureHelper::makeAttachmentTexture(0, GL_DEPTH24_STENCIL8, width, height, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8),
+			TextureHelper::textureBytes(GL_DEPTH24_STENCIL8, width, height), GPU_MEMORY_RENDER_TARGET, "G-buffer depth");
+
+		GLuint fbo = 0;
+		glGenFramebuffers(1, &fbo);
+		m_fbo.reset(fbo, 0, GPU_MEMORY_RENDER_TARGET, "G-buffer");
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_normalTex.get(), 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_albedoTex.get(), 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTex.get(), 0);
+		const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+
+		//Check the attachments are a usable combination.
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "Error::GBuffer::setup, frame buffer incomplete with status: " << status << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//! Binds the frame buffer so the geometry pass renders into the attachments, and clears them.
+	void bindForGeometry() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo.get());
+
+		//Clear each attachment directly so the window's clear colour isn't changed.
+		const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, zero);
+		glClearBufferfv(GL_COLOR, 1, zero);
+		glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+	}
+
+	//! Binds the attachments as textures for the lighting pass.
+	/**
+	\param shader The lighting shader to bind the attachments to.
+	\param firstUnit First of the three texture units to use.
+	*/
+	void bindForLighting(const Shader& shader, GLint firstUnit = 0) const
+	{
+		const GLuint textures[3] = { m_normalTex.get(), m_albedoTex.get(), m_depthTex.get() };
+		const char* samplerNames[3] = { "gNormal", "gAlbedo", "gDepth" };
+		for (int i = 0; i < 3; ++i)
+		{
+			glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glUniform1i(glGetUniformLocation(shader.programId, samplerNames[i]), firstUnit + i);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//! Copies the geometry pass depth into another frame buffer, so forward rendered geometry can be depth tested against it.
+	/**
+	\param targetFbo The frame buffer to copy the depth into (0 for the window).
+	*/
+	void blitDepth(GLuint targetFbo = 0) const
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo.get());
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFbo);
+		glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+	}
+
+	//! Releases the frame buffer and its attachments.
+	void final()
+	{
+		m_fbo.reset();
+		m_normalTex.reset();
+		m_albedoTex.reset();
+		m_depthTex.reset();
+	}
+
+	//! Returns the depth attachment.
+	GLuint getDepthTexture() const { return m_depthTex.get(); }
+};
+
+#endif
@@ -0,0 +1,614 @@
+#ifndef _GLTFLOADER_H_
+#define _GLTFLOADER_H_
+/**
+\file gltfLoader.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include "mesh.h"
+#include "json.h"
+#include "jobSystem.h"
+#include "mappedFileSystem.h"
+
+/**
+\class GltfLoader
+\brief A native loader for glTF 2.0 files, both binary (.glb) and text (.gltf) with external buffers.
+
+The file is mapped rather than read, and the vertex attributes are read straight from the mapped buffer views. Where a mesh's positions,
+texture coordinates and normals can be drawn as they are stored (no node transform and component types OpenGL can read), their buffer
+views are reported so the caller can upload them directly from the mapping without repacking. Every mesh also gets its vertices gathered
+into Vertex structures, which levels of detail, meshlets and occluders are built from. Embedded images are reported as ranges of the
+mapping so they can be decoded without a copy. Sparse accessors, data URIs and primitives other than triangle lists are unsupported.
+*/
+class GltfLoader
+{
+public:
+	/**
+	\struct BufferView
+	\brief A range of a buffer, in mapped memory.
+	*/
+	struct BufferView
+	{
+		const unsigned char* data;	//!< First byte of the view.
+		size_t size;				//!< Bytes in the view.
+	};
+
+	/**
+	\struct RawAttribute
+	\brief A vertex attribute which can be read by OpenGL straight from a buffer view.
+	*/
+	struct RawAttribute
+	{
+		int bufferView;			//!< Index of the buffer view holding the attribute.
+		GLint size;				//!< Number of components.
+		GLenum type;			//!< Type of each component, whose glTF codes are the OpenGL enums.
+		GLboolean normalised;	//!< Whether integer components are scaled to [0, 1].
+		GLsizei stride;			//!< Bytes from one vertex's attribute to the next.
+		size_t offset;			//!< Bytes from the start of the buffer view to the first vertex's attribute.
+	};
+
+	/**
+	\struct GltfMesh
+	\brief One triangle list primitive of a mesh, as placed by one node.
+	*/
+	struct GltfMesh
+	{
+		std::vector<Vertex> vertices;	//!< The vertices, transformed into model space.
+		std::vector<GLuint> indices;	//!< Three indices per triangle.
+		std::string diffuseMap;			//!< Image of the base colour texture, or empty.
+		std::string normalMap;			//!< Image of the normal texture, or empty.
+		std::vector<RawAttribute> rawAttributes; //!< Positions, texture coordinates and normals as stored, if they can be drawn that way, else empty.
+	};
+
+	/**
+	\struct GltfImage
+	\brief An image stored in one of the file's buffers.
+	*/
+	struct GltfImage
+	{
+		std::string name;			//!< Name meshes refer to the image by.
+		const unsigned char* data;	//!< The encoded image, in mapped memory.
+		size_t size;				//!< Bytes of the encoded image.
+	};
+
+private:
+	static const uint32_t GLB_MAGIC = 0x46546C67;		//!< "glTF", little endian.
+	static const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;	//!< "JSON", little endian.
+	static const uint32_t GLB_CHUNK_BIN = 0x004E4942;	//!< "BIN\0", little endian.
+	static const int MAX_NODE_DEPTH = 64;				//!< Deepest node hierarchy followed, which stops cycles.
+	static const size_t MAX_BYTE_STRIDE = 252;			//!< Largest buffer view stride the glTF specification allows.
+
+	/**
+	\struct Accessor
+	\brief A typed view of a buffer view's elements.
+	*/
+	struct Accessor
+	{
+		int bufferView;			//!< Index of the buffer view.
+		size_t offset;			//!< Bytes from the start of the buffer view to the first element.
+		GLenum componentType;	//!< Type of each component.
+		int components;			//!< Components per element.
+		bool normalised;		//!< Whether integer components are scaled.
+		size_t count;			//!< Number of elements.
+		size_t stride;			//!< Bytes from one element to the next.
+		const unsigned char* data; //!< First element, in mapped memory.
+	};
+
+	/**
+	\struct Placement
+	\brief A mesh placed by a node, with the node's world transform.
+	*/
+	struct Placement
+	{
+		int mesh;				//!< Index of the mesh.
+		glm::mat4 transform;	//!< The node's transform from mesh to model space.
+		bool identity;			//!< Whether the transform is the identity.
+	};
+
+	//! Reads a little endian 32 bit value.
+	static uint32_t readU32(const unsigned char* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	//! Returns the bytes of one component of a type, or 0 if it isn't a glTF component type.
+	static size_t componentBytes(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+		case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+		case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	//! Returns the components of an accessor type such as "VEC3", or 0 if it isn't supported.
+	static int typeComponents(const std::string& type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		return 0;
+	}
+
+	//! Reads an accessor and checks it lies within its buffer view.
+	/**
+	\param document The parsed file.
+	\param index Index of the accessor.
+	\param views The buffer views.
+	\param viewStrides The buffer views' strides, 0 for tightly packed.
+	\param accessor Where to store the accessor.
+	\return Whether the accessor is valid and supported.
+	*/
+	static bool readAccessor(const JsonValue& document, int index, const std::vector<BufferView>& views, const std::vector<size_t>& viewStrides, Accessor& accessor)
+	{
+		const JsonValue& json = document["accessors"].at((size_t)index);
+		if (!json.isObject() || json.has("sparse"))
+		{
+			return false;
+		}
+		accessor.bufferView = json["bufferView"].asInt(-1);
+		accessor.componentType = (GLenum)json["componentType"].asInt(0);
+		accessor.components = typeComponents(json["type"].asString());
+		accessor.normalised = json["normalized"].asBool(false);
+		if (!json["byteOffset"].asSize(accessor.offset) || !json["count"].asSize(accessor.count))
+		{
+			return false;
+		}
+		size_t elementBytes = componentBytes(accessor.componentType) * accessor.components;
+		if (accessor.bufferView < 0 || (size_t)accessor.bufferView >= views.size() || elementBytes == 0)
+		{
+			return false;
+		}
+		const BufferView& view = views[accessor.bufferView];
+		accessor.stride = viewStrides[accessor.bufferView] ? viewStrides[accessor.bufferView] : elementBytes;
+		accessor.data = view.data + accessor.offset;
+		if (accessor.count == 0)
+		{
+			return true;
+		}
+		if (accessor.stride < elementBytes || accessor.offset > view.size || view.size - accessor.offset < elementBytes)
+		{
+			return false;
+		}
+		return accessor.count - 1 <= (view.size - accessor.offset - elementBytes) / accessor.stride;
+	}
+
+	//! Reads one component of an element as a float, scaling normalised integers.
+	static float readComponent(const unsigned char* p, GLenum type, bool normalised)
+	{
+		switch (type)
+		{
+		case GL_FLOAT: { float v; std::memcpy(&v, p, 4); return v; }
+		case GL_UNSIGNED_BYTE: return normalised ? p[0] / 255.0f : (float)p[0];
+		case GL_BYTE: return normalised ? std::max((signed char)p[0] / 127.0f, -1.0f) : (float)(signed char)p[0];
+		case GL_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return normalised ? v / 65535.0f : (float)v; }
+		case GL_SHORT: { int16_t v; std::memcpy(&v, p, 2); return normalised ? std::max(v / 32767.0f, -1.0f) : (float)v; }
+		case GL_UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return (float)v; }
+		default: return 0.0f;
+		}
+	}
+
+	//! Reads up to four components of an accessor's element.
+	static glm::vec4 readElement(const Accessor& accessor, size_t index)
+	{
+		glm::vec4 value(0.0f);
+		const unsigned char* p = accessor.data + index * accessor.stride;
+		const size_t bytes = componentBytes(accessor.componentType);
+		for (int i = 0; i < accessor.components && i < 4; ++i)
+		{
+			value[i] = readComponent(p + i * bytes, accessor.componentType, accessor.normalised);
+		}
+		return value;
+	}
+
+	//! Reads an index from an unsigned byte, short or int accessor.
+	static GLuint readIndex(const Accessor& accessor, size_t index)
+	{
+		const unsigned char* p = accessor.data + index * accessor.stride;
+		switch (accessor.componentType)
+		{
+		case GL_UNSIGNED_BYTE: return p[0];
+		case GL_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+		default: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+		}
+	}
+
+	//! Returns a node's local transform, from its matrix or its translation, rotation and scale.
+	static glm::mat4 nodeTransform(const JsonValue& node)
+	{
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.size() == 16)
+		{
+			float values[16];
+			for (size_t i = 0; i < 16; ++i)
+			{
+				values[i] = (float)matrix.at(i).asNumber(0.0);
+			}
+			return glm::make_mat4(values); //Column major, as glTF stores it.
+		}
+		const JsonValue& translation = node["translation"];
+		const JsonValue& rotation = node["rotation"];
+		const JsonValue& scale = node["scale"];
+		glm::vec3 t((float)translation.at(0).asNumber(0.0), (float)translation.at(1).asNumber(0.0), (float)translation.at(2).asNumber(0.0));
+		glm::quat r((float)rotation.at(3).asNumber(1.0), (float)rotation.at(0).asNumber(0.0), (float)rotation.at(1).asNumber(0.0), (float)rotation.at(2).asNumber(0.0));
+		glm::vec3 s((float)scale.at(0).asNumber(1.0), (float)scale.at(1).asNumber(1.0), (float)scale.at(2).asNumber(1.0));
+		glm::mat4 transform = glm::mat4_cast(r);
+		transform[0] *= s.x;
+		transform[1] *= s.y;
+		transform[2] *= s.z;
+		transform[3] = glm::vec4(t, 1.0f);
+		return transform;
+	}
+
+	//! Collects the meshes placed by a node and its children.
+	static void collectNodes(const JsonValue& nodes, int index, const glm::mat4& parent, int depth, std::vector<Placement>& placements)
+	{
+		const JsonValue& node = nodes.at((size_t)index);
+		if (!node.isObject() || depth > MAX_NODE_DEPTH)
+		{
+			return;
+		}
+		glm::mat4 transform = parent * nodeTransform(node);
+		if (node.has("mesh"))
+		{
+			Placement placement;
+			placement.mesh = node["mesh"].asInt(-1);
+			placement.transform = transform;
+			placement.identity = transform == glm::mat4(1.0f);
+			placements.push_back(placement);
+		}
+		const JsonValue& children = node["children"];
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			collectNodes(nodes, children.at(i).asInt(-1), transform, depth + 1, placements);
+		}
+	}
+
+	//! Returns the name of the image a texture uses, or an empty string.
+	static std::string textureImage(const JsonValue& document, const JsonValue& textureInfo, const std::vector<std::string>& imageNames)
+	{
+		if (!textureInfo.isObject())
+		{
+			return std::string();
+		}
+		int source = document["textures"].at((size_t)textureInfo["index"].asInt(-1))["source"].asInt(-1);
+		return source >= 0 && (size_t)source < imageNames.size() ? imageNames[source] : std::string();
+	}
+
+	//! Gathers one triangle list primitive as placed by a node.
+	/**
+	\param document The parsed file.
+	\param primitive The primitive.
+	\param placement The node placing it.
+	\param views The buffer views.
+	\param viewStrides The buffer views' strides, 0 for tightly packed.
+	\param imageNames Names of the images, by index.
+	\param mesh Where to store the primitive.
+	\return Whether the primitive was valid.
+	*/
+	static bool buildPrimitive(const JsonValue& document, const JsonValue& primitive, const Placement& placement, const std::vector<BufferView>& views,
+		const std::vector<size_t>& viewStrides, const std::vector<std::string>& imageNames, GltfMesh& mesh)
+	{
+		const JsonValue& attributes = primitive["attributes"];
+		Accessor position, normal, texCoord, tangent, indices;
+		if (!readAccessor(document, attributes["POSITION"].asInt(-1), views, viewStrides, position) || position.components != 3)
+		{
+			return false;
+		}
+		const bool hasNormal = attributes.has("NORMAL") && readAccessor(document, attributes["NORMAL"].asInt(-1), views, viewStrides, normal) && normal.count == position.count;
+		const bool hasTexCoord = attributes.has("TEXCOORD_0") && readAccessor(document, attributes["TEXCOORD_0"].asInt(-1), views, viewStrides, texCoord) && texCoord.count == position.count;
+		const bool hasTangent = hasNormal && attributes.has("TANGENT") && readAccessor(document, attributes["TANGENT"].asInt(-1), views, viewStrides, tangent)
+			&& tangent.count == position.count && tangent.components == 4;
+
+		//Indices are optional, in which case every three vertices make a triangle.
+		if (primitive.has("indices"))
+		{
+			if (!readAccessor(document, primitive["indices"].asInt(-1), views, viewStrides, indices) || indices.components != 1
+				|| (indices.componentType != GL_UNSIGNED_BYTE && indices.componentType != GL_UNSIGNED_SHORT && indices.componentType != GL_UNSIGNED_INT))
+			{
+				return false;
+			}
+			mesh.indices.resize(indices.count - indices.count % 3);
+			for (size_t i = 0; i < mesh.indices.size(); ++i)
+			{
+				mesh.indices[i] = readIndex(indices, i);
+				if (mesh.indices[i] >= position.count)
+				{
+					return false;
+				}
+			}
+		}
+		else
+		{
+			mesh.indices.resize(position.count - position.count % 3);
+			for (size_t i = 0; i < mesh.indices.size(); ++i)
+			{
+				mesh.indices[i] = (GLuint)i;
+			}
+		}
+
+		//Normals are transformed by the inverse transpose, so non-uniform scales keep them perpendicular.
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(placement.transform)));
+		mesh.vertices.resize(position.count);
+		for (size_t i = 0; i < position.count; ++i)
+		{
+			Vertex& vertex = mesh.vertices[i];
+			vertex.position = glm::vec3(placement.transform * glm::vec4(glm::vec3(readElement(position, i)), 1.0f));
+			vertex.texCoords = hasTexCoord ? glm::vec2(readElement(texCoord, i)) : glm::vec2(0.0f);
+			vertex.normal = hasNormal ? glm::vec3(readElement(normal, i)) : glm::vec3(0.0f);
+			if (hasNormal && !placement.identity)
+			{
+				vertex.normal = normalMatrix * vertex.normal;
+				vertex.normal = glm::dot(vertex.normal, vertex.normal) > 0.0f ? glm::normalize(vertex.normal) : vertex.normal;
+			}
+			vertex.tangent = glm::vec4(0.0f);
+		}
+
+		//Missing normals are the area weighted average of the faces around each vertex.
+		if (!hasNormal)
+		{
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			{
+				Vertex& a = mesh.vertices[mesh.indices[i]];
+				Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+				Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+				glm::vec3 faceNormal = glm::cross(b.position - a.position, c.position - a.position);
+				a.normal += faceNormal;
+				b.normal += faceNormal;
+				c.normal += faceNormal;
+			}
+			for (std::vector<Vertex>::iterator it = mesh.vertices.begin(); mesh.vertices.end() != it; ++it)
+			{
+				it->normal = glm::dot(it->normal, it->normal) > 0.0f ? glm::normalize(it->normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+			}
+		}
+
+		//Stored tangents carry the bitangent's handedness in w, as the vertices do. A mirroring transform flips it.
+		if (hasTangent)
+		{
+			const glm::mat3 tangentMatrix(placement.transform);
+			const float mirror = glm::determinant(tangentMatrix) < 0.0f ? -1.0f : 1.0f;
+			for (size_t i = 0; i < position.count; ++i)
+			{
+				glm::vec4 stored = readElement(tangent, i);
+				glm::vec3 direction = tangentMatrix * glm::vec3(stored);
+				direction = glm::dot(direction, direction) > 0.0f ? glm::normalize(direction) : direction;
+				mesh.vertices[i].tangent = glm::vec4(direction, (stored.w < 0.0f ? -1.0f : 1.0f) * mirror);
+			}
+		}
+		else
+		{
+			Mesh::generateTangents(mesh.vertices, mesh.indices);
+		}
+
+		//Attributes OpenGL can read as stored are drawn from the buffer views, if nothing needed transforming or generating.
+		const bool rawTexCoord = hasTexCoord && texCoord.components == 2
+			&& (texCoord.componentType == GL_FLOAT || (texCoord.normalised && (texCoord.componentType == GL_UNSIGNED_BYTE || texCoord.componentType == GL_UNSIGNED_SHORT)));
+		if (placement.identity && hasNormal && rawTexCoord && position.componentType == GL_FLOAT && normal.componentType == GL_FLOAT && normal.components == 3)
+		{
+			const Accessor* raw[3] = { &position, &texCoord, &normal };
+			for (int i = 0; i < 3; ++i)
+			{
+				RawAttribute attribute = { raw[i]->bufferView, raw[i]->components, raw[i]->componentType, (GLboolean)raw[i]->normalised, (GLsizei)raw[i]->stride, raw[i]->offset };
+				mesh.rawAttributes.push_back(attribute);
+			}
+		}
+
+		//glTF materials are metallic-roughness, so only their base colour and normal textures map onto the scene shaders.
+		const JsonValue& material = document["materials"].at((size_t)primitive["material"].asInt(-1));
+		mesh.diffuseMap = textureImage(document, material["pbrMetallicRoughness"]["baseColorTexture"], imageNames);
+		mesh.normalMap = textureImage(document, material["normalTexture"], imageNames);
+		return true;
+	}
+
+public:
+	//! Loads a glTF 2.0 file.
+	/**
+	\param path The .glb or .gltf file.
+	\param fileSystem File system the files are mapped through, which keeps the mappings alive while the buffer views are used.
+	\param meshes Where to store one mesh per triangle list primitive per node.
+	\param views Where to store the file's buffer views, which raw attributes refer to.
+	\param images Where to store the images stored in the file's buffers. Other images are named by their path relative to the file.
+	\param cancelled Set to stop loading, or NULL.
+	\param bytesRead Counter the bytes read are added to, or NULL.
+	\param bytesTotal Counter the files' sizes are added to, or NULL.
+	\return Whether the file was loaded.
+	*/
+	static bool load(const std::string& path, MappedIOSystem& fileSystem, std::vector<GltfMesh>& meshes, std::vector<BufferView>& views, std::vector<GltfImage>& images,
+		const std::atomic<bool>* cancelled = NULL, std::atomic<size_t>* bytesRead = NULL, std::atomic<size_t>* bytesTotal = NULL)
+	{
+		std::shared_ptr<MappedFile> file;
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		if (!fileSystem.map(path.c_str(), file, data, size))
+		{
+			std::cerr << "Error::GltfLoader::load, could not open file: " << path << std::endl;
+			return false;
+		}
+		if (bytesTotal) *bytesTotal += size;
+		size_t totalRead = size;
+
+		//A binary file is a 12 byte header, a JSON chunk and an optional binary chunk, which buffer 0 refers to.
+		const char* text = (const char*)data;
+		size_t textSize = size;
+		BufferView binaryChunk = { NULL, 0 };
+		if (size >= 12 && readU32(data) == GLB_MAGIC)
+		{
+			if (readU32(data + 4) != 2 || size < 20 || readU32(data + 16) != GLB_CHUNK_JSON || readU32(data + 12) > size - 20)
+			{
+				std::cerr << "Error::GltfLoader::load, invalid binary glTF header: " << path << std::endl;
+				return false;
+			}
+			text = (const char*)data + 20;
+			textSize = readU32(data + 12);
+			size_t next = 20 + ((textSize + 3) & ~(size_t)3);
+			if (next + 8 <= size && readU32(data + next + 4) == GLB_CHUNK_BIN && readU32(data + next) <= size - next - 8)
+			{
+				binaryChunk.data = data + next + 8;
+				binaryChunk.size = readU32(data + next);
+			}
+		}
+		JsonValue document;
+		if (!document.parse(text, textSize) || document["asset"]["version"].asString().compare(0, 1, "2") != 0)
+		{
+			std::cerr << "Error::GltfLoader::load, invalid or unsupported glTF document: " << path << std::endl;
+			return false;
+		}
+
+		//Buffers are the binary chunk or files relative to this one.
+		const size_t slash = path.find_last_of("/\\");
+		const std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+		const JsonValue& bufferList = document["buffers"];
+		std::vector<BufferView> buffers(bufferList.size());
+		for (size_t i = 0; i < buffers.size(); ++i)
+		{
+			const std::string& uri = bufferList.at(i)["uri"].asString();
+			size_t length = 0;
+			if (!bufferList.at(i)["byteLength"].asSize(length))
+			{
+				std::cerr << "Error::GltfLoader::load, buffer " << i << " has an invalid byteLength." << std::endl;
+				return false;
+			}
+			std::shared_ptr<MappedFile> bufferFile;
+			if (uri.empty() && i == 0 && binaryChunk.data)
+			{
+				buffers[i] = binaryChunk;
+			}
+			else if (uri.empty() || uri.compare(0, 5, "data:") == 0 || !fileSystem.map((directory + uri).c_str(), bufferFile, buffers[i].data, buffers[i].size))
+			{
+				std::cerr << "Error::GltfLoader::load, unsupported or missing buffer " << i << ": " << uri.substr(0, 64) << std::endl;
+				return false;
+			}
+			else
+			{
+				totalRead += buffers[i].size;
+				if (bytesTotal) *bytesTotal += buffers[i].size;
+			}
+			if (buffers[i].size < length)
+			{
+				std::cerr << "Error::GltfLoader::load, buffer " << i << " is shorter than its byteLength." << std::endl;
+				return false;
+			}
+		}
+
+		const JsonValue& viewList = document["bufferViews"];
+		views.resize(viewList.size());
+		std::vector<size_t> viewStrides(viewList.size());
+		for (size_t i = 0; i < views.size(); ++i)
+		{
+			const JsonValue& view = viewList.at(i);
+			const int buffer = view["buffer"].asInt(-1);
+			size_t offset = 0, length = 0;
+			if (!view["byteOffset"].asSize(offset) || !view["byteLength"].asSize(length) || !view["byteStride"].asSize(viewStrides[i], 0, MAX_BYTE_STRIDE) ||
+				buffer < 0 || (size_t)buffer >= buffers.size() || offset > buffers[buffer].size || length > buffers[buffer].size - offset)
+			{
+				std::cerr << "Error::GltfLoader::load, buffer view " << i << " is invalid or out of range." << std::endl;
+				return false;
+			}
+			views[i].data = buffers[buffer].data + offset;
+			views[i].size = length;
+		}
+
+		//Images in buffer views are decoded from the mapping, named so they can't clash with a file.
+		const JsonValue& imageList = document["images"];
+		std::vector<std::string> imageNames(imageList.size());
+		for (size_t i = 0; i < imageNames.size(); ++i)
+		{
+			const JsonValue& image = imageList.at(i);
+			const int view = image["bufferView"].asInt(-1);
+			const std::string& uri = image["uri"].asString();
+			if (view >= 0 && (size_t)view < views.size())
+			{
+				std::ostringstream name;
+				name << "#image" << i;
+				imageNames[i] = name.str();
+				GltfImage embedded = { imageNames[i], views[view].data, views[view].size };
+				images.push_back(embedded);
+			}
+			else if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+			{
+				imageNames[i] = uri;
+			}
+			else
+			{
+				std::cerr << "Error::GltfLoader::load, unsupported image: " << i << std::endl;
+			}
+		}
+
+		//Place the meshes through the default scene's node hierarchy, or every mesh once if there's no scene.
+		std::vector<Placement> placements;
+		const JsonValue& scenes = document["scenes"];
+		if (scenes.size() > 0)
+		{
+			const JsonValue& roots = scenes.at((size_t)document["scene"].asInt(0))["nodes"];
+			for (size_t i = 0; i < roots.size(); ++i)
+			{
+				collectNodes(document["nodes"], roots.at(i).asInt(-1), glm::mat4(1.0f), 0, placements);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < document["meshes"].size(); ++i)
+			{
+				Placement placement = { (int)i, glm::mat4(1.0f), true };
+				placements.push_back(placement);
+			}
+		}
+
+		//One job per primitive, each gathering its own mesh.
+		std::vector<std::pair<const JsonValue*, const Placement*> > primitives;
+		for (std::vector<Placement>::const_iterator it = placements.begin(); placements.end() != it; ++it)
+		{
+			const JsonValue& primitiveList = document["meshes"].at((size_t)it->mesh)["primitives"];
+			for (size_t i = 0; i < primitiveList.size(); ++i)
+			{
+				if (primitiveList.at(i)["mode"].asInt(4) != GL_TRIANGLES)
+				{
+					std::cerr << "Error::GltfLoader::load, skipping a primitive which isn't a triangle list in mesh: " << it->mesh << std::endl;
+					continue;
+				}
+				primitives.push_back(std::make_pair(&primitiveList.at(i), &*it));
+			}
+		}
+		meshes.resize(primitives.size());
+		std::vector<char> valid(primitives.size(), 0);
+		JobSystem::instance().parallelFor(0, primitives.size(), [&](size_t i)
+		{
+			if (!(cancelled && cancelled->load()))
+			{
+				valid[i] = buildPrimitive(document, *primitives[i].first, *primitives[i].second, views, viewStrides, imageNames, meshes[i]);
+			}
+		});
+		if (bytesRead) *bytesRead += totalRead;
+		if (cancelled && cancelled->load())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < valid.size(); ++i)
+		{
+			if (!valid[i])
+			{
+				std::cerr << "Error::GltfLoader::load, invalid or unsupported primitive in: " << path << std::endl;
+				meshes.clear();
+				return false;
+			}
+		}
+		return !meshes.empty();
+	}
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef _GPU_MEMORY_H_
+#define _GPU_MEMORY_H_
+/**
+\file gpuMemory.h
+*/
+#include <GLEW/glew.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "gpuResources.h"
+#include "model.h"
+#include "textureCache.h"
+
+/**
+\struct GpuDriverMemory
+\brief Video memory as the driver reports it, through GL_NVX_gpu_memory_info or GL_ATI_meminfo. Sizes the driver doesn't report are 0.
+*/
+struct GpuDriverMemory
+{
+	const char* source;			//!< Extension the numbers came from, NULL if the driver supports neither.
+	size_t dedicatedBytes;		//!< Dedicated video memory of the GPU (NVX).
+	size_t totalAvailableBytes;	//!< Video memory available to the context (NVX).
+	size_t freeBytes;			//!< Video memory currently free (NVX), or free in the texture pool (ATI).
+	size_t freeVertexBytes;		//!< Video memory free in the vertex buffer pool (ATI).
+	size_t evictedBytes;		//!< Video memory evicted to make room since the context was created (NVX).
+	GLint evictionCount;		//!< Number of evictions since the context was created (NVX).
+
+	GpuDriverMemory() : source(NULL), dedicatedBytes(0), totalAvailableBytes(0), freeBytes(0), freeVertexBytes(0), evictedBytes(0), evictionCount(0) {}; //!< Constructor
+};
+
+/**
+\struct GpuMemoryReport
+\brief A snapshot of the video memory the renderer has allocated, by category, by model and in total, alongside what the driver reports.
+*/
+struct GpuMemoryReport
+{
+	//! One model's share of the allocations.
+	struct ModelEntry
+	{
+		std::string name;								//!< The model's file.
+		size_t categoryBytes[GPU_MEMORY_CATEGORY_COUNT]; //!< Bytes in each category.
+	};
+
+	size_t categoryBytes[GPU_MEMORY_CATEGORY_COUNT];	//!< Bytes of every live object in each category.
+	unsigned counts[GPU_RESOURCE_TYPE_COUNT];			//!< Number of live objects of each kind.
+	size_t totalBytes;									//!< Bytes of every live object.
+	size_t peakBytes;									//!< Most bytes live at once.
+	GpuDriverMemory driver;								//!< What the driver reports.
+	size_t cachedTextures;								//!< Number of textures in the TextureCache.
+	size_t retainedTextureBytes;						//!< Bytes of cached textures no model uses.
+	size_t textureCacheHits;							//!< Texture loads the cache saved.
+	size_t textureCacheMisses;							//!< Texture loads the cache didn't have.
+	std::vector<ModelEntry> models;						//!< Each model's share.
+};
+
+/**
+\class GpuMemoryTracker
+\brief Builds reports of the video memory accounted by the GpuResourceRegistry, and writes them as a one line summary or as JSON.
+*/
+class GpuMemoryTracker
+{
+private:
+	//! Writes a string as a JSON string literal.
+	static void writeJsonString(std::ostream& out, const std::string& text)
+	{
+		out << '"';
+		for (std::string::const_iterator it = text.begin(); text.end() != it; ++it)
+		{
+			if (*it == '"' || *it == '\\') out << '\\' << *it;
+			else if ((unsigned char)*it < 0x20) out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)*it << std::dec << std::setfill(' ');
+			else out << *it;
+		}
+		out << '"';
+	}
+
+	//! Writes bytes by category as the members of a JSON object.
+	static void writeJsonCategories(std::ostream& out, const size_t categoryBytes[GPU_MEMORY_CATEGORY_COUNT])
+	{
+		for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
+		{
+			out << (i ? ", " : "") << '"' << GpuResourceRegistry::categoryName((GpuMemoryCategory)i) << "\": " << categoryBytes[i];
+		}
+	}
+
+	//! Converts bytes to whole megabytes for display, rounding up so small allocations don't show as none.
+	static size_t toMegabytes(size_t bytes) { return (bytes + 1024 * 1024 - 1) / (1024 * 1024); }
+
+public:
+	//! Queries the driver for the video memory it has available. Must be called on a thread with a context current.
+	/**
+	\param info Where to store what the driver reports.
+	\return Whether the driver supports either extension.
+	*/
+	static bool queryDriver(GpuDriverMemory& info)
+	{
+		info = GpuDriverMemory();
+		if (GLEW_NVX_gpu_memory_info)
+		{
+			//Sizes are in kilobytes.
+			GLint dedicated = 0, totalAvailable = 0, currentAvailable = 0, evicted = 0;
+			glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &dedicated);
+			glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &totalAvailable);
+			glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &currentAvailable);
+			glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTION_COUNT_NVX, &info.evictionCount);
+			glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTED_MEMORY_NVX, &evicted);
+			info.source = "GL_NVX_gpu_memory_info";
+			info.dedicatedBytes = (size_t)dedicated * 1024;
+			info.totalAvailableBytes = (size_t)totalAvailable * 1024;
+			info.freeBytes = (size_t)currentAvailable * 1024;
+			info.evictedBytes = (size_t)evicted * 1024;
+			return true;
+		}
+		if (GLEW_ATI_meminfo)
+		{
+			//Each pool reports its total free kilobytes first, then the largest free block and the same two for auxiliary memory.
+			GLint textureFree[4] = { 0, 0, 0, 0 }, vertexFree[4] = { 0, 0, 0, 0 };
+			glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, textureFree);
+			glGetIntegerv(GL_VBO_FREE_MEMORY_ATI, vertexFree);
+			info.source = "GL_ATI_meminfo";
+			info.freeBytes = (size_t)textureFree[0] * 1024;
+			info.freeVertexBytes = (size_t)vertexFree[0] * 1024;
+			return true;
+		}
+		return false;
+	}
+
+	//! Fills a report with the registry's totals, and optionally what the driver reports. Models are added with addModel.
+	/**
+	\param report The report.
+	\param queryDriverMemory Whether to query the driver, which needs a context current on the calling thread.
+	*/
+	static void capture(GpuMemoryReport& report, bool queryDriverMemory)
+	{
+		const GpuResourceRegistry& registry = GpuResourceRegistry::instance();
+		for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
+		{
+			report.categoryBytes[i] = registry.getCategoryBytes((GpuMemoryCategory)i);
+		}
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; ++i)
+		{
+			report.counts[i] = registry.getCount((GpuResourceType)i);
+		}
+		report.totalBytes = registry.getTotalBytes();
+		report.peakBytes = registry.getPeakBytes();
+		const TextureCache& textureCache = TextureCache::instance();
+		report.cachedTextures = textureCache.getTextureCount();
+		report.retainedTextureBytes = textureCache.getRetainedBytes();
+		report.textureCacheHits = textureCache.getHits();
+		report.textureCacheMisses = textureCache.getMisses();
+		report.driver = GpuDriverMemory();
+		if (queryDriverMemory)
+		{
+			queryDriver(report.driver);
+		}
+		report.models.clear();
+	}
+
+	//! Adds a model's share of the allocations to a report.
+	/**
+	\param report The report.
+	\param name The model's file.
+	\param model The model.
+	*/
+	static void addModel(GpuMemoryReport& report, const std::string& name, const Model& model)
+	{
+		report.models.push_back(GpuMemoryReport::ModelEntry());
+		report.models.back().name = name;
+		model.getGpuMemoryByCategory(report.models.back().categoryBytes);
+	}
+
+	//! Formats a report as one line, short enough for a window title.
+	static std::string formatSummary(const GpuMemoryReport& report)
+	{
+		std::ostringstream out;
+		out << "GPU " << toMegabytes(report.totalBytes) << " MB (peak " << toMegabytes(report.peakBytes) << ")";
+		for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
+		{
+			out << (i ? ", " : " - ") << GpuResourceRegistry::categoryName((GpuMemoryCategory)i) << " " << toMegabytes(report.categoryBytes[i]);
+		}
+		if (report.driver.source)
+		{
+			out << " | driver free " << toMegabytes(report.driver.freeBytes) << " MB";
+			if (report.driver.totalAvailableBytes) out << " of " << toMegabytes(report.driver.totalAvailableBytes);
+		}
+		return out.str();
+	}
+
+	//! Writes a report as JSON, with every size in bytes.
+	static void writeJson(std::ostream& out, const GpuMemoryReport& report)
+	{
+		out << "{\n\t\"totalBytes\": " << report.totalBytes << ",\n\t\"peakBytes\": " << report.peakBytes << ",\n\t\"categories\": { ";
+		writeJsonCategories(out, report.categoryBytes);
+		out << " },\n\t\"objects\": { ";
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; ++i)
+		{
+			out << (i ? ", " : "") << '"' << GpuResourceRegistry::typeName((GpuResourceType)i) << "\": " << report.counts[i];
+		}
+		out << " },\n\t\"textureCache\": { \"textures\": " << report.cachedTextures << ", \"retainedBytes\": " << report.retainedTextureBytes
+			<< ", \"hits\": " << report.textureCacheHits << ", \"misses\": " << report.textureCacheMisses << " },\n\t\"models\": [";
+		for (size_t i = 0; i < report.models.size(); ++i)
+		{
+			out << (i ? ",\n\t\t{ \"name\": " : "\n\t\t{ \"name\": ");
+			writeJsonString(out, report.models[i].name);
+			out << ", ";
+			writeJsonCategories(out, report.models[i].categoryBytes);
+			out << " }";
+		}
+		out << (report.models.empty() ? "],\n" : "\n\t],\n");
+		out << "\t\"driver\": ";
+		if (!report.driver.source)
+		{
+			out << "null\n}\n";
+			return;
+		}
+		out << "{ \"source\": \"" << report.driver.source << "\", \"dedicatedBytes\": " << report.driver.dedicatedBytes
+			<< ", \"totalAvailableBytes\": " << report.driver.totalAvailableBytes << ", \"freeBytes\": " << report.driver.freeBytes
+			<< ", \"freeVertexBytes\": " << report.driver.freeVertexBytes << ", \"evictedBytes\": " << report.driver.evictedBytes
+			<< ", \"evictionCount\": " << report.driver.evictionCount << " }\n}\n";
+	}
+
+	//! Writes a report as JSON to a file.
+	/**
+	\param path The file.
+	\param report The report.
+	\return Whether the file was written.
+	*/
+	static bool dumpJson(const char* path, const GpuMemoryReport& report)
+	{
+		std::ofstream file(path);
+		if (!file)
+		{
+			std::cerr << "Error::GpuMemoryTracker::dumpJson, could not open " << path << " for writing." << std::endl;
+			return false;
+		}
+		writeJson(file, report);
+		return (bool)file;
+	}
+};
+
+#endif
@@ -0,0 +1,508 @@
+#ifndef _GPU_RESOURCES_H_
+#define _GPU_RESOURCES_H_
+/**
+\file gpuResources.h
+*/
+#include <GLEW/glew.h>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cstddef>
+#include <algorithm>
+
+//! Kinds of OpenGL object the registry tracks.
+enum GpuResourceType
+{
+	GPU_BUFFER,			//!< Buffer object.
+	GPU_TEXTURE,		//!< Texture object.
+	GPU_PROGRAM,		//!< Shader program.
+	GPU_FRAMEBUFFER,	//!< Frame buffer object.
+	GPU_RESOURCE_TYPE_COUNT
+};
+
+//! What an object's memory is used for, which video memory is accounted by.
+enum GpuMemoryCategory
+{
+	GPU_MEMORY_VERTEX,			//!< Vertex attribute buffers.
+	GPU_MEMORY_INDEX,			//!< Index buffers.
+	GPU_MEMORY_TEXTURE,			//!< Sampled textures, including their mip chains.
+	GPU_MEMORY_RENDER_TARGET,	//!< Textures rendered into, such as frame buffer attachments.
+	GPU_MEMORY_OTHER,			//!< Everything else, such as storage and indirect buffers.
+	GPU_MEMORY_CATEGORY_COUNT
+};
+
+/**
+\struct GpuHandle
+\brief A generational reference to an object in the GpuResourceRegistry. Once the object is released its slot's generation changes,
+so stale handles resolve to 0 instead of to whichever object reuses the slot.
+*/
+struct GpuHandle
+{
+	GLuint index;		//!< Slot in the registry.
+	GLuint generation;	//!< Generation of the slot when the handle was made, 0 for a null handle.
+
+	GpuHandle() : index(0), generation(0) {}; //!< Constructor for a null handle.
+	bool isNull() const { return generation == 0; } //!< Returns whether the handle refers to nothing.
+	bool operator==(const GpuHandle& other) const { return index == other.index && generation == other.generation; } //!< Whether both refer to the same object.
+	bool operator!=(const GpuHandle& other) const { return !(*this == other); } //!< Whether they refer to different objects.
+};
+
+/**
+\class GpuResourceRegistry
+\brief Tracks every live buffer, texture, program and frame buffer with its size, and deletes released objects once the GPU has
+retired the frames which may still use them.
+
+Objects can be registered and released on any thread, such as the loader's, but deletion happens on the drawing thread: endFrame
+fences the objects released during the frame, and collect deletes each batch once its fence has signalled.
+*/
+class GpuResourceRegistry
+{
+private:
+	//! A registered object.
+	struct Slot
+	{
+		GLuint id;				//!< OpenGL name, 0 when the slot is free.
+		GpuResourceType type;	//!< Kind of object.
+		GpuMemoryCategory category; //!< What the object's memory is used for.
+		size_t bytes;			//!< Estimated video memory of the object.
+		GLuint generation;		//!< Bumped each time the slot is released.
+		const char* label;		//!< What the object is, for the leak report.
+	};
+
+	//! An object waiting to be deleted.
+	struct PendingDelete
+	{
+		GpuResourceType type;	//!< Kind of object.
+		GLuint id;				//!< OpenGL name.
+	};
+
+	//! Objects released during one frame, deleted once the fence after that frame signals.
+	struct RetiringBatch
+	{
+		GLsync fence;							//!< Signalled when the GPU has finished the frame.
+		std::vector<PendingDelete> objects;		//!< Objects to delete.
+	};
+
+	std::vector<Slot> m_slots;					//!< Every slot, live or free.
+	std::vector<GLuint> m_freeSlots;			//!< Slots free to reuse.
+	std::vector<PendingDelete> m_released;		//!< Objects released since the last endFrame.
+	std::deque<RetiringBatch> m_retiring;		//!< Fenced batches, oldest first.
+	size_t m_bytes[GPU_RESOURCE_TYPE_COUNT];	//!< Bytes of the live objects of each kind.
+	unsigned m_counts[GPU_RESOURCE_TYPE_COUNT];	//!< Number of live objects of each kind.
+	size_t m_categoryBytes[GPU_MEMORY_CATEGORY_COUNT]; //!< Bytes of the live objects in each category.
+	size_t m_totalBytes;						//!< Bytes of every live object.
+	size_t m_peakBytes;							//!< Most bytes live at once.
+	mutable std::mutex m_mutex;					//!< Guards everything above.
+
+	GpuResourceRegistry() : m_totalBytes(0), m_peakBytes(0)
+	{
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; ++i)
+		{
+			m_bytes[i] = 0;
+			m_counts[i] = 0;
+		}
+		for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
+		{
+			m_categoryBytes[i] = 0;
+		}
+	}
+	GpuResourceRegistry(const GpuResourceRegistry&);
+	GpuResourceRegistry& operator=(const GpuResourceRegistry&);
+
+	//! Moves a slot's bytes in or out of the totals. The lock must be held.
+	/**
+	\param slot The slot.
+	\param added Whether the bytes are being added rather than removed.
+	*/
+	void account(const Slot& slot, bool added)
+	{
+		if (added)
+		{
+			m_bytes[slot.type] += slot.bytes;
+			m_categoryBytes[slot.category] += slot.bytes;
+			m_totalBytes += slot.bytes;
+			m_peakBytes = std::max(m_peakBytes, m_totalBytes);
+		}
+		else
+		{
+			m_bytes[slot.type] -= slot.bytes;
+			m_categoryBytes[slot.category] -= slot.bytes;
+			m_totalBytes -= slot.bytes;
+		}
+	}
+
+	//! Deletes objects. Must be called on a thread with a context current.
+	/**
+	\param objects The objects.
+	*/
+	static void deleteObjects(const std::vector<PendingDelete>& objects)
+	{
+		for (std::vector<PendingDelete>::const_iterator it = objects.begin(); objects.end() != it; ++it)
+		{
+			switch (it->type)
+			{
+			case GPU_BUFFER: glDeleteBuffers(1, &it->id); break;
+			case GPU_TEXTURE: glDeleteTextures(1, &it->id); break;
+			case GPU_PROGRAM: glDeleteProgram(it->id); break;
+			case GPU_FRAMEBUFFER: glDeleteFramebuffers(1, &it->id); break;
+			default: break;
+			}
+		}
+	}
+
+public:
+	//! Returns the registry shared by every context.
+	static GpuResourceRegistry& instance()
+	{
+		static GpuResourceRegistry registry;
+		return registry;
+	}
+
+	//! Returns the name of a memory category.
+	static const char* categoryName(GpuMemoryCategory category)
+	{
+		static const char* names[GPU_MEMORY_CATEGORY_COUNT] = { "vertex", "index", "texture", "renderTarget", "other" };
+		return category < GPU_MEMORY_CATEGORY_COUNT ? names[category] : "unknown";
+	}
+
+	//! Returns the name of a kind of object.
+	static const char* typeName(GpuResourceType type)
+	{
+		static const char* names[GPU_RESOURCE_TYPE_COUNT] = { "buffer", "texture", "program", "framebuffer" };
+		return type < GPU_RESOURCE_TYPE_COUNT ? names[type] : "unknown";
+	}
+
+	//! Registers an object so it's accounted for and deleted through the registry.
+	/**
+	\param type Kind of object.
+	\param id OpenGL name of the object, which the registry now owns.
+	\param bytes Estimated video memory of the object.
+	\param category What the object's memory is used for.
+	\param label What the object is, a string which outlives the object.
+	\return The object's handle, null if id is 0.
+	*/
+	GpuHandle add(GpuResourceType type, GLuint id, size_t bytes, GpuMemoryCategory category, const char* label)
+	{
+		GpuHandle handle;
+		if (id == 0)
+		{
+			return handle;
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_freeSlots.empty())
+		{
+			Slot slot = { 0, type, category, 0, 1, NULL };
+			m_freeSlots.push_back((GLuint)m_slots.size());
+			m_slots.push_back(slot);
+		}
+		handle.index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		Slot& slot = m_slots[handle.index];
+		slot.id = id;
+		slot.type = type;
+		slot.category = category;
+		slot.bytes = bytes;
+		slot.label = label;
+		handle.generation = slot.generation;
+		account(slot, true);
+		++m_counts[type];
+		return handle;
+	}
+
+	//! Returns the OpenGL name of an object, or 0 if the handle is null or the object was released.
+	GLuint resolve(GpuHandle handle) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (handle.isNull() || handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation)
+		{
+			return 0;
+		}
+		return m_slots[handle.index].id;
+	}
+
+	//! Updates an object's size, such as when its storage is reallocated.
+	/**
+	\param handle The object.
+	\param bytes Its new estimated video memory.
+	*/
+	void setBytes(GpuHandle handle, size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (handle.isNull() || handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation)
+		{
+			return;
+		}
+		Slot& slot = m_slots[handle.index];
+		account(slot, false);
+		slot.bytes = bytes;
+		account(slot, true);
+	}
+
+	//! Releases an object. Its handles go stale at once, but it's only deleted once the frames which may use it have retired.
+	/**
+	\param handle The object.
+	*/
+	void release(GpuHandle handle)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (handle.isNull() || handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation)
+		{
+			std::cerr << "Warning, GpuResourceRegistry::release, the handle is stale." << std::endl;
+			return;
+		}
+		Slot& slot = m_slots[handle.index];
+		PendingDelete object = { slot.type, slot.id };
+		m_released.push_back(object);
+		account(slot, false);
+		--m_counts[slot.type];
+		slot.id = 0;
+		slot.bytes = 0;
+		slot.label = NULL;
+		if (++slot.generation == 0) //Generation 0 is kept for null handles.
+		{
+			slot.generation = 1;
+		}
+		m_freeSlots.push_back(handle.index);
+	}
+
+	//! Fences the objects released during the frame just submitted, then deletes any earlier batches the GPU has finished with. Must be called on the drawing thread, after the frame's commands.
+	void endFrame()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_released.empty())
+			{
+				m_retiring.push_back(RetiringBatch());
+				m_retiring.back().fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				m_retiring.back().objects.swap(m_released);
+			}
+		}
+		collect();
+	}
+
+	//! Deletes the batches whose frames the GPU has retired, without waiting for the rest. Must be called on the drawing thread.
+	void collect()
+	{
+		std::vector<PendingDelete> retired;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			while (!m_retiring.empty())
+			{
+				GLenum status = glClientWaitSync(m_retiring.front().fence, 0, 0);
+				if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				{
+					break;
+				}
+				glDeleteSync(m_retiring.front().fence);
+				retired.insert(retired.end(), m_retiring.front().objects.begin(), m_retiring.front().objects.end());
+				m_retiring.pop_front();
+			}
+		}
+		deleteObjects(retired);
+	}
+
+	//! Deletes every released object at once, for shutdown or a context which is about to go. Must be called with a context current.
+	void flush()
+	{
+		std::vector<PendingDelete> objects;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (std::deque<RetiringBatch>::const_iterator it = m_retiring.begin(); m_retiring.end() != it; ++it)
+			{
+				glDeleteSync(it->fence);
+				objects.insert(objects.end(), it->objects.begin(), it->objects.end());
+			}
+			m_retiring.clear();
+			objects.insert(objects.end(), m_released.begin(), m_released.end());
+			m_released.clear();
+		}
+		deleteObjects(objects);
+	}
+
+	//! Returns the estimated video memory of the live objects of a kind.
+	size_t getBytes(GpuResourceType type) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_bytes[type];
+	}
+
+	//! Returns the estimated video memory of the live objects in a category.
+	size_t getCategoryBytes(GpuMemoryCategory category) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_categoryBytes[category];
+	}
+
+	//! Returns the estimated video memory of every live object.
+	size_t getTotalBytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_totalBytes;
+	}
+
+	//! Returns the most video memory the live objects have taken at once.
+	size_t getPeakBytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_peakBytes;
+	}
+
+	//! Returns an object's estimated video memory, 0 if the handle is stale.
+	size_t getBytes(GpuHandle handle) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (handle.isNull() || handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation)
+		{
+			return 0;
+		}
+		return m_slots[handle.index].bytes;
+	}
+
+	//! Returns the number of live objects of a kind.
+	unsigned getCount(GpuResourceType type) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_counts[type];
+	}
+
+	//! Returns the number of released objects still waiting for the GPU.
+	size_t getPendingCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t count = m_released.size();
+		for (std::deque<RetiringBatch>::const_iterator it = m_retiring.begin(); m_retiring.end() != it; ++it)
+		{
+			count += it->objects.size();
+		}
+		return count;
+	}
+
+	//! Prints the bytes and number of live objects of each kind, and the bytes of each category.
+	void report(std::ostream& out) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; ++i)
+		{
+			out << typeName((GpuResourceType)i) << "s: " << m_counts[i] << " live, " << m_bytes[i] / 1024 << " KB" << std::endl;
+		}
+		for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
+		{
+			out << categoryName((GpuMemoryCategory)i) << ": " << m_categoryBytes[i] / 1024 << " KB" << std::endl;
+		}
+	}
+
+	//! Reports every object still registered, which should be none once everything has been released at shutdown.
+	/**
+	\return The number of leaked objects.
+	*/
+	size_t reportLeaks() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t leaks = 0;
+		for (std::vector<Slot>::const_iterator it = m_slots.begin(); m_slots.end() != it; ++it)
+		{
+			if (it->id)
+			{
+				std::cerr << "Warning, GpuResourceRegistry::reportLeaks, " << typeName(it->type) << " " << it->id << " (" << (it->label ? it->label : "unlabelled")
+					<< ", " << it->bytes << " bytes) was never released." << std::endl;
+				++leaks;
+			}
+		}
+		return leaks;
+	}
+};
+
+/**
+\class GpuObject
+\brief Owns one OpenGL object through the GpuResourceRegistry, releasing it when destroyed. Objects can be moved but not copied,
+so only one owner ever releases them.
+*/
+template <GpuResourceType Type>
+class GpuObject
+{
+private:
+	GpuHandle m_handle;	//!< The object in the registry.
+	GLuint m_id;		//!< OpenGL name, cached so binding needn't take the registry's lock.
+
+	GpuObject(const GpuObject&);
+	GpuObject& operator=(const GpuObject&);
+
+public:
+	//! Constructor for an empty owner.
+	GpuObject() : m_id(0) {};
+
+	//! Constructor, taking ownership of an object.
+	/**
+	\param id OpenGL name of the object.
+	\param bytes Estimated video memory of the object.
+	\param category What the object's memory is used for.
+	\param label What the object is, for the leak report.
+	*/
+	GpuObject(GLuint id, size_t bytes, GpuMemoryCategory category, const char* label) : m_handle(GpuResourceRegistry::instance().add(Type, id, bytes, category, label)), m_id(id) {};
+
+	//! Move constructor, taking the other owner's object.
+	GpuObject(GpuObject&& other) noexcept : m_handle(other.m_handle), m_id(other.m_id)
+	{
+		other.m_handle = GpuHandle();
+		other.m_id = 0;
+	}
+
+	//! Move assignment, releasing this owner's object and taking the other's.
+	GpuObject& operator=(GpuObject&& other) noexcept
+	{
+		if (this != &other)
+		{
+			this->reset();
+			m_handle = other.m_handle;
+			m_id = other.m_id;
+			other.m_handle = GpuHandle();
+			other.m_id = 0;
+		}
+		return *this;
+	}
+
+	//! Destructor, which releases the object.
+	~GpuObject() { this->reset(); }
+
+	//! Releases the object, which is deleted once the GPU has finished with it.
+	void reset()
+	{
+		if (!m_handle.isNull())
+		{
+			GpuResourceRegistry::instance().release(m_handle);
+		}
+		m_handle = GpuHandle();
+		m_id = 0;
+	}
+
+	//! Releases the object and takes ownership of another.
+	/**
+	\param id OpenGL name of the object.
+	\param bytes Estimated video memory of the object.
+	\param category What the object's memory is used for.
+	\param label What the object is, for the leak report.
+	*/
+	void reset(GLuint id, size_t bytes, GpuMemoryCategory category, const char* label)
+	{
+		this->reset();
+		m_handle = GpuResourceRegistry::instance().add(Type, id, bytes, category, label);
+		m_id = id;
+	}
+
+	//! Updates the object's estimated video memory.
+	void setBytes(size_t bytes) { GpuResourceRegistry::instance().setBytes(m_handle, bytes); }
+	//! Returns the object's estimated video memory.
+	size_t getBytes() const { return GpuResourceRegistry::instance().getBytes(m_handle); }
+
+	GLuint get() const { return m_id; }						//!< Returns the OpenGL name, 0 if there's no object.
+	GpuHandle getHandle() const { return m_handle; }		//!< Returns the handle, for references which mustn't keep the object alive.
+	bool isNull() const { return m_handle.isNull(); }		//!< Returns whether there's no object.
+};
+
+typedef GpuObject<GPU_BUFFER> GpuBuffer;			//!< An owned buffer object.
+typedef GpuObject<GPU_TEXTURE> GpuTexture;			//!< An owned texture object.
+typedef GpuObject<GPU_PROGRAM> GpuProgram;			//!< An owned shader program.
+typedef GpuObject<GPU_FRAMEBUFFER> GpuFramebuffer;	//!< An owned frame buffer object.
+
+#endif
@@ -0,0 +1,308 @@
+#ifndef _HIZ_H_
+#define _HIZ_H_
+/**
+\file hiz.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include "shader.h"
+#include "frustum.h"
+#include "texture.h"
+#include "model.h"
+
+/**
+\class HiZOcclusion
+\brief GPU driven occlusion culling of many instances of a model. The previous frame's depth is reduced into a min/max hierarchical-Z pyramid, and a compute pass tests every instance's meshes against the frustum and the pyramid. The survivors' transforms are compacted into a buffer the draws read as instanced attributes, and the compute pass writes the indirect draw commands, so the CPU never reads the results back. Requires OpenGL 4.3.
+*/
+class HiZOcclusion
+{
+public:
+	static const GLuint CULL_GROUP_SIZE = 64;		//!< Work group size of the culling pass.
+	static const GLuint DOWNSAMPLE_GROUP_SIZE = 8;	//!< Work group width and height of the pyramid downsample pass.
+	static const GLuint INSTANCE_ATTRIBUTE = 5;		//!< First vertex attribute location of the instance transform (a mat4 uses four).
+	static const GLint TEXTURE_UNIT = 13;			//!< Texture unit the pyramid and depth copy are read from by the compute passes.
+
+private:
+	/**
+	\struct DrawCommand
+	\brief Layout of an indexed indirect draw command.
+	*/
+	struct DrawCommand
+	{
+		GLuint count;		  //!< Number of indices.
+		GLuint instanceCount; //!< Number of visible instances, counted by the culling pass.
+		GLuint firstIndex;	  //!< First index of the mesh's full resolution level.
+		GLint baseVertex;	  //!< Added to every index.
+		GLuint baseInstance;  //!< First slot of the mesh's region of the visible transform buffer.
+	};
+
+	GpuFramebuffer m_depthFbo;	//!< Frame buffer the window's depth is copied into.
+	GpuTexture m_depthTex;		//!< Copy of the window's depth.
+	GpuTexture m_pyramidTex;	//!< Min (red) and max (green) depth pyramid.
+	GLsizei m_width;			//!< Width of the depth and the pyramid's first level.
+	GLsizei m_height;			//!< Height of the depth and the pyramid's first level.
+	GLint m_levels;				//!< Number of levels in the pyramid.
+	glm::mat4 m_pyramidViewProjection; //!< View-projection the pyramid's depth was rendered with.
+	bool m_pyramidValid;		//!< Whether the pyramid has been built since the instances were last set.
+
+	const Model* m_model;				//!< The instanced model.
+	GLuint m_instanceCount;				//!< Number of instances.
+	GpuBuffer m_instanceBuffer;			//!< Transform of every instance.
+	GpuBuffer m_meshBoundsBuffer;		//!< Model space bounds (min, max) of every mesh.
+	GpuBuffer m_visibleBuffer;			//!< Transforms of the visible instances, a region per mesh.
+	GpuBuffer m_commandBuffer;			//!< Indirect draw command of every mesh.
+	std::vector<DrawCommand> m_commands; //!< Commands with no instances, which the command buffer is reset to each frame.
+
+public:
+	//! Default constructor. The textures and buffers are created by setup and setInstances.
+	HiZOcclusion() : m_width(0), m_height(0), m_levels(0), m_pyramidValid(false), m_model(NULL), m_instanceCount(0) {};
+
+	//! Returns whether the context supports compute shaders and indirect draws.
+	static bool isSupported() { return GLEW_VERSION_4_3 != 0; }
+
+	//! Creates the depth copy and the pyramid.
+	/**
+	\param width Width of the window's depth.
+	\param height Height of the window's depth.
+	*/
+	bool setup(GLsizei width, GLsizei height)
+	{
+		m_width = width;
+		m_height = height;
+		m_depthTex.reset(TextureHelper::makeAttachmentTexture(0, GL_DEPTH24_STENCIL8, width, height, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8),
+			TextureHelper::textureBytes(GL_DEPTH24_STENCIL8, width, height), GPU_MEMORY_RENDER_TARGET, "Hi-Z depth copy");
+		glBindTexture(GL_TEXTURE_2D, m_depthTex.get());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		GLuint fbo = 0;
+		glGenFramebuffers(1, &fbo);
+		m_depthFbo.reset(fbo, 0, GPU_MEMORY_RENDER_TARGET, "Hi-Z depth copy");
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTex.get(), 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "Error::HiZOcclusion::setup, frame buffer incomplete with status: " << status << std::endl;
+			return false;
+		}
+
+		//Immutable storage, so each level can be bound as an image.
+		m_levels = 1;
+		while ((std::max(width, height) >> m_levels) > 0) ++m_levels;
+		GLuint pyramid = 0;
+		glGenTextures(1, &pyramid);
+		m_pyramidTex.reset(pyramid, TextureHelper::textureBytes(GL_RG32F, width, height, 1, m_levels), GPU_MEMORY_RENDER_TARGET, "Hi-Z pyramid");
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		glTexStorage2D(GL_TEXTURE_2D, m_levels, GL_RG32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return true;
+	}
+
+	//! Uploads the instances of a model to cull and draw.
+	/**
+	\param model The model to instance.
+	\param transforms Transformation into world space of each instance.
+	*/
+	void setInstances(const Model& model, const std::vector<glm::mat4>& transforms)
+	{
+		m_model = &model;
+		m_instanceCount = (GLuint)transforms.size();
+		const std::vector<Mesh>& meshes = model.getMeshes();
+		if (m_instanceBuffer.isNull())
+		{
+			GLuint buffers[4];
+			glGenBuffers(4, buffers);
+			m_instanceBuffer.reset(buffers[0], 0, GPU_MEMORY_OTHER, "Hi-Z instances");
+			m_meshBoundsBuffer.reset(buffers[1], 0, GPU_MEMORY_OTHER, "Hi-Z mesh bounds");
+			m_visibleBuffer.reset(buffers[2], 0, GPU_MEMORY_VERTEX, "Hi-Z visible instances");
+			m_commandBuffer.reset(buffers[3], 0, GPU_MEMORY_OTHER, "Hi-Z draw commands");
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer.get());
+		glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(transforms.size(), 1) * sizeof(glm::mat4), transforms.empty() ? NULL : &transforms[0], GL_STATIC_DRAW);
+
+		//Each mesh draws its full resolution level, from its own region of the visible transforms.
+		std::vector<glm::vec4> meshBounds;
+		m_commands.clear();
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			meshBounds.push_back(glm::vec4(meshes[i].getBounds().min, 0.0f));
+			meshBounds.push_back(glm::vec4(meshes[i].getBounds().max, 0.0f));
+			const MeshLod& fullLevel = meshes[i].getLods()[0];
+			DrawCommand command = { fullLevel.indexCount, 0, fullLevel.indexOffset, 0, (GLuint)i * m_instanceCount };
+			m_commands.push_back(command);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_meshBoundsBuffer.get());
+		glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(meshBounds.size(), 1) * sizeof(glm::vec4), meshBounds.empty() ? NULL : &meshBounds[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer.get());
+		glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(meshes.size() * transforms.size(), 1) * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer.get());
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, std::max<size_t>(m_commands.size(), 1) * sizeof(DrawCommand), m_commands.empty() ? NULL : &m_commands[0], GL_DYNAMIC_COPY);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		m_instanceBuffer.setBytes(std::max<size_t>(transforms.size(), 1) * sizeof(glm::mat4));
+		m_meshBoundsBuffer.setBytes(std::max<size_t>(meshBounds.size(), 1) * sizeof(glm::vec4));
+		m_visibleBuffer.setBytes(std::max<size_t>(meshes.size() * transforms.size(), 1) * sizeof(glm::mat4));
+		m_commandBuffer.setBytes(std::max<size_t>(m_commands.size(), 1) * sizeof(DrawCommand));
+		m_pyramidValid = false;
+	}
+
+	//! Copies a frame buffer's depth and reduces it into the pyramid, which the next frame's culling tests against.
+	/**
+	\param downsampleShader Compute shader built from hiz_downsample.comp.
+	\param viewProjection View-projection the depth was rendered with.
+	\param sourceFbo Frame buffer to copy the depth from (0 for the window).
+	*/
+	void updatePyramid(const Shader& downsampleShader, const glm::mat4& viewProjection, GLuint sourceFbo = 0)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFbo.get());
+		glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, sourceFbo);
+
+		downsampleShader.use();
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, m_depthTex.get());
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(downsampleShader.programId, "depthTexture"), TEXTURE_UNIT);
+		GLint copyLoc = glGetUniformLocation(downsampleShader.programId, "copyDepth");
+
+		//The first level copies the depth, and every other level reduces the one before it.
+		for (GLint level = 0; level < m_levels; ++level)
+		{
+			GLsizei levelWidth = std::max(1, m_width >> level), levelHeight = std::max(1, m_height >> level);
+			glUniform1i(copyLoc, level == 0);
+			glBindImageTexture(0, m_pyramidTex.get(), std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+			glBindImageTexture(1, m_pyramidTex.get(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+			glDispatchCompute((levelWidth + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE, (levelHeight + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+		m_pyramidViewProjection = viewProjection;
+		m_pyramidValid = true;
+	}
+
+	//! Marks the pyramid out of date, for frames which don't rebuild it, so the next cull only uses the frustum rather than old depth.
+	void invalidatePyramid() { m_pyramidValid = false; }
+
+	//! Tests every instance's meshes against the frustum and the last pyramid, and writes the visible transforms and draw commands.
+	/**
+	\param cullShader Compute shader built from hiz_cull.comp.
+	\param frustum The camera's frustum in world space.
+	*/
+	void cull(const Shader& cullShader, const Frustum& frustum)
+	{
+		if (!m_model || m_instanceCount == 0 || m_commands.empty())
+		{
+			return;
+		}
+
+		//Reset the instance counts, then let the culling pass fill them in.
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer.get());
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, m_commands.size() * sizeof(DrawCommand), &m_commands[0]);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		cullShader.use();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceBuffer.get());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_meshBoundsBuffer.get());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleBuffer.get());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_commandBuffer.get());
+		for (int i = 0; i < 6; ++i)
+		{
+			std::stringstream planeName;
+			planeName << "frustumPlanes[" << i << "]";
+			glUniform4fv(glGetUniformLocation(cullShader.programId, planeName.str().c_str()), 1, glm::value_ptr(frustum.getPlane(i)));
+		}
+		glUniform1ui(glGetUniformLocation(cullShader.programId, "instanceCount"), m_instanceCount);
+		glUniform1ui(glGetUniformLocation(cullShader.programId, "meshCount"), (GLuint)m_commands.size());
+		glUniformMatrix4fv(glGetUniformLocation(cullShader.programId, "pyramidViewProjection"), 1, GL_FALSE, glm::value_ptr(m_pyramidViewProjection));
+		glUniform1i(glGetUniformLocation(cullShader.programId, "pyramidValid"), m_pyramidValid);
+		glUniform1i(glGetUniformLocation(cullShader.programId, "pyramidLevels"), m_levels);
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, m_pyramidTex.get());
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(cullShader.programId, "hiZPyramid"), TEXTURE_UNIT);
+
+		GLuint tests = m_instanceCount * (GLuint)m_commands.size();
+		glDispatchCompute((tests + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+		for (GLuint i = 0; i < 4; ++i) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+	}
+
+	//! Draws the visible instances with one indirect draw per mesh. The shader reads the transform from the instance attributes when its "instanced" uniform is set.
+	/**
+	\param shader The shader to render the instances with.
+	*/
+	void draw(const Shader& shader) const
+	{
+		if (!m_model || m_instanceCount == 0)
+		{
+			return;
+		}
+		glUniform1i(glGetUniformLocation(shader.programId, "instanced"), 1);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer.get());
+
+		const std::vector<Mesh>& meshes = m_model->getMeshes();
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			if (meshes[i].getVAOId() == 0)
+			{
+				continue;
+			}
+
+			//Attach the visible transforms to the mesh's vertex array, one mat4 (four vec4 columns) per instance.
+			glBindVertexArray(meshes[i].getVAOId());
+			glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer.get());
+			for (GLuint column = 0; column < 4; ++column)
+			{
+				glVertexAttribPointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(column * sizeof(glm::vec4)));
+				glVertexAttribDivisor(INSTANCE_ATTRIBUTE + column, 1);
+				glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + column);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			int texUnitCnt = meshes[i].bindTextures(shader);
+			glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)(i * sizeof(DrawCommand)));
+			meshes[i].unBindTextures(texUnitCnt);
+
+			//Detach them again so the mesh's ordinary draws are unaffected.
+			for (GLuint column = 0; column < 4; ++column)
+			{
+				glDisableVertexAttribArray(INSTANCE_ATTRIBUTE + column);
+				glVertexAttribDivisor(INSTANCE_ATTRIBUTE + column, 0);
+			}
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glUniform1i(glGetUniformLocation(shader.programId, "instanced"), 0);
+	}
+
+	//! Releases the textures, frame buffer and buffers.
+	void final()
+	{
+		m_depthTex.reset();
+		m_pyramidTex.reset();
+		m_depthFbo.reset();
+		m_instanceBuffer.reset();
+		m_meshBoundsBuffer.reset();
+		m_visibleBuffer.reset();
+		m_commandBuffer.reset();
+	}
+
+	//! Returns the number of instances.
+	GLuint getInstanceCount() const { return m_instanceCount; }
+};
+
+#endif
@@ -0,0 +1,463 @@
+#ifndef _JOBSYSTEM_H_
+#define _JOBSYSTEM_H_
+/**
+\file jobSystem.h
+*/
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+class JobSystem;
+
+/**
+\class JobCounter
+\brief Counts a group of unfinished jobs, which can be waited on or used as a dependency of later jobs.
+*/
+class JobCounter
+{
+	friend class JobSystem;
+private:
+	//! A job held back until the counter reaches zero.
+	struct PendingJob
+	{
+		std::function<void()> task; //!< The job's work.
+		JobCounter* counter;		//!< Counter the job decrements when it finishes.
+	};
+
+	std::atomic<int> m_count;				//!< Number of unfinished jobs.
+	mutable std::mutex m_mutex;				//!< Guards the pending jobs and the count reaching zero.
+	std::vector<PendingJob> m_pending;		//!< Jobs which depend on this counter.
+
+	JobCounter(const JobCounter&);
+	JobCounter& operator=(const JobCounter&);
+public:
+	JobCounter() : m_count(0) {}; //!< Constructor
+
+	//! Returns whether every job counted has finished.
+	bool isDone() const { return m_count.load() == 0; }
+	//! Returns the number of unfinished jobs.
+	int getCount() const { return m_count.load(); }
+};
+
+/**
+\class JobSystem
+\brief A pool of worker threads, one per spare core, each with its own deque of jobs which idle workers steal from.
+
+The first thread to use the job system is taken as the main thread, which owns the OpenGL context, until another thread takes over with setMainThread. Jobs must not make OpenGL calls,
+they queue them with runOnMainThread instead, and the main thread runs them from pumpMainThreadQueue once a frame.
+*/
+class JobSystem
+{
+private:
+	//! A job ready to run.
+	struct Job
+	{
+		std::function<void()> task; //!< The job's work.
+		JobCounter* counter;		//!< Counter the job decrements when it finishes, may be NULL.
+	};
+
+	//! A deque of jobs. Its owner pushes and pops at the back, thieves take from the front.
+	struct JobQueue
+	{
+		std::mutex mutex;		//!< Guards the jobs.
+		std::deque<Job> jobs;	//!< Queued jobs.
+	};
+
+	std::vector<std::thread> m_workers;		//!< Worker threads.
+	std::vector<JobQueue*> m_queues;		//!< One queue per worker, then a shared queue for jobs from other threads.
+	std::atomic<int> m_queuedJobs;			//!< Number of jobs in every queue, which workers sleep while it's zero.
+	std::mutex m_sleepMutex;				//!< Guards sleeping and waking workers.
+	std::condition_variable m_wake;			//!< Wakes sleeping workers.
+	std::atomic<bool> m_stop;				//!< Whether the workers should exit.
+	std::atomic<size_t> m_outsideThreads;	//!< Number of threads outside the pool which have asked for a thread index.
+	std::atomic<std::thread::id> m_mainThread; //!< The thread which owns the OpenGL context.
+	std::mutex m_mainMutex;					//!< Guards the main thread queue.
+	std::vector<std::function<void()> > m_mainQueue; //!< Work which must run on the main thread.
+
+	JobSystem(const JobSystem&);
+	JobSystem& operator=(const JobSystem&);
+
+	//! Constructor
+	JobSystem() : m_queuedJobs(0), m_stop(false), m_outsideThreads(0), m_mainThread(std::this_thread::get_id())
+	{
+		//One worker per core besides the main thread's, and at least one so jobs never depend on the main thread.
+		size_t workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+		for (size_t i = 0; i <= workerCount; ++i)
+		{
+			m_queues.push_back(new JobQueue());
+		}
+		for (size_t i = 0; i < workerCount; ++i)
+		{
+			m_workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+		}
+	}
+
+	//! Returns the index of the calling thread's queue, which is the shared queue for threads outside the pool.
+	size_t getLocalQueue()
+	{
+		int index = localQueueIndex();
+		return index < 0 ? m_workers.size() : (size_t)index;
+	}
+
+	//! Returns the calling thread's worker index, or -1 if it isn't a worker.
+	static int& localQueueIndex()
+	{
+		static thread_local int index = -1;
+		return index;
+	}
+
+	//! Returns the calling thread's index for per-thread data, or -1 if it hasn't been given one.
+	static int& localThreadIndex()
+	{
+		static thread_local int index = -1;
+		return index;
+	}
+
+	//! Queues a job on the calling thread's queue and wakes a worker.
+	/**
+	\param job The job to queue.
+	*/
+	void schedule(const Job& job)
+	{
+		JobQueue& queue = *m_queues[getLocalQueue()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(job);
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			++m_queuedJobs;
+		}
+		m_wake.notify_one();
+	}
+
+	//! Removes a job from a queue, the newest or oldest one counted by a counter if one is given. The queue must be locked.
+	/**
+	\param queue The queue to take from.
+	\param newest Whether to take from the back (the owner's end) rather than the front (the thieves' end).
+	\param counter Counter the job must decrement, or NULL for any job.
+	\param job Where to store the job.
+	\return Whether a job was found.
+	*/
+	bool popJob(JobQueue& queue, bool newest, const JobCounter* counter, Job& job)
+	{
+		if (queue.jobs.empty())
+		{
+			return false;
+		}
+		if (!counter)
+		{
+			if (newest)
+			{
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			}
+			else
+			{
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+			}
+			--m_queuedJobs;
+			return true;
+		}
+		for (size_t i = 0; i < queue.jobs.size(); ++i)
+		{
+			std::deque<Job>::iterator it = queue.jobs.begin() + (newest ? queue.jobs.size() - 1 - i : i);
+			if (it->counter == counter)
+			{
+				job = *it;
+				queue.jobs.erase(it);
+				--m_queuedJobs;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//! Takes a job from the thread's own queue, or steals one from another.
+	/**
+	\param queueIndex The calling thread's queue.
+	\param counter Counter the job must decrement, or NULL for any job.
+	\param job Where to store the job.
+	\return Whether a job was found.
+	*/
+	bool takeJob(size_t queueIndex, const JobCounter* counter, Job& job)
+	{
+		if (m_queuedJobs.load() == 0)
+		{
+			return false;
+		}
+		{
+			JobQueue& own = *m_queues[queueIndex];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (popJob(own, true, counter, job))
+			{
+				return true;
+			}
+		}
+		//Steal the oldest job, which tends to be the largest piece of work left.
+		for (size_t offset = 1; offset < m_queues.size(); ++offset)
+		{
+			JobQueue& victim = *m_queues[(queueIndex + offset) % m_queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (popJob(victim, false, counter, job))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//! Runs a job, then releases the jobs waiting on its counter if it was the last one.
+	/**
+	\param job The job to run.
+	*/
+	void execute(Job& job)
+	{
+		job.task();
+		if (!job.counter)
+		{
+			return;
+		}
+
+		//The counter may be destroyed by its waiter as soon as the lock is released, so it's not touched afterwards.
+		std::vector<JobCounter::PendingJob> released;
+		{
+			std::lock_guard<std::mutex> lock(job.counter->m_mutex);
+			if (job.counter->m_count.fetch_sub(1) == 1)
+			{
+				released.swap(job.counter->m_pending);
+			}
+		}
+		for (std::vector<JobCounter::PendingJob>::iterator it = released.begin(); released.end() != it; ++it)
+		{
+			Job next = { it->task, it->counter };
+			schedule(next);
+		}
+	}
+
+	//! Runs one queued job on the calling thread.
+	/**
+	\param counter Counter the job must decrement, or NULL to run any job.
+	\return Whether a job was run.
+	*/
+	bool runOneJob(const JobCounter* counter = NULL)
+	{
+		Job job;
+		if (!takeJob(getLocalQueue(), counter, job))
+		{
+			return false;
+		}
+		execute(job);
+		return true;
+	}
+
+	//! Runs jobs until the job system stops, sleeping while there are none.
+	/**
+	\param index The worker's index.
+	*/
+	void workerLoop(size_t index)
+	{
+		localQueueIndex() = (int)index;
+		localThreadIndex() = (int)index;
+		while (!m_stop.load())
+		{
+			if (runOneJob())
+			{
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_wake.wait(lock, [this]() { return m_queuedJobs.load() > 0 || m_stop.load(); });
+		}
+	}
+
+public:
+	//! Destructor, finishes the running jobs and joins the workers.
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (std::vector<std::thread>::iterator it = m_workers.begin(); m_workers.end() != it; ++it)
+		{
+			it->join();
+		}
+		for (std::vector<JobQueue*>::iterator it = m_queues.begin(); m_queues.end() != it; ++it)
+		{
+			delete *it;
+		}
+	}
+
+	//! Returns the job system, starting its workers on first use.
+	static JobSystem& instance()
+	{
+		static JobSystem system;
+		return system;
+	}
+
+	static const size_t MAX_OUTSIDE_THREADS = 4; //!< Threads outside the pool (such as the render and loader threads) given their own thread index.
+
+	//! Returns the number of thread indices, which is the size per-thread data needs.
+	size_t getThreadCount() const { return m_workers.size() + MAX_OUTSIDE_THREADS; }
+
+	//! Returns the calling thread's index, below getThreadCount, for picking its own per-thread data.
+	size_t getThreadIndex()
+	{
+		int& index = localThreadIndex();
+		if (index < 0)
+		{
+			//Threads outside the pool take the indices after the workers' as they first ask. Sharing an index would race on per-thread data, so running out is fatal.
+			size_t outside = m_outsideThreads++;
+			if (outside >= MAX_OUTSIDE_THREADS)
+			{
+				std::cerr << "Error::JobSystem::getThreadIndex, more than " << MAX_OUTSIDE_THREADS << " threads outside the pool asked for a thread index, raise MAX_OUTSIDE_THREADS." << std::endl;
+				std::abort();
+			}
+			index = (int)(m_workers.size() + outside);
+		}
+		return (size_t)index;
+	}
+
+	//! Returns whether the calling thread is the main thread, which owns the OpenGL context.
+	bool isMainThread() const { return std::this_thread::get_id() == m_mainThread.load(); }
+
+	//! Makes the calling thread the main thread, such as a render thread the OpenGL context has been moved to.
+	void setMainThread() { m_mainThread = std::this_thread::get_id(); }
+
+	//! Queues a job.
+	/**
+	\param task The job's work. It mustn't make OpenGL calls.
+	\param counter Counter incremented now and decremented when the job finishes, may be NULL.
+	\param dependency Counter which must reach zero before the job starts, may be NULL.
+	*/
+	void run(const std::function<void()>& task, JobCounter* counter = NULL, JobCounter* dependency = NULL)
+	{
+		if (counter)
+		{
+			++counter->m_count;
+		}
+		if (dependency)
+		{
+			std::lock_guard<std::mutex> lock(dependency->m_mutex);
+			if (dependency->m_count.load() > 0)
+			{
+				JobCounter::PendingJob pending = { task, counter };
+				dependency->m_pending.push_back(pending);
+				return;
+			}
+		}
+		Job job = { task, counter };
+		schedule(job);
+	}
+
+	//! Waits for a counter to reach zero, running its queued jobs meanwhile rather than blocking.
+	/**
+	\param counter The counter to wait on.
+	*/
+	void wait(const JobCounter& counter)
+	{
+		//Only the counter's own jobs are helped with, so a thread waiting on short work (such as the render thread recording draws) never
+		//picks up an unrelated long job (such as a texture decode for a load). Jobs held back by a dependency are left to the workers.
+		while (!counter.isDone())
+		{
+			if (!runOneJob(&counter))
+			{
+				std::this_thread::yield();
+			}
+		}
+		//Let the job which finished the counter release its lock before the counter can go out of scope.
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+	}
+
+	//! Splits a range into jobs of contiguous sub-ranges and waits for them all.
+	/**
+	\param begin First index of the range.
+	\param end One past the last index of the range.
+	\param func Called as func(first, last) for each sub-range, from any thread.
+	\param minGrain Fewest indices in a job. The grain is otherwise picked to give each thread a few jobs to balance between.
+	*/
+	template <typename Func>
+	void parallelForRange(size_t begin, size_t end, const Func& func, size_t minGrain = 1)
+	{
+		if (end <= begin)
+		{
+			return;
+		}
+		const size_t count = end - begin;
+		const size_t grain = std::max(std::max(minGrain, (size_t)1), count / ((m_workers.size() + 1) * 4));
+		if (count <= grain)
+		{
+			func(begin, end);
+			return;
+		}
+
+		//The caller takes the first sub-range itself, then helps with the rest while it waits.
+		JobCounter counter;
+		for (size_t first = begin + grain; first < end; first += grain)
+		{
+			size_t last = std::min(first + grain, end);
+			run([&func, first, last]() { func(first, last); }, &counter);
+		}
+		func(begin, std::min(begin + grain, end));
+		wait(counter);
+	}
+
+	//! Calls a function for each index in a range, split into jobs, and waits for them all.
+	/**
+	\param begin First index of the range.
+	\param end One past the last index of the range.
+	\param func Called as func(index) for each index, from any thread.
+	\param minGrain Fewest indices in a job.
+	*/
+	template <typename Func>
+	void parallelFor(size_t begin, size_t end, const Func& func, size_t minGrain = 1)
+	{
+		parallelForRange(begin, end, [&func](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
+			{
+				func(i);
+			}
+		}, minGrain);
+	}
+
+	//! Queues work which must run on the main thread, such as OpenGL calls. Runs it immediately if called from the main thread.
+	/**
+	\param task The work.
+	*/
+	void runOnMainThread(const std::function<void()>& task)
+	{
+		if (isMainThread())
+		{
+			task();
+			return;
+		}
+		std::lock_guard<std::mutex> lock(m_mainMutex);
+		m_mainQueue.push_back(task);
+	}
+
+	//! Runs the work queued for the main thread. Must be called from the main thread, once a frame.
+	void pumpMainThreadQueue()
+	{
+		std::vector<std::function<void()> > tasks;
+		{
+			std::lock_guard<std::mutex> lock(m_mainMutex);
+			tasks.swap(m_mainQueue);
+		}
+		for (std::vector<std::function<void()> >::iterator it = tasks.begin(); tasks.end() != it; ++it)
+		{
+			(*it)();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef _JSON_H_
+#define _JSON_H_
+/**
+\file json.h
+*/
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cmath>
+
+/**
+\class JsonValue
+\brief A parsed JSON document, enough to read file formats such as glTF. Looking up a missing member or element gives a null value, so paths
+can be followed without checking every step.
+*/
+class JsonValue
+{
+public:
+	//! The kinds of JSON value.
+	enum Type
+	{
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT
+	};
+
+private:
+	Type m_type;											//!< Kind of value.
+	double m_number;										//!< Value of a number, or 1 or 0 for a bool.
+	std::string m_string;									//!< Value of a string.
+	std::vector<JsonValue> m_elements;						//!< Elements of an array.
+	std::vector<std::pair<std::string, JsonValue> > m_members;	//!< Members of an object, in file order.
+
+	//! Returns the value given for missing members and elements.
+	static const JsonValue& null()
+	{
+		static const JsonValue value;
+		return value;
+	}
+
+	//! Skips whitespace.
+	static void skipSpace(const char*& p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		{
+			++p;
+		}
+	}
+
+	//! Appends a unicode code point as UTF-8.
+	static void appendUtf8(std::string& out, unsigned codePoint)
+	{
+		if (codePoint < 0x80)
+		{
+			out.push_back((char)codePoint);
+		}
+		else if (codePoint < 0x800)
+		{
+			out.push_back((char)(0xc0 | (codePoint >> 6)));
+			out.push_back((char)(0x80 | (codePoint & 0x3f)));
+		}
+		else
+		{
+			out.push_back((char)(0xe0 | (codePoint >> 12)));
+			out.push_back((char)(0x80 | ((codePoint >> 6) & 0x3f)));
+			out.push_back((char)(0x80 | (codePoint & 0x3f)));
+		}
+	}
+
+	//! Parses a string, starting at its opening quote.
+	static bool parseString(const char*& p, const char* end, std::string& out)
+	{
+		++p;
+		out.clear();
+		while (p < end && *p != '"')
+		{
+			if (*p != '\\')
+			{
+				out.push_back(*p++);
+				continue;
+			}
+			if (++p >= end)
+			{
+				return false;
+			}
+			switch (*p++)
+			{
+			case '"': out.push_back('"'); break;
+			case '\\': out.push_back('\\'); break;
+			case '/': out.push_back('/'); break;
+			case 'b': out.push_back('\b'); break;
+			case 'f': out.push_back('\f'); break;
+			case 'n': out.push_back('\n'); break;
+			case 'r': out.push_back('\r'); break;
+			case 't': out.push_back('\t'); break;
+			case 'u':
+			{
+				if (end - p < 4)
+				{
+					return false;
+				}
+				char hex[5] = { p[0], p[1], p[2], p[3], 0 };
+				appendUtf8(out, (unsigned)std::strtoul(hex, NULL, 16));
+				p += 4;
+				break;
+			}
+			default: return false;
+			}
+		}
+		if (p >= end)
+		{
+			return false;
+		}
+		++p;
+		return true;
+	}
+
+	//! Parses any value.
+	bool parseValue(const char*& p, const char* end, int depth)
+	{
+		skipSpace(p, end);
+		if (p >= end || depth > 256)
+		{
+			return false;
+		}
+		switch (*p)
+		{
+		case '{':
+		{
+			m_type = JSON_OBJECT;
+			++p;
+			skipSpace(p, end);
+			if (p < end && *p == '}')
+			{
+				++p;
+				return true;
+			}
+			while (p < end)
+			{
+				skipSpace(p, end);
+				m_members.push_back(std::make_pair(std::string(), JsonValue()));
+				if (p >= end || *p != '"' || !parseString(p, end, m_members.back().first))
+				{
+					return false;
+				}
+				skipSpace(p, end);
+				if (p >= end || *p++ != ':' || !m_members.back().second.parseValue(p, end, depth + 1))
+				{
+					return false;
+				}
+				skipSpace(p, end);
+				if (p < end && *p == ',')
+				{
+					++p;
+					continue;
+				}
+				if (p < end && *p == '}')
+				{
+					++p;
+					return true;
+				}
+				return false;
+			}
+			return false;
+		}
+		case '[':
+		{
+			m_type = JSON_ARRAY;
+			++p;
+			skipSpace(p, end);
+			if (p < end && *p == ']')
+			{
+				++p;
+				return true;
+			}
+			while (p < end)
+			{
+				m_elements.push_back(JsonValue());
+				if (!m_elements.back().parseValue(p, end, depth + 1))
+				{
+					return false;
+				}
+				skipSpace(p, end);
+				if (p < end && *p == ',')
+				{
+					++p;
+					continue;
+				}
+				if (p < end && *p == ']')
+				{
+					++p;
+					return true;
+				}
+				return false;
+			}
+			return false;
+		}
+		case '"':
+			m_type = JSON_STRING;
+			return parseString(p, end, m_string);
+		case 't':
+		case 'f':
+		case 'n':
+		{
+			const char* word = *p == 't' ? "true" : (*p == 'f' ? "false" : "null");
+			size_t length = std::strlen(word);
+			if ((size_t)(end - p) < length || std::strncmp(p, word, length) != 0)
+			{
+				return false;
+			}
+			m_type = *p == 'n' ? JSON_NULL : JSON_BOOL;
+			m_number = *p == 't' ? 1.0 : 0.0;
+			p += length;
+			return true;
+		}
+		default:
+		{
+			//strtod needs a terminated string, and numbers are short.
+			char number[64];
+			size_t length = 0;
+			while (p + length < end && length < sizeof(number) - 1 && std::strchr("+-0123456789.eE", p[length]))
+			{
+				number[length] = p[length];
+				++length;
+			}
+			number[length] = 0;
+			char* numberEnd = NULL;
+			m_number = std::strtod(number, &numberEnd);
+			if (length == 0 || numberEnd != number + length)
+			{
+				return false;
+			}
+			m_type = JSON_NUMBER;
+			p += length;
+			return true;
+		}
+		}
+	}
+
+public:
+	//! Constructor, for a null value.
+	JsonValue() : m_type(JSON_NULL), m_number(0.0) {};
+
+	//! Parses a JSON document.
+	/**
+	\param text The document's text, which needn't be terminated.
+	\param size Length of the text.
+	\return Whether the document is valid JSON.
+	*/
+	bool parse(const char* text, size_t size)
+	{
+		*this = JsonValue();
+		const char* p = text;
+		const char* end = text + size;
+		if (!parseValue(p, end, 0))
+		{
+			*this = JsonValue();
+			return false;
+		}
+		skipSpace(p, end);
+		//Binary formats may pad the text with zeros.
+		while (p < end && *p == 0)
+		{
+			++p;
+		}
+		return p == end;
+	}
+
+	//! Returns the kind of value.
+	Type getType() const { return m_type; }
+	//! Returns whether the value is null, which it is for missing members and elements.
+	bool isNull() const { return m_type == JSON_NULL; }
+	//! Returns whether the value is a number.
+	bool isNumber() const { return m_type == JSON_NUMBER; }
+	//! Returns whether the value is a string.
+	bool isString() const { return m_type == JSON_STRING; }
+	//! Returns whether the value is an array.
+	bool isArray() const { return m_type == JSON_ARRAY; }
+	//! Returns whether the value is an object.
+	bool isObject() const { return m_type == JSON_OBJECT; }
+
+	//! Returns a number's value, or a default for anything else.
+	double asNumber(double fallback = 0.0) const { return m_type == JSON_NUMBER ? m_number : fallback; }
+	//! Returns a number's value as an integer, or a default for anything else, including numbers outside an int's range.
+	int asInt(int fallback = 0) const { return m_type == JSON_NUMBER && m_number >= INT_MIN && m_number <= INT_MAX ? (int)m_number : fallback; }
+	//! Reads a whole, non-negative number as a size, such as an offset, length or count, without converting values which don't fit.
+	/**
+	\param value Where to store the size.
+	\param fallback Size to store if the value is missing (null).
+	\param limit Largest size allowed.
+	\return Whether the value is missing or a whole number from 0 to the limit. Negative, fractional, non-finite or larger numbers, and other types, fail.
+	*/
+	bool asSize(size_t& value, size_t fallback = 0, size_t limit = (size_t)-1) const
+	{
+		if (m_type == JSON_NULL)
+		{
+			value = fallback;
+			return true;
+		}
+		//Doubles hold every integer exactly up to 2^53, and comparisons with NaN fail.
+		if (m_type != JSON_NUMBER || !(m_number >= 0.0 && m_number <= 9007199254740992.0) || std::floor(m_number) != m_number || m_number > (double)limit)
+		{
+			return false;
+		}
+		value = (size_t)m_number;
+		return value <= limit;
+	}
+	//! Returns a bool's value, or a default for anything else.
+	bool asBool(bool fallback = false) const { return m_type == JSON_BOOL ? m_number != 0.0 : fallback; }
+	//! Returns a string's value, or an empty string for anything else.
+	const std::string& asString() const { return m_string; }
+
+	//! Returns the number of elements of an array or members of an object.
+	size_t size() const { return m_type == JSON_ARRAY ? m_elements.size() : m_members.size(); }
+	//! Returns an array's element, or null if it's out of range or this isn't an array.
+	const JsonValue& at(size_t index) const { return index < m_elements.size() ? m_elements[index] : null(); }
+	//! Returns an object's member, or null if it's missing or this isn't an object.
+	const JsonValue& operator[](const char* name) const
+	{
+		for (std::vector<std::pair<std::string, JsonValue> >::const_iterator it = m_members.begin(); m_members.end() != it; ++it)
+		{
+			if (it->first == name)
+			{
+				return it->second;
+			}
+		}
+		return null();
+	}
+	//! Returns whether an object has a member.
+	bool has(const char* name) const { return !(*this)[name].isNull(); }
+};
+
+#endif
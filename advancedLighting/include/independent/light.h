@@ -0,0 +1,32 @@
+#ifndef _LIGHT_H_
+#define _LIGHT_H_
+/**
+\file light.h
+*/
+#include <glm/glm.hpp>
+
+/**
+\struct PointLight
+\brief A small dynamic light with a finite radius of influence, used by the clustered lighting path.
+*/
+struct PointLight
+{
+	glm::vec3 position; //!< World space position of the light.
+	float radius;		//!< Distance at which the light's contribution reaches zero.
+	glm::vec3 colour;	//!< Colour of the light.
+	float intensity;	//!< Brightness multiplier applied to the colour.
+
+	//! Default constructor for a white light with no radius (and so no contribution).
+	PointLight() : position(0.0f), radius(0.0f), colour(1.0f), intensity(1.0f) {};
+
+	//! Constructor to set all of the light's values.
+	/**
+	\param pos World space position of the light.
+	\param range Radius of the light's influence.
+	\param col Colour of the light.
+	\param power Brightness multiplier of the light.
+	*/
+	PointLight(glm::vec3 pos, float range, glm::vec3 col, float power) : position(pos), radius(range), colour(col), intensity(power) {};
+};
+
+#endif
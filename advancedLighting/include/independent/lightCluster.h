@@ -0,0 +1,356 @@
+#ifndef _LIGHTCLUSTER_H_
+#define _LIGHTCLUSTER_H_
+/**
+\file lightCluster.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include "simd.h"
+#include "light.h"
+#include "shader.h"
+
+/**
+\class LightClusterGrid
+\brief Splits the camera's view frustum into a 3D grid of clusters (froxels) and assigns point lights to the clusters they touch, so the fragment shader only loops over nearby lights.
+*/
+class LightClusterGrid
+{
+public:
+	static const int TILES_X = 16;					//!< Number of clusters across the screen.
+	static const int TILES_Y = 9;					//!< Number of clusters down the screen.
+	static const int SLICES_Z = 24;					//!< Number of exponential depth slices.
+	static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES_Z; //!< Total number of clusters in the grid.
+	static const int MAX_LIGHTS = 1024;				//!< Maximum number of lights that can be assigned each frame.
+	static const int MAX_LIGHTS_PER_CLUSTER = 64;	//!< Cap on lights per cluster, which bounds the per-pixel cost.
+	static const GLint TEXTURE_UNIT_BASE = 8;		//!< First of the three texture units used for the light buffers (above the mesh's material units).
+
+private:
+	static const int TILES_PER_SLICE = TILES_X * TILES_Y; //!< Clusters in one depth slice (a multiple of 4 for the SIMD test).
+
+	//View space bounding boxes of every cluster, stored as separate arrays so four clusters can be tested at once.
+	std::vector<float> m_minX, m_minY, m_minZ; //!< Cluster bounding box minimums.
+	std::vector<float> m_maxX, m_maxY, m_maxZ; //!< Cluster bounding box maximums.
+
+	//Frustum the cluster bounds were built for.
+	float m_fov;		//!< Vertical field of view in radians.
+	float m_aspect;		//!< Width over height of the viewport.
+	float m_near;		//!< Near plane distance.
+	float m_far;		//!< Far plane distance.
+	float m_sliceScale; //!< Converts log(view depth) into a slice index.
+	float m_sliceBias;	//!< Offset subtracted after scaling to get the slice index.
+
+	//CPU side light lists.
+	std::vector<GLushort> m_clusterCounts;	//!< Number of lights assigned to each cluster this frame.
+	std::vector<GLushort> m_clusterScratch; //!< Fixed size per-cluster light lists before compaction.
+	std::vector<GLuint> m_gridData;			//!< Offset and count into the index list for each cluster.
+	std::vector<GLushort> m_indexData;		//!< Compacted light indices of all clusters.
+	std::vector<glm::vec4> m_lightData;		//!< Two texels per light: (position, radius) and (colour * intensity, 0).
+
+	//GPU side buffers which are read in the shader through buffer textures.
+	GpuBuffer m_lightBuffer; GpuTexture m_lightTexture; //!< Light data buffer and its buffer texture.
+	GpuBuffer m_gridBuffer; GpuTexture m_gridTexture;	//!< Cluster offset/count buffer and its buffer texture.
+	GpuBuffer m_indexBuffer; GpuTexture m_indexTexture; //!< Light index buffer and its buffer texture.
+
+	//! Rebuilds the view space bounding boxes of every cluster for the current frustum.
+	void buildClusterBounds()
+	{
+		const float tanY = std::tan(m_fov * 0.5f);
+		const float tanX = tanY * m_aspect;
+		const float depthRatio = m_far / m_near;
+
+		for (int slice = 0; slice < SLICES_Z; ++slice)
+		{
+			//Exponential slicing keeps clusters roughly cube shaped along the view direction.
+			float sliceNear = m_near * std::pow(depthRatio, (float)slice / SLICES_Z);
+			float sliceFar = m_near * std::pow(depthRatio, (float)(slice + 1) / SLICES_Z);
+
+			for (int y = 0; y < TILES_Y; ++y)
+			{
+				for (int x = 0; x < TILES_X; ++x)
+				{
+					//Tile edges in normalised device co-ordinates.
+					float ndcX0 = -1.0f + 2.0f * x / TILES_X;
+					float ndcX1 = -1.0f + 2.0f * (x + 1) / TILES_X;
+					float ndcY0 = -1.0f + 2.0f * y / TILES_Y;
+					float ndcY1 = -1.0f + 2.0f * (y + 1) / TILES_Y;
+
+					//The tile's corners at both depths of the slice bound the cluster.
+					glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+					const float depths[2] = { sliceNear, sliceFar };
+					const float ndcXs[2] = { ndcX0, ndcX1 };
+					const float ndcYs[2] = { ndcY0, ndcY1 };
+					for (int d = 0; d < 2; ++d)
+					{
+						for (int i = 0; i < 2; ++i)
+						{
+							for (int j = 0; j < 2; ++j)
+							{
+								glm::vec3 corner(ndcXs[i] * tanX * depths[d], ndcYs[j] * tanY * depths[d], -depths[d]);
+								boxMin = glm::min(boxMin, corner);
+								boxMax = glm::max(boxMax, corner);
+							}
+						}
+					}
+
+					int index = getClusterIndex(x, y, slice);
+					m_minX[index] = boxMin.x; m_minY[index] = boxMin.y; m_minZ[index] = boxMin.z;
+					m_maxX[index] = boxMax.x; m_maxY[index] = boxMax.y; m_maxZ[index] = boxMax.z;
+				}
+			}
+		}
+
+		m_sliceScale = SLICES_Z / std::log(depthRatio);
+		m_sliceBias = SLICES_Z * std::log(m_near) / std::log(depthRatio);
+	}
+
+	//! Returns the depth slice containing a view space depth.
+	/**
+	\param depth Positive distance along the view direction.
+	*/
+	int getSlice(float depth) const
+	{
+		int slice = (int)std::floor(std::log(depth) * m_sliceScale - m_sliceBias);
+		return std::max(0, std::min(slice, SLICES_Z - 1));
+	}
+
+	//! Adds a light to a cluster's list, ignoring it if the cluster is full.
+	/**
+	\param cluster Index of the cluster.
+	\param lightIndex Index of the light.
+	*/
+	void appendLight(int cluster, GLushort lightIndex)
+	{
+		GLushort& count = m_clusterCounts[cluster];
+		if (count < MAX_LIGHTS_PER_CLUSTER)
+		{
+			m_clusterScratch[cluster * MAX_LIGHTS_PER_CLUSTER + count++] = lightIndex;
+		}
+	}
+
+	//! Tests a light's bounding sphere against every cluster in one depth slice.
+	/**
+	\param slice The depth slice to test.
+	\param centre View space centre of the light.
+	\param radius Radius of the light.
+	\param lightIndex Index of the light to append to intersecting clusters.
+	*/
+	void assignToSlice(int slice, const glm::vec3& centre, float radius, GLushort lightIndex)
+	{
+		const int base = slice * TILES_PER_SLICE;
+		const float radiusSq = radius * radius;
+#if SHADERS_SIMD_SSE
+		//Test four clusters at a time with the squared distance from the sphere centre to each box.
+		const __m128 cx = _mm_set1_ps(centre.x), cy = _mm_set1_ps(centre.y), cz = _mm_set1_ps(centre.z);
+		const __m128 r2 = _mm_set1_ps(radiusSq);
+		const __m128 zero = _mm_setzero_ps();
+		for (int i = base; i < base + TILES_PER_SLICE; i += 4)
+		{
+			__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minX[i]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&m_maxX[i]))), zero);
+			__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minY[i]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&m_maxY[i]))), zero);
+			__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minZ[i]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&m_maxZ[i]))), zero);
+			__m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_cmple_ps(distSq, r2));
+			for (int lane = 0; mask != 0; ++lane, mask >>= 1)
+			{
+				if (mask & 1) appendLight(i + lane, lightIndex);
+			}
+		}
+#else
+		for (int i = base; i < base + TILES_PER_SLICE; ++i)
+		{
+			float dx = std::max(std::max(m_minX[i] - centre.x, centre.x - m_maxX[i]), 0.0f);
+			float dy = std::max(std::max(m_minY[i] - centre.y, centre.y - m_maxY[i]), 0.0f);
+			float dz = std::max(std::max(m_minZ[i] - centre.z, centre.z - m_maxZ[i]), 0.0f);
+			if (dx * dx + dy * dy + dz * dz <= radiusSq) appendLight(i, lightIndex);
+		}
+#endif
+	}
+
+	//! Creates a buffer and a buffer texture which views it.
+	/**
+	\param buffer Where to store the buffer.
+	\param texture Where to store the buffer texture, which has no storage of its own.
+	\param format Texel format the shader reads the buffer as.
+	\param label What the buffer is, for the leak report.
+	*/
+	static void makeBufferTexture(GpuBuffer& buffer, GpuTexture& texture, GLenum format, const char* label)
+	{
+		GLuint bufferId = 0, textureId = 0;
+		glGenBuffers(1, &bufferId);
+		buffer.reset(bufferId, 16, GPU_MEMORY_OTHER, label);
+		glBindBuffer(GL_TEXTURE_BUFFER, bufferId);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glGenTextures(1, &textureId);
+		texture.reset(textureId, 0, GPU_MEMORY_OTHER, label);
+		glBindTexture(GL_TEXTURE_BUFFER, textureId);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, bufferId);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	//! Replaces a buffer's contents, orphaning the previous storage so the GPU isn't stalled.
+	/**
+	\param buffer The buffer to fill.
+	\param size Size of the data in bytes.
+	\param data The data to copy into the buffer.
+	*/
+	static void fillBuffer(GpuBuffer& buffer, size_t size, const void* data)
+	{
+		buffer.setBytes(size);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer.get());
+		glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+		if (size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+public:
+	//! Constructor to size the cluster arrays. GL objects are created on the first upload.
+	LightClusterGrid() : m_fov(0.0f), m_aspect(0.0f), m_near(0.0f), m_far(0.0f), m_sliceScale(0.0f), m_sliceBias(0.0f)
+	{
+		m_minX.resize(CLUSTER_COUNT); m_minY.resize(CLUSTER_COUNT); m_minZ.resize(CLUSTER_COUNT);
+		m_maxX.resize(CLUSTER_COUNT); m_maxY.resize(CLUSTER_COUNT); m_maxZ.resize(CLUSTER_COUNT);
+		m_clusterCounts.resize(CLUSTER_COUNT);
+		m_clusterScratch.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+		m_gridData.resize(CLUSTER_COUNT * 2);
+		m_indexData.reserve(CLUSTER_COUNT * 4);
+		m_lightData.reserve(MAX_LIGHTS * 2);
+	}
+
+	//! Returns the flat index of a cluster from its grid co-ordinates.
+	static int getClusterIndex(int x, int y, int slice) { return x + y * TILES_X + slice * TILES_PER_SLICE; }
+
+	//! Rebuilds the cluster bounds if the camera's projection has changed since the last call.
+	/**
+	\param fov Vertical field of view in radians.
+	\param aspect Width over height of the viewport.
+	\param nearPlane Near plane distance.
+	\param farPlane Far plane distance.
+	*/
+	void updateFrustum(float fov, float aspect, float nearPlane, float farPlane)
+	{
+		if (fov == m_fov && aspect == m_aspect && nearPlane == m_near && farPlane == m_far)
+		{
+			return;
+		}
+		m_fov = fov;
+		m_aspect = aspect;
+		m_near = nearPlane;
+		m_far = farPlane;
+		buildClusterBounds();
+	}
+
+	//! Assigns lights to every cluster their sphere of influence intersects, then compacts the per-cluster lists.
+	/**
+	\param lights The lights in the scene.
+	\param view The camera's view matrix.
+	*/
+	void assignLights(const std::vector<PointLight>& lights, const glm::mat4& view)
+	{
+		std::fill(m_clusterCounts.begin(), m_clusterCounts.end(), (GLushort)0);
+		m_lightData.clear();
+
+		size_t lightCount = std::min(lights.size(), (size_t)MAX_LIGHTS);
+		for (size_t i = 0; i < lightCount; ++i)
+		{
+			const PointLight& light = lights[i];
+			m_lightData.push_back(glm::vec4(light.position, light.radius));
+			m_lightData.push_back(glm::vec4(light.colour * light.intensity, 0.0f));
+
+			//Skip lights which are entirely in front of the near plane or behind the far plane.
+			glm::vec3 centre = glm::vec3(view * glm::vec4(light.position, 1.0f));
+			float depth = -centre.z;
+			if (light.radius <= 0.0f || depth + light.radius < m_near || depth - light.radius > m_far)
+			{
+				continue;
+			}
+
+			//Only the depth slices the sphere overlaps need testing.
+			int firstSlice = getSlice(std::max(depth - light.radius, m_near));
+			int lastSlice = getSlice(std::min(depth + light.radius, m_far));
+			for (int slice = firstSlice; slice <= lastSlice; ++slice)
+			{
+				assignToSlice(slice, centre, light.radius, (GLushort)i);
+			}
+		}
+
+		//Compact the fixed size lists into one contiguous index list.
+		m_indexData.clear();
+		for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+		{
+			GLushort count = m_clusterCounts[cluster];
+			m_gridData[cluster * 2] = (GLuint)m_indexData.size();
+			m_gridData[cluster * 2 + 1] = count;
+			const GLushort* first = &m_clusterScratch[cluster * MAX_LIGHTS_PER_CLUSTER];
+			m_indexData.insert(m_indexData.end(), first, first + count);
+		}
+	}
+
+	//! Copies this frame's light data, cluster ranges and light indices to the GPU.
+	void upload()
+	{
+		if (m_lightBuffer.isNull())
+		{
+			makeBufferTexture(m_lightBuffer, m_lightTexture, GL_RGBA32F, "Cluster lights");
+			makeBufferTexture(m_gridBuffer, m_gridTexture, GL_RG32UI, "Cluster grid");
+			makeBufferTexture(m_indexBuffer, m_indexTexture, GL_R16UI, "Cluster light indices");
+		}
+		fillBuffer(m_lightBuffer, m_lightData.size() * sizeof(glm::vec4), m_lightData.empty() ? NULL : &m_lightData[0]);
+		fillBuffer(m_gridBuffer, m_gridData.size() * sizeof(GLuint), &m_gridData[0]);
+		fillBuffer(m_indexBuffer, m_indexData.size() * sizeof(GLushort), m_indexData.empty() ? NULL : &m_indexData[0]);
+	}
+
+	//! Binds the light buffers and sets the cluster uniforms of a shader.
+	/**
+	\param shader The shader to bind the clusters to.
+	\param screenWidth Width of the viewport in pixels.
+	\param screenHeight Height of the viewport in pixels.
+	*/
+	void bind(const Shader& shader, GLfloat screenWidth, GLfloat screenHeight) const
+	{
+		const GLuint textures[3] = { m_lightTexture.get(), m_gridTexture.get(), m_indexTexture.get() };
+		const char* samplerNames[3] = { "clusterLights", "clusterGrid", "clusterIndices" };
+		for (int i = 0; i < 3; ++i)
+		{
+			glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_BASE + i);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+			glUniform1i(glGetUniformLocation(shader.programId, samplerNames[i]), TEXTURE_UNIT_BASE + i);
+		}
+		glActiveTexture(GL_TEXTURE0);
+
+		glUniform3i(glGetUniformLocation(shader.programId, "clusterDims"), TILES_X, TILES_Y, SLICES_Z);
+		glUniform2f(glGetUniformLocation(shader.programId, "clusterScreenSize"), screenWidth, screenHeight);
+		glUniform1f(glGetUniformLocation(shader.programId, "clusterSliceScale"), m_sliceScale);
+		glUniform1f(glGetUniformLocation(shader.programId, "clusterSliceBias"), m_sliceBias);
+	}
+
+	//! Unbinds the light buffers from their texture units.
+	void unbind() const
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_BASE + i);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	//! Releases the buffers and buffer textures.
+	void final()
+	{
+		m_lightTexture.reset();
+		m_gridTexture.reset();
+		m_indexTexture.reset();
+		m_lightBuffer.reset();
+		m_gridBuffer.reset();
+		m_indexBuffer.reset();
+	}
+
+	//! Returns the number of lights assigned to a cluster in the last call to assignLights.
+	GLushort getClusterLightCount(int cluster) const { return m_clusterCounts[cluster]; }
+};
+
+#endif
@@ -0,0 +1,684 @@
+#ifndef _MAPPEDFILESYSTEM_H_
+#define _MAPPEDFILESYSTEM_H_
+/**
+\file mappedFileSystem.h
+*/
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <assimp/IOSystem.hpp>
+#include <assimp/IOStream.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <algorithm>
+#include "jobSystem.h"
+
+/**
+\class MappedFile
+\brief A whole file mapped read-only into memory, so it's read straight from the page cache without copying it into a buffer first.
+*/
+class MappedFile
+{
+private:
+	const unsigned char* m_data;	//!< Start of the mapping, NULL for an empty or closed file.
+	size_t m_size;					//!< Size of the file in bytes.
+#ifdef _WIN32
+	HANDLE m_file;					//!< The open file.
+	HANDLE m_mapping;				//!< The file mapping object the view is made from.
+	mutable JobCounter m_prefetchJobs;	//!< Prefetch jobs still touching the view, which close waits for before unmapping it.
+	std::atomic<bool> m_closing;	//!< Tells prefetch jobs to stop early because the view is being unmapped.
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+public:
+	static const size_t TOUCH_STRIDE = 4096; //!< Step between bytes touched to prefetch a mapping where the OS has no hint for it.
+
+#ifdef _WIN32
+	//! Constructor
+	MappedFile() : m_data(NULL), m_size(0), m_file(INVALID_HANDLE_VALUE), m_mapping(NULL), m_closing(false) {};
+#else
+	//! Constructor
+	MappedFile() : m_data(NULL), m_size(0) {};
+#endif
+	//! Destructor
+	~MappedFile() { close(); }
+
+	//! Maps a file, hinting that it will be read front to back.
+	/**
+	\param path The file to map.
+	\return Whether the file was mapped.
+	*/
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(m_file, &fileSize))
+		{
+			close();
+			return false;
+		}
+		m_size = (size_t)fileSize.QuadPart;
+		if (m_size == 0)
+		{
+			return true;
+		}
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		m_data = m_mapping ? (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+		struct stat status;
+		if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode))
+		{
+			::close(file);
+			return false;
+		}
+		m_size = (size_t)status.st_size;
+		if (m_size == 0)
+		{
+			::close(file);
+			return true;
+		}
+		//The mapping keeps the file referenced, so the descriptor isn't needed after mapping.
+		void* mapping = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		::close(file);
+		if (mapping != MAP_FAILED)
+		{
+			m_data = (const unsigned char*)mapping;
+			madvise(mapping, m_size, MADV_SEQUENTIAL);
+		}
+#endif
+		if (!m_data)
+		{
+			std::cerr << "Error::MappedFile::open, could not map " << path << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	//! Unmaps the file.
+	void close()
+	{
+#ifdef _WIN32
+		//Prefetch jobs read the view, so they must finish before it's unmapped.
+		m_closing = true;
+		JobSystem::instance().wait(m_prefetchJobs);
+		m_closing = false;
+		if (m_data) UnmapViewOfFile(m_data);
+		if (m_mapping) CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+		m_mapping = NULL;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if (m_data) munmap((void*)m_data, m_size);
+#endif
+		m_data = NULL;
+		m_size = 0;
+	}
+
+	//! Starts reading part of the file into memory in the background, so it's resident by the time it's parsed.
+	/**
+	\param offset First byte to prefetch.
+	\param size Number of bytes to prefetch.
+	*/
+	void prefetch(size_t offset, size_t size) const
+	{
+		if (!m_data || offset >= m_size)
+		{
+			return;
+		}
+		size = std::min(size, m_size - offset);
+#ifdef _WIN32
+		//Touching a byte of each page on a worker faults the pages in without blocking the caller. The job is counted, so close waits for it.
+		const unsigned char* data = m_data + offset;
+		const std::atomic<bool>* closing = &m_closing;
+		JobSystem::instance().run([data, size, closing]()
+		{
+			volatile unsigned char sink = 0;
+			for (size_t i = 0; i < size && !closing->load(std::memory_order_relaxed); i += TOUCH_STRIDE)
+			{
+				sink ^= data[i];
+			}
+		}, &m_prefetchJobs);
+#else
+		//madvise needs a page aligned start.
+		const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		const size_t alignedOffset = offset / pageSize * pageSize;
+		madvise((void*)(m_data + alignedOffset), size + offset - alignedOffset, MADV_WILLNEED);
+#endif
+	}
+
+	//! Starts reading the whole file into memory in the background.
+	void prefetch() const { prefetch(0, m_size); }
+
+	//! Returns the mapped bytes, NULL if the file is empty or isn't mapped.
+	const unsigned char* getData() const { return m_data; }
+	//! Returns the size of the file in bytes.
+	size_t getSize() const { return m_size; }
+};
+
+/**
+\class PackedArchive
+\brief Many files packed into one, mapped once so a model and all its materials and textures are read without opening each file.
+
+The archive starts with the magic "PAK1" and a 32 bit entry count. Each entry then stores a 32 bit name length, the name, and 64 bit offset
+and size of the file's bytes from the start of the archive. Numbers are little endian, and names are paths relative to the working directory
+with '/' separators, as the files were named when packed.
+*/
+class PackedArchive
+{
+public:
+	/**
+	\struct Entry
+	\brief Where a packed file's bytes are in the archive.
+	*/
+	struct Entry
+	{
+		uint64_t offset;	//!< Start of the file from the start of the archive.
+		uint64_t size;		//!< Size of the file in bytes.
+	};
+
+private:
+	std::shared_ptr<MappedFile> m_file;			//!< The mapped archive.
+	std::map<std::string, Entry> m_entries;		//!< Packed files by normalised name.
+
+	//! Reads a little endian number from the archive's directory.
+	template <typename T>
+	static bool readNumber(const unsigned char* data, size_t size, size_t& offset, T& value)
+	{
+		if (offset > size || size - offset < sizeof(T))
+		{
+			return false;
+		}
+		value = 0;
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			value |= (T)data[offset + i] << (8 * i);
+		}
+		offset += sizeof(T);
+		return true;
+	}
+
+	//! Appends a little endian number to a stream.
+	template <typename T>
+	static void writeNumber(std::ostream& out, T value)
+	{
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			out.put((char)((value >> (8 * i)) & 0xff));
+		}
+	}
+
+public:
+	//! Turns a path into the form archive entries are named by: '/' separators, without "./" parts or repeated separators.
+	static std::string normalisePath(const std::string& path)
+	{
+		std::string normalised;
+		normalised.reserve(path.size());
+		for (size_t i = 0; i < path.size(); ++i)
+		{
+			char c = path[i] == '\\' ? '/' : path[i];
+			if (c == '/' && !normalised.empty() && normalised[normalised.size() - 1] == '/')
+			{
+				continue;
+			}
+			if (c == '.' && (normalised.empty() || normalised[normalised.size() - 1] == '/') && i + 1 < path.size() && (path[i + 1] == '/' || path[i + 1] == '\\'))
+			{
+				++i;
+				continue;
+			}
+			normalised.push_back(c);
+		}
+		return normalised;
+	}
+
+	//! Maps an archive and reads its directory.
+	/**
+	\param path The archive file.
+	\return Whether the archive is valid.
+	*/
+	bool open(const std::string& path)
+	{
+		m_entries.clear();
+		m_file.reset(new MappedFile());
+		if (!m_file->open(path))
+		{
+			std::cerr << "Error::PackedArchive::open, could not open " << path << std::endl;
+			return false;
+		}
+		const unsigned char* data = m_file->getData();
+		const size_t size = m_file->getSize();
+		size_t offset = 4;
+		uint32_t count = 0;
+		if (size < 8 || std::memcmp(data, "PAK1", 4) != 0 || !readNumber(data, size, offset, count))
+		{
+			std::cerr << "Error::PackedArchive::open, " << path << " isn't a packed archive." << std::endl;
+			return false;
+		}
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t nameLength = 0;
+			Entry entry;
+			if (!readNumber(data, size, offset, nameLength) || size - offset < nameLength)
+			{
+				std::cerr << "Error::PackedArchive::open, " << path << " has a truncated directory." << std::endl;
+				return false;
+			}
+			std::string name((const char*)data + offset, nameLength);
+			offset += nameLength;
+			if (!readNumber(data, size, offset, entry.offset) || !readNumber(data, size, offset, entry.size)
+				|| entry.offset > size || entry.size > size - entry.offset)
+			{
+				std::cerr << "Error::PackedArchive::open, " << path << " has an entry outside the archive." << std::endl;
+				return false;
+			}
+			m_entries[normalisePath(name)] = entry;
+		}
+		return true;
+	}
+
+	//! Looks up a packed file.
+	/**
+	\param path The file's path, in any form normalisePath accepts.
+	\param data Where to store the start of the file's bytes, which stay valid while the archive's mapping is referenced.
+	\param size Where to store the file's size.
+	\return Whether the archive holds the file.
+	*/
+	bool find(const std::string& path, const unsigned char*& data, size_t& size) const
+	{
+		std::map<std::string, Entry>::const_iterator it = m_entries.find(normalisePath(path));
+		if (m_entries.end() == it)
+		{
+			return false;
+		}
+		data = m_file->getData() + it->second.offset;
+		size = (size_t)it->second.size;
+		return true;
+	}
+
+	//! Returns the mapped archive, which must be referenced while its files' bytes are used.
+	std::shared_ptr<MappedFile> getFile() const { return m_file; }
+
+	//! Packs files into a new archive.
+	/**
+	\param archivePath The archive to write.
+	\param files The files to pack, named in the archive by their paths as given.
+	\return Whether every file was packed.
+	*/
+	static bool pack(const std::string& archivePath, const std::vector<std::string>& files)
+	{
+		std::vector<std::string> contents(files.size());
+		uint64_t directorySize = 8;
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			std::ifstream in(files[i].c_str(), std::ios::binary);
+			if (!in)
+			{
+				std::cerr << "Error::PackedArchive::pack, could not read " << files[i] << std::endl;
+				return false;
+			}
+			contents[i].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			directorySize += 4 + normalisePath(files[i]).size() + 16;
+		}
+
+		std::ofstream out(archivePath.c_str(), std::ios::binary);
+		if (!out)
+		{
+			std::cerr << "Error::PackedArchive::pack, could not write " << archivePath << std::endl;
+			return false;
+		}
+		out.write("PAK1", 4);
+		writeNumber(out, (uint32_t)files.size());
+		uint64_t offset = directorySize;
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			std::string name = normalisePath(files[i]);
+			writeNumber(out, (uint32_t)name.size());
+			out.write(name.data(), name.size());
+			writeNumber(out, offset);
+			writeNumber(out, (uint64_t)contents[i].size());
+			offset += contents[i].size();
+		}
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			out.write(contents[i].data(), contents[i].size());
+		}
+		return out.good();
+	}
+};
+
+/**
+\class MappedIOStream
+\brief An Assimp stream reading from mapped memory, either a whole mapped file or a file inside a mapped archive.
+*/
+class MappedIOStream : public Assimp::IOStream
+{
+private:
+	std::shared_ptr<MappedFile> m_file;		//!< Keeps the mapping alive while the stream reads it.
+	const unsigned char* m_data;			//!< Start of the stream's bytes.
+	size_t m_size;							//!< Size of the stream in bytes.
+	size_t m_position;						//!< Offset of the next read.
+	std::atomic<size_t>* m_bytesRead;		//!< Counter the bytes read are added to, or NULL.
+
+public:
+	//! Constructor
+	/**
+	\param file The mapping the bytes are in.
+	\param data Start of the stream's bytes.
+	\param size Size of the stream in bytes.
+	\param bytesRead Counter the bytes read are added to, or NULL.
+	*/
+	MappedIOStream(const std::shared_ptr<MappedFile>& file, const unsigned char* data, size_t size, std::atomic<size_t>* bytesRead = NULL)
+		: m_file(file), m_data(data), m_size(size), m_position(0), m_bytesRead(bytesRead) {};
+
+	//! Copies whole elements out of the mapping, as fread does.
+	size_t Read(void* buffer, size_t size, size_t count)
+	{
+		if (size == 0)
+		{
+			return 0;
+		}
+		count = std::min(count, (m_size - m_position) / size);
+		std::memcpy(buffer, m_data + m_position, size * count);
+		m_position += size * count;
+		if (m_bytesRead) *m_bytesRead += size * count;
+		return count;
+	}
+
+	//! Mapped streams are read-only.
+	size_t Write(const void*, size_t, size_t) { return 0; }
+
+	aiReturn Seek(size_t offset, aiOrigin origin)
+	{
+		size_t position = 0;
+		switch (origin)
+		{
+		case aiOrigin_SET: position = offset; break;
+		case aiOrigin_CUR: position = m_position + offset; break;
+		case aiOrigin_END: position = m_size + offset; break; //The offset wraps, so negative offsets count back from the end.
+		default: return aiReturn_FAILURE;
+		}
+		if (position > m_size)
+		{
+			return aiReturn_FAILURE;
+		}
+		m_position = position;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const { return m_position; }
+	size_t FileSize() const { return m_size; }
+	void Flush() {}
+
+	//! Returns the stream's bytes, which can be parsed in place instead of read.
+	const unsigned char* getData() const { return m_data; }
+};
+
+/**
+\class MappedIOSystem
+\brief An Assimp file system which maps files instead of reading them through buffered streams, and serves files from mounted packed archives first.
+
+When a model file is opened the files it refers to (an OBJ's material libraries and a material library's textures) are prefetched, so they're
+read from disk while the model is parsed. Give it to Assimp::Importer::SetIOHandler, which takes ownership.
+*/
+class MappedIOSystem : public Assimp::IOSystem
+{
+private:
+	bool m_prefetchRelated;												//!< Whether files a model refers to are prefetched when it's opened.
+	std::vector<std::shared_ptr<PackedArchive> > m_archives;			//!< The archives mounted when the file system was made.
+	std::map<std::string, std::shared_ptr<MappedFile> > m_mappings;		//!< Files mapped so far, kept so they're only mapped once.
+	mutable std::mutex m_mutex;											//!< Guards the mappings, as textures are decoded on several threads.
+	std::atomic<size_t>* m_bytesRead;									//!< Counter the bytes read through streams are added to, or NULL.
+	std::atomic<size_t>* m_bytesTotal;									//!< Counter the sizes of opened streams are added to, or NULL.
+
+	//! Returns the archives mounted for every new file system, with the mutex guarding them.
+	static std::vector<std::shared_ptr<PackedArchive> >& mountedArchives(std::mutex*& mutex)
+	{
+		static std::mutex archivesMutex;
+		static std::vector<std::shared_ptr<PackedArchive> > archives;
+		mutex = &archivesMutex;
+		return archives;
+	}
+
+	//! Returns the lower case extension of a path, without the dot.
+	static std::string getExtension(const std::string& path)
+	{
+		size_t dot = path.find_last_of('.');
+		if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos)
+		{
+			return "";
+		}
+		std::string extension = path.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension;
+	}
+
+	//! Prefetches the files an OBJ or MTL file refers to, named on lines starting with one of the keywords.
+	/**
+	\param path The referring file.
+	\param data The referring file's bytes.
+	\param size Size of the referring file.
+	*/
+	void prefetchReferences(const std::string& path, const unsigned char* data, size_t size)
+	{
+		const std::string extension = getExtension(path);
+		const bool isObj = extension == "obj";
+		if (!isObj && extension != "mtl")
+		{
+			return;
+		}
+		const size_t slash = path.find_last_of("/\\");
+		const std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+		const char* text = (const char*)data;
+		for (size_t lineStart = 0; lineStart < size;)
+		{
+			const char* lineEnd = (const char*)std::memchr(text + lineStart, '\n', size - lineStart);
+			size_t lineLength = lineEnd ? (size_t)(lineEnd - text) - lineStart : size - lineStart;
+			const char* lineText = text + lineStart;
+			lineStart += lineLength + 1;
+
+			//Only lines which can hold a keyword are copied out, as most of an OBJ is vertices and faces.
+			size_t first = 0;
+			while (first < lineLength && (lineText[first] == ' ' || lineText[first] == '\t'))
+			{
+				++first;
+			}
+			if (first == lineLength || (isObj ? lineText[first] != 'm' : std::strchr("mbn", lineText[first]) == NULL))
+			{
+				continue;
+			}
+			std::string line(lineText, lineLength);
+			size_t keywordEnd = line.find_first_of(" \t", first);
+			if (keywordEnd == std::string::npos)
+			{
+				continue;
+			}
+			std::string keyword = line.substr(first, keywordEnd - first);
+			if (isObj ? keyword != "mtllib" : (keyword.compare(0, 4, "map_") != 0 && keyword != "bump" && keyword != "norm"))
+			{
+				continue;
+			}
+			//The file name is the last word, after any texture options.
+			size_t nameEnd = line.find_last_not_of(" \t\r");
+			size_t nameStart = line.find_last_of(" \t", nameEnd);
+			if (nameEnd == std::string::npos || nameStart == std::string::npos)
+			{
+				continue;
+			}
+			std::shared_ptr<MappedFile> file;
+			const unsigned char* fileData = NULL;
+			size_t fileSize = 0;
+			std::string referenced = directory + line.substr(nameStart + 1, nameEnd - nameStart);
+			if (map(referenced.c_str(), file, fileData, fileSize))
+			{
+				file->prefetch((size_t)(fileData - file->getData()), fileSize);
+			}
+		}
+	}
+
+public:
+	//! Constructor
+	/**
+	\param prefetchRelated Whether files a model refers to are prefetched when it's opened.
+	*/
+	explicit MappedIOSystem(bool prefetchRelated = true) : m_prefetchRelated(prefetchRelated), m_bytesRead(NULL), m_bytesTotal(NULL)
+	{
+		std::mutex* archivesMutex = NULL;
+		std::vector<std::shared_ptr<PackedArchive> >& archives = mountedArchives(archivesMutex);
+		std::lock_guard<std::mutex> lock(*archivesMutex);
+		m_archives = archives;
+	}
+
+	//! Mounts a packed archive, whose files are used in place of loose files with the same names by file systems made afterwards.
+	/**
+	\param path The archive file.
+	\return Whether the archive was mounted.
+	*/
+	static bool mountArchive(const std::string& path)
+	{
+		std::shared_ptr<PackedArchive> archive(new PackedArchive());
+		if (!archive->open(path))
+		{
+			return false;
+		}
+		std::mutex* archivesMutex = NULL;
+		std::vector<std::shared_ptr<PackedArchive> >& archives = mountedArchives(archivesMutex);
+		std::lock_guard<std::mutex> lock(*archivesMutex);
+		archives.push_back(archive);
+		return true;
+	}
+
+	//! Sets counters which track how much of the opened files has been read, for reporting progress.
+	/**
+	\param bytesRead Counter the bytes read through streams are added to, or NULL.
+	\param bytesTotal Counter the sizes of opened streams are added to, or NULL.
+	*/
+	void setProgressCounters(std::atomic<size_t>* bytesRead, std::atomic<size_t>* bytesTotal)
+	{
+		m_bytesRead = bytesRead;
+		m_bytesTotal = bytesTotal;
+	}
+
+	//! Maps a file, or finds it in a mounted archive. Safe to call on any thread.
+	/**
+	\param path The file.
+	\param file Where to store the mapping, which must be referenced while the bytes are used.
+	\param data Where to store the start of the file's bytes.
+	\param size Where to store the file's size.
+	\return Whether the file was found.
+	*/
+	bool map(const char* path, std::shared_ptr<MappedFile>& file, const unsigned char*& data, size_t& size)
+	{
+		for (std::vector<std::shared_ptr<PackedArchive> >::const_iterator it = m_archives.begin(); m_archives.end() != it; ++it)
+		{
+			if ((*it)->find(path, data, size))
+			{
+				file = (*it)->getFile();
+				return true;
+			}
+		}
+
+		const std::string name = PackedArchive::normalisePath(path);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::map<std::string, std::shared_ptr<MappedFile> >::const_iterator it = m_mappings.find(name);
+			if (m_mappings.end() != it)
+			{
+				file = it->second;
+				data = file->getData();
+				size = file->getSize();
+				return true;
+			}
+		}
+		std::shared_ptr<MappedFile> mapped(new MappedFile());
+		if (!mapped->open(name))
+		{
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		file = m_mappings.insert(std::make_pair(name, mapped)).first->second;
+		data = file->getData();
+		size = file->getSize();
+		return true;
+	}
+
+	bool Exists(const char* pFile) const
+	{
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		for (std::vector<std::shared_ptr<PackedArchive> >::const_iterator it = m_archives.begin(); m_archives.end() != it; ++it)
+		{
+			if ((*it)->find(pFile, data, size))
+			{
+				return true;
+			}
+		}
+#ifdef _WIN32
+		DWORD attributes = GetFileAttributesA(pFile);
+		return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+		struct stat status;
+		return stat(pFile, &status) == 0 && S_ISREG(status.st_mode);
+#endif
+	}
+
+	//! Both platforms accept '/', which is also how archive entries are named.
+	char getOsSeparator() const { return '/'; }
+
+	Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb")
+	{
+		//Importing only reads, and a mapping can't be written through.
+		if (std::strchr(pMode, 'w') || std::strchr(pMode, 'a') || std::strchr(pMode, '+'))
+		{
+			return NULL;
+		}
+		std::shared_ptr<MappedFile> file;
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		if (!map(pFile, file, data, size))
+		{
+			return NULL;
+		}
+		if (m_prefetchRelated)
+		{
+			prefetchReferences(pFile, data, size);
+		}
+		if (m_bytesTotal) *m_bytesTotal += size;
+		return new MappedIOStream(file, data, size, m_bytesRead);
+	}
+
+	void Close(Assimp::IOStream* pFile) { delete pFile; }
+};
+
+#endif
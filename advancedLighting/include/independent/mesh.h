@@ -12,10 +12,19 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <utility>
+#include <cstddef>
+#include <cmath>
+#include "gpuResources.h"
+#include "textureCache.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "shader.h"
+#include "frustum.h"
+#include "simd.h"
+#include "arena.h"
+#include "meshlet.h"
 
 /**
 \struct Vertex
@@ -26,8 +35,7 @@ struct Vertex
 	glm::vec3 position;
 	glm::vec2 texCoords;
 	glm::vec3 normal;
-	glm::vec3 tangent;
-	glm::vec3 bitangent;
+	glm::vec4 tangent; //!< Tangent in xyz and the bitangent's handedness, 1 or -1, in w. The bitangent is sign * cross(normal, tangent), as MikkTSpace defines it.
 };
 
 /**
@@ -39,6 +47,92 @@ struct Texture
 	GLuint id;
 	aiTextureType type;
 	std::string path;
+	TextureRef handle; //!< Keeps the texture in the TextureCache, which may share it with other models, while the material uses it.
+};
+
+/**
+\struct VertexAttribute
+\brief Where a vertex attribute is read from, as given to glVertexAttribPointer.
+*/
+struct VertexAttribute
+{
+	GLuint buffer;			//!< Buffer holding the attribute, 0 for the mesh's own vertex buffer.
+	GLint size;				//!< Number of components.
+	GLenum type;			//!< Type of each component.
+	GLboolean normalised;	//!< Whether integer components are scaled to [0, 1] or [-1, 1].
+	GLsizei stride;			//!< Bytes from one vertex's attribute to the next.
+	size_t offset;			//!< Bytes from the start of the buffer to the first vertex's attribute.
+};
+
+/**
+\struct VertexLayout
+\brief Where each of a mesh's vertex attributes (position, texture coordinates, normal and signed tangent) is read from.
+*/
+struct VertexLayout
+{
+	static const int ATTRIBUTE_COUNT = 4; //!< Attributes the scene shaders read, at locations 0 to 3.
+
+	VertexAttribute attributes[ATTRIBUTE_COUNT]; //!< The attributes, by shader location.
+
+	//! Returns the layout of interleaved Vertex structures in the mesh's own vertex buffer.
+	static VertexLayout interleaved()
+	{
+		VertexLayout layout;
+		const VertexAttribute attributes[ATTRIBUTE_COUNT] =
+		{
+			{ 0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, position) },
+			{ 0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, texCoords) },
+			{ 0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, normal) },
+			{ 0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, tangent) }
+		};
+		std::copy(attributes, attributes + ATTRIBUTE_COUNT, layout.attributes);
+		return layout;
+	}
+
+	//! Returns whether any attribute is read from the mesh's own vertex buffer.
+	bool usesOwnBuffer() const
+	{
+		for (int i = 0; i < ATTRIBUTE_COUNT; ++i)
+		{
+			if (attributes[i].buffer == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+/**
+\struct MeshLod
+\brief The range of a mesh's packed index buffer which holds one level of detail.
+*/
+struct MeshLod
+{
+	GLuint indexOffset; //!< First index of the level.
+	GLuint indexCount;	//!< Number of indices in the level.
+	float error;		//!< Largest distance the level deviates from the full resolution mesh, in model units.
+};
+
+/**
+\struct IndexRange
+\brief A contiguous range of a mesh's index buffer to draw.
+*/
+struct IndexRange
+{
+	GLuint indexOffset; //!< First index of the range.
+	GLuint indexCount;	//!< Number of indices in the range.
+};
+
+/**
+\struct LodSelection
+\brief The view information used to pick a level of detail from its projected error.
+*/
+struct LodSelection
+{
+	glm::vec3 viewPosition; //!< World space position of the camera.
+	float projectionScale;	//!< Pixels covered by one unit at a distance of one unit (see Camera::getProjectionScale).
+	float maxPixelError;	//!< Largest simplification error allowed on screen, in pixels.
 };
 
 /**
@@ -49,104 +143,394 @@ class Mesh
 {
 private:
 	std::vector<Vertex> vertData;	//!< Vertices in mesh.
-	std::vector<GLuint> indices;	//!< Indicies in mesh.
+	std::vector<GLuint> indices;	//!< Indicies in mesh, with every level of detail packed one after another.
+	std::vector<MeshLod> lods;		//!< Index ranges of the levels of detail, from full resolution to coarsest.
+	std::vector<Meshlet> meshlets;	//!< Clusters of the full resolution level's triangles, for finer culling.
 	std::vector<Texture> textures;  //!< Textures for mesh.
 	GLuint VAOId; //!< Vertex array.
-	GLuint VBOId; //!< Vertex buffer object.
-	GLuint EBOId; //!< Element buffer object.
+	GpuBuffer VBO; //!< Vertex buffer object.
+	GpuBuffer EBO; //!< Element buffer object.
+	VertexLayout layout; //!< Where the vertex array reads each attribute from.
+	BoundingBox bounds; //!< Bounding box of the vertices in model space.
+
+	//Meshes own their OpenGL objects, so they can be moved but not copied.
+	Mesh(const Mesh&);
+	Mesh& operator=(const Mesh&);
 
-	//! Initialise VAO, VBO and EBOs.
-	void setupMesh()  
+	//! Initialise the VBO and EBO. Buffers are shared between contexts, so this may run on a loader thread's context.
+	void setupBuffers()
 	{
-		glGenVertexArrays(1, &this->VAOId);
-		glGenBuffers(1, &this->VBOId);
-		glGenBuffers(1, &this->EBOId);
+		GLuint buffer = 0;
+		glGenBuffers(1, &buffer);
+		this->EBO.reset(buffer, sizeof(GLuint) * this->indices.size(), GPU_MEMORY_INDEX, "Mesh indices");
 
-		glBindVertexArray(this->VAOId);
-		glBindBuffer(GL_ARRAY_BUFFER, this->VBOId);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * this->vertData.size(), &this->vertData[0], GL_STATIC_DRAW);
-		
-		//Vertex positions.
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		glEnableVertexAttribArray(0);
+		//Both are filled through the array buffer binding, as the element binding belongs to a vertex array.
+		//The vertices are only uploaded if an attribute is read from them rather than from another buffer.
+		if (this->layout.usesOwnBuffer())
+		{
+			glGenBuffers(1, &buffer);
+			this->VBO.reset(buffer, sizeof(Vertex) * this->vertData.size(), GPU_MEMORY_VERTEX, "Mesh vertices");
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * this->vertData.size(), &this->vertData[0], GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, this->EBO.get());
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint)* this->indices.size(), &this->indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	/**
+	\struct TangentBatch
+	\brief Triangle corners waiting to have their tangent and bitangent accumulated, gathered in structure-of-arrays form so four are processed at once.
+	*/
+	struct TangentBatch
+	{
+		SIMD_ALIGN(16) float normal[3][4];		//!< Each corner's normal, one array per axis.
+		SIMD_ALIGN(16) float tangent[3][4];		//!< Each corner's triangle tangent, one array per axis.
+		SIMD_ALIGN(16) float bitangent[3][4];	//!< Each corner's triangle bitangent, one array per axis.
+		SIMD_ALIGN(16) float weight[4];			//!< Each corner's angle.
+		GLuint vertex[4];						//!< Vertex each corner's sums belong to.
+		int count;								//!< Number of corners gathered.
+	};
 
-		//Vertex texture positions.
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(3 * sizeof(GL_FLOAT)));
-		glEnableVertexAttribArray(1);
+	//! Projects the gathered corners' tangents and bitangents onto the planes of their normals, normalises them and adds them to their vertices' sums with their weights.
+	/**
+	\param batch The gathered corners, which is emptied.
+	\param sums Tangent then bitangent sum of each vertex.
+	*/
+	static void flushTangentBatch(TangentBatch& batch, glm::vec4* sums)
+	{
+		SIMD_ALIGN(16) float projected[2][3][4];
+#if SHADERS_SIMD_SSE
+		const __m128 nx = _mm_load_ps(batch.normal[0]), ny = _mm_load_ps(batch.normal[1]), nz = _mm_load_ps(batch.normal[2]);
+		const __m128 weight = _mm_load_ps(batch.weight);
+		const __m128 epsilon = _mm_set1_ps(1e-30f);
+		for (int d = 0; d < 2; ++d)
+		{
+			float (*direction)[4] = d == 0 ? batch.tangent : batch.bitangent;
+			__m128 dx = _mm_load_ps(direction[0]), dy = _mm_load_ps(direction[1]), dz = _mm_load_ps(direction[2]);
+			__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, nx), _mm_mul_ps(dy, ny)), _mm_mul_ps(dz, nz));
+			__m128 px = _mm_sub_ps(dx, _mm_mul_ps(nx, along));
+			__m128 py = _mm_sub_ps(dy, _mm_mul_ps(ny, along));
+			__m128 pz = _mm_sub_ps(dz, _mm_mul_ps(nz, along));
+			__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
 
-		//Vertex normal vectors.
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(5 * sizeof(GL_FLOAT)));
-		glEnableVertexAttribArray(2);
+			//Directions parallel to the normal add nothing.
+			__m128 usable = _mm_cmpgt_ps(lengthSquared, epsilon);
+			__m128 scale = _mm_and_ps(usable, _mm_div_ps(weight, _mm_sqrt_ps(_mm_max_ps(lengthSquared, epsilon))));
+			_mm_store_ps(projected[d][0], _mm_mul_ps(px, scale));
+			_mm_store_ps(projected[d][1], _mm_mul_ps(py, scale));
+			_mm_store_ps(projected[d][2], _mm_mul_ps(pz, scale));
+		}
+#else
+		for (int d = 0; d < 2; ++d)
+		{
+			float (*direction)[4] = d == 0 ? batch.tangent : batch.bitangent;
+			for (int i = 0; i < batch.count; ++i)
+			{
+				glm::vec3 normal(batch.normal[0][i], batch.normal[1][i], batch.normal[2][i]);
+				glm::vec3 value(direction[0][i], direction[1][i], direction[2][i]);
+				value -= normal * glm::dot(normal, value);
+				float lengthSquared = glm::dot(value, value);
+				value = lengthSquared > 1e-30f ? value * (batch.weight[i] / std::sqrt(lengthSquared)) : glm::vec3(0.0f);
+				projected[d][0][i] = value.x;
+				projected[d][1][i] = value.y;
+				projected[d][2][i] = value.z;
+			}
+		}
+#endif
+		//Corners can share a vertex, so the sums are added one corner at a time.
+		for (int i = 0; i < batch.count; ++i)
+		{
+			for (int d = 0; d < 2; ++d)
+			{
+				sums[batch.vertex[i] * 2 + d] += glm::vec4(projected[d][0][i], projected[d][1][i], projected[d][2][i], 0.0f);
+			}
+		}
+		batch.count = 0;
+	}
 
-		//Vertex tangent vectors.
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(8 * sizeof(GL_FLOAT)));
-		glEnableVertexAttribArray(3);
+public:
+	//! Initialise the VAO from the VBO and EBO. Vertex arrays aren't shared between contexts, so this must run on the context which draws the mesh.
+	void setupVertexArray()
+	{
+		if ((this->VBO.isNull() && this->layout.usesOwnBuffer()) || this->EBO.isNull() || this->VAOId != 0)
+		{
+			return;
+		}
+		glGenVertexArrays(1, &this->VAOId);
+		glBindVertexArray(this->VAOId);
+
+		//Vertex positions, texture positions, normal and signed tangent vectors, from wherever the layout says they are.
+		for (int i = 0; i < VertexLayout::ATTRIBUTE_COUNT; ++i)
+		{
+			const VertexAttribute& attribute = this->layout.attributes[i];
+			glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer ? attribute.buffer : this->VBO.get());
+			glVertexAttribPointer(i, attribute.size, attribute.type, attribute.normalised, attribute.stride, (GLvoid*)attribute.offset);
+			glEnableVertexAttribArray(i);
+		}
 
-		//Vertex bitangent vectors.
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(8 * sizeof(GL_FLOAT)));
-		glEnableVertexAttribArray(4);
-		
 		//Indicies data.
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBOId);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)* this->indices.size(), &this->indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO.get());
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glBindVertexArray(0);
 	}
-public:
+
 	//! A constructor for creating a mesh.
 	/**
 	\param vertData Mesh vertices.
 	\param textures Textures to set to the mesh.
 	\param indices Mesh indices.
+	\param lods Index ranges of the levels of detail packed in the indices. Empty for a single level.
+	\param meshlets Clusters of the full resolution level's triangles. Empty to only draw the mesh whole.
 	*/
-	Mesh(const std::vector<Vertex>& vertData, const std::vector<Texture> & textures, const std::vector<GLuint>& indices) :VAOId(0), VBOId(0), EBOId(0)
+	Mesh(std::vector<Vertex> vertData, std::vector<Texture> textures, std::vector<GLuint> indices, std::vector<MeshLod> lods = std::vector<MeshLod>(), std::vector<Meshlet> meshlets = std::vector<Meshlet>()) :VAOId(0), layout(VertexLayout::interleaved())
 	{
-		setData(vertData, textures, indices);
+		setData(std::move(vertData), std::move(textures), std::move(indices), std::move(lods), std::move(meshlets));
 	}
 
 	//! A constructor for creating a mesh with no data.
-	Mesh() : VAOId(0), VBOId(0), EBOId(0) {};
-	//! Default deconstructor.
-	~Mesh() {};
+	Mesh() : VAOId(0), layout(VertexLayout::interleaved()) {};
+	//! Move constructor, which takes over the other mesh's data and OpenGL objects.
+	Mesh(Mesh&& other) noexcept : VAOId(0), layout(VertexLayout::interleaved())
+	{
+		*this = std::move(other);
+	}
+	//! Move assignment, which deletes this mesh's OpenGL objects and takes over the other mesh's.
+	Mesh& operator=(Mesh&& other) noexcept
+	{
+		if (this != &other)
+		{
+			this->final();
+			this->vertData = std::move(other.vertData);
+			this->indices = std::move(other.indices);
+			this->textures = std::move(other.textures);
+			this->lods = std::move(other.lods);
+			this->meshlets = std::move(other.meshlets);
+			this->layout = other.layout;
+			this->bounds = other.bounds;
+			this->VAOId = other.VAOId;
+			this->VBO = std::move(other.VBO);
+			this->EBO = std::move(other.EBO);
+			other.VAOId = 0;
+		}
+		return *this;
+	}
+	//! Deconstructor, which deletes the mesh's OpenGL objects. It must run on the context which drew the mesh, as vertex arrays aren't shared.
+	~Mesh() { this->final(); }
 
 	//! Function to set the data of an existing mesh.
 	/**
 	\param vertData Mesh vertices.
 	\param textures Textures to set to the mesh.
 	\param indices Mesh indices.
+	\param lods Index ranges of the levels of detail packed in the indices. Empty for a single level.
+	\param meshlets Clusters of the full resolution level's triangles. Empty to only draw the mesh whole.
+	\param createVertexArray Whether to create the vertex array now. Pass false when loading on another context, then call setupVertexArray on the drawing context.
+	\param vertexLayout Where the vertex array reads the attributes from, such as buffers uploaded straight from a file, or NULL to upload and read the vertices.
+	The vertices are kept either way, for culling and levels of detail.
+	The vectors are taken by value, so callers which are done with theirs can move them in rather than have them copied.
 	*/
-	void setData(const std::vector<Vertex>& vertData, const std::vector<Texture> & textures, const std::vector<GLuint>& indices)
+	void setData(std::vector<Vertex> vertData, std::vector<Texture> textures, std::vector<GLuint> indices, std::vector<MeshLod> lods = std::vector<MeshLod>(), std::vector<Meshlet> meshlets = std::vector<Meshlet>(), bool createVertexArray = true, const VertexLayout* vertexLayout = NULL)
 	{
-		this->vertData = vertData;
-		this->indices = indices;
-		this->textures = textures;
-		if (!vertData.empty() && !indices.empty())
+		this->final();
+		this->layout = vertexLayout ? *vertexLayout : VertexLayout::interleaved();
+		this->vertData = std::move(vertData);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->lods = std::move(lods);
+		this->meshlets = std::move(meshlets);
+		if (this->lods.empty())
+		{
+			MeshLod fullLevel = { 0, (GLuint)this->indices.size(), 0.0f };
+			this->lods.push_back(fullLevel);
+		}
+
+		//Fit the bounding box used for culling to the vertices.
+		this->bounds = BoundingBox();
+		for (std::vector<Vertex>::const_iterator it = this->vertData.begin(); this->vertData.end() != it; ++it)
 		{
-			this->setupMesh();
+			this->bounds.expand(it->position);
+		}
+
+		if (!this->vertData.empty() && !this->indices.empty())
+		{
+			this->setupBuffers();
+			if (createVertexArray)
+			{
+				this->setupVertexArray();
+			}
 		}
 	}
 
-	//! Clears VAO and buffers.
-	void final() const
+	//! Sets the signed tangents of vertices from their triangles' texture coordinates, following MikkTSpace's conventions.
+	/**
+	Each triangle's UV derived tangent and bitangent are projected onto the plane of each corner's normal, normalised and weighted by the
+	corner's angle before being summed on the vertex, so the result doesn't depend on how a surface is triangulated. The bitangent sum only
+	decides the handedness sign. Makes no OpenGL calls, so meshes can be processed in parallel on the job system.
+	\param vertices The vertices, whose positions, texture coordinates and normals are set.
+	\param indices Three indices per triangle.
+	\param scratch Arena for the working sums, or NULL for the heap.
+	*/
+	static void generateTangents(Span<Vertex> vertices, Span<const GLuint> indices, Arena* scratch = NULL)
 	{
-		glDeleteVertexArrays(1, &this->VAOId);
-		glDeleteBuffers(1, &this->VBOId);
-		glDeleteBuffers(1, &this->EBOId);
+		//Tangent and bitangent sums of each vertex. Corners are gathered four at a time to be projected and normalised together.
+		ScratchVector<glm::vec4> sums(vertices.size() * 2, glm::vec4(0.0f), ArenaAllocator<glm::vec4>(scratch));
+		TangentBatch batch = TangentBatch();
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const GLuint corners[3] = { indices[i], indices[i + 1], indices[i + 2] };
+			const Vertex& a = vertices[corners[0]];
+			const Vertex& b = vertices[corners[1]];
+			const Vertex& c = vertices[corners[2]];
+			glm::vec3 edge1 = b.position - a.position, edge2 = c.position - a.position;
+			glm::vec2 uv1 = b.texCoords - a.texCoords, uv2 = c.texCoords - a.texCoords;
+			float determinant = uv1.x * uv2.y - uv2.x * uv1.y;
+			if (std::fabs(determinant) < 1e-12f)
+			{
+				continue;
+			}
+			float scale = 1.0f / determinant;
+			glm::vec3 tangent = (edge1 * uv2.y - edge2 * uv1.y) * scale;
+			glm::vec3 bitangent = (edge2 * uv1.x - edge1 * uv2.x) * scale;
+			for (int k = 0; k < 3; ++k)
+			{
+				const Vertex& vertex = vertices[corners[k]];
+				glm::vec3 toNext = vertices[corners[(k + 1) % 3]].position - vertex.position;
+				glm::vec3 toPrevious = vertices[corners[(k + 2) % 3]].position - vertex.position;
+				float lengths = glm::dot(toNext, toNext) * glm::dot(toPrevious, toPrevious);
+				if (lengths <= 0.0f)
+				{
+					continue;
+				}
+				const int slot = batch.count++;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					batch.normal[axis][slot] = vertex.normal[axis];
+					batch.tangent[axis][slot] = tangent[axis];
+					batch.bitangent[axis][slot] = bitangent[axis];
+				}
+				batch.weight[slot] = std::acos(std::max(-1.0f, std::min(1.0f, glm::dot(toNext, toPrevious) / std::sqrt(lengths))));
+				batch.vertex[slot] = corners[k];
+				if (batch.count == 4)
+				{
+					flushTangentBatch(batch, sums.data());
+				}
+			}
+		}
+		if (batch.count > 0)
+		{
+			flushTangentBatch(batch, sums.data());
+		}
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			Vertex& vertex = vertices[i];
+			glm::vec3 tangent = glm::vec3(sums[i * 2]) - vertex.normal * glm::dot(vertex.normal, glm::vec3(sums[i * 2]));
+			if (glm::dot(tangent, tangent) <= 1e-20f)
+			{
+				//Vertices without a usable UV gradient get any tangent perpendicular to the normal.
+				glm::vec3 axis = std::fabs(vertex.normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+				tangent = axis - vertex.normal * glm::dot(vertex.normal, axis);
+			}
+			float sign = glm::dot(glm::cross(vertex.normal, tangent), glm::vec3(sums[i * 2 + 1])) < 0.0f ? -1.0f : 1.0f;
+			vertex.tangent = glm::vec4(glm::normalize(tangent), sign);
+		}
+	}
+
+	//! Clears VAO and releases the buffers, which are deleted once the frames drawing them have retired. Called by the deconstructor, and safe to call more than once.
+	void final()
+	{
+		if (this->VAOId)
+		{
+			glDeleteVertexArrays(1, &this->VAOId);
+		}
+		this->VAOId = 0;
+		this->VBO.reset();
+		this->EBO.reset();
 	}
 
 	//! Get vertex 
 	GLuint getVAOId() const { return this->VAOId; }
+	//! Get an identifier of the mesh's textures, equal for meshes which bind the same textures, for sorting draws.
+	GLuint getMaterialId() const
+	{
+		GLuint materialId = 0;
+		for (std::vector<Texture>::const_iterator it = this->textures.begin(); this->textures.end() != it; ++it)
+		{
+			materialId = materialId * 31u + it->id;
+		}
+		return materialId;
+	}
+	//! Returns whether another mesh binds exactly the same textures as this one.
+	/**
+	\param other The mesh to compare with.
+	*/
+	bool hasSameTextures(const Mesh& other) const
+	{
+		if (this->textures.size() != other.textures.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < this->textures.size(); ++i)
+		{
+			if (this->textures[i].id != other.textures[i].id || this->textures[i].type != other.textures[i].type)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	//! Get the bytes of the mesh's own vertex buffer, which don't include attributes read from other buffers.
+	size_t getVertexBufferBytes() const { return !this->VBO.isNull() ? this->vertData.size() * sizeof(Vertex) : 0; }
+	//! Get the bytes of the mesh's index buffer, with every level of detail.
+	size_t getIndexBufferBytes() const { return !this->EBO.isNull() ? this->indices.size() * sizeof(GLuint) : 0; }
+	//! Get the bytes of the mesh's own vertex and index buffers, which don't include attributes read from other buffers.
+	size_t getBufferBytes() const { return this->getVertexBufferBytes() + this->getIndexBufferBytes(); }
 	const std::vector<Vertex>& getVertices() const { return this->vertData; }
 	const std::vector<GLuint>& getIndices() const { return this->indices; }
+	//! Get the textures the mesh binds.
+	const std::vector<Texture>& getTextures() const { return this->textures; }
+	//! Get the bounding box of the mesh in model space.
+	const BoundingBox& getBounds() const { return this->bounds; }
+	//! Get the index ranges of the levels of detail.
+	const std::vector<MeshLod>& getLods() const { return this->lods; }
+	//! Get the clusters of the full resolution level's triangles.
+	const std::vector<Meshlet>& getMeshlets() const { return this->meshlets; }
+
+	//! Returns the coarsest level of detail whose error projects to no more than the allowed number of pixels.
+	/**
+	\param selection The camera's position and projection.
+	\param transform The mesh's transformation into world space.
+	*/
+	int selectLod(const LodSelection& selection, const glm::mat4& transform) const
+	{
+		//Distance from the camera to the nearest point of the mesh's bounding sphere.
+		BoundingBox worldBounds = this->bounds.transformed(transform);
+		float distance = glm::length(worldBounds.getCentre() - selection.viewPosition) - glm::length(worldBounds.getExtent());
+		if (distance <= 0.0f)
+		{
+			return 0;
+		}
+
+		//Errors are in model units, so scale them by the transform's largest axis.
+		float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		for (int lod = (int)this->lods.size() - 1; lod > 0; --lod)
+		{
+			if (this->lods[lod].error * scale / distance * selection.projectionScale <= selection.maxPixelError)
+			{
+				return lod;
+			}
+		}
+		return 0;
+	}
 
 	//! Renders the mesh to a shader.
 	/**
 	\param shader The shader to render the mesh in.
+	\param lod The level of detail to draw.
 	*/
-	void draw(const Shader& shader) const 
+	void draw(const Shader& shader, int lod = 0) const 
 	{
 		//Check the array and buffer objects have been assigned.
-		if ((VAOId == 0) || (VBOId == 0) || (EBOId == 0)) 
+		if ((VAOId == 0) || EBO.isNull()) 
 		{
 			return;
 		}
@@ -156,13 +540,104 @@ public:
 		int texUnitCnt = this->bindTextures(shader);
 
 		//Draw the mesh.
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+		const MeshLod& level = this->lods[lod];
+		glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (GLvoid*)(level.indexOffset * sizeof(GLuint)));
 		
 		//Unbind the texture from the shader.
 		glBindVertexArray(0);
 		this->unBindTextures(texUnitCnt);
 	}
 
+	//! Finds the index ranges of the full resolution level's meshlets which survive frustum and normal cone culling. Makes no OpenGL calls.
+	/**
+	\param frustum The frustum to cull the meshlets against, in world space.
+	\param transform The mesh's transformation into world space.
+	\param viewPosition The camera position in world space.
+	\param ranges Where to store the ranges. Neighbouring survivors are merged into one range.
+	*/
+	void cullMeshlets(const Frustum& frustum, const glm::mat4& transform, const glm::vec3& viewPosition, std::vector<IndexRange>& ranges) const
+	{
+		ranges.clear();
+		if (this->meshlets.empty())
+		{
+			IndexRange whole = { this->lods[0].indexOffset, this->lods[0].indexCount };
+			ranges.push_back(whole);
+			return;
+		}
+
+		std::vector<char> visible;
+		MeshletCuller::cull(this->meshlets, frustum, transform, viewPosition, visible);
+
+		//Neighbouring survivors are contiguous in the index buffer, so merge them into one range.
+		for (size_t i = 0; i < this->meshlets.size(); ++i)
+		{
+			if (!visible[i])
+			{
+				continue;
+			}
+			if (i > 0 && visible[i - 1])
+			{
+				ranges.back().indexCount += this->meshlets[i].indexCount;
+			}
+			else
+			{
+				IndexRange range = { this->meshlets[i].indexOffset, this->meshlets[i].indexCount };
+				ranges.push_back(range);
+			}
+		}
+	}
+
+	//! Renders the full resolution level's meshlets which survive frustum and normal cone culling, with one multi-draw.
+	/**
+	\param shader The shader to render the mesh in.
+	\param frustum The frustum to cull the meshlets against, in world space.
+	\param transform The mesh's transformation into world space.
+	\param viewPosition The camera position in world space.
+	*/
+	void drawMeshlets(const Shader& shader, const Frustum& frustum, const glm::mat4& transform, const glm::vec3& viewPosition) const
+	{
+		if ((VAOId == 0) || EBO.isNull())
+		{
+			return;
+		}
+
+		std::vector<IndexRange> ranges;
+		this->cullMeshlets(frustum, transform, viewPosition, ranges);
+		if (ranges.empty())
+		{
+			return;
+		}
+		std::vector<GLsizei> counts;
+		std::vector<const GLvoid*> offsets;
+		for (std::vector<IndexRange>::const_iterator it = ranges.begin(); ranges.end() != it; ++it)
+		{
+			counts.push_back(it->indexCount);
+			offsets.push_back((const GLvoid*)(it->indexOffset * sizeof(GLuint)));
+		}
+
+		glBindVertexArray(this->VAOId);
+		int texUnitCnt = this->bindTextures(shader);
+		glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT, &offsets[0], (GLsizei)counts.size());
+		glBindVertexArray(0);
+		this->unBindTextures(texUnitCnt);
+	}
+
+	//! Renders only the mesh's geometry, without binding its textures. Used for depth only passes such as shadow maps.
+	/**
+	\param lod The level of detail to draw.
+	*/
+	void drawDepth(int lod = 0) const
+	{
+		if ((VAOId == 0) || EBO.isNull())
+		{
+			return;
+		}
+		const MeshLod& level = this->lods[lod];
+		glBindVertexArray(this->VAOId);
+		glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (GLvoid*)(level.indexOffset * sizeof(GLuint)));
+		glBindVertexArray(0);
+	}
+
 	//! Binds the current VAOId to the shader.
 	/**
 	\param shader The shader to bind to.
@@ -0,0 +1,458 @@
+#ifndef _MESHSIMPLIFY_H_
+#define _MESHSIMPLIFY_H_
+/**
+\file meshSimplify.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+#include <cmath>
+#include "mesh.h"
+
+/**
+\class MeshSimplifier
+\brief Generates levels of detail for a mesh with quadric error edge collapses. Vertices only ever collapse onto existing vertices, so every level shares the original vertex buffer (and its UVs and tangent frames). Vertices on UV seams, hard edges and open borders are locked so those edges are preserved.
+*/
+class MeshSimplifier
+{
+public:
+	static const int MAX_LODS = 5; //!< Most levels generated for a mesh, including the full resolution level.
+
+private:
+	/**
+	\struct Quadric
+	\brief Symmetric 4x4 matrix which sums the squared distances to a set of planes.
+	*/
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2; //!< Upper triangle of the matrix.
+
+		//! Constructor for an empty quadric.
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {};
+
+		//! Adds the plane with a normal and distance.
+		void addPlane(const glm::vec3& n, float d)
+		{
+			a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+			b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+			c2 += n.z * n.z; cd += n.z * d;
+			d2 += d * d;
+		}
+
+		//! Adds another quadric's planes to this one.
+		void add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+			bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+		}
+
+		//! Returns the sum of squared distances from a point to the planes.
+		double evaluate(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double result = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z + d2;
+			return result > 0.0 ? result : 0.0;
+		}
+	};
+
+	/**
+	\struct Collapse
+	\brief A candidate collapse of one vertex onto a neighbouring vertex.
+	*/
+	struct Collapse
+	{
+		GLuint from;  //!< Vertex which is removed.
+		GLuint to;	  //!< Vertex it is merged into.
+		double cost;  //!< Quadric error of the merge.
+
+		//! Orders collapses from cheapest to most expensive.
+		bool operator<(const Collapse& other) const { return cost < other.cost; }
+	};
+
+	/**
+	\struct PositionHash
+	\brief Hashes a vertex position by its exact bit pattern.
+	*/
+	struct PositionHash
+	{
+		size_t operator()(const glm::vec3& p) const
+		{
+			unsigned int bits[3];
+			memcpy(bits, &p[0], sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	//! Maps every vertex to the first vertex with the same position, so seams and hard edges can be detected.
+	/**
+	\param vertices The mesh's vertices.
+	\param remap Where to store the index of each vertex's position representative.
+	*/
+	static void buildPositionRemap(const std::vector<Vertex>& vertices, std::vector<GLuint>& remap)
+	{
+		std::unordered_map<glm::vec3, GLuint, PositionHash> firstWithPosition;
+		firstWithPosition.reserve(vertices.size());
+		remap.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			remap[i] = firstWithPosition.insert(std::make_pair(vertices[i].position, (GLuint)i)).first->second;
+		}
+	}
+
+	/**
+	\struct VertexHash
+	\brief Hashes a whole vertex by its exact bit pattern.
+	*/
+	struct VertexHash
+	{
+		size_t operator()(const Vertex& v) const
+		{
+			unsigned int bits[sizeof(Vertex) / sizeof(unsigned int)];
+			memcpy(bits, &v, sizeof(bits));
+			size_t hash = 0;
+			for (size_t i = 0; i < sizeof(bits) / sizeof(bits[0]); ++i)
+			{
+				hash = hash * 31u + bits[i];
+			}
+			return hash;
+		}
+	};
+
+	/**
+	\struct VertexEqual
+	\brief Compares two vertices by their exact bit patterns.
+	*/
+	struct VertexEqual
+	{
+		bool operator()(const Vertex& a, const Vertex& b) const { return memcmp(&a, &b, sizeof(Vertex)) == 0; }
+	};
+
+	//! Points every index at the first vertex with identical attributes, so duplicated vertices (as left by importers which don't weld) collapse together rather than being locked as seams.
+	/**
+	\param vertices The mesh's vertices.
+	\param indices The triangles to weld.
+	\param welded Where to store the welded triangles.
+	*/
+	static void weldIndices(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, std::vector<GLuint>& welded)
+	{
+		std::unordered_map<Vertex, GLuint, VertexHash, VertexEqual> firstIdentical;
+		firstIdentical.reserve(vertices.size());
+		std::vector<GLuint> weld(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			weld[i] = firstIdentical.insert(std::make_pair(vertices[i], (GLuint)i)).first->second;
+		}
+		welded.resize(indices.size());
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			welded[i] = weld[indices[i]];
+		}
+	}
+
+	//! Locks the vertices which must not move: those sharing a position with a vertex whose UVs or normal differ (UV seams and hard edges) and those on open borders.
+	/**
+	\param indices The welded triangles of the current level.
+	\param remap Position representative of each vertex.
+	\param locked Where to store whether each vertex is locked.
+	*/
+	static void findLockedVertices(const std::vector<GLuint>& indices, const std::vector<GLuint>& remap, std::vector<char>& locked)
+	{
+		//Only vertices the welded triangles use are counted, so a position has more than one wedge only where its attributes differ.
+		const size_t vertexCount = remap.size();
+		std::vector<char> used(vertexCount, 0);
+		std::vector<GLuint> wedgeCount(vertexCount, 0);
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			if (!used[indices[i]])
+			{
+				used[indices[i]] = 1;
+				++wedgeCount[remap[indices[i]]];
+			}
+		}
+
+		//An edge is on a border if no triangle uses it in the opposite direction.
+		std::unordered_set<unsigned long long> edges;
+		edges.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				unsigned long long a = remap[indices[i + e]], b = remap[indices[i + (e + 1) % 3]];
+				edges.insert((a << 32) | b);
+			}
+		}
+
+		locked.assign(vertexCount, 0);
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			locked[i] = wedgeCount[remap[i]] > 1;
+		}
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				unsigned long long a = remap[indices[i + e]], b = remap[indices[i + (e + 1) % 3]];
+				if (edges.find((b << 32) | a) == edges.end())
+				{
+					locked[indices[i + e]] = 1;
+					locked[indices[i + (e + 1) % 3]] = 1;
+				}
+			}
+		}
+	}
+
+	//! Returns whether collapsing a vertex would flip or collapse any of its remaining triangles.
+	/**
+	\param vertices The mesh's vertices.
+	\param indices The triangles of the current level.
+	\param remap Position representative of each vertex.
+	\param triangles Triangles around the collapsing vertex.
+	\param triangleCount Number of triangles around the collapsing vertex.
+	\param collapse The collapse to test.
+	*/
+	static bool flipsTriangles(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const std::vector<GLuint>& remap,
+		const GLuint* triangles, size_t triangleCount, const Collapse& collapse)
+	{
+		const glm::vec3& target = vertices[collapse.to].position;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			const GLuint* tri = &indices[triangles[t] * 3];
+			glm::vec3 corners[3];
+			bool containsTarget = false;
+			for (int c = 0; c < 3; ++c)
+			{
+				containsTarget = containsTarget || remap[tri[c]] == remap[collapse.to];
+				corners[c] = vertices[tri[c]].position;
+			}
+			if (containsTarget)
+			{
+				continue; //This triangle is removed by the collapse.
+			}
+
+			glm::vec3 oldNormal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+			for (int c = 0; c < 3; ++c)
+			{
+				if (tri[c] == collapse.from) corners[c] = target;
+			}
+			glm::vec3 newNormal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+			if (glm::dot(oldNormal, newNormal) <= 0.0f)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+public:
+	//! Simplifies a set of triangles towards a target index count without exceeding an error. Returns the largest error of any collapse made, in model units.
+	/**
+	\param vertices The mesh's vertices, which are shared by the result.
+	\param indices The triangles to simplify.
+	\param targetIndexCount Index count to stop at.
+	\param maxError Largest distance (in model units) a collapse may move the surface.
+	\param result Where to store the simplified triangles.
+	*/
+	static float simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, size_t targetIndexCount, float maxError, std::vector<GLuint>& result)
+	{
+		const size_t vertexCount = vertices.size();
+		std::vector<GLuint> welded;
+		weldIndices(vertices, indices, welded);
+		result = welded;
+
+		std::vector<GLuint> remap;
+		buildPositionRemap(vertices, remap);
+		std::vector<char> locked;
+		findLockedVertices(welded, remap, locked);
+
+		//Accumulate the planes of every triangle into the quadrics of its corners' positions.
+		std::vector<Quadric> quadrics(vertexCount);
+		for (size_t i = 0; i < welded.size(); i += 3)
+		{
+			const glm::vec3& p0 = vertices[welded[i]].position;
+			glm::vec3 normal = glm::cross(vertices[welded[i + 1]].position - p0, vertices[welded[i + 2]].position - p0);
+			float length = glm::length(normal);
+			if (length <= 0.0f)
+			{
+				continue;
+			}
+			normal /= length;
+			for (int c = 0; c < 3; ++c)
+			{
+				quadrics[remap[welded[i + c]]].addPlane(normal, -glm::dot(normal, p0));
+			}
+		}
+
+		const double maxCost = (double)maxError * maxError;
+		double worstCost = 0.0;
+		std::vector<GLuint> triangleOffsets, triangleList;
+		std::vector<Collapse> candidates;
+		std::vector<char> touched;
+		std::vector<GLuint> collapseTarget(vertexCount);
+
+		//Each pass collapses the cheapest independent edges, then rewrites the triangles.
+		while (result.size() > targetIndexCount)
+		{
+			const size_t triangleCount = result.size() / 3;
+
+			//Vertex to triangle adjacency of the current triangles.
+			triangleOffsets.assign(vertexCount + 1, 0);
+			for (size_t i = 0; i < result.size(); ++i) ++triangleOffsets[result[i] + 1];
+			for (size_t i = 0; i < vertexCount; ++i) triangleOffsets[i + 1] += triangleOffsets[i];
+			triangleList.resize(result.size());
+			std::vector<GLuint> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t i = 0; i < result.size(); ++i) triangleList[fill[result[i]]++] = (GLuint)(i / 3);
+
+			//Both directions of every edge are candidates, unless the vertex being removed is locked.
+			candidates.clear();
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				for (int e = 0; e < 3; ++e)
+				{
+					GLuint a = result[i + e], b = result[i + (e + 1) % 3];
+					for (int direction = 0; direction < 2; ++direction)
+					{
+						GLuint from = direction ? b : a, to = direction ? a : b;
+						if (locked[from] || remap[from] == remap[to])
+						{
+							continue;
+						}
+						Quadric combined = quadrics[remap[from]];
+						combined.add(quadrics[remap[to]]);
+						Collapse collapse = { from, to, combined.evaluate(vertices[to].position) };
+						candidates.push_back(collapse);
+					}
+				}
+			}
+			std::sort(candidates.begin(), candidates.end());
+
+			touched.assign(vertexCount, 0);
+			for (size_t i = 0; i < vertexCount; ++i) collapseTarget[i] = (GLuint)i;
+			size_t trianglesLeft = triangleCount;
+			size_t collapseCount = 0;
+			for (std::vector<Collapse>::const_iterator it = candidates.begin(); candidates.end() != it; ++it)
+			{
+				if (it->cost > maxCost || trianglesLeft * 3 <= targetIndexCount)
+				{
+					break;
+				}
+				if (touched[it->from] || touched[it->to])
+				{
+					continue;
+				}
+
+				const GLuint* triangles = &triangleList[triangleOffsets[it->from]];
+				size_t adjacentCount = triangleOffsets[it->from + 1] - triangleOffsets[it->from];
+				if (flipsTriangles(vertices, result, remap, triangles, adjacentCount, *it))
+				{
+					continue;
+				}
+
+				//Lock the neighbourhood for the rest of the pass so collapses never overlap.
+				size_t removed = 0;
+				for (size_t t = 0; t < adjacentCount; ++t)
+				{
+					const GLuint* tri = &result[triangles[t] * 3];
+					bool containsTarget = false;
+					for (int c = 0; c < 3; ++c)
+					{
+						touched[tri[c]] = 1;
+						containsTarget = containsTarget || remap[tri[c]] == remap[it->to];
+					}
+					removed += containsTarget ? 1 : 0;
+				}
+
+				collapseTarget[it->from] = it->to;
+				quadrics[remap[it->to]].add(quadrics[remap[it->from]]);
+				worstCost = std::max(worstCost, it->cost);
+				trianglesLeft -= std::min(removed, trianglesLeft);
+				++collapseCount;
+			}
+			if (collapseCount == 0)
+			{
+				break;
+			}
+
+			//Apply the collapses and drop triangles which became degenerate.
+			size_t writeIndex = 0;
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				GLuint a = collapseTarget[result[i]], b = collapseTarget[result[i + 1]], c = collapseTarget[result[i + 2]];
+				if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+				{
+					continue;
+				}
+				result[writeIndex++] = a;
+				result[writeIndex++] = b;
+				result[writeIndex++] = c;
+			}
+			result.resize(writeIndex);
+		}
+		return (float)std::sqrt(worstCost);
+	}
+
+	//! Builds a chain of progressively simpler levels and packs their indices one after another.
+	/**
+	\param vertices The mesh's vertices, shared by every level.
+	\param indices The full resolution triangles.
+	\param packedIndices Where to store the indices of every level.
+	\param lods Where to store the index range and error of each level.
+	*/
+	static void buildLodChain(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, std::vector<GLuint>& packedIndices, std::vector<MeshLod>& lods)
+	{
+		//Triangle ratio and largest allowed error (relative to the mesh's size) of each simplified level.
+		const float TRIANGLE_RATIOS[MAX_LODS] = { 1.0f, 0.5f, 0.25f, 0.125f, 0.0625f };
+		const float ERROR_RATIOS[MAX_LODS] = { 0.0f, 0.005f, 0.01f, 0.025f, 0.05f };
+		const size_t MIN_INDEX_COUNT = 64 * 3;
+
+		//Each level aims for half the triangles of the one before, so the packed levels usually fit in twice the full resolution.
+		packedIndices.clear();
+		packedIndices.reserve(indices.size() * 2);
+		packedIndices.assign(indices.begin(), indices.end());
+		lods.clear();
+		MeshLod fullLevel = { 0, (GLuint)indices.size(), 0.0f };
+		lods.push_back(fullLevel);
+		if (indices.size() <= MIN_INDEX_COUNT)
+		{
+			return;
+		}
+
+		BoundingBox bounds;
+		for (std::vector<Vertex>::const_iterator it = vertices.begin(); vertices.end() != it; ++it)
+		{
+			bounds.expand(it->position);
+		}
+		const float meshSize = glm::length(bounds.getExtent());
+
+		//The first level is simplified from the given indices rather than a copy of them.
+		std::vector<GLuint> previous, next;
+		const std::vector<GLuint>* current = &indices;
+		for (int level = 1; level < MAX_LODS; ++level)
+		{
+			size_t target = std::max((size_t)(indices.size() * TRIANGLE_RATIOS[level]) / 3 * 3, MIN_INDEX_COUNT);
+			float error = simplify(vertices, *current, target, ERROR_RATIOS[level] * meshSize, next);
+
+			//Stop once simplification no longer removes a worthwhile number of triangles.
+			if (next.size() > current->size() * 9 / 10)
+			{
+				break;
+			}
+			MeshLod lod = { (GLuint)packedIndices.size(), (GLuint)next.size(), lods.back().error + error };
+			lods.push_back(lod);
+			packedIndices.insert(packedIndices.end(), next.begin(), next.end());
+			previous.swap(next);
+			current = &previous;
+			if (current->size() <= MIN_INDEX_COUNT)
+			{
+				break;
+			}
+		}
+	}
+};
+
+#endif
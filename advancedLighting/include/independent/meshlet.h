@@ -0,0 +1,300 @@
+#ifndef _MESHLET_H_
+#define _MESHLET_H_
+/**
+\file meshlet.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "frustum.h"
+#include "jobSystem.h"
+
+/**
+\struct Meshlet
+\brief A small cluster of a mesh's triangles, stored as a contiguous range of its index buffer, with bounds for culling it on its own.
+*/
+struct Meshlet
+{
+	GLuint indexOffset;	 //!< First index of the meshlet's triangles.
+	GLuint indexCount;	 //!< Number of indices in the meshlet.
+	glm::vec3 centre;	 //!< Centre of the bounding sphere in model space.
+	float radius;		 //!< Radius of the bounding sphere.
+	glm::vec3 coneApex;	 //!< Apex of the normal cone, which every triangle's plane is behind.
+	glm::vec3 coneAxis;	 //!< Average facing direction of the triangles.
+	float coneCutoff;	 //!< Sine of the cone's spread. Greater than one when the triangles face too many ways to be culled.
+};
+
+/**
+\class MeshletBuilder
+\brief Partitions a mesh's triangles into meshlets of neighbouring triangles and computes their bounding spheres and normal cones.
+*/
+class MeshletBuilder
+{
+public:
+	static const size_t MAX_TRIANGLES = 124; //!< Most triangles in a meshlet.
+	static const size_t MAX_VERTICES = 64;	 //!< Most unique vertex positions in a meshlet.
+
+private:
+	//! Computes the bounding sphere and normal cone of a meshlet's triangles.
+	/**
+	\param vertices The mesh's vertices.
+	\param indices The mesh's indices.
+	\param meshlet The meshlet to fill the bounds of.
+	*/
+	template <typename VertexType>
+	static void computeBounds(const std::vector<VertexType>& vertices, const std::vector<GLuint>& indices, Meshlet& meshlet)
+	{
+		const GLuint end = meshlet.indexOffset + meshlet.indexCount;
+		BoundingBox box;
+		glm::vec3 normalSum(0.0f);
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.indexCount / 3);
+		for (GLuint i = meshlet.indexOffset; i < end; i += 3)
+		{
+			const glm::vec3& p0 = vertices[indices[i]].position;
+			const glm::vec3& p1 = vertices[indices[i + 1]].position;
+			const glm::vec3& p2 = vertices[indices[i + 2]].position;
+			box.expand(p0);
+			box.expand(p1);
+			box.expand(p2);
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			normals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f));
+			normalSum += normals.back();
+		}
+
+		meshlet.centre = box.getCentre();
+		meshlet.radius = 0.0f;
+		for (GLuint i = meshlet.indexOffset; i < end; ++i)
+		{
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].position - meshlet.centre));
+		}
+
+		//The cone's spread is set by the triangle which faces furthest from the average direction.
+		float sumLength = glm::length(normalSum);
+		meshlet.coneAxis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneApex = meshlet.centre;
+		meshlet.coneCutoff = 2.0f;
+		float minDot = 1.0f;
+		for (size_t t = 0; t < normals.size(); ++t)
+		{
+			minDot = std::min(minDot, glm::dot(normals[t], meshlet.coneAxis));
+		}
+		if (sumLength <= 0.0f || minDot <= 0.1f)
+		{
+			return; //Facing too many ways for the cone to ever cull the meshlet.
+		}
+
+		//Move the apex back along the axis until it is behind every triangle's plane.
+		float maxDistance = 0.0f;
+		for (size_t t = 0; t < normals.size(); ++t)
+		{
+			const glm::vec3& p0 = vertices[indices[meshlet.indexOffset + t * 3]].position;
+			float planeDistance = glm::dot(meshlet.centre - p0, normals[t]);
+			float axisDot = glm::dot(meshlet.coneAxis, normals[t]);
+			if (axisDot > 0.0f)
+			{
+				maxDistance = std::max(maxDistance, planeDistance / axisDot);
+			}
+		}
+		meshlet.coneApex = meshlet.centre - meshlet.coneAxis * maxDistance;
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+
+	//! Maps every vertex to the first vertex with the same position, so triangles which only share a position (across UV seams or in unwelded meshes) are still neighbours.
+	/**
+	\param vertices The mesh's vertices.
+	\param remap Where to store the index of each vertex's position representative.
+	*/
+	template <typename VertexType>
+	static void buildPositionRemap(const std::vector<VertexType>& vertices, std::vector<GLuint>& remap)
+	{
+		std::vector<GLuint> order(vertices.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = (GLuint)i;
+		std::sort(order.begin(), order.end(), [&](GLuint a, GLuint b)
+		{
+			const glm::vec3& pa = vertices[a].position;
+			const glm::vec3& pb = vertices[b].position;
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			if (pa.z != pb.z) return pa.z < pb.z;
+			return a < b;
+		});
+		remap.resize(vertices.size());
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			remap[order[i]] = (i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position) ? remap[order[i - 1]] : order[i];
+		}
+	}
+
+public:
+	//! Reorders the start of an index buffer into meshlets of neighbouring triangles and returns their ranges and bounds.
+	/**
+	\param vertices The mesh's vertices.
+	\param indices The mesh's indices. The first indexCount are reordered.
+	\param indexCount Number of indices (from the start) to partition, such as the full resolution level of detail.
+	\param meshlets Where to store the meshlets.
+	*/
+	template <typename VertexType>
+	static void build(const std::vector<VertexType>& vertices, std::vector<GLuint>& indices, size_t indexCount, std::vector<Meshlet>& meshlets)
+	{
+		meshlets.clear();
+		const size_t triangleCount = indexCount / 3;
+		const size_t vertexCount = vertices.size();
+		if (triangleCount == 0)
+		{
+			return;
+		}
+
+		//Position to triangle adjacency, used to grow each meshlet into its neighbours. Vertices are counted by position too.
+		std::vector<GLuint> remap;
+		buildPositionRemap(vertices, remap);
+		std::vector<GLuint> triangleOffsets(vertexCount + 1, 0), triangleList(triangleCount * 3);
+		for (size_t i = 0; i < triangleCount * 3; ++i) ++triangleOffsets[remap[indices[i]] + 1];
+		for (size_t i = 0; i < vertexCount; ++i) triangleOffsets[i + 1] += triangleOffsets[i];
+		std::vector<GLuint> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i) triangleList[fill[remap[indices[i]]]++] = (GLuint)(i / 3);
+
+		std::vector<GLuint> reordered;
+		reordered.reserve(triangleCount * 3);
+		std::vector<char> emitted(triangleCount, 0);
+		std::vector<GLuint> vertexStamp(vertexCount, 0); //Meshlet number (plus one) each position was last added to.
+		std::vector<GLuint> frontier;
+
+		for (size_t seed = 0; seed < triangleCount; ++seed)
+		{
+			if (emitted[seed])
+			{
+				continue;
+			}
+
+			Meshlet meshlet;
+			meshlet.indexOffset = (GLuint)reordered.size();
+			const GLuint stamp = (GLuint)meshlets.size() + 1;
+			size_t meshletVertices = 0, meshletTriangles = 0;
+			frontier.clear();
+			frontier.push_back((GLuint)seed);
+
+			while (!frontier.empty() && meshletTriangles < MAX_TRIANGLES)
+			{
+				//Prefer the frontier triangle which adds the fewest new vertices.
+				size_t best = 0;
+				int bestNewVertices = 4;
+				for (size_t f = 0; f < frontier.size() && bestNewVertices > 0; ++f)
+				{
+					//Triangles taken by this or another meshlet are dropped from the frontier as they're found.
+					while (f < frontier.size() && emitted[frontier[f]])
+					{
+						frontier[f] = frontier.back();
+						frontier.pop_back();
+					}
+					if (f == frontier.size())
+					{
+						break;
+					}
+					int newVertices = 0;
+					for (int c = 0; c < 3; ++c)
+					{
+						newVertices += vertexStamp[remap[indices[frontier[f] * 3 + c]]] != stamp;
+					}
+					if (newVertices < bestNewVertices)
+					{
+						best = f;
+						bestNewVertices = newVertices;
+					}
+				}
+				if (bestNewVertices > 3 || meshletVertices + bestNewVertices > MAX_VERTICES)
+				{
+					break;
+				}
+
+				GLuint triangle = frontier[best];
+				frontier[best] = frontier.back();
+				frontier.pop_back();
+				emitted[triangle] = 1;
+				++meshletTriangles;
+				for (int c = 0; c < 3; ++c)
+				{
+					reordered.push_back(indices[triangle * 3 + c]);
+					GLuint vertex = remap[indices[triangle * 3 + c]];
+					if (vertexStamp[vertex] == stamp)
+					{
+						continue;
+					}
+
+					//A new vertex brings its other triangles into the frontier.
+					vertexStamp[vertex] = stamp;
+					++meshletVertices;
+					for (GLuint t = triangleOffsets[vertex]; t < triangleOffsets[vertex + 1]; ++t)
+					{
+						if (!emitted[triangleList[t]]) frontier.push_back(triangleList[t]);
+					}
+				}
+			}
+
+			meshlet.indexCount = (GLuint)reordered.size() - meshlet.indexOffset;
+			meshlets.push_back(meshlet);
+		}
+
+		std::copy(reordered.begin(), reordered.end(), indices.begin());
+		for (std::vector<Meshlet>::iterator it = meshlets.begin(); meshlets.end() != it; ++it)
+		{
+			computeBounds(vertices, indices, *it);
+		}
+	}
+};
+
+/**
+\class MeshletCuller
+\brief Culls meshlets against a frustum and by their normal cones, splitting large meshes across the job system's threads.
+*/
+class MeshletCuller
+{
+public:
+	static const size_t MIN_MESHLETS_PER_JOB = 256; //!< Fewest meshlets worth handing to another thread.
+
+	//! Returns whether a meshlet might be visible.
+	/**
+	\param meshlet The meshlet to test.
+	\param frustum The frustum in world space.
+	\param transform The mesh's transformation into world space.
+	\param scale The transform's largest axis scale.
+	\param localViewPosition The camera position in the mesh's model space.
+	*/
+	static bool isVisible(const Meshlet& meshlet, const Frustum& frustum, const glm::mat4& transform, float scale, const glm::vec3& localViewPosition)
+	{
+		//Every triangle faces away when the camera is inside the cone behind the apex.
+		glm::vec3 toApex = meshlet.coneApex - localViewPosition;
+		float apexDistance = glm::length(toApex);
+		if (apexDistance > 0.0f && glm::dot(toApex, meshlet.coneAxis) >= meshlet.coneCutoff * apexDistance)
+		{
+			return false;
+		}
+		return frustum.intersects(glm::vec3(transform * glm::vec4(meshlet.centre, 1.0f)), meshlet.radius * scale);
+	}
+
+	//! Tests every meshlet, and marks which might be visible.
+	/**
+	\param meshlets The meshlets to test.
+	\param frustum The frustum in world space.
+	\param transform The mesh's transformation into world space. Cones assume it doesn't scale unevenly.
+	\param viewPosition The camera position in world space.
+	\param visible Where to store whether each meshlet might be visible.
+	*/
+	static void cull(const std::vector<Meshlet>& meshlets, const Frustum& frustum, const glm::mat4& transform, const glm::vec3& viewPosition, std::vector<char>& visible)
+	{
+		visible.resize(meshlets.size());
+		const glm::vec3 localViewPosition = glm::vec3(glm::inverse(transform) * glm::vec4(viewPosition, 1.0f));
+		const float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+		//Each job tests its own contiguous range, so the results need no synchronisation.
+		JobSystem::instance().parallelFor(0, meshlets.size(), [&](size_t i)
+		{
+			visible[i] = isVisible(meshlets[i], frustum, transform, scale, localViewPosition);
+		}, MIN_MESHLETS_PER_JOB);
+	}
+};
+
+#endif
@@ -4,11 +4,71 @@
 \file model.h
 */
 #include <map>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <sstream>
+#include <cstdio>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/ProgressHandler.hpp>
 #include "mesh.h"
+#include "commandList.h"
+#include "meshSimplify.h"
+#include "occlusion.h"
 #include "texture.h"
+#include "blockCompression.h"
+#include "jobSystem.h"
+#include "resourceLoader.h"
+#include "mappedFileSystem.h"
+#include "objLoader.h"
+#include "gltfLoader.h"
+#include "arena.h"
+
+/**
+\struct LoadProgress
+\brief A snapshot of how far a model's load has got.
+*/
+struct LoadProgress
+{
+	size_t bytesRead;			//!< Bytes of the model's files read so far.
+	size_t bytesTotal;			//!< Size of the files opened so far, which grows as materials and textures are opened.
+	unsigned meshesProcessed;	//!< Meshes whose levels of detail and meshlets are built.
+	unsigned meshCount;			//!< Meshes in the model, 0 until the file is imported.
+	unsigned texturesDecoded;	//!< Textures decoded so far.
+	unsigned textureCount;		//!< Textures to decode, 0 until the materials are processed.
+
+	//! Returns a rough fraction of the load done, with reading, mesh processing and texture decoding weighted equally.
+	float getFraction() const
+	{
+		float reading = bytesTotal ? (float)bytesRead / bytesTotal : 0.0f;
+		float meshes = meshCount ? (float)meshesProcessed / meshCount : 0.0f;
+		float textures = textureCount ? (float)texturesDecoded / textureCount : meshes;
+		return (reading + meshes + textures) / 3.0f;
+	}
+};
+
+/**
+\class ImportProgressHandler
+\brief Called by Assimp while it imports, aborting the import once the load is cancelled.
+*/
+class ImportProgressHandler : public Assimp::ProgressHandler
+{
+private:
+	const std::atomic<bool>& m_cancelled; //!< Set when the load is cancelled.
+public:
+	//! Constructor
+	/**
+	\param cancelled Set when the load is cancelled.
+	*/
+	explicit ImportProgressHandler(const std::atomic<bool>& cancelled) : m_cancelled(cancelled) {};
+
+	//! Returns false, which aborts the import, once the load is cancelled.
+	bool Update(float) { return !m_cancelled.load(); }
+};
 
 /**
 \class Model
@@ -16,18 +76,89 @@
 */
 class Model
 {
+public:
+	//! How far a model has got through loading.
+	enum LoadState
+	{
+		LOAD_EMPTY,		//!< Nothing has been loaded.
+		LOAD_PENDING,	//!< Being imported and uploaded.
+		LOAD_UPLOADED,	//!< Uploaded on the loader's context, waiting for its fence before it can be drawn.
+		LOAD_READY,		//!< Ready to draw.
+		LOAD_FAILED,	//!< Loading failed.
+		LOAD_CANCELLED	//!< Loading was cancelled before the model was uploaded.
+	};
+
 private:
 	std::vector<Mesh> meshes;								  //!< This model's meshes.
 	std::string modelFileDir;								  //!< Directory of the model file.
 	typedef std::map<std::string, Texture> LoadedTextMapType; //!< Model's textures and their file directories.
-	LoadedTextMapType loadedTextureMap;						  //!< Model's oaded textures.
+	LoadedTextMapType loadedTextureMap;						  //!< Model's loaded textures, whose handles keep them in the TextureCache.
+	BoundingBox bounds;										  //!< Bounding box of all the meshes in model space.
+	std::atomic<int> loadState;								  //!< The model's LoadState. Only the loading thread touches the meshes until it's uploaded.
+	GLsync uploadFence;										  //!< Signalled once the loader's uploads have finished.
+	size_t textureBytes;									  //!< Estimated video memory of the model's textures, including any shared with other models.
+	std::vector<GpuBuffer> sourceBuffers;					  //!< Vertex buffers uploaded straight from a file's buffer views, which the meshes read attributes from.
+	size_t sourceBufferBytes;								  //!< Video memory of the source buffers.
+	std::shared_future<bool> loadFuture;					  //!< Result of an asynchronous load.
+	std::atomic<bool> cancelRequested;						  //!< Whether the current load should stop at its next check.
+	std::atomic<size_t> progressBytesRead;					  //!< Bytes of the model's files read by the current load.
+	std::atomic<size_t> progressBytesTotal;					  //!< Size of the files the current load has opened.
+	std::atomic<unsigned> progressMeshes;					  //!< Meshes the current load has processed.
+	std::atomic<unsigned> progressMeshCount;				  //!< Meshes the current load will process.
+	std::atomic<unsigned> progressTextures;					  //!< Textures the current load has decoded.
+	std::atomic<unsigned> progressTextureCount;				  //!< Textures the current load will decode.
+
+	//Models own their OpenGL objects, so they can be moved but not copied.
+	Model(const Model&);
+	Model& operator=(const Model&);
+
+	//! Waits for an asynchronous load to finish, then releases the meshes, buffers and textures, which are deleted once the frames drawing them have retired.
+	void release()
+	{
+		if (this->loadFuture.valid())
+		{
+			this->loadFuture.wait();
+		}
+		if (this->uploadFence)
+		{
+			glDeleteSync(this->uploadFence);
+			this->uploadFence = 0;
+		}
+		this->meshes.clear();
+		this->sourceBuffers.clear();
+		this->loadedTextureMap.clear();
+		this->bounds = BoundingBox();
+		this->textureBytes = 0;
+		this->sourceBufferBytes = 0;
+		this->loadState = LOAD_EMPTY;
+	}
 
-	//! Processes mesh nodes.
+	/**
+	\struct MeshData
+	\brief A mesh's data gathered from the imported scene, processed on the job system before anything is uploaded to OpenGL.
+	*/
+	struct MeshData
+	{
+		std::vector<Vertex> vertices;	//!< The mesh's vertices.
+		std::vector<GLuint> indices;	//!< The mesh's indices, with every level of detail packed in once they're built.
+		std::vector<MeshLod> lods;		//!< The mesh's levels of detail.
+		std::vector<Meshlet> meshlets;	//!< The full resolution level's meshlets.
+		std::vector<Texture> textures;	//!< The mesh's textures, whose ids are set once they're uploaded.
+		std::vector<GltfLoader::RawAttribute> rawAttributes; //!< Positions, texture coordinates and normals to draw straight from a glTF file's buffer views, if any.
+		const aiMesh* source;			//!< Assimp mesh still to be converted on the job system, or NULL once the vertices are gathered.
+
+		//! Constructor
+		MeshData() : source(NULL) {};
+	};
+
+	//! Processes mesh nodes. Only the meshes and their materials are collected here, as the meshes are converted in parallel afterwards.
 	/**
 	\param node The mesh nodes to process.
 	\param sceneObjPtr Pointer to a scene object.
+	\param materials Textures of the materials resolved so far, by material index.
+	\param meshData Where to add a work item for each mesh.
 	*/
-	bool processNode(const aiNode* node, const aiScene* sceneObjPtr)
+	bool processNode(const aiNode* node, const aiScene* sceneObjPtr, std::map<unsigned, std::vector<Texture> >& materials, std::vector<MeshData>& meshData)
 	{
 		//End if there aren't any nodes or scene objects to process.
 		if (!node || !sceneObjPtr)
@@ -35,137 +166,146 @@ private:
 			return false;
 		}
 
-		//Add every mesh in the given node to this model's meshes.
+		//Collect every mesh in the given node, stopping if the load is cancelled.
 		for (size_t i = 0; i < node->mNumMeshes; ++i)
 		{
+			if (this->cancelRequested.load())
+			{
+				return false;
+			}
 			const aiMesh* meshPtr = sceneObjPtr->mMeshes[node->mMeshes[i]];
-			if (meshPtr)
+			if (!meshPtr)
 			{
-				Mesh meshObj;
-				if (this->processMesh(meshPtr, sceneObjPtr, meshObj))
+				continue;
+			}
+			meshData.push_back(MeshData());
+			meshData.back().source = meshPtr;
+
+			//Materials add to the shared texture map, so each is resolved once here rather than by the conversion jobs.
+			std::map<unsigned, std::vector<Texture> >::const_iterator material = materials.find(meshPtr->mMaterialIndex);
+			if (materials.end() == material && meshPtr->mMaterialIndex < sceneObjPtr->mNumMaterials)
+			{
+				std::vector<Texture>& textures = materials[meshPtr->mMaterialIndex];
+				const aiMaterial* materialPtr = sceneObjPtr->mMaterials[meshPtr->mMaterialIndex];
+				const aiTextureType types[3] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT };
+				for (int type = 0; type < 3; ++type)
 				{
-					this->meshes.push_back(meshObj);
+					std::vector<Texture> typeTextures;
+					this->processMaterial(materialPtr, sceneObjPtr, types[type], typeTextures);
+					textures.insert(textures.end(), typeTextures.begin(), typeTextures.end());
 				}
+				material = materials.find(meshPtr->mMaterialIndex);
+			}
+			if (materials.end() != material)
+			{
+				meshData.back().textures = material->second;
 			}
 		}
 
 		//Also process the child nodes of the given node.
 		for (size_t i = 0; i < node->mNumChildren; ++i)
 		{
-			this->processNode(node->mChildren[i], sceneObjPtr);
+			if (!this->processNode(node->mChildren[i], sceneObjPtr, materials, meshData) && this->cancelRequested.load())
+			{
+				return false;
+			}
 		}
 		return true;
 	}
 
-	//! Set mesh data to a specified mesh.
+	//! Resets the progress counters and cancellation for a new load.
+	void resetProgress()
+	{
+		this->cancelRequested = false;
+		this->progressBytesRead = 0;
+		this->progressBytesTotal = 0;
+		this->progressMeshes = 0;
+		this->progressMeshCount = 0;
+		this->progressTextures = 0;
+		this->progressTextureCount = 0;
+	}
+
+	//! Converts a mesh from the imported scene into vertices and indices. Makes no OpenGL calls and touches nothing shared, so meshes can be converted in parallel.
 	/**
 	\param meshPtr The mesh to retrieve the data from.
-	\param sceneObjPtr Pointer to a scene object.
-	\param meshObj Pointer to the mesh object to set the meshPtr data to.
+	\param meshData Where to store the meshPtr data.
+	\param scratch Arena for the mesh's temporary data.
+	\return Whether the mesh was made of triangles.
 	*/
-	bool processMesh(const aiMesh* meshPtr, const aiScene* sceneObjPtr, Mesh& meshObj)
+	static bool processMesh(const aiMesh* meshPtr, MeshData& meshData, Arena* scratch)
 	{
-		//End if there aren't any meshes or scene objects to process.
-		if (!meshPtr || !sceneObjPtr)
-		{
-			return false;
-		}
-
-		//Temporary variables to store mesh data in.
-		std::vector<Vertex> vertData;
-		std::vector<Texture> textures;
-		std::vector<GLuint> indices;
+		//Where to store the mesh data, sized up front so every vertex and index is written in place.
+		std::vector<Vertex>& vertData = meshData.vertices;
+		std::vector<GLuint>& indices = meshData.indices;
+		vertData.resize(meshPtr->mNumVertices);
+		indices.resize((size_t)meshPtr->mNumFaces * 3);
 
 		//Get above data from the mesh.
 		for (size_t i = 0; i < meshPtr->mNumVertices; ++i)
 		{
-			Vertex vertex;
+			Vertex& vertex = vertData[i];
 
 			//Get vertex positions from mesh.
-			if (meshPtr->HasPositions())
-			{
-				vertex.position.x = meshPtr->mVertices[i].x;
-				vertex.position.y = meshPtr->mVertices[i].y;
-				vertex.position.z = meshPtr->mVertices[i].z;
-			}
+			vertex.position = meshPtr->HasPositions() ? glm::vec3(meshPtr->mVertices[i].x, meshPtr->mVertices[i].y, meshPtr->mVertices[i].z) : glm::vec3(0.0f);
 
 			//Get texture positions from mesh.
-			if (meshPtr->HasTextureCoords(0))
-			{
-				vertex.texCoords.x = meshPtr->mTextureCoords[0][i].x;
-				vertex.texCoords.y = meshPtr->mTextureCoords[0][i].y;
-			}
-			else
-			{
-				vertex.texCoords = glm::vec2(0.0f, 0.0f);
-			}
-
+			vertex.texCoords = meshPtr->HasTextureCoords(0) ? glm::vec2(meshPtr->mTextureCoords[0][i].x, meshPtr->mTextureCoords[0][i].y) : glm::vec2(0.0f);
 
 			//Get normals from mesh.
-			if (meshPtr->HasNormals())
-			{
-				vertex.normal.x = meshPtr->mNormals[i].x;
-				vertex.normal.y = meshPtr->mNormals[i].y;
-				vertex.normal.z = meshPtr->mNormals[i].z;
-			}
-		
-			//Get tangents and bitangents from mesh.
-			if (meshPtr->HasTangentsAndBitangents())
-			{
-				glm::vec3 tangent;
-				glm::vec3 bitangent;
-				tangent.x = meshPtr->mTangents[i].x;
-				tangent.y = meshPtr->mTangents[i].y;
-				tangent.z = meshPtr->mTangents[i].z;
-				bitangent.x = meshPtr->mBitangents[i].x;
-				bitangent.y = meshPtr->mBitangents[i].y;
-				bitangent.z = meshPtr->mBitangents[i].z;
-			
-				vertex.tangent = tangent;
-				vertex.bitangent = bitangent;
-			}
+			vertex.normal = meshPtr->HasNormals() ? glm::vec3(meshPtr->mNormals[i].x, meshPtr->mNormals[i].y, meshPtr->mNormals[i].z) : glm::vec3(0.0f);
 
-			vertData.push_back(vertex);
+			//Tangents are generated once the indices are gathered.
+			vertex.tangent = glm::vec4(0.0f);
 		}
 
 		//Get indices from mesh.
 		for (size_t i = 0; i < meshPtr->mNumFaces; ++i)
 		{
-			aiFace face = meshPtr->mFaces[i];
+			const aiFace& face = meshPtr->mFaces[i];
 			if (face.mNumIndices != 3)
 			{
 				std::cerr << "Error:Model::processMesh, mesh not transformed to triangle mesh." << std::endl;
+				vertData.clear();
+				indices.clear();
 				return false;
 			}
-			for (size_t j = 0; j < face.mNumIndices; ++j)
+			indices[i * 3] = face.mIndices[0];
+			indices[i * 3 + 1] = face.mIndices[1];
+			indices[i * 3 + 2] = face.mIndices[2];
+		}
+		Mesh::generateTangents(vertData, indices, scratch);
+		return true;
+	}
+
+	//! Converts a mesh if it came from Assimp, then builds its levels of detail and meshlets. Makes no OpenGL calls, so meshes can be processed in parallel.
+	/**
+	\param meshData The mesh's gathered data.
+	\param scratch Arena for the mesh's temporary data, which isn't used by any other job.
+	\return Whether the mesh is valid, which it isn't if it couldn't be converted.
+	*/
+	static bool processMeshDetail(MeshData& meshData, Arena* scratch)
+	{
+		if (meshData.source)
+		{
+			const aiMesh* source = meshData.source;
+			meshData.source = NULL;
+			if (!processMesh(source, meshData, scratch))
 			{
-				indices.push_back(face.mIndices[j]);
+				return false;
 			}
 		}
-
-		//Get texture data from mesh.
-		if (meshPtr->mMaterialIndex >= 0)
+		if (meshData.vertices.empty() || meshData.indices.empty())
 		{
-			const aiMaterial* materialPtr = sceneObjPtr->mMaterials[meshPtr->mMaterialIndex];
-
-			//Get texture diffusion.
-			std::vector<Texture> diffuseTexture;
-			this->processMaterial(materialPtr, sceneObjPtr, aiTextureType_DIFFUSE, diffuseTexture);
-			textures.insert(textures.end(), diffuseTexture.begin(), diffuseTexture.end());
-
-			//Get texture specularity.
-			std::vector<Texture> specularTexture;
-			this->processMaterial(materialPtr, sceneObjPtr, aiTextureType_SPECULAR, specularTexture);
-			textures.insert(textures.end(), specularTexture.begin(), specularTexture.end());
-
-			//Get texture normal map data.
-			std::vector<Texture> normalTexture;
-			this->processMaterial(materialPtr, sceneObjPtr, aiTextureType_HEIGHT, normalTexture);
-			textures.insert(textures.end(), normalTexture.begin(), normalTexture.end());
+			return false;
 		}
 
-		//Set the retrieved data to the specified mesh object.
-		meshObj.setData(vertData, textures, indices);
+		//Generate the levels of detail, which share the vertices and are packed into one index buffer.
+		std::vector<GLuint> packedIndices;
+		MeshSimplifier::buildLodChain(meshData.vertices, meshData.indices, packedIndices, meshData.lods);
+
+		//Partition the full resolution level into meshlets for finer culling.
+		MeshletBuilder::build(meshData.vertices, packedIndices, meshData.lods[0].indexCount, meshData.meshlets);
+		meshData.indices.swap(packedIndices);
 		return true;
 	}
 
@@ -194,7 +334,6 @@ private:
 		//For every given material...
 		for (size_t i = 0; i < matPtr->GetTextureCount(textureType); ++i)
 		{
-			Texture text; //Where to temporarily store collected texture data.
 			aiString textPath;
 			aiReturn retStatus = matPtr->GetTexture(textureType, i, &textPath);
 
@@ -204,26 +343,506 @@ private:
 				continue;
 			}
 
-			std::string absolutePath = this->modelFileDir + "/" + textPath.C_Str();
-			LoadedTextMapType::const_iterator it = this->loadedTextureMap.find(absolutePath);
+			this->addTexture(textPath.C_Str(), textureType, textures);
+		}
+		return true;
+	};
+
+	//! Block compresses a decoded texture, frees its pixels and writes the result to the DDS cache. Safe to call on any thread.
+	/**
+	\param image The decoded image, as RGBA8.
+	\param normalMap Whether the image is a normal map, which is compressed to two channels.
+	\param cacheKey Key to cache the compressed texture under, or NULL to not cache it.
+	\param compressed Where to store the compressed texture.
+	*/
+	static void compressTexture(TextureHelper::DecodedImage& image, bool normalMap, const TextureKey* cacheKey, TextureHelper::CompressedImage& compressed)
+	{
+		BlockCompressor::compress(image.data, image.width, image.height, BlockCompressor::chooseFormat(image.data, image.width, image.height, normalMap), compressed);
+		SOIL_free_image_data(image.data);
+		image.data = NULL;
+		const std::string ddsPath = cacheKey && !compressed.data.empty() ? TextureCache::instance().getDdsPath(*cacheKey, compressed.internalFormat) : std::string();
+		if (ddsPath.empty())
+		{
+			return;
+		}
+		//Written under a name of its own then renamed, so another load never reads a half written file.
+		std::ostringstream tempPath;
+		tempPath << ddsPath << "." << std::this_thread::get_id() << ".tmp";
+		if (!TextureHelper::writeDDS(tempPath.str().c_str(), compressed) || std::rename(tempPath.str().c_str(), ddsPath.c_str()) != 0)
+		{
+			std::remove(tempPath.str().c_str());
+		}
+	}
+
+	//! Decodes a texture's source image and, when compressing, block compresses it and writes it to the DDS cache. Safe to call on any thread.
+	/**
+	\param data The source file's bytes, or NULL to read the file from its path.
+	\param size Size of the source bytes.
+	\param path Path of the source file.
+	\param normalMap Whether the image is a normal map.
+	\param loadChannels Channels to decode the image with.
+	\param compress Whether to block compress the image.
+	\param cacheKey Key to cache the compressed texture under, or NULL to not cache it.
+	\param image Where to store the decoded image, which is freed again if it's compressed.
+	\param compressed Where to store the compressed texture.
+	*/
+	static void decodeTexture(const unsigned char* data, size_t size, const std::string& path, bool normalMap, int loadChannels, bool compress,
+		const TextureKey* cacheKey, TextureHelper::DecodedImage& image, TextureHelper::CompressedImage& compressed)
+	{
+		if (data) TextureHelper::decodeImageFromMemory(data, size, image, loadChannels);
+		else TextureHelper::decodeImage(path.c_str(), image, loadChannels);
+		if (compress && image.data)
+		{
+			compressTexture(image, normalMap, cacheKey, compressed);
+		}
+	}
+
+	//! Maps a compressed texture an earlier run wrote to the DDS cache, and checks it's readable. Unreadable files are removed. Safe to call on any thread.
+	/**
+	\param key The texture's key.
+	\param normalMap Whether the texture is a normal map, which is only ever BC5. Colour textures are BC1 or BC3.
+	\param file Where to store the mapped file.
+	\param path Where to store the file's path.
+	\return Whether a readable file was found.
+	*/
+	static bool mapCachedTexture(const TextureKey& key, bool normalMap, std::shared_ptr<MappedFile>& file, std::string& path)
+	{
+		const GLenum formats[] = { GL_COMPRESSED_RG_RGTC2, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT };
+		for (size_t f = normalMap ? 0 : 1; f < (normalMap ? 1 : 3); ++f)
+		{
+			path = TextureCache::instance().getDdsPath(key, formats[f]);
+			if (path.empty() || !std::ifstream(path.c_str(), std::ios::in | std::ios::binary))
+			{
+				continue;
+			}
+			file = std::make_shared<MappedFile>();
+			TextureHelper::DDSLayout layout;
+			if (file->open(path) && TextureHelper::parseDDS(file->getData(), file->getSize(), path.c_str(), layout))
+			{
+				return true;
+			}
+			//The mapping is closed first, as a mapped file can't be removed on Windows.
+			file.reset();
+			std::cerr << "Error::Model::mapCachedTexture, removing unreadable cached texture " << path << std::endl;
+			std::remove(path.c_str());
+		}
+		path.clear();
+		return false;
+	}
+
+	//! Adds a texture to a mesh's textures, sharing it with the other meshes which use the same file.
+	/**
+	\param textPath Path of the texture file, relative to the model file.
+	\param textureType The texture's type.
+	\param textures Where to add the texture.
+	*/
+	void addTexture(const std::string& textPath, const aiTextureType textureType, std::vector<Texture>& textures)
+	{
+		std::string absolutePath = this->modelFileDir + "/" + textPath;
+		LoadedTextMapType::const_iterator it = this->loadedTextureMap.find(absolutePath);
+
+		//New textures are loaded once every mesh has been gathered, so their files can be decoded in parallel.
+		if (it == this->loadedTextureMap.end())
+		{
+			Texture text;
+			text.id = 0;
+			text.path = absolutePath;
+			text.type = textureType;
+			textures.push_back(text);
+			loadedTextureMap[absolutePath] = text;
+		}
+		else
+		{
+			textures.push_back(it->second);
+		}
+	}
+
+	//! Imports an OBJ file with the native loader, which is much faster than Assimp on large files.
+	/**
+	\param filePath The OBJ file.
+	\param fileSystem File system the files are mapped through.
+	\param meshData Where to add the data of each mesh.
+	\param scratch Arena for the load's temporary data.
+	\return Whether the file was imported. It isn't if it uses something the native loader doesn't support.
+	*/
+	bool importObj(const std::string& filePath, MappedIOSystem& fileSystem, std::vector<MeshData>& meshData, Arena* scratch)
+	{
+		std::vector<ObjLoader::ObjMesh> objMeshes;
+		std::map<std::string, ObjLoader::ObjMaterial> materials;
+		if (!ObjLoader::load(filePath, fileSystem, objMeshes, materials, &this->cancelRequested, &this->progressBytesRead, &this->progressBytesTotal, scratch))
+		{
+			return false;
+		}
+		this->progressMeshCount = (unsigned)objMeshes.size();
+		meshData.resize(objMeshes.size());
+		for (size_t i = 0; i < objMeshes.size(); ++i)
+		{
+			meshData[i].vertices.swap(objMeshes[i].vertices);
+			meshData[i].indices.swap(objMeshes[i].indices);
+
+			//Textures are added in the same order as processMesh adds Assimp's.
+			std::map<std::string, ObjLoader::ObjMaterial>::const_iterator material = materials.find(objMeshes[i].material);
+			if (materials.end() == material && !objMeshes[i].material.empty())
+			{
+				//Assimp also falls back to its default material, without textures.
+				std::cerr << "Error::Model::importObj, could not find material: " << objMeshes[i].material << std::endl;
+			}
+			else if (materials.end() != material)
+			{
+				if (!material->second.diffuseMap.empty()) this->addTexture(material->second.diffuseMap, aiTextureType_DIFFUSE, meshData[i].textures);
+				if (!material->second.specularMap.empty()) this->addTexture(material->second.specularMap, aiTextureType_SPECULAR, meshData[i].textures);
+				if (!material->second.normalMap.empty()) this->addTexture(material->second.normalMap, aiTextureType_HEIGHT, meshData[i].textures);
+			}
+		}
+		return true;
+	}
+
+	//! Imports a glTF 2.0 file with the native loader, as the bundled Assimp predates glTF 2.0.
+	/**
+	\param filePath The .glb or .gltf file.
+	\param fileSystem File system the files are mapped through, which keeps the buffer views and embedded images mapped.
+	\param meshData Where to add the data of each mesh.
+	\param views Where to store the file's buffer views, which the meshes' raw attributes refer to.
+	\param embeddedImages Where to store the images stored in the file, by the texture path meshes use for them.
+	\return Whether the file was imported.
+	*/
+	bool importGltf(const std::string& filePath, MappedIOSystem& fileSystem, std::vector<MeshData>& meshData, std::vector<GltfLoader::BufferView>& views,
+		std::map<std::string, GltfLoader::BufferView>& embeddedImages)
+	{
+		std::vector<GltfLoader::GltfMesh> gltfMeshes;
+		std::vector<GltfLoader::GltfImage> images;
+		if (!GltfLoader::load(filePath, fileSystem, gltfMeshes, views, images, &this->cancelRequested, &this->progressBytesRead, &this->progressBytesTotal))
+		{
+			return false;
+		}
+		for (std::vector<GltfLoader::GltfImage>::const_iterator it = images.begin(); images.end() != it; ++it)
+		{
+			GltfLoader::BufferView image = { it->data, it->size };
+			embeddedImages[this->modelFileDir + "/" + it->name] = image;
+		}
+		this->progressMeshCount = (unsigned)gltfMeshes.size();
+		meshData.resize(gltfMeshes.size());
+		for (size_t i = 0; i < gltfMeshes.size(); ++i)
+		{
+			meshData[i].vertices.swap(gltfMeshes[i].vertices);
+			meshData[i].indices.swap(gltfMeshes[i].indices);
+			meshData[i].rawAttributes.swap(gltfMeshes[i].rawAttributes);
+			if (!gltfMeshes[i].diffuseMap.empty()) this->addTexture(gltfMeshes[i].diffuseMap, aiTextureType_DIFFUSE, meshData[i].textures);
+			if (!gltfMeshes[i].normalMap.empty()) this->addTexture(gltfMeshes[i].normalMap, aiTextureType_HEIGHT, meshData[i].textures);
+		}
+		return true;
+	}
+
+	//! Uploads a mesh's vertex attributes from the glTF buffer views they're stored in, giving the layout to draw them with.
+	/**
+	\param data The mesh, whose raw attributes are set.
+	\param views The file's buffer views.
+	\param viewBuffers Buffers already uploaded, by buffer view, so meshes sharing a view share its buffer.
+	\param layout Where to store the layout.
+	*/
+	void uploadRawAttributes(const MeshData& data, const std::vector<GltfLoader::BufferView>& views, std::map<int, GLuint>& viewBuffers, VertexLayout& layout)
+	{
+		//Buffer views go straight from the mapping to OpenGL, without being repacked.
+		for (size_t i = 0; i < data.rawAttributes.size(); ++i)
+		{
+			const GltfLoader::RawAttribute& raw = data.rawAttributes[i];
+			std::map<int, GLuint>::const_iterator it = viewBuffers.find(raw.bufferView);
+			if (viewBuffers.end() == it)
+			{
+				GLuint buffer = 0;
+				glGenBuffers(1, &buffer);
+				glBindBuffer(GL_ARRAY_BUFFER, buffer);
+				glBufferData(GL_ARRAY_BUFFER, views[raw.bufferView].size, views[raw.bufferView].data, GL_STATIC_DRAW);
+				this->sourceBuffers.push_back(GpuBuffer(buffer, views[raw.bufferView].size, GPU_MEMORY_VERTEX, "glTF buffer view"));
+				this->sourceBufferBytes += views[raw.bufferView].size;
+				it = viewBuffers.insert(std::make_pair(raw.bufferView, buffer)).first;
+			}
+			VertexAttribute attribute = { it->second, raw.size, raw.type, raw.normalised, raw.stride, raw.offset };
+			layout.attributes[i] = attribute;
+		}
+
+		//Tangents are transformed or generated, so they get a small buffer of their own, written through a mapping rather than a staging copy.
+		const size_t tangentBytes = data.vertices.size() * sizeof(glm::vec4);
+		GLuint buffer = 0;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, tangentBytes, NULL, GL_STATIC_DRAW);
+		glm::vec4* tangents = tangentBytes ? (glm::vec4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, tangentBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) : NULL;
+		if (tangents)
+		{
+			for (size_t i = 0; i < data.vertices.size(); ++i)
+			{
+				tangents[i] = data.vertices[i].tangent;
+			}
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		this->sourceBuffers.push_back(GpuBuffer(buffer, tangentBytes, GPU_MEMORY_VERTEX, "glTF tangents"));
+		this->sourceBufferBytes += tangentBytes;
+		const VertexAttribute tangent = { buffer, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 0 };
+		layout.attributes[3] = tangent;
+	}
+
+	//! Imports the model from an external file and uploads its buffers and textures to the current context.
+	/**
+	\param filePath Directory to retrieve the model from.
+	\param createVertexArrays Whether to create the meshes' vertex arrays, which only the context that draws them can.
+	*/
+	bool importModel(const std::string& filePath, bool createVertexArrays)
+	{
+		Assimp::Importer importer;
+		if (filePath.empty())
+		{
+			std::cerr << "Error:Model::importModel, empty model file path." << std::endl;
+			return false;
+		}
+		if (this->cancelRequested.load())
+		{
+			return false;
+		}
+		//Files are mapped instead of read through buffered streams, counting the bytes read. The importer owns the file system and the progress handler, and deletes them.
+		MappedIOSystem* fileSystem = new MappedIOSystem();
+		fileSystem->setProgressCounters(&this->progressBytesRead, &this->progressBytesTotal);
+		importer.SetIOHandler(fileSystem);
+		importer.SetProgressHandler(new ImportProgressHandler(this->cancelRequested));
+		this->modelFileDir = filePath.substr(0, filePath.find_last_of('/'));
+		std::vector<MeshData> meshData;
+		Arena scratch; //Everything only needed while loading, released in one shot when the load returns.
+		std::vector<GltfLoader::BufferView> views;
+		std::map<std::string, GltfLoader::BufferView> embeddedImages;
+
+		//OBJ files go through the native loader, falling back to Assimp for anything it doesn't support. glTF 2.0 files only have the native loader.
+		std::string extension = filePath.substr(filePath.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (extension == "glb" || extension == "gltf")
+		{
+			if (!this->importGltf(filePath, *fileSystem, meshData, views, embeddedImages))
+			{
+				if (!this->cancelRequested.load())
+				{
+					std::cerr << "Error:Model::importModel, could not import glTF file: " << filePath << std::endl;
+				}
+				return false;
+			}
+		}
+		else if (extension != "obj" || !this->importObj(filePath, *fileSystem, meshData, &scratch))
+		{
+			if (this->cancelRequested.load())
+			{
+				return false;
+			}
+			//Assimp reads the files again, so the bytes the native loader counted would be counted twice.
+			this->progressBytesRead = 0;
+			this->progressBytesTotal = 0;
+			const aiScene* sceneObjPtr = importer.ReadFile(filePath, 
+				aiProcess_Triangulate 
+				| aiProcess_JoinIdenticalVertices
+				| aiProcess_FlipUVs 
+				| aiProcess_GenSmoothNormals);
+			if (this->cancelRequested.load())
+			{
+				return false;
+			}
+			if (!sceneObjPtr
+				|| sceneObjPtr->mFlags == AI_SCENE_FLAGS_INCOMPLETE
+				|| !sceneObjPtr->mRootNode)
+			{
+				std::cerr << "Error:Model::importModel, description: " 
+					<< importer.GetErrorString() << std::endl;
+				return false;
+			}
+			std::map<unsigned, std::vector<Texture> > materials;
+			if (!this->processNode(sceneObjPtr->mRootNode, sceneObjPtr, materials, meshData))
+			{
+				if (!this->cancelRequested.load())
+				{
+					std::cerr << "Error:Model::importModel, process node failed."<< std::endl;
+				}
+				return false;
+			}
+			this->progressMeshCount = (unsigned)meshData.size();
+		}
+
+		//Decode the new textures while the meshes are converted and their levels of detail and meshlets built, all on the job system.
+		JobSystem& jobs = JobSystem::instance();
+		std::vector<std::string> texturePaths;
+		std::vector<aiTextureType> textureTypes;
+		for (LoadedTextMapType::const_iterator it = this->loadedTextureMap.begin(); this->loadedTextureMap.end() != it; ++it)
+		{
+			if (it->second.id == 0)
+			{
+				texturePaths.push_back(it->first);
+				textureTypes.push_back(it->second.type);
+			}
+		}
+		std::vector<TextureHelper::DecodedImage> images(texturePaths.size());
+		std::vector<TextureHelper::CompressedImage> compressedImages(texturePaths.size());
+		std::vector<std::shared_ptr<MappedFile> > ddsFiles(texturePaths.size());
+		std::vector<std::string> ddsPaths(texturePaths.size());
+		std::vector<TextureKey> textureKeys(texturePaths.size());
+		std::vector<TextureRef> cachedTextures(texturePaths.size());
+		const bool compress = TextureCache::instance().isCompressionEnabled();
+		this->progressTextureCount = (unsigned)texturePaths.size();
+		JobCounter decoded;
+		for (size_t i = 0; i < texturePaths.size(); ++i)
+		{
+			jobs.run([this, &texturePaths, &textureTypes, &images, &compressedImages, &ddsFiles, &ddsPaths, &textureKeys, &cachedTextures, &embeddedImages, fileSystem, compress, i]()
+			{
+				if (this->cancelRequested.load())
+				{
+					return;
+				}
+				//Textures are decoded straight from their mapping, which was prefetched while the model was parsed, or from the model file for embedded images.
+				std::map<std::string, GltfLoader::BufferView>::const_iterator embedded = embeddedImages.find(texturePaths[i]);
+				std::shared_ptr<MappedFile> file;
+				const unsigned char* data = NULL;
+				size_t size = 0;
+				bool mapped = false;
+				if (embeddedImages.end() != embedded)
+				{
+					data = embedded->second.data;
+					size = embedded->second.size;
+				}
+				else if (fileSystem->map(texturePaths[i].c_str(), file, data, size))
+				{
+					mapped = true;
+					this->progressBytesTotal += size;
+				}
+
+				//Compressed normal maps keep only X and Y, so they're keyed apart from the same image used for colour. Compressed colour
+				//textures are BC1 or BC3 depending on their alpha, which is only known once they're decoded, so their key only says they're compressed.
+				const bool normalMap = textureTypes[i] == aiTextureType_HEIGHT;
+				const GLint internalFormat = compress ? (normalMap ? GL_COMPRESSED_RG_RGTC2 : GL_COMPRESSED_RGBA) : GL_RGB;
+				const int loadChannels = compress ? SOIL_LOAD_RGBA : SOIL_LOAD_RGB;
 
-			//If texture data was loaded successfully, set to texture.
-			if (it == this->loadedTextureMap.end())
+				//The source bytes are hashed first, so an image another model has already uploaded isn't decoded again.
+				//Files which can't be mapped are keyed by their path, with no size so they can't match an image's contents.
+				TextureCache& cache = TextureCache::instance();
+				if (data)
+				{
+					textureKeys[i] = TextureCache::makeKey(data, size, internalFormat, loadChannels);
+				}
+				else
+				{
+					textureKeys[i] = TextureCache::makeKey((const unsigned char*)texturePaths[i].data(), texturePaths[i].size(), internalFormat, loadChannels);
+					textureKeys[i].contentSize = 0;
+				}
+				cachedTextures[i] = cache.find(textureKeys[i]);
+				if (cachedTextures[i].isNull())
+				{
+					//A compressed texture an earlier run wrote to the DDS cache is read back instead of decoding and encoding the image again.
+					//Path keyed textures aren't cached on disk, as their key wouldn't change if the file was edited.
+					const bool diskCache = compress && textureKeys[i].contentSize != 0;
+					if (!diskCache || !mapCachedTexture(textureKeys[i], normalMap, ddsFiles[i], ddsPaths[i]))
+					{
+						decodeTexture(data, size, texturePaths[i], normalMap, loadChannels, compress, diskCache ? &textureKeys[i] : NULL, images[i], compressedImages[i]);
+					}
+				}
+				if (mapped)
+				{
+					this->progressBytesRead += size;
+				}
+				++this->progressTextures;
+			}, &decoded);
+		}
+		std::vector<char> valid(meshData.size(), 0);
+		jobs.parallelFor(0, meshData.size(), [this, &meshData, &valid](size_t i)
+		{
+			if (!this->cancelRequested.load())
 			{
-				GLuint textId = TextureHelper::load2DTexture(absolutePath.c_str());
-				text.id = textId;
-				text.path = absolutePath;
-				text.type = textureType;
-				textures.push_back(text);
-				loadedTextureMap[absolutePath] = text;
+				//Each mesh's temporary data is released as soon as it's processed, so the peak is the largest mesh's rather than every mesh's.
+				Arena meshScratch;
+				valid[i] = processMeshDetail(meshData[i], &meshScratch);
+				++this->progressMeshes;
+			}
+		});
+
+		//Every Assimp mesh has been converted, so the imported scene can go before the decoded textures and uploads add to the peak memory.
+		importer.FreeScene();
+		jobs.wait(decoded);
+
+		//Nothing has been uploaded yet, so a cancelled load only has the decoded pixels to free.
+		if (this->cancelRequested.load())
+		{
+			for (size_t i = 0; i < images.size(); ++i)
+			{
+				if (images[i].data) SOIL_free_image_data(images[i].data);
+			}
+			return false;
+		}
+
+		//OpenGL calls stay on this thread, which owns the current context. Textures the cache didn't have are added to it, unless another load added them first.
+		TextureCache& textureCache = TextureCache::instance();
+		for (size_t i = 0; i < texturePaths.size(); ++i)
+		{
+			Texture& text = this->loadedTextureMap[texturePaths[i]];
+			if (cachedTextures[i].isNull())
+			{
+				GLuint textureId = 0;
+				size_t bytes = 0;
+				if (ddsFiles[i])
+				{
+					textureId = TextureHelper::uploadDDS(ddsFiles[i]->getData(), ddsFiles[i]->getSize(), ddsPaths[i].c_str(), &bytes);
+					ddsFiles[i].reset();
+					if (textureId == 0)
+					{
+						//The file is removed and the source decoded and encoded again here, so the material still has its texture this run.
+						std::cerr << "Error::Model::importModel, removing unreadable cached texture " << ddsPaths[i] << " for " << texturePaths[i] << std::endl;
+						std::remove(ddsPaths[i].c_str());
+						std::map<std::string, GltfLoader::BufferView>::const_iterator embedded = embeddedImages.find(texturePaths[i]);
+						const bool isEmbedded = embeddedImages.end() != embedded;
+						decodeTexture(isEmbedded ? embedded->second.data : NULL, isEmbedded ? embedded->second.size : 0, texturePaths[i],
+							textureTypes[i] == aiTextureType_HEIGHT, SOIL_LOAD_RGBA, true, &textureKeys[i], images[i], compressedImages[i]);
+					}
+				}
+				if (textureId == 0 && !compressedImages[i].data.empty())
+				{
+					bytes = compressedImages[i].data.size();
+					textureId = TextureHelper::uploadCompressedImage(compressedImages[i]);
+					compressedImages[i] = TextureHelper::CompressedImage();
+				}
+				else if (textureId == 0)
+				{
+					bytes = TextureHelper::textureBytes(GL_RGB, images[i].width, images[i].height, 1, 0);
+					textureId = TextureHelper::uploadImage(images[i]);
+				}
+				text.handle = textureCache.insert(textureKeys[i], textureId, bytes, texturePaths[i]);
 			}
 			else
 			{
-				textures.push_back(it->second);
+				text.handle = std::move(cachedTextures[i]);
+			}
+			text.id = text.handle.getId();
+			this->textureBytes += textureCache.getBytes(text.handle.getKey());
+		}
+		//The meshes' data is moved into them rather than copied, and every upload happens here once the work on the job system is done.
+		std::map<int, GLuint> viewBuffers;
+		this->meshes.reserve(this->meshes.size() + meshData.size());
+		for (std::vector<MeshData>::iterator it = meshData.begin(); meshData.end() != it; ++it)
+		{
+			if (!valid[it - meshData.begin()])
+			{
+				continue;
+			}
+			for (std::vector<Texture>::iterator text = it->textures.begin(); it->textures.end() != text; ++text)
+			{
+				const Texture& loaded = this->loadedTextureMap[text->path];
+				text->id = loaded.id;
+				text->handle = loaded.handle;
+			}
+			VertexLayout layout = VertexLayout::interleaved();
+			if (!it->rawAttributes.empty())
+			{
+				this->uploadRawAttributes(*it, views, viewBuffers, layout);
 			}
+			this->meshes.push_back(Mesh());
+			Mesh& meshObj = this->meshes.back();
+			meshObj.setData(std::move(it->vertices), std::move(it->textures), std::move(it->indices), std::move(it->lods), std::move(it->meshlets), createVertexArrays, &layout);
+			this->bounds.expand(meshObj.getBounds());
 		}
 		return true;
-	};
+	}
+
 public:
 	//! Draws the model to a shader.
 	/**
@@ -231,6 +850,12 @@ public:
 	*/
 	void draw(const Shader& shader) const
 	{
+		//Models still loading are skipped.
+		if (this->loadState.load() != LOAD_READY)
+		{
+			return;
+		}
+
 		//Draw all set meshes.
 		for (std::vector<Mesh>::const_iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
 		{
@@ -238,51 +863,386 @@ public:
 		}
 	}
 
-	//! Loads the model from an external file.
+	//! Draws the meshes of the model which are inside a frustum.
+	/**
+	\param shader The shader to render the model to.
+	\param frustum The frustum to cull the meshes against, in world space.
+	\param transform The model's transformation into world space.
+	\param lodSelection The view used to pick each mesh's level of detail, or NULL to always draw full resolution.
+	\param meshletViewPosition Camera position (in world space) to cull full resolution meshes' meshlets from, or NULL to draw meshes whole.
+	\param occlusion Rasterised occluders to cull the meshes against, or NULL to skip occlusion culling.
+	*/
+	void draw(const Shader& shader, const Frustum& frustum, const glm::mat4& transform, const LodSelection* lodSelection = NULL, const glm::vec3* meshletViewPosition = NULL, const OcclusionBuffer* occlusion = NULL) const
+	{
+		if (this->loadState.load() != LOAD_READY)
+		{
+			return;
+		}
+		BoundingBox worldBounds = this->bounds.transformed(transform);
+		if (!frustum.intersects(worldBounds) || (occlusion && !occlusion->isVisible(worldBounds)))
+		{
+			return;
+		}
+		for (std::vector<Mesh>::const_iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
+		{
+			BoundingBox meshBounds = it->getBounds().transformed(transform);
+			if (!frustum.intersects(meshBounds) || (occlusion && !occlusion->isVisible(meshBounds)))
+			{
+				continue;
+			}
+
+			//Close meshes are drawn at full resolution, where culling their meshlets saves the most.
+			int lod = lodSelection ? it->selectLod(*lodSelection, transform) : 0;
+			if (lod == 0 && meshletViewPosition)
+			{
+				it->drawMeshlets(shader, frustum, transform, *meshletViewPosition);
+			}
+			else
+			{
+				it->draw(shader, lod);
+			}
+		}
+	}
+
+	//! Records the draws of the meshes inside a frustum into per-thread command lists, with the meshes culled and recorded in parallel on the job system. Makes no OpenGL calls.
+	/**
+	\param lists One command list per job system thread, picked by JobSystem::getThreadIndex. Resized if there are too few.
+	\param frustum The frustum to cull the meshes against, in world space.
+	\param transform The model's transformation into world space.
+	\param viewPosition Camera position in world space, which the draws are sorted front to back from.
+	\param lodSelection The view used to pick each mesh's level of detail, or NULL to always draw full resolution.
+	\param meshletCulling Whether full resolution meshes are culled per meshlet.
+	\param occlusion Rasterised occluders to cull the meshes against, or NULL to skip occlusion culling.
+	*/
+	void record(std::vector<CommandList>& lists, const Frustum& frustum, const glm::mat4& transform, const glm::vec3& viewPosition, const LodSelection* lodSelection = NULL, bool meshletCulling = false, const OcclusionBuffer* occlusion = NULL) const
+	{
+		if (this->loadState.load() != LOAD_READY)
+		{
+			return;
+		}
+		BoundingBox worldBounds = this->bounds.transformed(transform);
+		if (!frustum.intersects(worldBounds) || (occlusion && !occlusion->isVisible(worldBounds)))
+		{
+			return;
+		}
+		JobSystem& jobs = JobSystem::instance();
+		if (lists.size() < jobs.getThreadCount())
+		{
+			lists.resize(jobs.getThreadCount());
+		}
+
+		jobs.parallelFor(0, this->meshes.size(), [&](size_t i)
+		{
+			const Mesh& mesh = this->meshes[i];
+			BoundingBox meshBounds = mesh.getBounds().transformed(transform);
+			if (mesh.getVAOId() == 0 || !frustum.intersects(meshBounds) || (occlusion && !occlusion->isVisible(meshBounds)))
+			{
+				return;
+			}
+
+			//Close meshes are drawn at full resolution, where culling their meshlets saves the most.
+			std::vector<IndexRange> ranges;
+			int lod = lodSelection ? mesh.selectLod(*lodSelection, transform) : 0;
+			if (lod == 0 && meshletCulling)
+			{
+				mesh.cullMeshlets(frustum, transform, viewPosition, ranges);
+			}
+			else
+			{
+				IndexRange range = { mesh.getLods()[lod].indexOffset, mesh.getLods()[lod].indexCount };
+				ranges.push_back(range);
+			}
+
+			//Ranges are found before the list is touched, as meshlet culling may run other meshes' jobs on this thread while it waits.
+			GLuint64 sortKey = CommandList::makeSortKey(mesh.getMaterialId(), mesh.getVAOId(), glm::length(meshBounds.getCentre() - viewPosition));
+			lists[jobs.getThreadIndex()].addDraw(&mesh, transform, sortKey, ranges.empty() ? NULL : &ranges[0], ranges.size());
+		});
+	}
+
+	//! Draws the geometry of the meshes inside a frustum without their textures, for depth only passes.
+	/**
+	\param frustum The frustum to cull the meshes against, in world space.
+	\param transform The model's transformation into world space.
+	*/
+	void drawDepth(const Frustum& frustum, const glm::mat4& transform) const
+	{
+		if (this->loadState.load() != LOAD_READY)
+		{
+			return;
+		}
+		if (!frustum.intersects(this->bounds.transformed(transform)))
+		{
+			return;
+		}
+		for (std::vector<Mesh>::const_iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
+		{
+			if (frustum.intersects(it->getBounds().transformed(transform)))
+			{
+				it->drawDepth();
+			}
+		}
+	}
+
+	//! Adds the meshes inside a frustum to an occlusion buffer as occluders, using the coarsest level of detail which stays close to the full resolution surface.
+	/**
+	\param occlusion The occlusion buffer to add the occluders to.
+	\param frustum The frustum to cull the meshes against, in world space.
+	\param transform The model's transformation into world space.
+	*/
+	void addOccluders(OcclusionBuffer& occlusion, const Frustum& frustum, const glm::mat4& transform) const
+	{
+		if (this->loadState.load() != LOAD_READY)
+		{
+			return;
+		}
+		//Largest level of detail error allowed in an occluder, relative to the mesh's size, so simplified silhouettes barely overhang.
+		const float OCCLUDER_MAX_ERROR = 0.01f;
+		for (std::vector<Mesh>::const_iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
+		{
+			if (it->getIndices().empty() || !frustum.intersects(it->getBounds().transformed(transform)))
+			{
+				continue;
+			}
+			const std::vector<MeshLod>& lods = it->getLods();
+			size_t lod = lods.size() - 1;
+			while (lod > 0 && lods[lod].error > OCCLUDER_MAX_ERROR * glm::length(it->getBounds().getExtent()))
+			{
+				--lod;
+			}
+			occlusion.addOccluder(it->getVertices(), &it->getIndices()[lods[lod].indexOffset], lods[lod].indexCount, transform);
+		}
+	}
+
+	//! Loads the model from an external file on the calling thread, whose context must be current.
 	/**
 	\param filePath Directory to retrieve the model from.
 	*/
 	bool loadModel(const std::string& filePath)
 	{
-		Assimp::Importer importer;
-		if (filePath.empty())
+		this->resetProgress();
+		this->loadState = LOAD_PENDING;
+		bool loaded = this->importModel(filePath, true);
+		this->loadState = loaded ? LOAD_READY : (this->cancelRequested.load() ? LOAD_CANCELLED : LOAD_FAILED);
+		return loaded;
+	}
+
+	//! Loads the model from an external file on a loader thread, so rendering carries on meanwhile. The model is drawn once isReady finds its uploads finished.
+	/**
+	\param filePath Directory to retrieve the model from.
+	\param loader The loader thread, whose context shares objects with the drawing context.
+	\return Whether the model loaded, available once the loader has uploaded it.
+	*/
+	std::shared_future<bool> loadModelAsync(const std::string& filePath, ResourceLoader& loader)
+	{
+		if (this->loadState.load() == LOAD_PENDING || this->loadState.load() == LOAD_UPLOADED)
 		{
-			std::cerr << "Error:Model::loadModel, empty model file path." << std::endl;
-			return false;
+			std::cerr << "Error:Model::loadModelAsync, model is already loading." << std::endl;
+			return this->loadFuture;
 		}
-		const aiScene* sceneObjPtr = importer.ReadFile(filePath, 
-			aiProcess_Triangulate 
-			| aiProcess_FlipUVs 
-			| aiProcess_GenSmoothNormals
-			| aiProcess_CalcTangentSpace);
-		if (!sceneObjPtr
-			|| sceneObjPtr->mFlags == AI_SCENE_FLAGS_INCOMPLETE
-			|| !sceneObjPtr->mRootNode)
-		{
-			std::cerr << "Error:Model::loadModel, description: " 
-				<< importer.GetErrorString() << std::endl;
-			return false;
+		std::shared_ptr<std::promise<bool> > result = std::make_shared<std::promise<bool> >();
+		this->loadFuture = result->get_future().share();
+		this->resetProgress();
+		this->loadState = LOAD_PENDING;
+		bool queued = loader.enqueue([this, filePath, result]()
+		{
+			bool loaded = this->importModel(filePath, false);
+
+			//The fence tells the drawing context when the uploads are complete, so flush it to the GPU.
+			if (loaded)
+			{
+				this->uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				glFlush();
+			}
+			this->loadState = loaded ? LOAD_UPLOADED : (this->cancelRequested.load() ? LOAD_CANCELLED : LOAD_FAILED);
+			result->set_value(loaded);
+		});
+		if (!queued)
+		{
+			std::cerr << "Error:Model::loadModelAsync, the loader isn't running." << std::endl;
+			this->loadState = LOAD_FAILED;
+			result->set_value(false);
+		}
+		return this->loadFuture;
+	}
+
+	//! Returns whether the model can be drawn, finishing an asynchronous load once its uploads are complete. Must be called on the drawing context's thread.
+	bool isReady()
+	{
+		int state = this->loadState.load();
+		if (state != LOAD_UPLOADED)
+		{
+			return state == LOAD_READY;
 		}
-		this->modelFileDir = filePath.substr(0, filePath.find_last_of('/')); 
-		if (!this->processNode(sceneObjPtr->mRootNode, sceneObjPtr))
+		GLenum status = glClientWaitSync(this->uploadFence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
 		{
-			std::cerr << "Error:Model::loadModel, process node failed."<< std::endl;
 			return false;
 		}
+		glDeleteSync(this->uploadFence);
+		this->uploadFence = 0;
+
+		//Vertex arrays aren't shared between contexts, so they're made here from the uploaded buffers.
+		for (std::vector<Mesh>::iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
+		{
+			it->setupVertexArray();
+		}
+		this->loadState = LOAD_READY;
 		return true;
 	}
 
-	//! Deconstructor to remove all meshes.
+	//! Returns how far the model has got through loading.
+	LoadState getLoadState() const { return (LoadState)this->loadState.load(); }
+
+	//! Asks the current load to stop at its next check, after which its state becomes LOAD_CANCELLED. A load which has already uploaded isn't affected. Safe to call on any thread.
+	void cancelLoad() { this->cancelRequested = true; }
+
+	//! Returns how far the current or last load got. Safe to call on any thread.
+	LoadProgress getLoadProgress() const
+	{
+		LoadProgress progress;
+		progress.bytesRead = this->progressBytesRead.load();
+		progress.bytesTotal = this->progressBytesTotal.load();
+		progress.meshesProcessed = this->progressMeshes.load();
+		progress.meshCount = this->progressMeshCount.load();
+		progress.texturesDecoded = this->progressTextures.load();
+		progress.textureCount = this->progressTextureCount.load();
+		return progress;
+	}
+
+	//! Constructor
+	Model() : loadState(LOAD_EMPTY), uploadFence(0), textureBytes(0), sourceBufferBytes(0), cancelRequested(false), progressBytesRead(0), progressBytesTotal(0),
+		progressMeshes(0), progressMeshCount(0), progressTextures(0), progressTextureCount(0) {};
+
+	//! Move constructor, which takes over the other model's meshes and OpenGL objects.
+	Model(Model&& other) : loadState(LOAD_EMPTY), uploadFence(0), textureBytes(0), sourceBufferBytes(0), cancelRequested(false), progressBytesRead(0), progressBytesTotal(0),
+		progressMeshes(0), progressMeshCount(0), progressTextures(0), progressTextureCount(0)
+	{
+		*this = std::move(other);
+	}
+
+	//! Move assignment, which deletes this model's objects and takes over the other model's. An asynchronous load of either is waited for first, as it writes to its model.
+	Model& operator=(Model&& other)
+	{
+		if (this == &other)
+		{
+			return *this;
+		}
+		this->release();
+		if (other.loadFuture.valid())
+		{
+			other.loadFuture.wait();
+		}
+		this->meshes = std::move(other.meshes);
+		this->modelFileDir = std::move(other.modelFileDir);
+		this->loadedTextureMap = std::move(other.loadedTextureMap);
+		this->sourceBuffers = std::move(other.sourceBuffers);
+		this->loadFuture = std::move(other.loadFuture);
+		this->bounds = other.bounds;
+		this->loadState = other.loadState.load();
+		this->uploadFence = other.uploadFence;
+		this->textureBytes = other.textureBytes;
+		this->sourceBufferBytes = other.sourceBufferBytes;
+		this->cancelRequested = other.cancelRequested.load();
+		this->progressBytesRead = other.progressBytesRead.load();
+		this->progressBytesTotal = other.progressBytesTotal.load();
+		this->progressMeshes = other.progressMeshes.load();
+		this->progressMeshCount = other.progressMeshCount.load();
+		this->progressTextures = other.progressTextures.load();
+		this->progressTextureCount = other.progressTextureCount.load();
+
+		//The other model is left empty, so its deconstructor has nothing to delete.
+		other.meshes.clear();
+		other.loadedTextureMap.clear();
+		other.sourceBuffers.clear();
+		other.uploadFence = 0;
+		other.release();
+		return *this;
+	}
+
+	//! Deconstructor to remove all meshes. Waits for an asynchronous load to finish first.
 	~Model()
 	{
+		this->release();
+	}
+
+	//! Returns an estimate of the video memory the model's buffers and textures take, once it has been uploaded.
+	size_t getGpuMemoryUsage() const
+	{
+		size_t categoryBytes[GPU_MEMORY_CATEGORY_COUNT];
+		this->getGpuMemoryByCategory(categoryBytes);
+		size_t bytes = 0;
+		for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
+		{
+			bytes += categoryBytes[i];
+		}
+		return bytes;
+	}
+
+	//! Gets the TextureCache keys of the model's textures, each once. Other models may share them.
+	/**
+	\param keys Where to store the keys, in order.
+	*/
+	void getTextureKeys(std::vector<TextureKey>& keys) const
+	{
+		keys.clear();
+		for (std::vector<Mesh>::const_iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
+		{
+			for (std::vector<Texture>::const_iterator text = it->getTextures().begin(); it->getTextures().end() != text; ++text)
+			{
+				if (!text->handle.isNull())
+				{
+					keys.push_back(text->handle.getKey());
+				}
+			}
+		}
+		std::sort(keys.begin(), keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end(), [](const TextureKey& a, const TextureKey& b) { return !(a < b) && !(b < a); }), keys.end());
+	}
+
+	//! Gets an estimate of the video memory the model takes in each category, all 0 until it has been uploaded.
+	/**
+	\param categoryBytes Where to store the bytes, indexed by GpuMemoryCategory.
+	*/
+	void getGpuMemoryByCategory(size_t categoryBytes[GPU_MEMORY_CATEGORY_COUNT]) const
+	{
+		for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
+		{
+			categoryBytes[i] = 0;
+		}
+		int state = this->loadState.load();
+		if (state != LOAD_UPLOADED && state != LOAD_READY)
+		{
+			return;
+		}
+		categoryBytes[GPU_MEMORY_TEXTURE] = this->textureBytes;
+		categoryBytes[GPU_MEMORY_VERTEX] = this->sourceBufferBytes;
+		for (std::vector<Mesh>::const_iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
+		{
+			categoryBytes[GPU_MEMORY_VERTEX] += it->getVertexBufferBytes();
+			categoryBytes[GPU_MEMORY_INDEX] += it->getIndexBufferBytes();
+		}
+	}
+
+	//! Returns the system memory of the geometry the model keeps for culling and occluders, once it has been uploaded.
+	size_t getCpuMemoryUsage() const
+	{
+		int state = this->loadState.load();
+		if (state != LOAD_UPLOADED && state != LOAD_READY)
+		{
+			return 0;
+		}
+		size_t bytes = 0;
 		for (std::vector<Mesh>::const_iterator it = this->meshes.begin(); this->meshes.end() != it; ++it)
 		{
-			it->final();
+			bytes += it->getVertices().size() * sizeof(Vertex) + it->getIndices().size() * sizeof(GLuint) + it->getMeshlets().size() * sizeof(Meshlet);
 		}
+		return bytes;
 	}
 
 	//! Get function to retrieve the model's mesh[es].
 	const std::vector<Mesh>& getMeshes() const { return this->meshes; }
+	//! Get function to retrieve the bounding box of the whole model in model space.
+	const BoundingBox& getBounds() const { return this->bounds; }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,831 @@
+#ifndef _OBJLOADER_H_
+#define _OBJLOADER_H_
+/**
+\file objLoader.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include "mesh.h"
+#include "simd.h"
+#include "jobSystem.h"
+#include "mappedFileSystem.h"
+#include "arena.h"
+
+/**
+\class ObjLoader
+\brief A fast path for importing Wavefront OBJ files and their MTL material libraries straight into vertex and index arrays.
+
+The mapped file is split at line breaks into chunks which are parsed in parallel. The chunks' triangles are then grouped into one mesh per
+material, and each mesh's corners are deduplicated into vertices with an open addressing hash table, in parallel per mesh. The result matches what Assimp gives
+with triangulation, flipped UVs and smooth normals, and the tangents come from Mesh::generateTangents as they do for Assimp imports. Files using anything else (points, lines, free-form geometry
+or line continuations) are reported as unsupported so the caller can fall back to Assimp.
+*/
+class ObjLoader
+{
+public:
+	static const size_t MIN_CHUNK_BYTES = 256 * 1024; //!< Smallest part of a file parsed as one job.
+
+	/**
+	\struct ObjMaterial
+	\brief Texture maps of a material from an MTL file, as written in the file.
+	*/
+	struct ObjMaterial
+	{
+		std::string diffuseMap;		//!< map_Kd.
+		std::string specularMap;	//!< map_Ks.
+		std::string normalMap;		//!< map_Bump or bump, which Assimp also treats as a height map.
+	};
+
+	/**
+	\struct ObjMesh
+	\brief The triangles of an OBJ file which use one material.
+	*/
+	struct ObjMesh
+	{
+		std::string material;			//!< Name of the material, empty if the triangles come before any usemtl.
+		std::vector<Vertex> vertices;	//!< Deduplicated vertices.
+		std::vector<GLuint> indices;	//!< Three indices per triangle.
+	};
+
+private:
+	/**
+	\struct Corner
+	\brief A face corner's position, texture coordinate and normal indices as parsed, 0 if absent.
+
+	Positive indices are 1-based from the start of the file. Negative indices count back from the end of the chunk's data at the face,
+	so they're stored relative to the chunk (0-based) and flagged, to be resolved once the earlier chunks' counts are known.
+	*/
+	struct Corner
+	{
+		int index[3];			//!< Position, texture coordinate and normal indices.
+		unsigned char relative;	//!< Bit i is set if index i is relative to the chunk.
+	};
+
+	/**
+	\struct Chunk
+	\brief Everything parsed from one part of the file.
+	*/
+	struct Chunk
+	{
+		const char* begin;										//!< First byte of the chunk.
+		const char* end;										//!< One past the last byte of the chunk.
+		std::vector<glm::vec3> positions;						//!< v lines.
+		std::vector<glm::vec2> texCoords;						//!< vt lines.
+		std::vector<glm::vec3> normals;							//!< vn lines.
+		std::vector<Corner> corners;							//!< Three corners per triangle, with polygons fanned into triangles.
+		std::vector<std::pair<size_t, std::string> > materials;	//!< usemtl names, with the first triangle which uses them.
+		std::vector<std::string> libraries;						//!< mtllib names.
+		bool unsupported;										//!< Whether the chunk uses something the loader can't handle.
+	};
+
+	/**
+	\struct TriangleRun
+	\brief Consecutive triangles of a chunk which use the same material.
+	*/
+	struct TriangleRun
+	{
+		size_t chunk;	//!< Index of the chunk.
+		size_t first;	//!< First triangle of the run.
+		size_t end;		//!< One past the last triangle of the run.
+		size_t group;	//!< Index of the material's group.
+	};
+
+	/**
+	\struct CornerKey
+	\brief A resolved corner, 0-based, with ~0 for an absent texture coordinate or normal.
+	*/
+	struct CornerKey
+	{
+		GLuint position;	//!< Index of the position.
+		GLuint texCoord;	//!< Index of the texture coordinate.
+		GLuint normal;		//!< Index of the normal.
+
+		bool operator==(const CornerKey& other) const { return position == other.position && texCoord == other.texCoord && normal == other.normal; }
+	};
+
+	/**
+	\struct CornerHash
+	\brief Hashes a resolved corner's indices.
+	*/
+	struct CornerHash
+	{
+		size_t operator()(const CornerKey& key) const
+		{
+			//Mixed with a multiply so neighbouring indices spread across the table.
+			uint64_t hash = ((uint64_t)key.position * 73856093u) ^ ((uint64_t)key.texCoord * 19349663u) ^ ((uint64_t)key.normal * 83492791u);
+			return (size_t)((hash * 0x9e3779b97f4a7c15ull) >> 32);
+		}
+	};
+
+	//! Skips spaces and tabs.
+	static void skipSpaces(const char*& p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+		{
+			++p;
+		}
+	}
+
+	//! Returns the number of decimal digits starting at a position, checking 16 bytes at a time where SSE is available.
+	static size_t digitRun(const char* p, const char* end)
+	{
+		size_t run = 0;
+#if SHADERS_SIMD_SSE
+		while (end - p >= 16)
+		{
+			//A byte is a digit if subtracting '0' leaves it no more than 9 as an unsigned value.
+			__m128i offset = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi8('0'));
+			__m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
+			unsigned mask = (unsigned)_mm_movemask_epi8(isDigit);
+			if (mask != 0xffff)
+			{
+				unsigned notDigit = ~mask & 0xffff;
+				unsigned first = 0;
+				while (!(notDigit & (1u << first)))
+				{
+					++first;
+				}
+				return run + first;
+			}
+			p += 16;
+			run += 16;
+		}
+#endif
+		while (p < end && (unsigned)(*p - '0') < 10)
+		{
+			++p;
+			++run;
+		}
+		return run;
+	}
+
+	//! Accumulates a run of decimal digits into a mantissa, converting eight at a time with SWAR arithmetic where it's known to be little endian.
+	/**
+	\param p The first digit, moved past the run.
+	\param run Number of digits.
+	\param mantissa The value to accumulate into.
+	\param digits Significant digits accumulated so far, which stops at 19 so the mantissa can't overflow.
+	\return Number of digits which didn't fit in the mantissa.
+	*/
+	static int accumulateDigits(const char*& p, size_t run, uint64_t& mantissa, int& digits)
+	{
+		const char* end = p + run;
+		//Leading zeros aren't significant.
+		while (p < end && mantissa == 0 && *p == '0')
+		{
+			++p;
+		}
+#if SHADERS_SIMD_SSE
+		while (end - p >= 8 && digits + 8 <= 19)
+		{
+			uint64_t chunk;
+			std::memcpy(&chunk, p, sizeof(chunk));
+			chunk -= 0x3030303030303030ull;
+			chunk = (chunk * 10 + (chunk >> 8)) & 0x00ff00ff00ff00ffull;
+			chunk = (chunk * 100 + (chunk >> 16)) & 0x0000ffff0000ffffull;
+			chunk = (chunk * 10000 + (chunk >> 32)) & 0x00000000ffffffffull;
+			mantissa = mantissa * 100000000ull + chunk;
+			digits += 8;
+			p += 8;
+		}
+#endif
+		while (p < end && digits < 19)
+		{
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			digits += mantissa != 0;
+			++p;
+		}
+		int dropped = (int)(end - p);
+		p = end;
+		return dropped;
+	}
+
+	//! Parses a decimal float such as -0.982556 or 1.5e-3.
+	/**
+	\param p Where to start, moved past the number.
+	\param end End of the line.
+	\param value Where to store the number.
+	\return Whether a number was parsed.
+	*/
+	static bool parseFloat(const char*& p, const char* end, float& value)
+	{
+		static const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		skipSpaces(p, end);
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+		uint64_t mantissa = 0;
+		int digits = 0;
+		size_t integerRun = digitRun(p, end);
+		int exponent = accumulateDigits(p, integerRun, mantissa, digits);
+		size_t fractionRun = 0;
+		if (p < end && *p == '.')
+		{
+			++p;
+			fractionRun = digitRun(p, end);
+			const char* fractionStart = p;
+			int dropped = accumulateDigits(p, fractionRun, mantissa, digits);
+			exponent -= (int)(p - fractionStart) - dropped;
+		}
+		if (integerRun == 0 && fractionRun == 0)
+		{
+			return false;
+		}
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			++p;
+			bool negativeExponent = p < end && *p == '-';
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				++p;
+			}
+			int exponentValue = 0;
+			size_t exponentRun = digitRun(p, end);
+			if (exponentRun == 0)
+			{
+				return false;
+			}
+			for (size_t i = 0; i < exponentRun; ++i, ++p)
+			{
+				exponentValue = std::min(exponentValue * 10 + (*p - '0'), 1000);
+			}
+			exponent += negativeExponent ? -exponentValue : exponentValue;
+		}
+
+		//Both the mantissa and a power of ten up to 22 are exact as doubles, so one rounding gives a correctly rounded float in almost every case.
+		double result = (double)mantissa;
+		if (exponent < 0)
+		{
+			result = exponent >= -22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+		}
+		else if (exponent > 0)
+		{
+			result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+		}
+		value = (float)(negative ? -result : result);
+		return true;
+	}
+
+	//! Parses a face corner index, which may be negative.
+	static bool parseIndex(const char*& p, const char* end, int& value)
+	{
+		bool negative = p < end && *p == '-';
+		if (negative)
+		{
+			++p;
+		}
+		size_t run = digitRun(p, end);
+		if (run == 0 || run > 9)
+		{
+			return false;
+		}
+		value = 0;
+		for (size_t i = 0; i < run; ++i, ++p)
+		{
+			value = value * 10 + (*p - '0');
+		}
+		value = negative ? -value : value;
+		return value != 0;
+	}
+
+	//! Parses a face corner such as 1, 1/2, 1//3 or 1/2/3.
+	/**
+	\param p Where to start, moved past the corner.
+	\param end End of the line.
+	\param chunk The chunk being parsed, whose counts negative indices are relative to.
+	\param corner Where to store the corner.
+	\return Whether a corner was parsed.
+	*/
+	static bool parseCorner(const char*& p, const char* end, const Chunk& chunk, Corner& corner)
+	{
+		const int counts[3] = { (int)chunk.positions.size(), (int)chunk.texCoords.size(), (int)chunk.normals.size() };
+		corner.index[0] = corner.index[1] = corner.index[2] = 0;
+		corner.relative = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			if (i > 0)
+			{
+				//Later indices follow a '/', and the texture coordinate may be left out as in 1//3.
+				if (p >= end || *p != '/')
+				{
+					break;
+				}
+				++p;
+				if (p < end && *p == '/')
+				{
+					continue;
+				}
+			}
+			int value = 0;
+			if (!parseIndex(p, end, value))
+			{
+				return false;
+			}
+			if (value < 0)
+			{
+				corner.index[i] = counts[i] + value;
+				corner.relative |= 1 << i;
+			}
+			else
+			{
+				corner.index[i] = value;
+			}
+		}
+		return true;
+	}
+
+	//! Returns the rest of a line as a name, without surrounding spaces.
+	static std::string parseName(const char* p, const char* end)
+	{
+		skipSpaces(p, end);
+		while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		{
+			--end;
+		}
+		return std::string(p, end);
+	}
+
+	//! Returns whether a line starts with a keyword followed by a space.
+	static bool startsWith(const char* p, const char* end, const char* keyword, size_t length)
+	{
+		return (size_t)(end - p) > length && std::memcmp(p, keyword, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+	}
+
+	//! Parses a chunk of the file.
+	/**
+	\param chunk The chunk, whose begin and end are set.
+	*/
+	static void parseChunk(Chunk& chunk)
+	{
+		chunk.unsupported = false;
+		std::vector<Corner> polygon;
+		for (const char* p = chunk.begin; p < chunk.end && !chunk.unsupported;)
+		{
+			const char* lineEnd = (const char*)std::memchr(p, '\n', chunk.end - p);
+			if (!lineEnd)
+			{
+				lineEnd = chunk.end;
+			}
+			const char* next = lineEnd + 1;
+			while (lineEnd > p && (lineEnd[-1] == '\r' || lineEnd[-1] == ' ' || lineEnd[-1] == '\t'))
+			{
+				--lineEnd;
+			}
+			skipSpaces(p, lineEnd);
+			if (p == lineEnd || *p == '#')
+			{
+				p = next;
+				continue;
+			}
+			if (lineEnd[-1] == '\\')
+			{
+				chunk.unsupported = true;
+				break;
+			}
+
+			if (startsWith(p, lineEnd, "v", 1))
+			{
+				glm::vec3 position;
+				p += 1;
+				chunk.unsupported = !parseFloat(p, lineEnd, position.x) || !parseFloat(p, lineEnd, position.y) || !parseFloat(p, lineEnd, position.z);
+				chunk.positions.push_back(position);
+			}
+			else if (startsWith(p, lineEnd, "vt", 2))
+			{
+				//Only the first two of up to three components are used, with V flipped as aiProcess_FlipUVs does.
+				glm::vec2 texCoord;
+				p += 2;
+				chunk.unsupported = !parseFloat(p, lineEnd, texCoord.x);
+				texCoord.y = 0.0f;
+				skipSpaces(p, lineEnd);
+				if (p < lineEnd)
+				{
+					chunk.unsupported |= !parseFloat(p, lineEnd, texCoord.y);
+				}
+				texCoord.y = 1.0f - texCoord.y;
+				chunk.texCoords.push_back(texCoord);
+			}
+			else if (startsWith(p, lineEnd, "vn", 2))
+			{
+				glm::vec3 normal;
+				p += 2;
+				chunk.unsupported = !parseFloat(p, lineEnd, normal.x) || !parseFloat(p, lineEnd, normal.y) || !parseFloat(p, lineEnd, normal.z);
+				chunk.normals.push_back(normal);
+			}
+			else if (startsWith(p, lineEnd, "f", 1))
+			{
+				p += 1;
+				polygon.clear();
+				skipSpaces(p, lineEnd);
+				while (p < lineEnd)
+				{
+					Corner corner;
+					if (!parseCorner(p, lineEnd, chunk, corner))
+					{
+						chunk.unsupported = true;
+						break;
+					}
+					polygon.push_back(corner);
+					skipSpaces(p, lineEnd);
+				}
+				if (polygon.size() < 3)
+				{
+					chunk.unsupported = true;
+					break;
+				}
+				//Polygons are fanned into triangles from their first corner, as aiProcess_Triangulate does for convex polygons.
+				for (size_t i = 2; i < polygon.size(); ++i)
+				{
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[i - 1]);
+					chunk.corners.push_back(polygon[i]);
+				}
+			}
+			else if (startsWith(p, lineEnd, "usemtl", 6))
+			{
+				chunk.materials.push_back(std::make_pair(chunk.corners.size() / 3, parseName(p + 6, lineEnd)));
+			}
+			else if (startsWith(p, lineEnd, "mtllib", 6))
+			{
+				chunk.libraries.push_back(parseName(p + 6, lineEnd));
+			}
+			else if (startsWith(p, lineEnd, "l", 1) || startsWith(p, lineEnd, "p", 1) || startsWith(p, lineEnd, "curv", 4) || startsWith(p, lineEnd, "surf", 4)
+				|| startsWith(p, lineEnd, "cstype", 6) || startsWith(p, lineEnd, "vp", 2))
+			{
+				chunk.unsupported = true;
+			}
+			//Objects, groups, smoothing groups and anything else only affect how Assimp splits the meshes, so they're skipped.
+			p = next;
+		}
+	}
+
+	//! Returns whether a word is a number, such as a texture option's argument.
+	static bool isNumber(const char* p, const char* end)
+	{
+		if (p == end)
+		{
+			return false;
+		}
+		std::string word(p, end);
+		char* parsedEnd = NULL;
+		std::strtod(word.c_str(), &parsedEnd);
+		return parsedEnd == word.c_str() + word.size();
+	}
+
+	//! Parses a texture map statement's file name, which is the rest of the line after any options, so it may contain spaces.
+	/**
+	\param p Start of the statement's arguments, after its keyword.
+	\param end End of the line.
+	\return The file name.
+	*/
+	static std::string parseMapName(const char* p, const char* end)
+	{
+		skipSpaces(p, end);
+		while (p < end && *p == '-')
+		{
+			const char* option = p + 1;
+			while (p < end && *p != ' ' && *p != '\t') ++p;
+			const std::string name(option, p);
+
+			//-mm takes two values, -o, -s and -t one to three numbers, and every other option one value.
+			const bool numbers = name == "o" || name == "s" || name == "t";
+			int minArguments = name == "mm" ? 2 : 1, maxArguments = numbers ? 3 : minArguments;
+			for (int i = 0; i < maxArguments; ++i)
+			{
+				skipSpaces(p, end);
+				const char* word = p;
+				while (p < end && *p != ' ' && *p != '\t') ++p;
+				if (i >= minArguments && !isNumber(word, p))
+				{
+					p = word;
+					break;
+				}
+			}
+			skipSpaces(p, end);
+		}
+		return parseName(p, end);
+	}
+
+	//! Parses an MTL file's texture maps.
+	/**
+	\param path The MTL file.
+	\param fileSystem File system the file is mapped through.
+	\param materials Where to add the materials by name.
+	\return Whether the file was found.
+	*/
+	static bool parseMaterials(const std::string& path, MappedIOSystem& fileSystem, std::map<std::string, ObjMaterial>& materials)
+	{
+		std::shared_ptr<MappedFile> file;
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		if (!fileSystem.map(path.c_str(), file, data, size))
+		{
+			return false;
+		}
+		const char* text = (const char*)data;
+		ObjMaterial* material = NULL;
+		for (const char* p = text; p < text + size;)
+		{
+			const char* lineEnd = (const char*)std::memchr(p, '\n', text + size - p);
+			if (!lineEnd)
+			{
+				lineEnd = text + size;
+			}
+			const char* next = lineEnd + 1;
+			skipSpaces(p, lineEnd);
+			if (startsWith(p, lineEnd, "newmtl", 6))
+			{
+				material = &materials[parseName(p + 6, lineEnd)];
+			}
+			else if (material)
+			{
+				std::string* map = NULL;
+				size_t keywordLength = 0;
+				if (startsWith(p, lineEnd, "map_Kd", 6)) { map = &material->diffuseMap; keywordLength = 6; }
+				else if (startsWith(p, lineEnd, "map_Ks", 6)) { map = &material->specularMap; keywordLength = 6; }
+				else if (startsWith(p, lineEnd, "map_Bump", 8) || startsWith(p, lineEnd, "map_bump", 8)) { map = &material->normalMap; keywordLength = 8; }
+				else if (startsWith(p, lineEnd, "bump", 4)) { map = &material->normalMap; keywordLength = 4; }
+				if (map)
+				{
+					*map = parseMapName(p + keywordLength, lineEnd);
+				}
+			}
+			p = next;
+		}
+		return true;
+	}
+
+	//! Builds one material's mesh by deduplicating its corners into vertices, then generates its tangents.
+	/**
+	\param corners The mesh's resolved corners, three per triangle.
+	\param positions Every position in the file.
+	\param texCoords Every texture coordinate in the file.
+	\param normals Every normal in the file.
+	\param smoothNormals Normals averaged from the faces around each position, for corners without one.
+	\param scratch Arena for the hash table, or NULL for the heap.
+	\param mesh Where to store the vertices and indices.
+	*/
+	static void buildMesh(Span<const CornerKey> corners, Span<const glm::vec3> positions, Span<const glm::vec2> texCoords,
+		Span<const glm::vec3> normals, Span<const glm::vec3> smoothNormals, Arena* scratch, ObjMesh& mesh)
+	{
+		//Open addressing with linear probing, sized to at most half full, keeps the lookups in a flat array.
+		size_t tableSize = 16;
+		while (tableSize < corners.size() * 2)
+		{
+			tableSize *= 2;
+		}
+		const ArenaAllocator<GLuint> allocator(scratch);
+		ScratchVector<GLuint> table(tableSize, ~0u, allocator);
+		mesh.indices.resize(corners.size());
+		mesh.vertices.reserve(corners.size() / 2);
+		ScratchVector<CornerKey> vertexKeys(allocator);
+		vertexKeys.reserve(corners.size() / 2);
+		for (size_t i = 0; i < corners.size(); ++i)
+		{
+			const CornerKey& key = corners[i];
+			size_t slot = CornerHash()(key) & (tableSize - 1);
+			while (table[slot] != ~0u && !(vertexKeys[table[slot]] == key))
+			{
+				slot = (slot + 1) & (tableSize - 1);
+			}
+			if (table[slot] == ~0u)
+			{
+				table[slot] = (GLuint)mesh.vertices.size();
+				vertexKeys.push_back(key);
+				Vertex vertex;
+				vertex.position = positions[key.position];
+				vertex.texCoords = key.texCoord != ~0u ? texCoords[key.texCoord] : glm::vec2(0.0f);
+				vertex.normal = key.normal != ~0u ? normals[key.normal] : smoothNormals[key.position];
+				vertex.tangent = glm::vec4(0.0f);
+				mesh.vertices.push_back(vertex);
+			}
+			mesh.indices[i] = table[slot];
+		}
+
+		Mesh::generateTangents(mesh.vertices, mesh.indices, scratch);
+	}
+
+public:
+	//! Loads an OBJ file and its material libraries.
+	/**
+	\param path The OBJ file.
+	\param fileSystem File system the files are mapped through, so mounted archives and prefetching apply.
+	\param meshes Where to store one mesh per material.
+	\param materials Where to store the materials the meshes use, by name.
+	\param cancelled Set to stop loading, or NULL.
+	\param bytesRead Counter the bytes parsed are added to, or NULL.
+	\param bytesTotal Counter the file's size is added to, or NULL.
+	\param scratch Arena for the data which is only needed while loading, or NULL for the heap.
+	\return Whether the file was loaded. It isn't if the file is missing, invalid or uses something unsupported, in which case Assimp should be tried.
+	*/
+	static bool load(const std::string& path, MappedIOSystem& fileSystem, std::vector<ObjMesh>& meshes, std::map<std::string, ObjMaterial>& materials,
+		const std::atomic<bool>* cancelled = NULL, std::atomic<size_t>* bytesRead = NULL, std::atomic<size_t>* bytesTotal = NULL, Arena* scratch = NULL)
+	{
+		std::shared_ptr<MappedFile> file;
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		if (!fileSystem.map(path.c_str(), file, data, size) || size == 0)
+		{
+			return false;
+		}
+		if (bytesTotal) *bytesTotal += size;
+
+		//Split the file at line breaks into chunks, one job each.
+		JobSystem& jobs = JobSystem::instance();
+		const char* text = (const char*)data;
+		size_t chunkCount = std::max((size_t)1, std::min(size / MIN_CHUNK_BYTES, (size_t)jobs.getThreadCount() * 4));
+		std::vector<Chunk> chunks(chunkCount);
+		const char* chunkStart = text;
+		for (size_t i = 0; i < chunkCount; ++i)
+		{
+			const char* chunkEnd = text + size;
+			if (i + 1 < chunkCount)
+			{
+				chunkEnd = std::max(chunkStart, text + size * (i + 1) / chunkCount);
+				const char* lineBreak = (const char*)std::memchr(chunkEnd, '\n', text + size - chunkEnd);
+				chunkEnd = lineBreak ? lineBreak + 1 : text + size;
+			}
+			chunks[i].begin = chunkStart;
+			chunks[i].end = chunkEnd;
+			chunkStart = chunkEnd;
+		}
+		jobs.parallelFor(0, chunks.size(), [&chunks, cancelled, bytesRead](size_t i)
+		{
+			if (cancelled && cancelled->load())
+			{
+				chunks[i].unsupported = true;
+				return;
+			}
+			parseChunk(chunks[i]);
+			if (bytesRead) *bytesRead += chunks[i].end - chunks[i].begin;
+		});
+
+		//Count what the earlier chunks hold, so indices can be resolved and the vertex data gathered into arrays sized up front.
+		std::vector<int> bases(chunks.size() * 3);
+		size_t totals[3] = { 0, 0, 0 };
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			if (chunks[i].unsupported)
+			{
+				return false;
+			}
+			bases[i * 3] = (int)totals[0];
+			bases[i * 3 + 1] = (int)totals[1];
+			bases[i * 3 + 2] = (int)totals[2];
+			totals[0] += chunks[i].positions.size();
+			totals[1] += chunks[i].texCoords.size();
+			totals[2] += chunks[i].normals.size();
+		}
+		const ArenaAllocator<char> allocator(scratch);
+		ScratchVector<glm::vec3> positions(allocator), normals(allocator);
+		ScratchVector<glm::vec2> texCoords(allocator);
+		positions.reserve(totals[0]);
+		texCoords.reserve(totals[1]);
+		normals.reserve(totals[2]);
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			//Each chunk's arrays are freed as soon as they're gathered, so the data is only held twice for one chunk at a time.
+			positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+			texCoords.insert(texCoords.end(), chunks[i].texCoords.begin(), chunks[i].texCoords.end());
+			normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+			std::vector<glm::vec3>().swap(chunks[i].positions);
+			std::vector<glm::vec2>().swap(chunks[i].texCoords);
+			std::vector<glm::vec3>().swap(chunks[i].normals);
+		}
+		const int counts[3] = { (int)positions.size(), (int)texCoords.size(), (int)normals.size() };
+
+		//Sort the triangles into one group per material, in the order materials are first used, as runs of consecutive triangles.
+		std::map<std::string, size_t> groupOf;
+		std::vector<size_t> groupSizes;
+		std::vector<TriangleRun> runs;
+		std::vector<std::string> libraries;
+		std::string material;
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			const Chunk& chunk = chunks[i];
+			libraries.insert(libraries.end(), chunk.libraries.begin(), chunk.libraries.end());
+			size_t nextMaterial = 0;
+			const size_t triangleCount = chunk.corners.size() / 3;
+			for (size_t triangle = 0; triangle < triangleCount;)
+			{
+				while (nextMaterial < chunk.materials.size() && chunk.materials[nextMaterial].first == triangle)
+				{
+					material = chunk.materials[nextMaterial++].second;
+				}
+				std::map<std::string, size_t>::iterator it = groupOf.find(material);
+				if (groupOf.end() == it)
+				{
+					it = groupOf.insert(std::make_pair(material, groupSizes.size())).first;
+					groupSizes.push_back(0);
+					meshes.push_back(ObjMesh());
+					meshes.back().material = material;
+				}
+				TriangleRun run = { i, triangle, nextMaterial < chunk.materials.size() ? chunk.materials[nextMaterial].first : triangleCount, it->second };
+				groupSizes[run.group] += (run.end - run.first) * 3;
+				runs.push_back(run);
+				triangle = run.end;
+			}
+			while (nextMaterial < chunk.materials.size())
+			{
+				material = chunk.materials[nextMaterial++].second;
+			}
+		}
+
+		//Resolve every corner into its group, each sized up front so no scratch memory is wasted on growing them.
+		std::vector<ScratchVector<CornerKey> > groups(groupSizes.size(), ScratchVector<CornerKey>(allocator));
+		for (size_t i = 0; i < groups.size(); ++i)
+		{
+			groups[i].reserve(groupSizes[i]);
+		}
+		bool needsSmoothNormals = false;
+		for (std::vector<TriangleRun>::const_iterator run = runs.begin(); runs.end() != run; ++run)
+		{
+			const Chunk& chunk = chunks[run->chunk];
+			ScratchVector<CornerKey>& group = groups[run->group];
+			for (size_t c = run->first * 3; c < run->end * 3; ++c)
+			{
+				const Corner& corner = chunk.corners[c];
+				GLuint resolved[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					int index = (corner.relative & (1 << k)) ? bases[run->chunk * 3 + k] + corner.index[k] : corner.index[k] - 1;
+					if (k > 0 && corner.index[k] == 0 && !(corner.relative & (1 << k)))
+					{
+						resolved[k] = ~0u;
+						continue;
+					}
+					if (index < 0 || index >= counts[k])
+					{
+						meshes.clear();
+						return false;
+					}
+					resolved[k] = (GLuint)index;
+				}
+				needsSmoothNormals |= resolved[2] == ~0u;
+				CornerKey key = { resolved[0], resolved[1], resolved[2] };
+				group.push_back(key);
+			}
+		}
+		std::vector<Chunk>().swap(chunks);
+		if (groups.empty())
+		{
+			return false;
+		}
+
+		//Corners without normals get the area weighted average of the normals of the faces around their position, as aiProcess_GenSmoothNormals gives.
+		ScratchVector<glm::vec3> smoothNormals(allocator);
+		if (needsSmoothNormals)
+		{
+			smoothNormals.assign(positions.size(), glm::vec3(0.0f));
+			for (std::vector<ScratchVector<CornerKey> >::const_iterator group = groups.begin(); groups.end() != group; ++group)
+			{
+				for (size_t c = 0; c + 2 < group->size(); c += 3)
+				{
+					const GLuint a = (*group)[c].position, b = (*group)[c + 1].position, d = (*group)[c + 2].position;
+					glm::vec3 faceNormal = glm::cross(positions[b] - positions[a], positions[d] - positions[a]);
+					smoothNormals[a] += faceNormal;
+					smoothNormals[b] += faceNormal;
+					smoothNormals[d] += faceNormal;
+				}
+			}
+			for (ScratchVector<glm::vec3>::iterator it = smoothNormals.begin(); smoothNormals.end() != it; ++it)
+			{
+				*it = glm::dot(*it, *it) > 0.0f ? glm::normalize(*it) : glm::vec3(0.0f, 1.0f, 0.0f);
+			}
+		}
+
+		jobs.parallelFor(0, groups.size(), [&](size_t i)
+		{
+			//Each mesh's hash table and tangent sums are released once it's built, rather than held until the load ends.
+			Arena meshScratch;
+			buildMesh(groups[i], positions, texCoords, normals, smoothNormals, scratch ? &meshScratch : NULL, meshes[i]);
+		});
+
+		//Material libraries are relative to the OBJ file.
+		const size_t slash = path.find_last_of("/\\");
+		const std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+		for (std::vector<std::string>::const_iterator it = libraries.begin(); libraries.end() != it; ++it)
+		{
+			if (!parseMaterials(directory + *it, fileSystem, materials))
+			{
+				std::cerr << "Error::ObjLoader::load, could not read material library: " << directory + *it << std::endl;
+			}
+		}
+		return !(cancelled && cancelled->load());
+	}
+};
+
+#endif
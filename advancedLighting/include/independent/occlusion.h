@@ -0,0 +1,334 @@
+#ifndef _OCCLUSION_H_
+#define _OCCLUSION_H_
+/**
+\file occlusion.h
+*/
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "simd.h"
+#include "frustum.h"
+#include "jobSystem.h"
+
+/**
+\class OcclusionBuffer
+\brief A low resolution depth buffer which occluder triangles are software rasterised into on the CPU, with an 8x8 block hierarchy for quickly testing bounding boxes against it. Horizontal bands of the buffer are rasterised in parallel on the job system. Needs no OpenGL, so it can be used without a GPU.
+
+Depths are stored as one over the clip space w, which is linear in screen space: larger values are nearer and zero is infinitely far away.
+*/
+class OcclusionBuffer
+{
+public:
+	static const int BLOCK_SIZE = 8; //!< Width and height of the blocks the hierarchy stores the furthest depth of.
+	static const size_t MIN_BLOCK_ROWS_PER_JOB = 2; //!< Fewest block rows in a band handed to another thread.
+
+private:
+	/**
+	\struct ScreenTriangle
+	\brief An occluder triangle after projection: screen space x and y, and one over w.
+	*/
+	struct ScreenTriangle
+	{
+		glm::vec3 corners[3]; //!< Pixel x, pixel y and one over w of each corner.
+	};
+
+	int m_width;						//!< Width of the buffer in pixels (a multiple of the block size).
+	int m_height;						//!< Height of the buffer in pixels (a multiple of the block size).
+	std::vector<float> m_depth;			//!< Nearest occluder depth of each pixel.
+	std::vector<float> m_blockDepth;	//!< Furthest depth of each block of pixels.
+	std::vector<ScreenTriangle> m_triangles; //!< Occluder triangles waiting to be rasterised.
+	glm::mat4 m_viewProjection;			//!< View-projection the occluders and boxes are projected with.
+
+	//! Projects a clip space point to pixel x, pixel y and one over w.
+	glm::vec3 toScreen(const glm::vec4& clip) const
+	{
+		float invW = 1.0f / clip.w;
+		return glm::vec3((clip.x * invW * 0.5f + 0.5f) * m_width, (clip.y * invW * 0.5f + 0.5f) * m_height, invW);
+	}
+
+	//! Rasterises every occluder triangle into a band of rows, then updates the band's blocks.
+	/**
+	\param firstRow First row of the band (a multiple of the block size).
+	\param endRow Row after the band's last row.
+	*/
+	void rasteriseBand(int firstRow, int endRow)
+	{
+		for (std::vector<ScreenTriangle>::const_iterator it = m_triangles.begin(); m_triangles.end() != it; ++it)
+		{
+			glm::vec3 a = it->corners[0], b = it->corners[1], c = it->corners[2];
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (std::abs(area) < 1e-6f)
+			{
+				continue;
+			}
+			if (area < 0.0f)
+			{
+				std::swap(b, c); //Occluders are rasterised two sided, so wind every triangle the same way.
+				area = -area;
+			}
+
+			int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+			int maxX = std::min(m_width - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+			int minY = std::max(firstRow, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+			int maxY = std::min(endRow - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+			if (minX > maxX || minY > maxY)
+			{
+				continue;
+			}
+
+			//Edge functions (x * A + y * B + C), positive inside, and the depth plane.
+			const glm::vec3 corners[3] = { a, b, c };
+			float edgeA[3], edgeB[3], edgeC[3];
+			for (int e = 0; e < 3; ++e)
+			{
+				const glm::vec3& from = corners[e];
+				const glm::vec3& to = corners[(e + 1) % 3];
+				edgeA[e] = from.y - to.y;
+				edgeB[e] = to.x - from.x;
+				edgeC[e] = from.x * to.y - from.y * to.x;
+			}
+			float depthA = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+			float depthB = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+			float depthC = a.z - depthA * a.x - depthB * a.y;
+
+			minX &= ~3; //Four pixels are rasterised at a time.
+			for (int y = minY; y <= maxY; ++y)
+			{
+				float* row = &m_depth[y * m_width];
+				float py = y + 0.5f;
+#if SHADERS_SIMD_SSE
+				const __m128 steps = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+				const __m128 zero = _mm_setzero_ps();
+				__m128 rowEdge[3], stepEdge[3];
+				for (int e = 0; e < 3; ++e)
+				{
+					rowEdge[e] = _mm_set1_ps(edgeB[e] * py + edgeC[e]);
+					stepEdge[e] = _mm_set1_ps(edgeA[e]);
+				}
+				const __m128 rowDepth = _mm_set1_ps(depthB * py + depthC);
+				const __m128 stepDepth = _mm_set1_ps(depthA);
+				for (int x = minX; x <= maxX; x += 4)
+				{
+					__m128 px = _mm_add_ps(_mm_set1_ps((float)x), steps);
+					__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[0], px), rowEdge[0]), zero);
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[1], px), rowEdge[1]), zero));
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(stepEdge[2], px), rowEdge[2]), zero));
+					if (_mm_movemask_ps(inside) == 0)
+					{
+						continue;
+					}
+					__m128 depth = _mm_add_ps(_mm_mul_ps(stepDepth, px), rowDepth);
+					__m128 old = _mm_loadu_ps(&row[x]);
+					__m128 nearest = _mm_max_ps(old, depth);
+					_mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+				}
+#else
+				for (int x = minX; x <= maxX; ++x)
+				{
+					float px = x + 0.5f;
+					if (edgeA[0] * px + edgeB[0] * py + edgeC[0] >= 0.0f && edgeA[1] * px + edgeB[1] * py + edgeC[1] >= 0.0f && edgeA[2] * px + edgeB[2] * py + edgeC[2] >= 0.0f)
+					{
+						row[x] = std::max(row[x], depthA * px + depthB * py + depthC);
+					}
+				}
+#endif
+			}
+		}
+
+		//Each block stores the furthest depth of its pixels.
+		const int blocksX = m_width / BLOCK_SIZE;
+		for (int blockY = firstRow / BLOCK_SIZE; blockY < endRow / BLOCK_SIZE; ++blockY)
+		{
+			for (int blockX = 0; blockX < blocksX; ++blockX)
+			{
+				float furthest = m_depth[blockY * BLOCK_SIZE * m_width + blockX * BLOCK_SIZE];
+				for (int y = 0; y < BLOCK_SIZE; ++y)
+				{
+					const float* row = &m_depth[(blockY * BLOCK_SIZE + y) * m_width + blockX * BLOCK_SIZE];
+					for (int x = 0; x < BLOCK_SIZE; ++x) furthest = std::min(furthest, row[x]);
+				}
+				m_blockDepth[blockY * blocksX + blockX] = furthest;
+			}
+		}
+	}
+
+public:
+	//! Default constructor. The buffer is allocated by setup.
+	OcclusionBuffer() : m_width(0), m_height(0) {};
+
+	//! Allocates the buffer.
+	/**
+	\param width Width in pixels, rounded up to a multiple of the block size.
+	\param height Height in pixels, rounded up to a multiple of the block size.
+	*/
+	void setup(int width = 256, int height = 192)
+	{
+		m_width = (width + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+		m_height = (height + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+		m_depth.assign(m_width * m_height, 0.0f);
+		m_blockDepth.assign((m_width / BLOCK_SIZE) * (m_height / BLOCK_SIZE), 0.0f);
+	}
+
+	//! Starts a new frame: clears the buffer and the occluders, and sets the view they are projected with.
+	/**
+	\param viewProjection The camera's combined projection and view matrix.
+	*/
+	void beginFrame(const glm::mat4& viewProjection)
+	{
+		m_viewProjection = viewProjection;
+		m_triangles.clear();
+		std::fill(m_depth.begin(), m_depth.end(), 0.0f);
+		std::fill(m_blockDepth.begin(), m_blockDepth.end(), 0.0f);
+	}
+
+	//! Projects occluder triangles and queues them for rasterisation. Triangles crossing the near plane are clipped.
+	/**
+	\param vertices The occluder's vertices.
+	\param indices The occluder's triangle indices.
+	\param indexCount Number of indices.
+	\param transform The occluder's transformation into world space.
+	*/
+	template <typename VertexType>
+	void addOccluder(const std::vector<VertexType>& vertices, const unsigned int* indices, size_t indexCount, const glm::mat4& transform)
+	{
+		const glm::mat4 toClip = m_viewProjection * transform;
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			glm::vec4 clip[3];
+			int behind = 0;
+			for (int c = 0; c < 3; ++c)
+			{
+				clip[c] = toClip * glm::vec4(vertices[indices[i + c]].position, 1.0f);
+				behind += clip[c].z < -clip[c].w;
+			}
+			if (behind == 3)
+			{
+				continue;
+			}
+			if (behind == 0)
+			{
+				ScreenTriangle triangle = { { toScreen(clip[0]), toScreen(clip[1]), toScreen(clip[2]) } };
+				m_triangles.push_back(triangle);
+				continue;
+			}
+
+			//Clip against the near plane (z = -w), which leaves a triangle or a quad.
+			glm::vec4 polygon[4];
+			int count = 0;
+			for (int c = 0; c < 3; ++c)
+			{
+				const glm::vec4& from = clip[c];
+				const glm::vec4& to = clip[(c + 1) % 3];
+				float fromDistance = from.z + from.w, toDistance = to.z + to.w;
+				if (fromDistance >= 0.0f) polygon[count++] = from;
+				if ((fromDistance >= 0.0f) != (toDistance >= 0.0f))
+				{
+					polygon[count++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+				}
+			}
+			for (int c = 2; c < count; ++c)
+			{
+				ScreenTriangle triangle = { { toScreen(polygon[0]), toScreen(polygon[c - 1]), toScreen(polygon[c]) } };
+				m_triangles.push_back(triangle);
+			}
+		}
+	}
+
+	//! Rasterises the queued occluders, with horizontal bands of the buffer spread across the job system.
+	void rasterise()
+	{
+		const int blockRows = std::max(1, m_height / BLOCK_SIZE);
+
+		//Bands share no pixels or blocks, so they need no synchronisation. Every band walks every triangle, so they're kept a few block rows tall.
+		JobSystem::instance().parallelForRange(0, (size_t)blockRows, [this, blockRows](size_t first, size_t last)
+		{
+			rasteriseBand((int)first * BLOCK_SIZE, (int)last == blockRows ? m_height : (int)last * BLOCK_SIZE);
+		}, MIN_BLOCK_ROWS_PER_JOB);
+	}
+
+	//! Returns whether any part of a world space box might be in front of the occluders.
+	/**
+	\param box The box to test.
+	*/
+	bool isVisible(const BoundingBox& box) const
+	{
+		if (box.isEmpty())
+		{
+			return false;
+		}
+
+		//Screen space rectangle and nearest depth of the box's corners.
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = 0.0f;
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+			glm::vec4 clip = m_viewProjection * glm::vec4(point, 1.0f);
+			if (clip.z < -clip.w)
+			{
+				return true; //Crosses the near plane, so is too close to be occluded.
+			}
+			glm::vec3 screen = toScreen(clip);
+			minX = std::min(minX, screen.x);
+			maxX = std::max(maxX, screen.x);
+			minY = std::min(minY, screen.y);
+			maxY = std::max(maxY, screen.y);
+			nearest = std::max(nearest, screen.z);
+		}
+		int x0 = std::max(0, (int)std::floor(minX)), x1 = std::min(m_width - 1, (int)std::ceil(maxX));
+		int y0 = std::max(0, (int)std::floor(minY)), y1 = std::min(m_height - 1, (int)std::ceil(maxY));
+		if (x0 > x1 || y0 > y1)
+		{
+			return false; //Off screen.
+		}
+
+		//The box is hidden if it's behind the furthest depth of every block it touches.
+		const int blocksX = m_width / BLOCK_SIZE;
+		bool hiddenByBlocks = true;
+		for (int blockY = y0 / BLOCK_SIZE; blockY <= y1 / BLOCK_SIZE && hiddenByBlocks; ++blockY)
+		{
+			for (int blockX = x0 / BLOCK_SIZE; blockX <= x1 / BLOCK_SIZE && hiddenByBlocks; ++blockX)
+			{
+				hiddenByBlocks = nearest < m_blockDepth[blockY * blocksX + blockX];
+			}
+		}
+		if (hiddenByBlocks)
+		{
+			return false;
+		}
+
+		//Otherwise test the pixels the box covers.
+		for (int y = y0; y <= y1; ++y)
+		{
+			const float* row = &m_depth[y * m_width];
+			int x = x0;
+#if SHADERS_SIMD_SSE
+			const __m128 boxDepth = _mm_set1_ps(nearest);
+			for (; x + 3 <= x1; x += 4)
+			{
+				if (_mm_movemask_ps(_mm_cmpge_ps(boxDepth, _mm_loadu_ps(&row[x]))) != 0)
+				{
+					return true;
+				}
+			}
+#endif
+			for (; x <= x1; ++x)
+			{
+				if (nearest >= row[x])
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	//! Returns the width of the buffer in pixels.
+	int getWidth() const { return m_width; }
+	//! Returns the height of the buffer in pixels.
+	int getHeight() const { return m_height; }
+	//! Returns the nearest occluder depth (one over w) of a pixel, zero where there is none.
+	float getDepth(int x, int y) const { return m_depth[y * m_width + x]; }
+};
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef _POINTSHADOW_H_
+#define _POINTSHADOW_H_
+/**
+\file pointShadow.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <sstream>
+#include "shadow.h"
+#include "frustum.h"
+#include "texture.h"
+
+/**
+\class PointShadowMap
+\brief Omnidirectional shadows of a point light, rendered into a depth cube map in a single layered pass. A geometry shader routes each triangle to the cube faces its mesh was found to touch on the CPU.
+*/
+class PointShadowMap
+{
+public:
+	static const GLint TEXTURE_UNIT = 12; //!< Texture unit the shadow cube map is bound to.
+
+private:
+	const float NEAR_PLANE = 0.05f; //!< Near plane of each face's projection.
+
+	GpuTexture m_cubeMap;			//!< Depth cube map storing the distance to the nearest caster in each direction.
+	GpuFramebuffer m_fbo;			//!< Frame buffer with the whole cube map attached as a layered target.
+	GLsizei m_resolution;			//!< Width and height of each face.
+	float m_farPlane;				//!< Range of the light, which depths are divided by.
+	glm::vec3 m_lightPosition;		//!< Position the cube map was last rendered from.
+	glm::mat4 m_faceMatrices[6];	//!< View-projection of each cube face.
+	Frustum m_faceFrustums[6];		//!< Culling frustum of each cube face.
+	unsigned int m_casterRevision;	//!< Incremented whenever the static casters change.
+	unsigned int m_renderedRevision; //!< Static caster revision the cube map was rendered with.
+	bool m_valid;					//!< Whether the cube map's contents can be reused.
+
+	//! Rebuilds the face matrices and frustums around the light's position.
+	void updateFaces()
+	{
+		//Standard cube map face orientations (+X, -X, +Y, -Y, +Z, -Z).
+		const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+		const glm::vec3 ups[6] = { glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0) };
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, NEAR_PLANE, m_farPlane);
+		for (int face = 0; face < 6; ++face)
+		{
+			m_faceMatrices[face] = projection * glm::lookAt(m_lightPosition, m_lightPosition + directions[face], ups[face]);
+			m_faceFrustums[face] = Frustum(m_faceMatrices[face]);
+		}
+	}
+
+public:
+	//! Default constructor. The cube map is created by setup.
+	PointShadowMap() : m_resolution(0), m_farPlane(25.0f), m_lightPosition(0.0f), m_casterRevision(0), m_renderedRevision(0), m_valid(false) {};
+
+	//! Creates the depth cube map and the layered frame buffer used to render into it.
+	/**
+	\param resolution Width and height of each face.
+	\param farPlane Range of the light.
+	*/
+	bool setup(GLsizei resolution = 512, float farPlane = 25.0f)
+	{
+		m_resolution = resolution;
+		m_farPlane = farPlane;
+		m_cubeMap.reset(TextureHelper::makeAttachmentCubeMap(GL_DEPTH_COMPONENT24, resolution), TextureHelper::textureBytes(GL_DEPTH_COMPONENT24, resolution, resolution, 6),
+			GPU_MEMORY_RENDER_TARGET, "Point shadow cube map");
+
+		GLuint fbo = 0;
+		glGenFramebuffers(1, &fbo);
+		m_fbo.reset(fbo, 0, GPU_MEMORY_RENDER_TARGET, "Point shadow");
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_cubeMap.get(), 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "Error::PointShadowMap::setup, frame buffer incomplete with status: " << status << std::endl;
+			return false;
+		}
+		updateFaces();
+		return true;
+	}
+
+	//! Moves the light, which invalidates the cube map if it has moved.
+	/**
+	\param position World space position of the light.
+	*/
+	void setLightPosition(const glm::vec3& position)
+	{
+		if (position == m_lightPosition)
+		{
+			return;
+		}
+		m_lightPosition = position;
+		m_valid = false;
+		updateFaces();
+	}
+
+	//! Marks the static casters as changed, so the cube map is re-rendered.
+	void invalidateStaticCasters() { ++m_casterRevision; }
+
+	//! Returns a bit for each cube face whose frustum a world space box touches.
+	/**
+	\param box The box to test.
+	*/
+	int getFaceMask(const BoundingBox& box) const
+	{
+		int mask = 0;
+		for (int face = 0; face < 6; ++face)
+		{
+			if (m_faceFrustums[face].intersects(box)) mask |= 1 << face;
+		}
+		return mask;
+	}
+
+	//! Renders every caster's meshes into all the cube faces they touch in one pass. Skipped when the light, the casters and their revision haven't changed. Returns whether the cube map was rendered.
+	/**
+	\param layeredShader Shader with the point_shadow vertex, geometry and fragment stages.
+	\param casters The models which cast shadows.
+	*/
+	bool render(const Shader& layeredShader, const std::vector<ShadowCaster>& casters)
+	{
+		//Only dynamic casters or a change to the light or static casters require a new cube map.
+		bool hasDynamicCaster = false;
+		for (std::vector<ShadowCaster>::const_iterator it = casters.begin(); casters.end() != it; ++it)
+		{
+			hasDynamicCaster = hasDynamicCaster || !it->isStatic;
+		}
+		if (m_valid && !hasDynamicCaster && m_renderedRevision == m_casterRevision)
+		{
+			return false;
+		}
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo.get());
+		glViewport(0, 0, m_resolution, m_resolution);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		layeredShader.use();
+		for (int face = 0; face < 6; ++face)
+		{
+			std::stringstream matrixName;
+			matrixName << "faceMatrices[" << face << "]";
+			glUniformMatrix4fv(glGetUniformLocation(layeredShader.programId, matrixName.str().c_str()), 1, GL_FALSE, glm::value_ptr(m_faceMatrices[face]));
+		}
+		glUniform3f(glGetUniformLocation(layeredShader.programId, "lightPos"), m_lightPosition.x, m_lightPosition.y, m_lightPosition.z);
+		glUniform1f(glGetUniformLocation(layeredShader.programId, "farPlane"), m_farPlane);
+		GLint modelLoc = glGetUniformLocation(layeredShader.programId, "model");
+		GLint faceMaskLoc = glGetUniformLocation(layeredShader.programId, "faceMask");
+
+		for (std::vector<ShadowCaster>::const_iterator it = casters.begin(); casters.end() != it; ++it)
+		{
+			if (!it->model || getFaceMask(it->model->getBounds().transformed(it->transform)) == 0)
+			{
+				continue;
+			}
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(it->transform));
+
+			//Each mesh is only emitted to the faces its bounds touch.
+			const std::vector<Mesh>& meshes = it->model->getMeshes();
+			for (std::vector<Mesh>::const_iterator mesh = meshes.begin(); meshes.end() != mesh; ++mesh)
+			{
+				int faceMask = getFaceMask(mesh->getBounds().transformed(it->transform));
+				if (faceMask != 0)
+				{
+					glUniform1i(faceMaskLoc, faceMask);
+					mesh->drawDepth();
+				}
+			}
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		m_valid = true;
+		m_renderedRevision = m_casterRevision;
+		return true;
+	}
+
+	//! Binds the shadow cube map and sets its uniforms in a shader.
+	/**
+	\param shader The shader which samples the shadows.
+	*/
+	void bind(const Shader& shader) const
+	{
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubeMap.get());
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(shader.programId, "pointShadowMap"), TEXTURE_UNIT);
+		glUniform1f(glGetUniformLocation(shader.programId, "pointShadowFar"), m_farPlane);
+	}
+
+	//! Releases the frame buffer and cube map.
+	void final()
+	{
+		m_fbo.reset();
+		m_cubeMap.reset();
+	}
+};
+
+#endif
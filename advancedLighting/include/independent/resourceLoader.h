@@ -0,0 +1,123 @@
+#ifndef _RESOURCELOADER_H_
+#define _RESOURCELOADER_H_
+/**
+\file resourceLoader.h
+*/
+#include <GLEW/glew.h>
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+\class ResourceLoader
+\brief A background thread with its own OpenGL context, shared with the main one, which runs loading tasks so creating buffers and textures never stalls rendering.
+
+Buffers and textures made on the loader's context can be used on the main context once a fence the task creates has signalled. Vertex arrays and
+framebuffers aren't shared between contexts, so they must still be made on the context which uses them.
+*/
+class ResourceLoader
+{
+private:
+	GLFWwindow* m_context;							//!< Hidden window which owns the loader's context.
+	std::thread m_thread;							//!< The loader thread.
+	std::mutex m_mutex;								//!< Guards the tasks and the stop flag.
+	std::condition_variable m_wake;					//!< Wakes the loader when a task is queued or it should stop.
+	std::deque<std::function<void()> > m_tasks;		//!< Queued loading tasks.
+	bool m_stop;									//!< Whether the loader should exit.
+
+	ResourceLoader(const ResourceLoader&);
+	ResourceLoader& operator=(const ResourceLoader&);
+
+	//! Runs queued tasks on the loader's context until stopped.
+	void loaderLoop()
+	{
+		glfwMakeContextCurrent(m_context);
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+				if (m_stop)
+				{
+					break;
+				}
+				task = m_tasks.front();
+				m_tasks.pop_front();
+			}
+			task();
+		}
+		glfwMakeContextCurrent(NULL);
+	}
+
+public:
+	//! Constructor
+	ResourceLoader() : m_context(NULL), m_stop(false) {};
+
+	//! Creates the loader's context and starts its thread. Must be called on the main thread, as GLFW only creates windows there.
+	/**
+	\param mainWindow Window whose context the loader's context shares objects with. It mustn't be current on another thread.
+	\return Whether the loader started.
+	*/
+	bool setup(GLFWwindow* mainWindow)
+	{
+		//The window hints from creating the main window still apply, so the contexts match.
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		m_context = glfwCreateWindow(1, 1, "Loader", NULL, mainWindow);
+		glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+		if (!m_context)
+		{
+			std::cerr << "Error::ResourceLoader::setup, could not create a shared context." << std::endl;
+			return false;
+		}
+		m_stop = false;
+		m_thread = std::thread(&ResourceLoader::loaderLoop, this);
+		return true;
+	}
+
+	//! Queues a task to run on the loader thread, with the loader's context current.
+	/**
+	\param task The task. It should end by creating a fence (and flushing) for whatever it made.
+	\return Whether the task was queued, which it isn't if the loader isn't running.
+	*/
+	bool enqueue(const std::function<void()>& task)
+	{
+		if (!m_context)
+		{
+			return false;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push_back(task);
+		}
+		m_wake.notify_one();
+		return true;
+	}
+
+	//! Returns whether the loader thread is running.
+	bool isRunning() const { return m_context != NULL; }
+
+	//! Stops the loader once its current task finishes, dropping queued tasks, and destroys its context. Must be called on the main thread.
+	void final()
+	{
+		if (!m_context)
+		{
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_tasks.clear();
+		}
+		m_wake.notify_one();
+		m_thread.join();
+		glfwDestroyWindow(m_context);
+		m_context = NULL;
+	}
+};
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef _SCENESTREAMER_H_
+#define _SCENESTREAMER_H_
+/**
+\file sceneStreamer.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+#include <set>
+#include <string>
+#include <algorithm>
+#include "model.h"
+#include "commandList.h"
+#include "resourceLoader.h"
+
+const float STREAM_CANCEL_DISTANCE_SCALE = 1.5f; //!< Multiple of the load distance beyond which loads are cancelled, larger so loads at the edge aren't restarted over and over.
+
+/**
+\struct StreamedModel
+\brief A model placed in the world which is loaded when the camera comes near it and evicted when memory runs short.
+*/
+struct StreamedModel
+{
+	std::string path;		//!< File the model is loaded from.
+	glm::mat4 transform;	//!< The model's transformation into world space.
+	BoundingBox bounds;		//!< World space bounds, known before the model is loaded.
+	Model* model;			//!< The model while it's loading or resident, otherwise NULL.
+	unsigned lastUsedFrame;	//!< Last frame the camera was within loading distance, which orders eviction.
+	size_t gpuBytes;		//!< Video memory the model took when last loaded, 0 if it never has been.
+	size_t textureBytes;	//!< Part of gpuBytes taken by textures, which other models may share.
+	std::vector<TextureKey> textureKeys; //!< TextureCache entries of the model's textures when last loaded.
+	size_t cpuBytes;		//!< System memory the model took when last loaded, 0 if it never has been.
+	bool failed;			//!< Whether loading failed, so it isn't retried.
+
+	//! Returns whether the model is loaded and can be drawn.
+	bool isResident() const { return model && model->getLoadState() == Model::LOAD_READY; }
+};
+
+/**
+\class SceneStreamer
+\brief Loads registered models on the background loader as the camera approaches them, evicts the least recently used ones to stay within
+memory budgets, and draws a placeholder box for each model until it's resident.
+*/
+class SceneStreamer
+{
+public:
+	static const int MAX_LOADS_IN_FLIGHT = 2; //!< Most models loading at once, so nearby models aren't queued behind far ones.
+
+private:
+	std::vector<StreamedModel> m_entries;	//!< The registered models.
+	ResourceLoader* m_loader;				//!< Loader thread the models are loaded on.
+	float m_loadDistance;					//!< Distance from a model's bounds at which it starts loading.
+	size_t m_gpuBudget;						//!< Most video memory the resident models may take.
+	size_t m_cpuBudget;						//!< Most system memory the resident models may take.
+	unsigned m_frame;						//!< Number of updates so far.
+	bool m_residencyChanged;				//!< Whether a model became resident or was evicted this update.
+	Mesh m_placeholder;						//!< Unit cube drawn in place of models which aren't resident.
+
+	//! Returns the distance from a point to the nearest point of a box, 0 if it's inside.
+	static float distanceToBox(const glm::vec3& point, const BoundingBox& box)
+	{
+		return glm::length(glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f)));
+	}
+
+	//! Evicts least recently used models until the extra memory fits in the budgets. Models in use this frame or still loading are kept.
+	/**
+	\param extraGpuBytes Video memory about to be needed.
+	\param extraCpuBytes System memory about to be needed.
+	\return Whether the extra memory fits.
+	*/
+	bool evictFor(size_t extraGpuBytes, size_t extraCpuBytes)
+	{
+		while (getGpuMemoryUsage() + extraGpuBytes > m_gpuBudget || getCpuMemoryUsage() + extraCpuBytes > m_cpuBudget)
+		{
+			StreamedModel* oldest = NULL;
+			for (std::vector<StreamedModel>::iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+			{
+				if (it->isResident() && it->lastUsedFrame != m_frame && (!oldest || it->lastUsedFrame < oldest->lastUsedFrame))
+				{
+					oldest = &*it;
+				}
+			}
+			if (!oldest)
+			{
+				return false;
+			}
+			delete oldest->model;
+			oldest->model = NULL;
+			m_residencyChanged = true;
+		}
+		return true;
+	}
+
+	//! Builds the placeholder cube, from -1 to 1 on each axis so it can be scaled to a model's bounds.
+	void setupPlaceholder()
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (int side = -1; side <= 1; side += 2)
+			{
+				//Each face gets its own four vertices so it has a flat normal.
+				glm::vec3 normal(0.0f), u(0.0f), v(0.0f);
+				normal[axis] = (float)side;
+				u[(axis + 1) % 3] = 1.0f;
+				v[(axis + 2) % 3] = (float)side;
+				GLuint first = (GLuint)vertices.size();
+				for (int corner = 0; corner < 4; ++corner)
+				{
+					glm::vec2 uv((float)(corner & 1), (float)(corner >> 1));
+					Vertex vertex;
+					vertex.position = normal + u * (uv.x * 2.0f - 1.0f) + v * (uv.y * 2.0f - 1.0f);
+					vertex.texCoords = uv;
+					vertex.normal = normal;
+					vertex.tangent = glm::vec4(u, 1.0f); //cross(normal, u) is v.
+					vertices.push_back(vertex);
+				}
+				GLuint faceIndices[6] = { first, first + 1, first + 3, first, first + 3, first + 2 };
+				indices.insert(indices.end(), faceIndices, faceIndices + 6);
+			}
+		}
+		m_placeholder.setData(std::move(vertices), std::vector<Texture>(), std::move(indices));
+	}
+
+public:
+	//! Constructor
+	SceneStreamer() : m_loader(NULL), m_loadDistance(0.0f), m_gpuBudget(0), m_cpuBudget(0), m_frame(0), m_residencyChanged(false) {};
+
+	//! Sets the streamer up. Must be called on the drawing context's thread.
+	/**
+	\param loader Loader thread the models are loaded on.
+	\param loadDistance Distance from a model's bounds at which it starts loading.
+	\param gpuBudget Most video memory the resident models may take, in bytes.
+	\param cpuBudget Most system memory the resident models may take, in bytes.
+	*/
+	void setup(ResourceLoader& loader, float loadDistance, size_t gpuBudget, size_t cpuBudget)
+	{
+		m_loader = &loader;
+		m_loadDistance = loadDistance;
+		m_gpuBudget = gpuBudget;
+		m_cpuBudget = cpuBudget;
+		setupPlaceholder();
+	}
+
+	//! Registers a model to be streamed in.
+	/**
+	\param path File the model is loaded from.
+	\param transform The model's transformation into world space.
+	\param localBounds The model's bounds in model space, which stand in for it until it's loaded.
+	\return The model's index.
+	*/
+	size_t addModel(const std::string& path, const glm::mat4& transform, const BoundingBox& localBounds)
+	{
+		StreamedModel entry;
+		entry.path = path;
+		entry.transform = transform;
+		entry.bounds = localBounds.transformed(transform);
+		entry.model = NULL;
+		entry.lastUsedFrame = 0;
+		entry.gpuBytes = 0;
+		entry.textureBytes = 0;
+		entry.cpuBytes = 0;
+		entry.failed = false;
+		m_entries.push_back(entry);
+		return m_entries.size() - 1;
+	}
+
+	//! Finishes loads, starts loading the nearest models in range and evicts models to stay within the budgets. Must be called on the drawing context's thread once a frame.
+	/**
+	\param viewPosition The camera's position in world space.
+	\return Whether a model became resident or was evicted, which changes the static shadow casters.
+	*/
+	bool update(const glm::vec3& viewPosition)
+	{
+		++m_frame;
+		m_residencyChanged = false;
+
+		//Finish the loads whose uploads are complete, and cancel those the camera has moved away from so the loader moves on to models it needs.
+		int loading = 0;
+		for (std::vector<StreamedModel>::iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+		{
+			if (!it->model || it->isResident())
+			{
+				continue;
+			}
+			if (it->model->isReady())
+			{
+				size_t categoryBytes[GPU_MEMORY_CATEGORY_COUNT];
+				it->model->getGpuMemoryByCategory(categoryBytes);
+				it->gpuBytes = it->model->getGpuMemoryUsage();
+				it->textureBytes = categoryBytes[GPU_MEMORY_TEXTURE];
+				it->model->getTextureKeys(it->textureKeys);
+				it->cpuBytes = it->model->getCpuMemoryUsage();
+				m_residencyChanged = true;
+			}
+			else if (it->model->getLoadState() == Model::LOAD_FAILED)
+			{
+				std::cerr << "Error::SceneStreamer::update, could not load " << it->path << std::endl;
+				delete it->model;
+				it->model = NULL;
+				it->failed = true;
+			}
+			else if (it->model->getLoadState() == Model::LOAD_CANCELLED)
+			{
+				delete it->model;
+				it->model = NULL;
+			}
+			else if (it->model->getLoadState() == Model::LOAD_PENDING && distanceToBox(viewPosition, it->bounds) > m_loadDistance * STREAM_CANCEL_DISTANCE_SCALE)
+			{
+				//Cancelled loads stop at their next check, so they don't hold up new ones.
+				it->model->cancelLoad();
+			}
+			else
+			{
+				++loading;
+			}
+		}
+
+		//Models in range count as used this frame, and the nearest which aren't loaded yet are queued first.
+		std::vector<std::pair<float, size_t> > wanted;
+		for (size_t i = 0; i < m_entries.size(); ++i)
+		{
+			StreamedModel& entry = m_entries[i];
+			float distance = distanceToBox(viewPosition, entry.bounds);
+			if (distance > m_loadDistance)
+			{
+				continue;
+			}
+			entry.lastUsedFrame = m_frame;
+			if (!entry.model && !entry.failed)
+			{
+				wanted.push_back(std::make_pair(distance, i));
+			}
+		}
+		std::sort(wanted.begin(), wanted.end());
+		for (size_t i = 0; i < wanted.size() && loading < MAX_LOADS_IN_FLIGHT; ++i)
+		{
+			//A model's size is only known once it has loaded before, otherwise room is made after it arrives.
+			StreamedModel& entry = m_entries[wanted[i].second];
+			if (!evictFor(entry.gpuBytes, entry.cpuBytes))
+			{
+				continue;
+			}
+			entry.model = new Model();
+			entry.model->loadModelAsync(entry.path, *m_loader);
+			++loading;
+		}
+
+		evictFor(0, 0);
+		return m_residencyChanged;
+	}
+
+	//! Records the draws of the resident models inside a frustum, and a placeholder box for each model which isn't resident. Makes no OpenGL calls.
+	/**
+	\param lists One command list per job system thread, see Model::record.
+	\param frustum The frustum to cull against, in world space.
+	\param viewPosition Camera position in world space.
+	\param lodSelection The view used to pick levels of detail, or NULL to always draw full resolution.
+	\param meshletCulling Whether full resolution meshes are culled per meshlet.
+	\param occlusion Rasterised occluders to cull against, or NULL to skip occlusion culling.
+	*/
+	void record(std::vector<CommandList>& lists, const Frustum& frustum, const glm::vec3& viewPosition, const LodSelection* lodSelection = NULL, bool meshletCulling = false, const OcclusionBuffer* occlusion = NULL) const
+	{
+		JobSystem& jobs = JobSystem::instance();
+		if (lists.size() < jobs.getThreadCount())
+		{
+			lists.resize(jobs.getThreadCount());
+		}
+		const IndexRange placeholderRange = { 0, (GLuint)m_placeholder.getIndices().size() };
+		for (std::vector<StreamedModel>::const_iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+		{
+			if (it->isResident())
+			{
+				it->model->record(lists, frustum, it->transform, viewPosition, lodSelection, meshletCulling, occlusion);
+			}
+			else if (!it->failed && frustum.intersects(it->bounds))
+			{
+				glm::mat4 boxTransform = glm::scale(glm::translate(glm::mat4(), it->bounds.getCentre()), it->bounds.getExtent());
+				GLuint64 sortKey = CommandList::makeSortKey(m_placeholder.getMaterialId(), m_placeholder.getVAOId(), distanceToBox(viewPosition, it->bounds));
+				lists[jobs.getThreadIndex()].addDraw(&m_placeholder, boxTransform, sortKey, &placeholderRange, 1);
+			}
+		}
+	}
+
+	//! Returns the registered models.
+	const std::vector<StreamedModel>& getEntries() const { return m_entries; }
+
+	//! Returns the video memory the resident and loading models take. Textures resident models share through the TextureCache are counted once.
+	size_t getGpuMemoryUsage() const
+	{
+		//Loading models are charged what they took last time, as nothing tells which of their textures will be shared yet.
+		size_t bytes = 0;
+		std::set<TextureKey> textures;
+		for (std::vector<StreamedModel>::const_iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+		{
+			if (!it->model)
+			{
+				continue;
+			}
+			if (!it->isResident())
+			{
+				bytes += it->gpuBytes;
+				continue;
+			}
+			bytes += it->gpuBytes - it->textureBytes;
+			textures.insert(it->textureKeys.begin(), it->textureKeys.end());
+		}
+		const TextureCache& textureCache = TextureCache::instance();
+		for (std::set<TextureKey>::const_iterator it = textures.begin(); textures.end() != it; ++it)
+		{
+			bytes += textureCache.getBytes(*it);
+		}
+		return bytes;
+	}
+
+	//! Returns the system memory the resident and loading models take.
+	size_t getCpuMemoryUsage() const
+	{
+		size_t bytes = 0;
+		for (std::vector<StreamedModel>::const_iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+		{
+			bytes += it->model ? it->cpuBytes : 0;
+		}
+		return bytes;
+	}
+
+	//! Deletes every model and the placeholder. Must be called on the drawing context's thread.
+	void final()
+	{
+		for (std::vector<StreamedModel>::iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+		{
+			delete it->model;
+			it->model = NULL;
+		}
+		m_placeholder.final();
+	}
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include "gpuResources.h"
 
 /**
 \struct ShaderFile
@@ -33,6 +34,13 @@ struct ShaderFile
 */
 class Shader
 {
+private:
+	GpuProgram m_program; //!< Owns the program, so it's released once however the shader is destroyed.
+
+	//Copies would delete the program out from under each other, so shaders can't be copied.
+	Shader(const Shader&);
+	Shader& operator=(const Shader&);
+
 public:
 	GLuint programId; //!< Shader program's ID number for retrieval. 
 
@@ -64,13 +72,25 @@ public:
 		loadFromFile(fileVec);
 	}
 
+	//! Shader constructor for a compute shader program. Requires OpenGL 4.3.
+	/**
+	\param computePath Path to the shader program's compute shader.
+	*/
+	explicit Shader(const char* computePath) : programId(0)
+	{
+		std::vector<ShaderFile> fileVec;
+		fileVec.push_back(ShaderFile(GL_COMPUTE_SHADER, computePath));
+		loadFromFile(fileVec);
+	}
+
 	//! Shader deconstructor to delete the shader program.
-	~Shader()
+	~Shader() { this->final(); }
+
+	//! Releases the shader program, which is deleted once the frames using it have retired.
+	void final()
 	{
-		if (this->programId)
-		{
-			glDeleteProgram(this->programId);
-		}
+		m_program.reset();
+		this->programId = 0;
 	}
 
 	//! Set OpenGL to use this shader program.
@@ -132,6 +152,7 @@ private:
 		if (bSuccess)
 		{
 			this->programId = glCreateProgram();
+			m_program.reset(this->programId, 0, GPU_MEMORY_OTHER, "Shader program");
 			for (size_t i = 0; i < shaderCount; ++i)
 			{
 				glAttachShader(this->programId, shaderObjectIdVec[i]);
@@ -0,0 +1,323 @@
+#ifndef _SHADOW_H_
+#define _SHADOW_H_
+/**
+\file shadow.h
+*/
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+#include <sstream>
+#include <cmath>
+#include "model.h"
+#include "frustum.h"
+#include "texture.h"
+
+/**
+\struct ShadowCaster
+\brief A model instance which is drawn into shadow maps.
+*/
+struct ShadowCaster
+{
+	const Model* model;	 //!< The model to draw.
+	glm::mat4 transform; //!< The model's transformation into world space.
+	bool isStatic;		 //!< Static casters are the only ones drawn into cached cascades.
+
+	//! Constructor to set the caster's values.
+	/**
+	\param casterModel The model to draw.
+	\param casterTransform The model's transformation into world space.
+	\param staticCaster Whether the caster never moves.
+	*/
+	ShadowCaster(const Model* casterModel, const glm::mat4& casterTransform, bool staticCaster) : model(casterModel), transform(casterTransform), isStatic(staticCaster) {};
+};
+
+/**
+\class CascadedShadowMap
+\brief Directional light shadows split into cascades along the camera's view, rendered into the layers of a depth texture array. The far cascades are cached and only re-rendered when the light, the static casters or the camera's coverage changes.
+*/
+class CascadedShadowMap
+{
+public:
+	static const int CASCADE_COUNT = 4;			//!< Number of cascades (must match the shaders' arrays).
+	static const int STATIC_CASCADE_START = 2;	//!< Cascades from this index onwards are cached and only contain static casters.
+	static const GLint TEXTURE_UNIT = 11;		//!< Texture unit the shadow map array is bound to.
+
+private:
+	const float SPLIT_LAMBDA = 0.75f;			//!< Blend between logarithmic (1) and uniform (0) cascade splits.
+	const float MAX_SHADOW_DISTANCE = 60.0f;	//!< Furthest view distance which receives shadows.
+	const float CASTER_PULLBACK = 20.0f;		//!< Extra depth towards the light so casters outside the view still cast into it.
+	const float CACHE_PADDING = 1.5f;			//!< How much larger a cached cascade is than required, so it survives camera movement.
+
+	/**
+	\struct Cascade
+	\brief The fitted projection and cache state of one cascade.
+	*/
+	struct Cascade
+	{
+		glm::mat4 viewProjection; //!< World to light clip space transformation.
+		float splitFar;			  //!< View depth at which this cascade ends.
+		glm::vec3 centre;		  //!< Centre of the sphere the cascade currently covers.
+		float radius;			  //!< Radius of the sphere the cascade currently covers.
+		unsigned int revision;	  //!< Static caster revision the cascade was rendered with.
+		bool valid;				  //!< Whether the cascade's cached contents can be reused.
+		bool needsRender;		  //!< Whether the cascade must be rendered this frame.
+	};
+
+	Cascade m_cascades[CASCADE_COUNT]; //!< Every cascade, nearest first.
+	GpuTexture m_depthArray;		   //!< Depth texture array with one layer per cascade.
+	GpuFramebuffer m_fbo;			   //!< Frame buffer the cascade layers are attached to while rendering.
+	GLsizei m_resolution;			   //!< Width and height of each cascade.
+	glm::vec3 m_lightDirection;		   //!< Direction the light travels in.
+	glm::mat4 m_lightRotation;		   //!< Rotation from world space into the light's view space.
+	unsigned int m_casterRevision;	   //!< Incremented whenever the static casters change.
+
+	//! Returns the bounding sphere of a slice of the camera's frustum in world space.
+	/**
+	\param inverseView The inverse of the camera's view matrix.
+	\param tanX Tangent of half the horizontal field of view.
+	\param tanY Tangent of half the vertical field of view.
+	\param sliceNear View depth of the start of the slice.
+	\param sliceFar View depth of the end of the slice.
+	\param radius Where to store the sphere's radius.
+	*/
+	static glm::vec3 fitSlice(const glm::mat4& inverseView, float tanX, float tanY, float sliceNear, float sliceFar, float& radius)
+	{
+		glm::vec3 corners[8];
+		glm::vec3 centre(0.0f);
+		for (int i = 0; i < 8; ++i)
+		{
+			float depth = (i < 4) ? sliceNear : sliceFar;
+			glm::vec3 viewCorner(((i & 1) ? tanX : -tanX) * depth, ((i & 2) ? tanY : -tanY) * depth, -depth);
+			corners[i] = glm::vec3(inverseView * glm::vec4(viewCorner, 1.0f));
+			centre += corners[i] * 0.125f;
+		}
+
+		radius = 0.0f;
+		for (int i = 0; i < 8; ++i)
+		{
+			radius = std::max(radius, glm::length(corners[i] - centre));
+		}
+
+		//Quantise the radius so the projection's size doesn't flicker as the camera rotates.
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+		return centre;
+	}
+
+	//! Fits a cascade's projection around a sphere, snapped to whole shadow map texels so the shadow edges don't shimmer as the camera moves.
+	/**
+	\param cascade The cascade to fit.
+	\param centre Centre of the sphere to cover.
+	\param radius Radius of the sphere to cover.
+	*/
+	void fitCascade(Cascade& cascade, const glm::vec3& centre, float radius)
+	{
+		float texelSize = 2.0f * radius / m_resolution;
+		glm::vec3 lightCentre = glm::vec3(m_lightRotation * glm::vec4(centre, 1.0f));
+		lightCentre.x = std::floor(lightCentre.x / texelSize) * texelSize;
+		lightCentre.y = std::floor(lightCentre.y / texelSize) * texelSize;
+
+		glm::mat4 projection = glm::ortho(lightCentre.x - radius, lightCentre.x + radius, lightCentre.y - radius, lightCentre.y + radius,
+			-(lightCentre.z + radius + CASTER_PULLBACK), -(lightCentre.z - radius));
+		cascade.viewProjection = projection * m_lightRotation;
+		cascade.centre = glm::vec3(glm::inverse(m_lightRotation) * glm::vec4(lightCentre, 1.0f));
+		cascade.radius = radius;
+	}
+
+public:
+	//! Default constructor. The shadow map is created by setup.
+	CascadedShadowMap() : m_resolution(0), m_lightDirection(0.0f, -1.0f, 0.0f), m_casterRevision(0)
+	{
+		for (int i = 0; i < CASCADE_COUNT; ++i)
+		{
+			m_cascades[i].splitFar = 0.0f;
+			m_cascades[i].radius = 0.0f;
+			m_cascades[i].revision = 0;
+			m_cascades[i].valid = false;
+			m_cascades[i].needsRender = true;
+		}
+		m_lightRotation = glm::lookAt(glm::vec3(0.0f), m_lightDirection, glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+
+	//! Creates the depth texture array and the frame buffer used to render into it.
+	/**
+	\param resolution Width and height of each cascade.
+	*/
+	bool setup(GLsizei resolution = 1024)
+	{
+		m_resolution = resolution;
+		m_depthArray.reset(TextureHelper::makeAttachmentTextureArray(CASCADE_COUNT, GL_DEPTH_COMPONENT24, resolution, resolution),
+			TextureHelper::textureBytes(GL_DEPTH_COMPONENT24, resolution, resolution, CASCADE_COUNT), GPU_MEMORY_RENDER_TARGET, "Cascaded shadow maps");
+
+		GLuint fbo = 0;
+		glGenFramebuffers(1, &fbo);
+		m_fbo.reset(fbo, 0, GPU_MEMORY_RENDER_TARGET, "Cascaded shadows");
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthArray.get(), 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cerr << "Error::CascadedShadowMap::setup, frame buffer incomplete with status: " << status << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//! Sets the direction of the light, invalidating every cached cascade if it has changed.
+	/**
+	\param direction Direction the light travels in.
+	*/
+	void setLightDirection(const glm::vec3& direction)
+	{
+		glm::vec3 newDirection = glm::normalize(direction);
+		if (glm::dot(newDirection, m_lightDirection) > 0.99999f)
+		{
+			return;
+		}
+		m_lightDirection = newDirection;
+
+		//Choose an up vector which isn't parallel to the light.
+		glm::vec3 up = std::abs(newDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		m_lightRotation = glm::lookAt(glm::vec3(0.0f), newDirection, up);
+		for (int i = 0; i < CASCADE_COUNT; ++i)
+		{
+			m_cascades[i].valid = false;
+		}
+	}
+
+	//! Marks the static casters as changed, so the cached cascades are re-rendered.
+	void invalidateStaticCasters() { ++m_casterRevision; }
+
+	//! Splits the camera's frustum into cascades and fits each cascade's projection. Cached cascades are only refitted when the camera leaves the region they cover.
+	/**
+	\param cameraView The camera's view matrix.
+	\param fov The camera's vertical field of view in radians.
+	\param aspect Width over height of the viewport.
+	\param nearPlane The camera's near plane distance.
+	\param farPlane The camera's far plane distance.
+	*/
+	void update(const glm::mat4& cameraView, float fov, float aspect, float nearPlane, float farPlane)
+	{
+		const float tanY = std::tan(fov * 0.5f);
+		const float tanX = tanY * aspect;
+		const float shadowFar = std::min(farPlane, MAX_SHADOW_DISTANCE);
+		const glm::mat4 inverseView = glm::inverse(cameraView);
+
+		float splitNear = nearPlane;
+		for (int i = 0; i < CASCADE_COUNT; ++i)
+		{
+			//Practical split scheme: blend logarithmic and uniform distributions.
+			float fraction = (float)(i + 1) / CASCADE_COUNT;
+			float logSplit = nearPlane * std::pow(shadowFar / nearPlane, fraction);
+			float uniformSplit = nearPlane + (shadowFar - nearPlane) * fraction;
+			float splitFar = SPLIT_LAMBDA * logSplit + (1.0f - SPLIT_LAMBDA) * uniformSplit;
+
+			Cascade& cascade = m_cascades[i];
+			cascade.splitFar = splitFar;
+
+			float radius;
+			glm::vec3 centre = fitSlice(inverseView, tanX, tanY, splitNear, splitFar, radius);
+			if (i < STATIC_CASCADE_START)
+			{
+				fitCascade(cascade, centre, radius);
+				cascade.needsRender = true;
+			}
+			else
+			{
+				//Reuse the cached cascade while it still covers the slice and nothing it contains has changed.
+				bool covered = cascade.valid && glm::length(centre - cascade.centre) + radius <= cascade.radius;
+				if (!covered)
+				{
+					fitCascade(cascade, centre, radius * CACHE_PADDING);
+				}
+				cascade.needsRender = !covered || cascade.revision != m_casterRevision;
+			}
+			splitNear = splitFar;
+		}
+	}
+
+	//! Renders the casters into every cascade which needs it, culling each caster against the cascade's frustum. Returns how many cascades were rendered.
+	/**
+	\param depthShader Shader which transforms vertices by the "lightSpace" and "model" uniforms.
+	\param casters The models which cast shadows.
+	*/
+	int render(const Shader& depthShader, const std::vector<ShadowCaster>& casters)
+	{
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo.get());
+		glViewport(0, 0, m_resolution, m_resolution);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+		depthShader.use();
+
+		int renderedCount = 0;
+		for (int i = 0; i < CASCADE_COUNT; ++i)
+		{
+			Cascade& cascade = m_cascades[i];
+			if (!cascade.needsRender)
+			{
+				continue;
+			}
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthArray.get(), 0, i);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glUniformMatrix4fv(glGetUniformLocation(depthShader.programId, "lightSpace"), 1, GL_FALSE, glm::value_ptr(cascade.viewProjection));
+
+			const bool cached = i >= STATIC_CASCADE_START;
+			const Frustum frustum(cascade.viewProjection);
+			for (std::vector<ShadowCaster>::const_iterator it = casters.begin(); casters.end() != it; ++it)
+			{
+				if (!it->model || (cached && !it->isStatic))
+				{
+					continue;
+				}
+				glUniformMatrix4fv(glGetUniformLocation(depthShader.programId, "model"), 1, GL_FALSE, glm::value_ptr(it->transform));
+				it->model->drawDepth(frustum, it->transform);
+			}
+
+			cascade.valid = true;
+			cascade.revision = m_casterRevision;
+			cascade.needsRender = false;
+			++renderedCount;
+		}
+
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		return renderedCount;
+	}
+
+	//! Binds the shadow map array and sets the cascade uniforms of a shader.
+	/**
+	\param shader The shader which samples the shadows.
+	*/
+	void bind(const Shader& shader) const
+	{
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthArray.get());
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(shader.programId, "shadowMap"), TEXTURE_UNIT);
+		glUniform3f(glGetUniformLocation(shader.programId, "sunDirection"), m_lightDirection.x, m_lightDirection.y, m_lightDirection.z);
+		for (int i = 0; i < CASCADE_COUNT; ++i)
+		{
+			std::stringstream matrixName, splitName;
+			matrixName << "cascadeMatrices[" << i << "]";
+			splitName << "cascadeSplits[" << i << "]";
+			glUniformMatrix4fv(glGetUniformLocation(shader.programId, matrixName.str().c_str()), 1, GL_FALSE, glm::value_ptr(m_cascades[i].viewProjection));
+			glUniform1f(glGetUniformLocation(shader.programId, splitName.str().c_str()), m_cascades[i].splitFar);
+		}
+	}
+
+	//! Releases the frame buffer and shadow maps.
+	void final()
+	{
+		m_fbo.reset();
+		m_depthArray.reset();
+	}
+};
+
+#endif
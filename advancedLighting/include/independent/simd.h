@@ -0,0 +1,23 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+/**
+\file simd.h
+*/
+
+//Enable the SSE code paths when compiling for x86/x64 (MSVC always provides SSE2 on x64, GCC/Clang define __SSE2__).
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SHADERS_SIMD_SSE 1
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#else
+#define SHADERS_SIMD_SSE 0
+#endif
+
+//Alignment specifier for data which is loaded with aligned SIMD instructions.
+#if defined(_MSC_VER)
+#define SIMD_ALIGN(x) __declspec(align(x))
+#else
+#define SIMD_ALIGN(x) __attribute__((aligned(x)))
+#endif
+
+#endif
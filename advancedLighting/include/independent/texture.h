@@ -6,6 +6,14 @@
 #include <GLEW/glew.h>
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+#include "jobSystem.h"
+#include "mappedFileSystem.h"
 
 /**
 \class TextureHelper
@@ -14,16 +22,85 @@
 class TextureHelper
 {
 public:
-	//! A function to load a 2D texture from a file. If parameters aren't set they're set to their defaults.
+	/**
+	\struct DecodedImage
+	\brief An image file's pixels, decoded on any thread and waiting to be uploaded on the OpenGL thread.
+	*/
+	struct DecodedImage
+	{
+		GLubyte* data;	//!< Pixel data, NULL if the file couldn't be loaded.
+		int width;		//!< Width in pixels.
+		int height;		//!< Height in pixels.
+		DecodedImage() : data(NULL), width(0), height(0) {}; //!< Constructor
+	};
+
+	/**
+	\struct CompressedImage
+	\brief A block compressed image and its mip chain, encoded on any thread and waiting to be uploaded or written to a DDS file.
+	*/
+	struct CompressedImage
+	{
+		GLenum internalFormat;				//!< Compressed format, such as GL_COMPRESSED_RG_RGTC2.
+		int width;							//!< Width of the first level in pixels.
+		int height;							//!< Height of the first level in pixels.
+		std::vector<unsigned char> data;	//!< Every level's blocks, largest level first.
+		std::vector<size_t> levelSizes;		//!< Bytes of each level.
+		CompressedImage() : internalFormat(0), width(0), height(0) {}; //!< Constructor
+	};
+
+	//! A function to decode an image file into memory. Makes no OpenGL calls, so it can run on a job system thread.
 	/**
 	\param filename Name of the texture file.
+	\param image Where to store the pixels.
+	\param loadChannels The texture's colour channels.
+	\return Whether the file was decoded.
+	*/
+	static bool decodeImage(const char* filename, DecodedImage& image, int loadChannels = SOIL_LOAD_RGB)
+	{
+		int channels = 0;
+		image.data = SOIL_load_image(filename, &image.width, &image.height, &channels, loadChannels);
+		if (image.data == NULL) //Check that data was loaded successfully.
+		{
+			std::cerr << "Error::Texture could not load texture file:" << filename << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//! A function to decode an image file already in memory, such as a mapped file. Safe to call on any thread.
+	/**
+	\param data The file's bytes.
+	\param size Size of the file in bytes.
+	\param image Where to store the decoded pixels, which uploadImage frees.
+	\param loadChannels The texture's colour channels.
+	\return Whether the file was decoded.
+	*/
+	static bool decodeImageFromMemory(const unsigned char* data, size_t size, DecodedImage& image, int loadChannels = SOIL_LOAD_RGB)
+	{
+		int channels = 0;
+		image.data = SOIL_load_image_from_memory(data, (int)size, &image.width, &image.height, &channels, loadChannels);
+		if (image.data == NULL)
+		{
+			std::cerr << "Error::Texture could not decode texture from memory." << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	//! A function to upload a decoded image to a new 2D texture, then free its pixels. Must be called on the OpenGL thread.
+	/**
+	\param image The decoded image.
 	\param internalFormat Colour format of the texture.
 	\param picFormat Picture format of the texture.
-	\param loadChannels The texture's colour channels.
 	\param alpha Whether or not to enable alpha transparency in the texture.
 	*/
-	static GLuint load2DTexture(const char* filename, GLint internalFormat = GL_RGB, GLenum picFormat = GL_RGB, int loadChannels = SOIL_LOAD_RGB, GLboolean alpha = false)
+	static GLuint uploadImage(DecodedImage& image, GLint internalFormat = GL_RGB, GLenum picFormat = GL_RGB, GLboolean alpha = false)
 	{
+		if (image.data == NULL)
+		{
+			return 0;
+		}
+
 		//Step 1: Create and bind textures.
 		GLuint textureId = 0;
 		glGenTextures(1, &textureId);
@@ -36,30 +113,226 @@ public:
 		//Step 3: Set filtering data.
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // ΪMipMap趨filter
-		
-		//Variables to store data for next step.
-		GLubyte *imageData = NULL;
-		int picWidth, picHeight;
-		int channels = 0;
 
-		//Step 4: Load texture data from file.
-		imageData = SOIL_load_image(filename, &picWidth, &picHeight, &channels, loadChannels);
-		if (imageData == NULL) //Check that data was loaded successfully.
-		{
-			std::cerr << "Error::Texture could not load texture file:" << filename << std::endl;
-			return 0;
-		}
-		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, picWidth, picHeight, 0, picFormat, GL_UNSIGNED_BYTE, imageData);
+		//Step 4: Upload the texture data.
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, picFormat, GL_UNSIGNED_BYTE, image.data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 		
 		//Step 4.5: Free imageData variable from memory.
-		SOIL_free_image_data(imageData);
+		SOIL_free_image_data(image.data);
+		image.data = NULL;
 
 		//Step 5: Find the texture via OpenGL.
 		glBindTexture(GL_TEXTURE_2D, 0);
 		return textureId;
 	}
 
+	//! A function to upload a compressed image and its mip chain to a new 2D texture. Must be called on the OpenGL thread.
+	/**
+	\param image The compressed image.
+	\return The texture, 0 if the image is empty.
+	*/
+	static GLuint uploadCompressedImage(const CompressedImage& image)
+	{
+		if (image.data.empty() || image.levelSizes.empty())
+		{
+			return 0;
+		}
+		//Mips can't be generated for compressed formats, so every level is uploaded.
+		const GLsizei levels = (GLsizei)image.levelSizes.size();
+		GLuint textureId = allocateCompressedTexture(GL_TEXTURE_2D, image.internalFormat, image.width, image.height, 1, levels);
+		GLsizei width = image.width, height = image.height;
+		size_t offset = 0;
+		for (GLsizei level = 0; level < levels; ++level)
+		{
+			uploadCompressedLevel(GL_TEXTURE_2D, image.internalFormat, level, 0, width, height, image.levelSizes[level], &image.data[offset]);
+			offset += image.levelSizes[level];
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return textureId;
+	}
+
+	//! A function to create a block compressed texture and allocate its levels, with immutable storage when the context supports it. Leaves it bound.
+	/**
+	\param target GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP or GL_TEXTURE_CUBE_MAP_ARRAY.
+	\param internalFormat The compressed format.
+	\param width Width of the first level.
+	\param height Height of the first level.
+	\param layers Number of layers of an array, counting each face of a cube map array. 1 otherwise.
+	\param levels Number of mip levels.
+	*/
+	static GLuint allocateCompressedTexture(GLenum target, GLenum internalFormat, GLsizei width, GLsizei height, GLsizei layers, GLsizei levels)
+	{
+		GLuint textureId = 0;
+		glGenTextures(1, &textureId);
+		glBindTexture(target, textureId);
+		const bool layered = target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_CUBE_MAP_ARRAY;
+		if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage)
+		{
+			if (layered) glTexStorage3D(target, levels, internalFormat, width, height, layers);
+			else glTexStorage2D(target, levels, internalFormat, width, height);
+		}
+		else
+		{
+			//Without immutable storage, each level is allocated empty and filled by uploadCompressedLevel.
+			for (GLsizei level = 0; level < levels; ++level)
+			{
+				const GLsizei levelBytes = (GLsizei)textureBytes(internalFormat, width, height);
+				if (layered) glCompressedTexImage3D(target, level, internalFormat, width, height, layers, 0, levelBytes * layers, NULL);
+				else if (target == GL_TEXTURE_CUBE_MAP)
+				{
+					for (GLenum face = 0; face < 6; ++face)
+					{
+						glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internalFormat, width, height, 0, levelBytes, NULL);
+					}
+				}
+				else glCompressedTexImage2D(target, level, internalFormat, width, height, 0, levelBytes, NULL);
+				width = std::max(width / 2, 1);
+				height = std::max(height / 2, 1);
+			}
+		}
+		//Cube maps are clamped so their faces' edges filter together; everything else repeats.
+		const GLint wrap = (target == GL_TEXTURE_CUBE_MAP || target == GL_TEXTURE_CUBE_MAP_ARRAY) ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		return textureId;
+	}
+
+	//! A function to upload one level of one layer or face of a texture from allocateCompressedTexture, which must be bound.
+	/**
+	\param target The texture's target.
+	\param internalFormat The compressed format.
+	\param level The mip level.
+	\param layer The layer of an array, the face of a cube map, or the layer times six plus the face of a cube map array.
+	\param width Width of the level.
+	\param height Height of the level.
+	\param bytes Size of the level's blocks.
+	\param data The blocks, which may point straight into a mapped file.
+	*/
+	static void uploadCompressedLevel(GLenum target, GLenum internalFormat, GLint level, GLint layer, GLsizei width, GLsizei height, size_t bytes, const void* data)
+	{
+		if (target == GL_TEXTURE_2D_ARRAY || target == GL_TEXTURE_CUBE_MAP_ARRAY)
+		{
+			glCompressedTexSubImage3D(target, level, 0, 0, layer, width, height, 1, internalFormat, (GLsizei)bytes, data);
+		}
+		else
+		{
+			GLenum face = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer : target;
+			glCompressedTexSubImage2D(face, level, 0, 0, width, height, internalFormat, (GLsizei)bytes, data);
+		}
+	}
+
+	//! A function to load a 2D texture from a file. If parameters aren't set they're set to their defaults.
+	/**
+	\param filename Name of the texture file.
+	\param internalFormat Colour format of the texture.
+	\param picFormat Picture format of the texture.
+	\param loadChannels The texture's colour channels.
+	\param alpha Whether or not to enable alpha transparency in the texture.
+	*/
+	static GLuint load2DTexture(const char* filename, GLint internalFormat = GL_RGB, GLenum picFormat = GL_RGB, int loadChannels = SOIL_LOAD_RGB, GLboolean alpha = false)
+	{
+		DecodedImage image;
+		if (!decodeImage(filename, image, loadChannels))
+		{
+			return 0;
+		}
+		return uploadImage(image, internalFormat, picFormat, alpha);
+	}
+
+	//! A function to load several 2D textures, decoding the files in parallel on the job system then uploading them on the calling (OpenGL) thread.
+	/**
+	\param filenames Names of the texture files.
+	\param textureIds Where to store the textures, 0 for any which couldn't be loaded.
+	\param internalFormat Colour format of the textures.
+	\param picFormat Picture format of the textures.
+	\param loadChannels The textures' colour channels.
+	*/
+	static void load2DTextures(const std::vector<std::string>& filenames, std::vector<GLuint>& textureIds, GLint internalFormat = GL_RGB, GLenum picFormat = GL_RGB, int loadChannels = SOIL_LOAD_RGB)
+	{
+		std::vector<DecodedImage> images(filenames.size());
+		JobSystem::instance().parallelFor(0, filenames.size(), [&](size_t i)
+		{
+			decodeImage(filenames[i].c_str(), images[i], loadChannels);
+		});
+		textureIds.resize(filenames.size());
+		for (size_t i = 0; i < filenames.size(); ++i)
+		{
+			textureIds[i] = uploadImage(images[i], internalFormat, picFormat);
+		}
+	}
+
+	//! A function to estimate the bytes of one texel of an uncompressed format, for accounting video memory.
+	/**
+	\param internalFormat The texture's sized internal format.
+	Drivers pad three byte formats, such as RGB8 and 24 bit depth, to four bytes, so they're counted as four.
+	*/
+	static size_t bytesPerTexel(GLint internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_R8: return 1;
+		case GL_RG8: case GL_R16: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+		case GL_RGB: case GL_RGB8: case GL_DEPTH_COMPONENT24: case GL_RG16: case GL_RG16F: case GL_R32F: case GL_R32UI:
+		case GL_RGBA: case GL_RGBA8: case GL_DEPTH24_STENCIL8: case GL_DEPTH_COMPONENT32F: return 4;
+		case GL_RG32F: case GL_RGBA16F: return 8;
+		case GL_RGB32F: return 12;
+		case GL_RGBA32F: case GL_RGBA32UI: return 16;
+		default: return 4;
+		}
+	}
+
+	//! A function to find the bytes of each 4x4 block of a block compressed format.
+	/**
+	\param internalFormat The texture's internal format.
+	\return The bytes of a block, 0 if the format isn't block compressed.
+	*/
+	static size_t compressedBlockBytes(GLint internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1: case GL_COMPRESSED_SIGNED_RED_RGTC1: return 8;
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2: case GL_COMPRESSED_SIGNED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM: case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM: case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT: case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT: return 16;
+		default: return 0;
+		}
+	}
+
+	//! A function to estimate the video memory of a texture.
+	/**
+	\param internalFormat The texture's sized internal format. Block compressed formats are counted by their blocks.
+	\param width Width of the first level.
+	\param height Height of the first level.
+	\param layers Number of layers or cube faces.
+	\param levels Number of mip levels, 0 for a full chain.
+	*/
+	static size_t textureBytes(GLint internalFormat, GLsizei width, GLsizei height, GLsizei layers = 1, GLint levels = 1)
+	{
+		const size_t blockBytes = compressedBlockBytes(internalFormat);
+		const size_t texelBytes = bytesPerTexel(internalFormat);
+		size_t bytes = 0;
+		for (GLint level = 0; levels == 0 || level < levels; ++level)
+		{
+			if (blockBytes) bytes += (size_t)((width + 3) / 4) * ((height + 3) / 4) * layers * blockBytes;
+			else bytes += (size_t)width * height * layers * texelBytes;
+			if (width == 1 && height == 1)
+			{
+				break;
+			}
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		return bytes;
+	}
+
 	//! A function to create a texture which can be attached to a frame buffer.
 	/**
 	\param level Level of detail. More that 0 will reduce image detail.
@@ -82,6 +355,66 @@ public:
 		return textId;
 	}
 
+	//! A function to create a layered texture which can be attached to a frame buffer one layer at a time. Depth formats are set up for hardware shadow comparison.
+	/**
+	\param layers Number of layers in the texture array.
+	\param internalFormat Number of colour components in the texture.
+	\param width Texture width.
+	\param height Texture height.
+	\param picFormat Format of pixel data.
+	\param picDataType Type of pixel data.
+	*/
+	static GLuint makeAttachmentTextureArray(GLsizei layers, GLint internalFormat = GL_DEPTH_COMPONENT24, GLsizei width = 1024, GLsizei height = 1024, GLenum picFormat = GL_DEPTH_COMPONENT, GLenum picDataType = GL_FLOAT)
+	{
+		GLuint textId;
+		glGenTextures(1, &textId);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textId);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, layers, 0, picFormat, picDataType, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (picFormat == GL_DEPTH_COMPONENT)
+		{
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		return textId;
+	}
+
+	//! A function to create a cube map which can be attached to a frame buffer as a whole, so all six faces are rendered in one layered pass. Depth formats are set up for hardware shadow comparison.
+	/**
+	\param internalFormat Number of colour components in the texture.
+	\param size Width and height of each face.
+	\param picFormat Format of pixel data.
+	\param picDataType Type of pixel data.
+	*/
+	static GLuint makeAttachmentCubeMap(GLint internalFormat = GL_DEPTH_COMPONENT24, GLsizei size = 512, GLenum picFormat = GL_DEPTH_COMPONENT, GLenum picDataType = GL_FLOAT)
+	{
+		GLuint textId;
+		glGenTextures(1, &textId);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, textId);
+		for (GLenum face = 0; face < 6; ++face)
+		{
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, internalFormat, size, size, 0, picFormat, picDataType, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		if (picFormat == GL_DEPTH_COMPONENT)
+		{
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+		return textId;
+	}
+
 	//! A function to create a multi-sampled texture which can be attached to a frame buffer.
 	/**
 	\param sampleNum Number of samples the texture is comprised of.
@@ -101,102 +434,313 @@ public:
 	}
 
 #define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
+#define FOURCC_DXT2 0x32545844 // Equivalent to "DXT2" in ASCII, DXT3 with premultiplied alpha
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
+#define FOURCC_DXT4 0x34545844 // Equivalent to "DXT4" in ASCII, DXT5 with premultiplied alpha
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+#define FOURCC_ATI1 0x31495441 // Equivalent to "ATI1" in ASCII, one channel BC4
+#define FOURCC_BC4U 0x55344342 // Equivalent to "BC4U" in ASCII
+#define FOURCC_BC4S 0x53344342 // Equivalent to "BC4S" in ASCII
+#define FOURCC_ATI2 0x32495441 // Equivalent to "ATI2" in ASCII, two channel BC5
+#define FOURCC_BC5U 0x55354342 // Equivalent to "BC5U" in ASCII, another name for BC5
+#define FOURCC_BC5S 0x53354342 // Equivalent to "BC5S" in ASCII
+#define FOURCC_DX10 0x30315844 // Equivalent to "DX10" in ASCII, followed by an extended header with a DXGI format
 
-	//! Function to load an external DDS (DirectDraw Surface) file.
 	/**
-	\param filename Name of the DDS file.
+	\struct DDSLayout
+	\brief What a DDS file holds and where its blocks are, once its headers have been validated against the file's size.
 	*/
-	static GLuint loadDDS(const char * filename)
+	struct DDSLayout
 	{
-		//Load the file from the given name.
-		std::ifstream file(filename, std::ios::in | std::ios::binary);
-		//Check file was loaded successfully.
-		if (!file) {
-			std::cout << "Error::loadDDs, could not open:" 
-				<< filename << "for read." << std::endl;
-			return 0;
+		GLenum target;			//!< GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP or GL_TEXTURE_CUBE_MAP_ARRAY.
+		GLenum internalFormat;	//!< The block compressed format.
+		unsigned width;			//!< Width of the first level.
+		unsigned height;		//!< Height of the first level.
+		unsigned levels;		//!< Number of mip levels.
+		unsigned layers;		//!< Number of array elements, 1 for a single texture or cube map.
+		unsigned faces;			//!< 6 for cube maps, otherwise 1.
+		size_t dataOffset;		//!< Offset of the first blocks from the start of the file.
+		size_t surfaceBytes;	//!< Bytes of each face or layer's mip chain, which follow one another.
+		DDSLayout() : target(0), internalFormat(0), width(0), height(0), levels(0), layers(0), faces(0), dataOffset(0), surfaceBytes(0) {}; //!< Constructor
+	};
+
+	//! A function to find the compressed format of a DXGI format, from a DDS file's extended header.
+	/**
+	\param dxgiFormat The DXGI_FORMAT value.
+	\return The format, 0 if it isn't a supported block compressed one.
+	*/
+	static GLenum dxgiCompressedFormat(unsigned dxgiFormat)
+	{
+		switch (dxgiFormat)
+		{
+		case 70: case 71: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;			//BC1_TYPELESS, BC1_UNORM
+		case 72: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;				//BC1_UNORM_SRGB
+		case 73: case 74: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;			//BC2_TYPELESS, BC2_UNORM
+		case 75: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;				//BC2_UNORM_SRGB
+		case 76: case 77: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;			//BC3_TYPELESS, BC3_UNORM
+		case 78: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;				//BC3_UNORM_SRGB
+		case 79: case 80: return GL_COMPRESSED_RED_RGTC1;					//BC4_TYPELESS, BC4_UNORM
+		case 81: return GL_COMPRESSED_SIGNED_RED_RGTC1;						//BC4_SNORM
+		case 82: case 83: return GL_COMPRESSED_RG_RGTC2;					//BC5_TYPELESS, BC5_UNORM
+		case 84: return GL_COMPRESSED_SIGNED_RG_RGTC2;						//BC5_SNORM
+		case 94: case 95: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;	//BC6H_TYPELESS, BC6H_UF16
+		case 96: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;				//BC6H_SF16
+		case 97: case 98: return GL_COMPRESSED_RGBA_BPTC_UNORM;				//BC7_TYPELESS, BC7_UNORM
+		case 99: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;				//BC7_UNORM_SRGB
+		default: return 0;
 		}
+	}
 
-		//Get the file type.
-		char filecode[4];
-		file.read(filecode, 4);
-		//Check the file type is a DDS.
-		if (strncmp(filecode, "DDS ", 4) != 0) {
-			std::cout << "Error::loadDDs, format is not dds :" << filename  << std::endl;
-			file.close();
-			return 0;
+	//! A function to read a little endian 32 bit value from a file's bytes.
+	static unsigned readUint32(const unsigned char* data, size_t offset)
+	{
+		return (unsigned)data[offset] | ((unsigned)data[offset + 1] << 8) | ((unsigned)data[offset + 2] << 16) | ((unsigned)data[offset + 3] << 24);
+	}
+
+	//! A function to read and validate the headers of a DDS file. Makes no OpenGL calls.
+	/**
+	\param data The file's bytes.
+	\param size Size of the file.
+	\param filename Name of the file, for errors.
+	\param layout Where to store what the file holds.
+	\return Whether the file is a supported DDS file with every level it describes present.
+	*/
+	static bool parseDDS(const unsigned char* data, size_t size, const char* filename, DDSLayout& layout)
+	{
+		layout = DDSLayout();
+		//The magic number, then a 124 byte header whose pixel format is 32 bytes.
+		if (data == NULL || size < 128 || std::memcmp(data, "DDS ", 4) != 0)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, format is not dds: " << filename << std::endl;
+			return false;
+		}
+		if (readUint32(data, 4) != 124 || readUint32(data, 76) != 32)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, header has the wrong size: " << filename << std::endl;
+			return false;
+		}
+		layout.height = readUint32(data, 12);
+		layout.width = readUint32(data, 16);
+		layout.levels = std::max(readUint32(data, 28), 1u);
+		const unsigned pixelFlags = readUint32(data, 80), fourCC = readUint32(data, 84), caps2 = readUint32(data, 112);
+		if ((pixelFlags & 0x4) == 0) //DDPF_FOURCC
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, only block compressed files are supported: " << filename << std::endl;
+			return false;
 		}
 
-		//Get surface data from file.
-		char header[124];
-		file.read(header, 124);
-
-		//Set texture data to read surface data.
-		unsigned int height = *(unsigned int*)&(header[8]);
-		unsigned int width = *(unsigned int*)&(header[12]);
-		unsigned int linearSize = *(unsigned int*)&(header[16]);
-		unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-		unsigned int fourCC = *(unsigned int*)&(header[80]);
-
-		//Variables for buffer.
-		char * buffer = NULL;
-		unsigned int bufsize;
-		//Calculate required size of buffer from mipmap.
-		bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-		buffer = new char[bufsize];
-		file.read(buffer, bufsize);
-		//Close DDS file.
-		file.close();
-
-		//Set component/format data.
-		unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-		unsigned int format;
-		switch (fourCC)
-		{
-		case FOURCC_DXT1:
-			format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-			break;
-		case FOURCC_DXT3:
-			format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-			break;
-		case FOURCC_DXT5:
-			format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-			break;
-		default:
-			delete[] buffer;
-			return 0;
+		layout.dataOffset = 128;
+		layout.layers = 1;
+		layout.faces = 1;
+		if (fourCC == FOURCC_DX10)
+		{
+			//The extended header gives the DXGI format, the dimension, whether it's a cube map and the array size.
+			if (size < 148)
+			{
+				std::cerr << "Error::TextureHelper::parseDDS, extended header is truncated: " << filename << std::endl;
+				return false;
+			}
+			layout.internalFormat = dxgiCompressedFormat(readUint32(data, 128));
+			if (readUint32(data, 132) != 3) //D3D10_RESOURCE_DIMENSION_TEXTURE2D
+			{
+				std::cerr << "Error::TextureHelper::parseDDS, only 2D textures, arrays and cube maps are supported: " << filename << std::endl;
+				return false;
+			}
+			layout.faces = (readUint32(data, 136) & 0x4) ? 6 : 1; //RESOURCE_MISC_TEXTURECUBE
+			layout.layers = readUint32(data, 140);
+			layout.dataOffset = 148;
+		}
+		else
+		{
+			switch (fourCC)
+			{
+			case FOURCC_DXT1: layout.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+			case FOURCC_DXT2: case FOURCC_DXT3: layout.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;
+			case FOURCC_DXT4: case FOURCC_DXT5: layout.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+			case FOURCC_ATI1: case FOURCC_BC4U: layout.internalFormat = GL_COMPRESSED_RED_RGTC1; break;
+			case FOURCC_BC4S: layout.internalFormat = GL_COMPRESSED_SIGNED_RED_RGTC1; break;
+			case FOURCC_ATI2: case FOURCC_BC5U: layout.internalFormat = GL_COMPRESSED_RG_RGTC2; break;
+			case FOURCC_BC5S: layout.internalFormat = GL_COMPRESSED_SIGNED_RG_RGTC2; break;
+			default: break;
+			}
+			if (caps2 & 0x200000) //DDSCAPS2_VOLUME
+			{
+				std::cerr << "Error::TextureHelper::parseDDS, volume textures are not supported: " << filename << std::endl;
+				return false;
+			}
+			if (caps2 & 0x200) //DDSCAPS2_CUBEMAP
+			{
+				if ((caps2 & 0xFC00) != 0xFC00)
+				{
+					std::cerr << "Error::TextureHelper::parseDDS, cube maps missing faces are not supported: " << filename << std::endl;
+					return false;
+				}
+				layout.faces = 6;
+			}
+		}
+		if (layout.internalFormat == 0)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, unsupported format: " << filename << std::endl;
+			return false;
 		}
 
-		//Create OpenGL texture.
-		GLuint textureID;
-		glGenTextures(1, &textureID);
+		//Dimensions are bounded first, so the sizes below can't overflow.
+		const unsigned MAX_SIZE = 16384, MAX_LAYERS = 2048;
+		unsigned fullChain = 1;
+		while ((std::max(layout.width, layout.height) >> fullChain) > 0) ++fullChain;
+		if (layout.width == 0 || layout.height == 0 || layout.width > MAX_SIZE || layout.height > MAX_SIZE || layout.layers == 0 || layout.layers > MAX_LAYERS)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, invalid size " << layout.width << "x" << layout.height << "x" << layout.layers << ": " << filename << std::endl;
+			return false;
+		}
+		if (layout.levels > fullChain)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, " << layout.levels << " mip levels is more than a " << layout.width << "x" << layout.height << " texture has: " << filename << std::endl;
+			return false;
+		}
+		if (layout.faces == 6 && layout.width != layout.height)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, cube map faces are not square: " << filename << std::endl;
+			return false;
+		}
 
-		//Bind the newly created texture to the GPU.
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		//Every face or layer holds its whole mip chain before the next starts.
+		layout.surfaceBytes = textureBytes(layout.internalFormat, layout.width, layout.height, 1, layout.levels);
+		const size_t surfaces = (size_t)layout.layers * layout.faces;
+		if (layout.surfaceBytes > (std::numeric_limits<size_t>::max() - layout.dataOffset) / surfaces)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, levels are too large to address: " << filename << std::endl;
+			return false;
+		}
+		const size_t required = layout.dataOffset + layout.surfaceBytes * surfaces;
+		if (required > size)
+		{
+			std::cerr << "Error::TextureHelper::parseDDS, file is truncated, it has " << size << " bytes but its levels need " << required << ": " << filename << std::endl;
+			return false;
+		}
 
-		unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-		unsigned int offset = 0;
+		if (layout.faces == 6) layout.target = layout.layers > 1 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+		else layout.target = layout.layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+		return true;
+	}
 
-		//Load mipMaps.
-		for (unsigned int level = 0; level < mipMapCount && (width || height); ++level)
+	//! Function to upload a DDS file already in memory, such as a mapped file, each level straight from its bytes. Must be called on the OpenGL thread.
+	/**
+	\param data The file's bytes.
+	\param size Size of the file.
+	\param filename Name of the file, for errors.
+	\param bytes Where to store the video memory of the texture, if not NULL.
+	\param target Where to store the target to bind the texture to, if not NULL.
+	\return The texture, 0 if the file is invalid or the context doesn't support it.
+	*/
+	static GLuint uploadDDS(const unsigned char* data, size_t size, const char* filename, size_t* bytes = NULL, GLenum* target = NULL)
+	{
+		DDSLayout layout;
+		if (!parseDDS(data, size, filename, layout))
+		{
+			return 0;
+		}
+		const bool bptc = layout.internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM || layout.internalFormat == GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+			|| layout.internalFormat == GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT || layout.internalFormat == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+		if (bptc && !(GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc))
+		{
+			std::cerr << "Error::TextureHelper::uploadDDS, BC6H and BC7 are not supported by this context: " << filename << std::endl;
+			return 0;
+		}
+		if (layout.target == GL_TEXTURE_CUBE_MAP_ARRAY && !(GLEW_VERSION_4_0 || GLEW_ARB_texture_cube_map_array))
 		{
-			unsigned int size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
-			glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, size, buffer + offset);
+			std::cerr << "Error::TextureHelper::uploadDDS, cube map arrays are not supported by this context: " << filename << std::endl;
+			return 0;
+		}
 
-			offset += size;
-			width /= 2;
-			height /= 2;
+		const bool layered = layout.target == GL_TEXTURE_2D_ARRAY || layout.target == GL_TEXTURE_CUBE_MAP_ARRAY;
+		GLuint textureId = allocateCompressedTexture(layout.target, layout.internalFormat, layout.width, layout.height,
+			layered ? layout.layers * layout.faces : 1, layout.levels);
+		const unsigned char* surface = data + layout.dataOffset;
+		for (unsigned layer = 0; layer < layout.layers * layout.faces; ++layer, surface += layout.surfaceBytes)
+		{
+			const unsigned char* level = surface;
+			GLsizei width = layout.width, height = layout.height;
+			for (unsigned i = 0; i < layout.levels; ++i)
+			{
+				const size_t levelBytes = textureBytes(layout.internalFormat, width, height);
+				uploadCompressedLevel(layout.target, layout.internalFormat, i, layer, width, height, levelBytes, level);
+				level += levelBytes;
+				width = std::max(width / 2, 1);
+				height = std::max(height / 2, 1);
+			}
+		}
+		glBindTexture(layout.target, 0);
+
+		if (bytes) *bytes = layout.surfaceBytes * layout.layers * layout.faces;
+		if (target) *target = layout.target;
+		return textureId;
+	}
 
-			//Constrain Non-Power-Of-Two textures. 
-			if (width < 1) width = 1;
-			if (height < 1) height = 1;
+	//! Function to load an external DDS (DirectDraw Surface) file, which is mapped rather than read so its levels are uploaded straight from the mapping.
+	/**
+	\param filename Name of the DDS file.
+	\param bytes Where to store the video memory of the texture, if not NULL.
+	\param target Where to store the target to bind the texture to, if not NULL: GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP or GL_TEXTURE_CUBE_MAP_ARRAY.
+	*/
+	static GLuint loadDDS(const char * filename, size_t* bytes = NULL, GLenum* target = NULL)
+	{
+		MappedFile file;
+		if (!file.open(filename))
+		{
+			std::cerr << "Error::TextureHelper::loadDDS, could not open " << filename << " for read." << std::endl;
+			return 0;
 		}
+		return uploadDDS(file.getData(), file.getSize(), filename, bytes, target);
+	}
 
-		delete[] buffer;
-		return textureID;
+	//! Function to write a compressed image and its mip chain to a DDS file, which loadDDS can read back.
+	/**
+	\param filename Name of the DDS file.
+	\param image The compressed image, in BC1, BC3 or BC5.
+	\return Whether the file was written.
+	*/
+	static bool writeDDS(const char* filename, const CompressedImage& image)
+	{
+		unsigned int fourCC;
+		switch (image.internalFormat)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: fourCC = FOURCC_DXT1; break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: fourCC = FOURCC_DXT5; break;
+		case GL_COMPRESSED_RG_RGTC2: fourCC = FOURCC_ATI2; break;
+		default:
+			std::cerr << "Error::TextureHelper::writeDDS, unsupported format for " << filename << std::endl;
+			return false;
+		}
+		if (image.levelSizes.empty())
+		{
+			return false;
+		}
+
+		//The header's flags say it has a linear size, mip count and a four character code, which is all loadDDS reads.
+		unsigned int header[31];
+		std::memset(header, 0, sizeof(header));
+		header[0] = 124;											//Header size.
+		header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;	//CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT and LINEARSIZE.
+		header[2] = (unsigned int)image.height;
+		header[3] = (unsigned int)image.width;
+		header[4] = (unsigned int)image.levelSizes[0];
+		header[6] = (unsigned int)image.levelSizes.size();
+		header[18] = 32;											//Pixel format size.
+		header[19] = 0x4;											//FOURCC.
+		header[20] = fourCC;
+		header[26] = 0x1000 | (image.levelSizes.size() > 1 ? 0x8 | 0x400000 : 0); //TEXTURE, and COMPLEX and MIPMAP with a chain.
+
+		std::ofstream file(filename, std::ios::out | std::ios::binary);
+		if (!file)
+		{
+			std::cerr << "Error::TextureHelper::writeDDS, could not open " << filename << " for writing." << std::endl;
+			return false;
+		}
+		file.write("DDS ", 4);
+		file.write((const char*)header, sizeof(header));
+		file.write((const char*)image.data.data(), image.data.size());
+		return (bool)file;
 	}
 };
 
@@ -0,0 +1,440 @@
+#ifndef _TEXTURE_CACHE_H_
+#define _TEXTURE_CACHE_H_
+/**
+\file textureCache.h
+*/
+#include <GLEW/glew.h>
+#include <map>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "gpuResources.h"
+
+/**
+\struct TextureKey
+\brief Identifies a texture by a hash of its source file's bytes and the parameters it was loaded with, so identical images share one
+texture whatever their paths.
+*/
+struct TextureKey
+{
+	uint64_t contentHash;	//!< Hash of the source bytes.
+	uint64_t contentSize;	//!< Size of the source bytes.
+	GLint internalFormat;	//!< Format the texture was uploaded as.
+	int loadChannels;		//!< Channels the image was decoded with.
+
+	TextureKey() : contentHash(0), contentSize(0), internalFormat(0), loadChannels(0) {}; //!< Constructor
+
+	//! Orders keys, so they can be used in a map.
+	bool operator<(const TextureKey& other) const
+	{
+		if (contentHash != other.contentHash) return contentHash < other.contentHash;
+		if (contentSize != other.contentSize) return contentSize < other.contentSize;
+		if (internalFormat != other.internalFormat) return internalFormat < other.internalFormat;
+		return loadChannels < other.loadChannels;
+	}
+};
+
+class TextureRef;
+
+/**
+\class TextureCache
+\brief Shares textures between every model in the process, keyed by content, and counts the references to each.
+
+Textures nothing references are kept while they fit in the retain budget, so a model which is evicted and streamed back in, or another
+model using the same images, finds them still uploaded. Past the budget the least recently used are evicted, and the eviction hooks are
+told. Safe to use from any thread; only the textures' creation and deletion need a context.
+*/
+class TextureCache
+{
+	friend class TextureRef;
+public:
+	typedef std::function<void(const TextureKey&, const std::string&, size_t)> EvictionHook; //!< Called with the key, name and bytes of each evicted texture.
+
+private:
+	//! A cached texture.
+	struct Entry
+	{
+		GpuTexture texture;		//!< The texture.
+		size_t bytes;			//!< Estimated video memory of the texture.
+		unsigned references;	//!< Number of TextureRefs to the texture.
+		uint64_t lastReleased;	//!< Tick the last reference went, which orders eviction.
+		std::string name;		//!< File the texture was first loaded from.
+
+		Entry() : bytes(0), references(0), lastReleased(0) {}; //!< Constructor
+		Entry(Entry&& other) noexcept : texture(std::move(other.texture)), bytes(other.bytes), references(other.references), lastReleased(other.lastReleased), name(std::move(other.name)) {}; //!< Move constructor
+	};
+	//! An evicted texture, reported to the hooks once the lock is released.
+	struct Eviction
+	{
+		TextureKey key;		//!< The texture's key.
+		std::string name;	//!< File it was loaded from.
+		size_t bytes;		//!< Its video memory.
+	};
+
+	std::map<TextureKey, Entry> m_entries;		//!< Every cached texture.
+	std::vector<EvictionHook> m_evictionHooks;	//!< Told about each eviction.
+	size_t m_retainBudget;						//!< Most bytes of unreferenced textures to keep.
+	size_t m_retainedBytes;						//!< Bytes of unreferenced textures being kept.
+	size_t m_bytes;								//!< Bytes of every cached texture.
+	uint64_t m_tick;							//!< Incremented as references go, to order eviction.
+	size_t m_hits;								//!< Lookups which found a texture.
+	size_t m_misses;							//!< Lookups which didn't.
+	bool m_compress;							//!< Whether imported textures are block compressed.
+	std::string m_ddsDirectory;					//!< Where compressed textures are cached as DDS files, empty for none.
+	mutable std::mutex m_mutex;					//!< Guards everything above.
+
+	TextureCache() : m_retainBudget(0), m_retainedBytes(0), m_bytes(0), m_tick(0), m_hits(0), m_misses(0), m_compress(false) {};
+	TextureCache(const TextureCache&);
+	TextureCache& operator=(const TextureCache&);
+
+	//! Adds a reference to a texture.
+	void addReference(const TextureKey& key)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<TextureKey, Entry>::iterator it = m_entries.find(key);
+		if (m_entries.end() != it && it->second.references++ == 0)
+		{
+			m_retainedBytes -= it->second.bytes;
+		}
+	}
+
+	//! Removes a reference to a texture, keeping it if it fits in the retain budget.
+	void removeReference(const TextureKey& key)
+	{
+		std::vector<Eviction> evicted;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::map<TextureKey, Entry>::iterator it = m_entries.find(key);
+			if (m_entries.end() == it || it->second.references == 0)
+			{
+				return;
+			}
+			if (--it->second.references == 0)
+			{
+				it->second.lastReleased = ++m_tick;
+				m_retainedBytes += it->second.bytes;
+				evictUnreferenced(m_retainBudget, evicted);
+			}
+		}
+		notifyEvictions(evicted);
+	}
+
+	//! Evicts the least recently used unreferenced textures until those left fit in a budget. The lock must be held.
+	/**
+	\param budget Most bytes of unreferenced textures to keep.
+	\param evicted Where to add the evicted textures.
+	*/
+	void evictUnreferenced(size_t budget, std::vector<Eviction>& evicted)
+	{
+		while (m_retainedBytes > budget || (budget == 0 && hasUnreferenced()))
+		{
+			std::map<TextureKey, Entry>::iterator oldest = m_entries.end();
+			for (std::map<TextureKey, Entry>::iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+			{
+				if (it->second.references == 0 && (m_entries.end() == oldest || it->second.lastReleased < oldest->second.lastReleased))
+				{
+					oldest = it;
+				}
+			}
+			if (m_entries.end() == oldest)
+			{
+				break;
+			}
+			Eviction eviction = { oldest->first, oldest->second.name, oldest->second.bytes };
+			evicted.push_back(eviction);
+			m_retainedBytes -= oldest->second.bytes;
+			m_bytes -= oldest->second.bytes;
+			m_entries.erase(oldest); //Releases the texture, which is deleted once the frames using it have retired.
+		}
+	}
+
+	//! Returns whether any texture is unreferenced. The lock must be held.
+	bool hasUnreferenced() const
+	{
+		for (std::map<TextureKey, Entry>::const_iterator it = m_entries.begin(); m_entries.end() != it; ++it)
+		{
+			if (it->second.references == 0) return true;
+		}
+		return false;
+	}
+
+	//! Tells the hooks about evicted textures, outside the lock so they can use the cache.
+	void notifyEvictions(const std::vector<Eviction>& evicted)
+	{
+		if (evicted.empty())
+		{
+			return;
+		}
+		std::vector<EvictionHook> hooks;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			hooks = m_evictionHooks;
+		}
+		for (std::vector<Eviction>::const_iterator it = evicted.begin(); evicted.end() != it; ++it)
+		{
+			for (std::vector<EvictionHook>::const_iterator hook = hooks.begin(); hooks.end() != hook; ++hook)
+			{
+				(*hook)(it->key, it->name, it->bytes);
+			}
+		}
+	}
+
+public:
+	//! Returns the cache shared by every model.
+	static TextureCache& instance()
+	{
+		static TextureCache cache;
+		return cache;
+	}
+
+	//! Hashes bytes, such as an image file's, for a TextureKey. Eight bytes are mixed at a time, so hashing costs little next to decoding.
+	/**
+	\param data The bytes.
+	\param size Number of bytes.
+	*/
+	static uint64_t hashBytes(const unsigned char* data, size_t size)
+	{
+		const uint64_t PRIME = 0x100000001b3ull;
+		uint64_t hash = 0xcbf29ce484222325ull ^ (size * 0x9e3779b97f4a7c15ull);
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			std::memcpy(&word, data + i, 8);
+			hash = (hash ^ word) * PRIME;
+			hash ^= hash >> 29;
+		}
+		for (; i < size; ++i)
+		{
+			hash = (hash ^ data[i]) * PRIME;
+		}
+		//Finalise so every input bit reaches every output bit.
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ull;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	//! Makes the key of an image file loaded with some parameters.
+	/**
+	\param data The file's bytes.
+	\param size Size of the file.
+	\param internalFormat Format the texture is uploaded as.
+	\param loadChannels Channels the image is decoded with.
+	*/
+	static TextureKey makeKey(const unsigned char* data, size_t size, GLint internalFormat, int loadChannels)
+	{
+		TextureKey key;
+		key.contentHash = hashBytes(data, size);
+		key.contentSize = size;
+		key.internalFormat = internalFormat;
+		key.loadChannels = loadChannels;
+		return key;
+	}
+
+	//! Finds a cached texture.
+	/**
+	\param key The texture's key.
+	\return A reference to the texture, null if it isn't cached.
+	*/
+	TextureRef find(const TextureKey& key);
+
+	//! Adds a texture, or finds the one already cached with the same key if another load got there first.
+	/**
+	\param key The texture's key.
+	\param textureId The texture, which the cache takes ownership of. It's released if the key is already cached.
+	\param bytes Estimated video memory of the texture.
+	\param name File the texture was loaded from.
+	\return A reference to the cached texture.
+	*/
+	TextureRef insert(const TextureKey& key, GLuint textureId, size_t bytes, const std::string& name);
+
+	//! Sets the most bytes of unreferenced textures to keep for reuse, evicting the least recently used past it.
+	void setRetainBudget(size_t bytes)
+	{
+		std::vector<Eviction> evicted;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_retainBudget = bytes;
+			evictUnreferenced(m_retainBudget, evicted);
+		}
+		notifyEvictions(evicted);
+	}
+
+	//! Adds a function to call whenever a texture is evicted.
+	void addEvictionHook(const EvictionHook& hook)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_evictionHooks.push_back(hook);
+	}
+
+	//! Evicts every unreferenced texture, such as before the context goes.
+	void evictUnreferenced()
+	{
+		std::vector<Eviction> evicted;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			evictUnreferenced(0, evicted);
+		}
+		notifyEvictions(evicted);
+	}
+
+	//! Returns the video memory of a cached texture, 0 if it isn't cached.
+	size_t getBytes(const TextureKey& key) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<TextureKey, Entry>::const_iterator it = m_entries.find(key);
+		return m_entries.end() == it ? 0 : it->second.bytes;
+	}
+
+	//! Sets whether models block compress their textures as they're imported, and where to keep the results for later runs.
+	/**
+	\param enabled Whether to compress textures.
+	\param ddsDirectory Directory to cache the compressed textures in as DDS files, created if it doesn't exist. Empty to compress every run.
+	*/
+	void setCompression(bool enabled, const std::string& ddsDirectory = std::string())
+	{
+		if (!ddsDirectory.empty())
+		{
+#ifdef _WIN32
+			_mkdir(ddsDirectory.c_str());
+#else
+			mkdir(ddsDirectory.c_str(), 0755);
+#endif
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_compress = enabled;
+		m_ddsDirectory = ddsDirectory;
+	}
+
+	//! Returns whether models block compress their textures as they're imported.
+	bool isCompressionEnabled() const { std::lock_guard<std::mutex> lock(m_mutex); return m_compress; }
+
+	//! Returns the DDS file a compressed texture is cached in, named by its key and the format it's compressed to, or an empty string if there's no cache directory.
+	/**
+	\param key The texture's key.
+	\param format The compressed format the file holds.
+	*/
+	std::string getDdsPath(const TextureKey& key, GLenum format) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_ddsDirectory.empty())
+		{
+			return std::string();
+		}
+		char name[64];
+		std::snprintf(name, sizeof(name), "/%016llx-%llx-%x.dds", (unsigned long long)key.contentHash, (unsigned long long)key.contentSize, (unsigned)format);
+		return m_ddsDirectory + name;
+	}
+
+	//! Returns the number of cached textures.
+	size_t getTextureCount() const { std::lock_guard<std::mutex> lock(m_mutex); return m_entries.size(); }
+	//! Returns the video memory of every cached texture.
+	size_t getBytes() const { std::lock_guard<std::mutex> lock(m_mutex); return m_bytes; }
+	//! Returns the video memory of the unreferenced textures kept for reuse.
+	size_t getRetainedBytes() const { std::lock_guard<std::mutex> lock(m_mutex); return m_retainedBytes; }
+	//! Returns the number of lookups which found a texture.
+	size_t getHits() const { std::lock_guard<std::mutex> lock(m_mutex); return m_hits; }
+	//! Returns the number of lookups which didn't.
+	size_t getMisses() const { std::lock_guard<std::mutex> lock(m_mutex); return m_misses; }
+};
+
+/**
+\class TextureRef
+\brief A counted reference to a texture in the TextureCache, which keeps the texture from being evicted while any material holds one.
+*/
+class TextureRef
+{
+	friend class TextureCache;
+private:
+	TextureKey m_key;	//!< The texture's key.
+	GLuint m_id;		//!< The texture, 0 for a null reference.
+
+	//! Constructor for a reference the cache has already counted.
+	TextureRef(const TextureKey& key, GLuint id) : m_key(key), m_id(id) {};
+
+public:
+	//! Constructor for a null reference.
+	TextureRef() : m_id(0) {};
+	//! Copy constructor, adding a reference.
+	TextureRef(const TextureRef& other) : m_key(other.m_key), m_id(other.m_id)
+	{
+		if (m_id) TextureCache::instance().addReference(m_key);
+	}
+	//! Move constructor, taking the other's reference.
+	TextureRef(TextureRef&& other) noexcept : m_key(other.m_key), m_id(other.m_id)
+	{
+		other.m_id = 0;
+	}
+	//! Assignment, swapping with a copy so the old reference is removed.
+	TextureRef& operator=(TextureRef other) noexcept
+	{
+		std::swap(m_key, other.m_key);
+		std::swap(m_id, other.m_id);
+		return *this;
+	}
+	//! Destructor, removing the reference.
+	~TextureRef()
+	{
+		if (m_id) TextureCache::instance().removeReference(m_key);
+	}
+
+	GLuint getId() const { return m_id; }					//!< Returns the texture, 0 for a null reference.
+	bool isNull() const { return m_id == 0; }				//!< Returns whether the reference is null.
+	const TextureKey& getKey() const { return m_key; }		//!< Returns the texture's key.
+};
+
+inline TextureRef TextureCache::find(const TextureKey& key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<TextureKey, Entry>::iterator it = m_entries.find(key);
+	if (m_entries.end() == it)
+	{
+		++m_misses;
+		return TextureRef();
+	}
+	++m_hits;
+	if (it->second.references++ == 0)
+	{
+		m_retainedBytes -= it->second.bytes;
+	}
+	return TextureRef(key, it->second.texture.get());
+}
+
+inline TextureRef TextureCache::insert(const TextureKey& key, GLuint textureId, size_t bytes, const std::string& name)
+{
+	if (textureId == 0)
+	{
+		return TextureRef();
+	}
+	GpuTexture texture(textureId, bytes, GPU_MEMORY_TEXTURE, "Cached texture");
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<TextureKey, Entry>::iterator it = m_entries.find(key);
+	if (m_entries.end() == it)
+	{
+		Entry entry;
+		entry.texture = std::move(texture);
+		entry.bytes = bytes;
+		entry.name = name;
+		it = m_entries.insert(std::make_pair(key, std::move(entry))).first;
+		m_bytes += bytes;
+	}
+	if (it->second.references++ == 0 && it->second.texture.get() != textureId)
+	{
+		m_retainedBytes -= it->second.bytes;
+	}
+	return TextureRef(key, it->second.texture.get());
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _TRIPLEBUFFER_H_
+#define _TRIPLEBUFFER_H_
+/**
+\file tripleBuffer.h
+*/
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+/**
+\class TripleBuffer
+\brief Hands values (such as a frame's state) from a producer thread to a consumer thread through three slots, so neither ever waits for the other to finish with a slot.
+
+The producer fills the write slot and publishes it, which swaps it with the ready slot. The consumer takes the ready slot by swapping it with the one it read last.
+Publishing again before the consumer takes a value replaces it, so the consumer always gets the newest.
+*/
+template <typename T>
+class TripleBuffer
+{
+private:
+	T m_slots[3];							//!< The values.
+	int m_writeSlot;						//!< Slot the producer is filling.
+	int m_readySlot;						//!< Slot holding the newest published value.
+	int m_readSlot;							//!< Slot the consumer is reading.
+	bool m_fresh;							//!< Whether the ready slot holds a value the consumer hasn't taken.
+	bool m_stopped;							//!< Whether the consumer should stop waiting for values.
+	std::mutex m_mutex;						//!< Guards the slot indices and flags.
+	std::condition_variable m_published;	//!< Signalled when a value is published or the buffer stops.
+	std::condition_variable m_taken;		//!< Signalled when the consumer takes a value or the buffer stops.
+
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer& operator=(const TripleBuffer&);
+public:
+	//! Constructor
+	TripleBuffer() : m_writeSlot(0), m_readySlot(1), m_readSlot(2), m_fresh(false), m_stopped(false) {};
+
+	//! Returns the slot to fill. Only the producer may use it, until it publishes.
+	T& getWriteSlot() { return m_slots[m_writeSlot]; }
+
+	//! Makes the filled write slot the newest value, and hands the producer another slot.
+	void publish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::swap(m_writeSlot, m_readySlot);
+			m_fresh = true;
+		}
+		m_published.notify_one();
+	}
+
+	//! Waits until the consumer has taken the newest value, so the producer stays at most one value ahead.
+	/**
+	\param timeout Longest time to wait, so the producer can keep handling input while the consumer is slow.
+	\return Whether the value was taken.
+	*/
+	bool waitUntilTaken(std::chrono::milliseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_taken.wait_for(lock, timeout, [this]() { return !m_fresh || m_stopped; });
+	}
+
+	//! Waits for a value newer than the last one taken and returns it. Only the consumer may use it, until it acquires again.
+	/**
+	\return The newest value, or NULL once the buffer is stopped.
+	*/
+	const T* acquire()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_published.wait(lock, [this]() { return m_fresh || m_stopped; });
+			if (m_stopped)
+			{
+				return NULL;
+			}
+			std::swap(m_readSlot, m_readySlot);
+			m_fresh = false;
+		}
+		m_taken.notify_one();
+		return &m_slots[m_readSlot];
+	}
+
+	//! Stops the consumer waiting for values, which makes acquire return NULL.
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopped = true;
+		}
+		m_published.notify_all();
+		m_taken.notify_all();
+	}
+};
+
+#endif
@@ -0,0 +1,171 @@
+#version 330
+
+in vec2 ScreenCoord;
+
+//Light Uniform Data
+struct LightAttr
+{
+	vec3 position;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+uniform LightAttr light;
+
+//Camera Uniform Data
+uniform vec3 viewPos;
+uniform mat4 view;
+uniform mat4 inverseViewProjection;
+
+//G-Buffer Inputs
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform sampler2D gDepth;
+
+//Clustered Point Light Data
+uniform bool clusteredLighting;
+uniform samplerBuffer clusterLights;   //Two texels per light: (position, radius) and (colour, unused).
+uniform usamplerBuffer clusterGrid;    //One texel per cluster: (first light index, light count).
+uniform usamplerBuffer clusterIndices; //Light indices grouped by cluster.
+uniform ivec3 clusterDims;
+uniform vec2 clusterScreenSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+
+//Directional Sun Light and Cascaded Shadow Data
+uniform bool sunLighting;
+uniform vec3 sunDirection; //Direction the sun light travels in, in world space.
+uniform vec3 sunColour;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 cascadeMatrices[4];
+uniform float cascadeSplits[4];
+
+//Point Light Shadow Data
+uniform bool pointShadows;
+uniform samplerCubeShadow pointShadowMap; //Distance to the nearest caster divided by pointShadowFar.
+uniform float pointShadowFar;
+
+//Final Pixel Colour Output Location
+out vec4 color;
+
+//Function to unwrap an octahedral encoded normal back into a unit vector.
+vec3 octahedralDecode(vec2 encoded)
+{
+	vec2 f = encoded * 2.0 - 1.0;
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+//Function to calculate the diffuse and specular factors of a light direction.
+vec2 lightFactors(vec3 lightDir, vec3 normal, vec3 viewDir)
+{
+	float diffFactor = max(dot(lightDir, normal), 0.0);
+	float specFactor = pow(max(dot(normalize(lightDir + viewDir), normal), 0.0), 32.0);
+	return vec2(diffFactor, specFactor);
+}
+
+//Function to find how lit a world position is by the main point light, from its shadow cube map.
+float pointShadow(vec3 fragPos)
+{
+	vec3 fromLight = fragPos - light.position;
+	float reference = length(fromLight) / pointShadowFar - 0.005;
+	return texture(pointShadowMap, vec4(fromLight, reference));
+}
+
+//Function to find how lit a world position is by the sun, from the cascade covering its view depth.
+float cascadedShadow(vec3 fragPos, float viewDepth)
+{
+	//Beyond the last cascade nothing is shadowed.
+	int cascade = 0;
+	while(cascade < 4 && viewDepth > cascadeSplits[cascade])
+	{
+		++cascade;
+	}
+	if(cascade == 4)
+	{
+		return 1.0;
+	}
+
+	vec4 lightSpacePos = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
+	vec3 shadowCoord = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+
+	//3x3 percentage closer filtering with hardware depth comparison.
+	vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0;
+	for(int x = -1; x <= 1; ++x)
+	{
+		for(int y = -1; y <= 1; ++y)
+		{
+			lit += texture(shadowMap, vec4(shadowCoord.xy + vec2(x, y) * texelSize, float(cascade), shadowCoord.z - 0.001));
+		}
+	}
+	return lit / 9.0;
+}
+
+//Function to sum the contributions of the point lights assigned to this pixel's cluster.
+vec3 clusteredPointLights(vec3 fragPos, float viewDepth, vec3 normal, vec3 viewDir)
+{
+	ivec3 cluster;
+	cluster.xy = ivec2(gl_FragCoord.xy / clusterScreenSize * vec2(clusterDims.xy));
+	cluster.z = int(log(viewDepth) * clusterSliceScale - clusterSliceBias);
+	cluster = clamp(cluster, ivec3(0), clusterDims - 1);
+	int clusterIndex = cluster.x + clusterDims.x * (cluster.y + clusterDims.y * cluster.z);
+
+	uvec2 range = texelFetch(clusterGrid, clusterIndex).xy;
+	vec3 result = vec3(0.0);
+	for(uint i = 0u; i < range.y; ++i)
+	{
+		int lightIndex = int(texelFetch(clusterIndices, int(range.x + i)).r);
+		vec4 positionRadius = texelFetch(clusterLights, lightIndex * 2);
+		vec3 lightColour = texelFetch(clusterLights, lightIndex * 2 + 1).rgb;
+
+		vec3 toLight = positionRadius.xyz - fragPos;
+		float distRatio = length(toLight) / positionRadius.w;
+		float attenuation = clamp(1.0 - distRatio * distRatio, 0.0, 1.0);
+		attenuation *= attenuation;
+
+		vec2 factors = lightFactors(normalize(toLight), normal, viewDir);
+		result += (factors.x + factors.y) * attenuation * lightColour;
+	}
+	return result;
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+
+	//Leave pixels which no geometry covered as the clear colour.
+	if(albedo.a == 0.0)
+	{
+		discard;
+	}
+
+	//Reconstruct the world space position from the depth buffer.
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	vec4 clipPos = vec4(ScreenCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	vec4 worldPos = inverseViewProjection * clipPos;
+	vec3 fragPos = worldPos.xyz / worldPos.w;
+	float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+
+	vec3 normal = octahedralDecode(texelFetch(gNormal, pixel, 0).rg);
+	vec3 viewDir = normalize(viewPos - fragPos);
+
+	//Main light, with the same ambient, diffuse and specular terms as the forward pass.
+	vec2 factors = lightFactors(normalize(light.position - fragPos), normal, viewDir);
+	float lightVisibility = pointShadows ? pointShadow(fragPos) : 1.0;
+	vec3 result = 0.1 * light.ambient + (factors.x * light.diffuse + factors.y * light.specular) * lightVisibility;
+
+	if(sunLighting)
+	{
+		vec2 sunFactors = lightFactors(-sunDirection, normal, viewDir);
+		result += (sunFactors.x + sunFactors.y) * cascadedShadow(fragPos, viewDepth) * sunColour;
+	}
+	if(clusteredLighting)
+	{
+		result += clusteredPointLights(fragPos, viewDepth, normal, viewDir);
+	}
+	color = vec4(result * albedo.rgb, 1.0);
+}
@@ -0,0 +1,78 @@
+#version 330
+
+//Interface Block
+in VS_OUT
+{
+	in vec3 FragPos;
+	in vec2 TextCoord;
+	in vec3 FragNormal;
+	
+	//Tangent space position conversions.
+	vec3 TangentLightPos;
+    vec3 TangentViewPos;
+    vec3 TangentFragPos;
+
+	//Clustered lighting data.
+	float ViewDepth; //Distance along the camera's view direction.
+	mat3 TBN;        //World to tangent space conversion.
+}fs_in;
+
+//User Input Variables
+uniform bool parallaxMapping;
+uniform bool normalMapping;
+uniform float heightScale;
+
+//Model Textures
+uniform sampler2D texture_diffuse0;
+uniform sampler2D texture_normal0;
+uniform sampler2D texture_height0;
+
+//G-Buffer Outputs
+layout(location = 0) out vec2 gNormal; //Octahedral encoded world space normal.
+layout(location = 1) out vec4 gAlbedo; //Surface colour, alpha marks covered pixels.
+
+//Function to offset the texture fragment with parallax.
+vec2 parallaxMap(vec2 textCoord, vec3 viewDir)
+{
+	float height = texture(texture_height0, textCoord).r;
+	vec2  offset = viewDir.xy / viewDir.z * (height * heightScale);
+	return textCoord - offset;
+}
+
+//Function to fold a unit vector onto an octahedron and unwrap it into the [0, 1] square.
+vec2 octahedralEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return folded * 0.5 + 0.5;
+}
+
+void main()
+{   
+	vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+	vec2 textCoord = fs_in.TextCoord;
+
+	//Parallax map texture fragment if toggled to.
+	if(parallaxMapping)
+	{
+		textCoord = parallaxMap(fs_in.TextCoord, viewDir);
+		
+		//Discard if out of texture co-ordinate range.
+		if(textCoord.x < 0.0 || textCoord.y < 0.0 || textCoord.x > 1.0 || textCoord.y > 1.0)
+		{	
+			discard;
+		}
+	}
+
+	//Normal Mapping (in tangent space, like the forward pass).
+	vec3 normal = normalize(fs_in.FragNormal);
+	if(normalMapping)
+	{
+		vec2 normalXY = texture(texture_normal0, fs_in.TextCoord).rg * 2.0 - 1.0; //Z is rebuilt, as BC5 normal maps only store X and Y.
+		normal = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
+	}
+
+	//TBN is orthonormal, so its transpose takes the normal back into world space.
+	gNormal = octahedralEncode(normalize(transpose(fs_in.TBN) * normal));
+	gAlbedo = vec4(texture(texture_diffuse0, textCoord).rgb, 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330
+
+in vec3 FragPos;
+
+//Light Uniform Data
+uniform vec3 lightPos;
+uniform float farPlane;
+
+//Store the linear distance to the light, so every face can be compared the same way.
+void main()
+{
+	gl_FragDepth = length(FragPos - lightPos) / farPlane;
+}
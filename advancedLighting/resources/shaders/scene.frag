@@ -11,6 +11,10 @@ in VS_OUT
 	vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+
+	//Clustered lighting data.
+	float ViewDepth; //Distance along the camera's view direction.
+	mat3 TBN;        //World to tangent space conversion.
 }fs_in;
 
 //Light Uniform Data
@@ -23,6 +27,29 @@ struct LightAttr
 };
 uniform LightAttr light;
 
+//Clustered Point Light Data
+uniform bool clusteredLighting;
+uniform samplerBuffer clusterLights;   //Two texels per light: (position, radius) and (colour, unused).
+uniform usamplerBuffer clusterGrid;    //One texel per cluster: (first light index, light count).
+uniform usamplerBuffer clusterIndices; //Light indices grouped by cluster.
+uniform ivec3 clusterDims;
+uniform vec2 clusterScreenSize;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+
+//Directional Sun Light and Cascaded Shadow Data
+uniform bool sunLighting;
+uniform vec3 sunDirection; //Direction the sun light travels in, in world space.
+uniform vec3 sunColour;
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 cascadeMatrices[4];
+uniform float cascadeSplits[4];
+
+//Point Light Shadow Data
+uniform bool pointShadows;
+uniform samplerCubeShadow pointShadowMap; //Distance to the nearest caster divided by pointShadowFar.
+uniform float pointShadowFar;
+
 //User Input Variables
 uniform bool parallaxMapping;
 uniform bool normalMapping;
@@ -45,6 +72,77 @@ vec2 parallaxMap(vec2 textCoord, vec3 viewDir)
 	return textCoord - offset;
 }
 
+//Function to find how lit a world position is by the main point light, from its shadow cube map.
+float pointShadow(vec3 fragPos)
+{
+	vec3 fromLight = fragPos - light.position;
+	float reference = length(fromLight) / pointShadowFar - 0.005;
+	return texture(pointShadowMap, vec4(fromLight, reference));
+}
+
+//Function to find how lit a world position is by the sun, from the cascade covering its view depth.
+float cascadedShadow(vec3 fragPos, float viewDepth)
+{
+	//Beyond the last cascade nothing is shadowed.
+	int cascade = 0;
+	while(cascade < 4 && viewDepth > cascadeSplits[cascade])
+	{
+		++cascade;
+	}
+	if(cascade == 4)
+	{
+		return 1.0;
+	}
+
+	vec4 lightSpacePos = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
+	vec3 shadowCoord = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+
+	//3x3 percentage closer filtering with hardware depth comparison.
+	vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0;
+	for(int x = -1; x <= 1; ++x)
+	{
+		for(int y = -1; y <= 1; ++y)
+		{
+			lit += texture(shadowMap, vec4(shadowCoord.xy + vec2(x, y) * texelSize, float(cascade), shadowCoord.z - 0.001));
+		}
+	}
+	return lit / 9.0;
+}
+
+//Function to sum the contributions of the point lights assigned to this fragment's cluster.
+vec3 clusteredPointLights(vec3 normal, vec3 viewDir)
+{
+	//Find the cluster from the fragment's screen tile and exponential depth slice.
+	ivec3 cluster;
+	cluster.xy = ivec2(gl_FragCoord.xy / clusterScreenSize * vec2(clusterDims.xy));
+	cluster.z = int(log(fs_in.ViewDepth) * clusterSliceScale - clusterSliceBias);
+	cluster = clamp(cluster, ivec3(0), clusterDims - 1);
+	int clusterIndex = cluster.x + clusterDims.x * (cluster.y + clusterDims.y * cluster.z);
+
+	uvec2 range = texelFetch(clusterGrid, clusterIndex).xy;
+	vec3 result = vec3(0.0);
+	for(uint i = 0u; i < range.y; ++i)
+	{
+		int lightIndex = int(texelFetch(clusterIndices, int(range.x + i)).r);
+		vec4 positionRadius = texelFetch(clusterLights, lightIndex * 2);
+		vec3 lightColour = texelFetch(clusterLights, lightIndex * 2 + 1).rgb;
+
+		//Smooth falloff which reaches zero at the light's radius.
+		vec3 toLight = positionRadius.xyz - fs_in.FragPos;
+		float distRatio = length(toLight) / positionRadius.w;
+		float attenuation = clamp(1.0 - distRatio * distRatio, 0.0, 1.0);
+		attenuation *= attenuation;
+
+		//Same diffuse and specular model as the main light, in tangent space.
+		vec3 lightDir = normalize(fs_in.TBN * toLight);
+		float diffFactor = max(dot(lightDir, normal), 0.0);
+		float specFactor = pow(max(dot(normalize(lightDir + viewDir), normal), 0.0), 32.0);
+		result += (diffFactor + specFactor) * attenuation * lightColour;
+	}
+	return result;
+}
+
 void main()
 {   
 	vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
@@ -68,8 +166,9 @@ void main()
 	vec3 normal = normalize(fs_in.FragNormal);
 	if(normalMapping) //Only normal map model when user interaction has toggled for it.
 	{
-		normal = texture(texture_normal0, fs_in.TextCoord).rgb;
-		normal = normalize(normal * 2.0 - 1.0); //Constrain within range.
+		//Only X and Y are read, as two channel (BC5) normal maps don't store Z. It's rebuilt from them, facing out of the surface.
+		vec2 normalXY = texture(texture_normal0, fs_in.TextCoord).rg * 2.0 - 1.0; //Constrain within range.
+		normal = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
 	}
 	
 	//Ambient Light Colour Contribution
@@ -87,6 +186,22 @@ void main()
 	vec3 specular = specFactor * light.specular;
 	
 	//Resultant Final Colour from Combined Contributions
-	vec3 result = (ambient + diffuse + specular ) * objectColor;
+	float lightVisibility = pointShadows ? pointShadow(fs_in.FragPos) : 1.0;
+	vec3 result = (ambient + (diffuse + specular) * lightVisibility) * objectColor;
+	
+	//Shadowed Sun Light Contribution
+	if(sunLighting)
+	{
+		vec3 sunDir = normalize(fs_in.TBN * -sunDirection);
+		float sunDiffuse = max(dot(sunDir, normal), 0.0);
+		float sunSpecular = pow(max(dot(normalize(sunDir + viewDir), normal), 0.0), 32.0);
+		result += (sunDiffuse + sunSpecular) * cascadedShadow(fs_in.FragPos, fs_in.ViewDepth) * sunColour * objectColor;
+	}
+
+	//Clustered Point Light Contributions
+	if(clusteredLighting)
+	{
+		result += clusteredPointLights(normal, viewDir) * objectColor;
+	}
 	color = vec4(result , 1.0f);
 }
\ No newline at end of file
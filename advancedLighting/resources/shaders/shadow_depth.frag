@@ -0,0 +1,6 @@
+#version 330
+
+//Only depth is written, which the rasteriser does without any fragment output.
+void main()
+{
+}
@@ -17,6 +17,16 @@
 *<br>
 *	P Key: Toggle Parallax Mapping On/Off <br>
 *	N Key: Toggle Normal Mapping On/Off <br>
+*	L Key: Toggle Clustered Point Lights On/Off <br>
+*	G Key: Toggle Deferred Shading On/Off <br>
+*	C Key: Toggle Sun Light with Cascaded Shadows On/Off <br>
+*	O Key: Toggle Point Light Shadows On/Off <br>
+*	M Key: Toggle Mesh Levels of Detail On/Off <br>
+*	K Key: Toggle Meshlet Culling On/Off <br>
+*	V Key: Toggle Software Occlusion Culling On/Off <br>
+*	H Key: Toggle GPU Hi-Z Culled Instance Field On/Off (OpenGL 4.3) <br>
+*	B Key: Toggle Video Memory Overlay in the Window Title On/Off <br>
+*	J Key: Write Video Memory Report to gpuMemory.json <br>
 *<br>
 *	R Key: Reset Camera <br>
 *	Space Key: Stop Model Rotation <br>
@@ -32,12 +42,28 @@
 
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <sstream>
+#include <mutex>
+#include <atomic>
 
 //Required Class' Header Files
 #include "../../include/independent/shader.h"
 #include "../../include/independent/camera.h"
 #include "../../include/independent/texture.h"
 #include "../../include/independent/model.h"
+#include "../../include/independent/lightCluster.h"
+#include "../../include/independent/gbuffer.h"
+#include "../../include/independent/shadow.h"
+#include "../../include/independent/pointShadow.h"
+#include "../../include/independent/hiz.h"
+#include "../../include/independent/jobSystem.h"
+#include "../../include/independent/tripleBuffer.h"
+#include "../../include/independent/resourceLoader.h"
+#include "../../include/independent/sceneStreamer.h"
+#include "../../include/independent/mappedFileSystem.h"
+#include "../../include/independent/gpuResources.h"
+#include "../../include/independent/gpuMemory.h"
 
 //Viewing Variables
 Camera camera = Camera();
@@ -65,26 +91,127 @@ bool bRotate = true;		  //!< Whether or not the model should rotate.
 GLfloat fHeightScale = 0.1f;  //!< Parallax's height mapping height.
 Model objectModel;			  //!< The model to be rendered.
 
+//Clustered Lighting Variables
+const int POINT_LIGHT_COUNT = 256;	//!< Number of small dynamic point lights orbiting the model.
+bool bClusteredLights = true;		//!< Whether or not the clustered point lights are applied.
+std::vector<PointLight> pointLights; //!< The dynamic point lights in the scene.
+LightClusterGrid lightClusters;		//!< Assigns the point lights to the clusters of the camera's frustum.
+
+//Deferred Shading Variables
+bool bDeferredShading = false; //!< Whether the scene is rendered with the deferred path rather than the forward pass.
+GBuffer gBuffer;			   //!< Normal, albedo and depth targets of the deferred geometry pass.
+
+//Shadow Variables
+glm::vec3 sunDirection(-0.4f, -1.0f, -0.3f);	//!< Direction the sun light travels in.
+bool bSunShadows = true;						//!< Whether or not the shadowed sun light is applied.
+CascadedShadowMap cascadedShadows;				//!< Cascaded shadow maps of the sun light.
+bool bPointShadows = true;						//!< Whether or not the main point light casts shadows.
+PointShadowMap pointShadows;					//!< Shadow cube map of the main point light.
+
+//Level of Detail Variables
+bool bMeshLods = true;				//!< Whether or not meshes are drawn at the level of detail picked from their screen size.
+const GLfloat LOD_PIXEL_ERROR = 1.0f; //!< Largest simplification error allowed on screen, in pixels.
+bool bMeshletCulling = true;		//!< Whether or not full resolution meshes are culled per meshlet by the frustum and their normal cones.
+
+//Occlusion Culling Variables
+bool bOcclusionCulling = true;		//!< Whether or not meshes hidden behind the rasterised occluders are culled.
+OcclusionBuffer occlusionBuffer;	//!< Low resolution CPU depth buffer the occluders are rasterised into.
+
+//GPU Culling Variables
+const int INSTANCE_GRID_SIZE = 32;	//!< Width and depth of the grid of model instances culled on the GPU.
+bool bHiZInstances = false;			//!< Whether or not the GPU culled instance field is drawn.
+HiZOcclusion hiZOcclusion;			//!< Culls the instance field against the previous frame's depth pyramid.
+
+//Streaming Variables
+const GLfloat STREAM_LOAD_DISTANCE = 30.0f;				//!< Distance from a streamed model's bounds at which it starts loading.
+const size_t STREAM_GPU_BUDGET = 256 * 1024 * 1024;		//!< Most video memory the streamed models may take.
+const size_t STREAM_CPU_BUDGET = 256 * 1024 * 1024;		//!< Most system memory the streamed models may take.
+const size_t TEXTURE_RETAIN_BUDGET = 64 * 1024 * 1024;	//!< Most video memory of textures no model uses to keep, for models streamed back in.
+const char* TEXTURE_DDS_CACHE_PATH = "resources/textureCache"; //!< Directory model textures are cached in once block compressed, so later runs skip encoding them.
+SceneStreamer sceneStreamer;							//!< Loads the models listed in streamedModels.txt as the camera approaches them.
+const char* MODEL_ARCHIVE_PATH = "resources/models.pak";	//!< Packed archive whose files are read instead of loose model, material and texture files, if it exists.
+
+//Memory Reporting Variables
+const char* WINDOW_TITLE = "P2423910 Shaders Assignment";	//!< The window's title while the memory overlay is off.
+const char* GPU_MEMORY_DUMP_PATH = "gpuMemory.json";		//!< File the video memory report is written to.
+const double MEMORY_OVERLAY_INTERVAL = 0.5;					//!< Seconds between updates of the memory overlay.
+bool bMemoryOverlay = false;								//!< Whether the video memory summary is shown in the window's title.
+std::atomic<bool> bDumpGpuMemory(false);					//!< Set to have the render thread write the video memory report.
+std::mutex memoryOverlayMutex;								//!< Guards memoryOverlayText.
+std::string memoryOverlayText;								//!< Latest summary from the render thread, which only the main thread may show.
+
+//Render Thread Variables
+/**
+\struct FrameState
+\brief Everything the render thread needs to draw one frame, copied from the simulation so the two threads share no changing state.
+*/
+struct FrameState
+{
+	glm::mat4 projection;				 //!< The camera's projection matrix.
+	glm::mat4 view;						 //!< The camera's view matrix.
+	glm::mat4 model;					 //!< The model's transformation.
+	glm::vec3 viewPosition;				 //!< The camera's position.
+	GLfloat fieldOfView;				 //!< The camera's vertical field of view in radians.
+	GLfloat nearPlane;					 //!< The camera's near plane distance.
+	GLfloat farPlane;					 //!< The camera's far plane distance.
+	GLfloat projectionScale;			 //!< The camera's projection scale for the window's height, used to pick levels of detail.
+	glm::vec3 lightPosition;			 //!< Position of the main point light.
+	std::vector<PointLight> pointLights; //!< The dynamic point lights.
+	bool normalMapping;					 //!< Copy of bNormalMapping.
+	bool parallaxMapping;				 //!< Copy of bParallaxMapping.
+	bool rotate;						 //!< Copy of bRotate.
+	bool clusteredLights;				 //!< Copy of bClusteredLights.
+	bool deferredShading;				 //!< Copy of bDeferredShading.
+	bool sunShadows;					 //!< Copy of bSunShadows.
+	bool pointShadows;					 //!< Copy of bPointShadows.
+	bool meshLods;						 //!< Copy of bMeshLods.
+	bool meshletCulling;				 //!< Copy of bMeshletCulling.
+	bool occlusionCulling;				 //!< Copy of bOcclusionCulling.
+	bool hiZInstances;					 //!< Copy of bHiZInstances.
+	bool memoryOverlay;					 //!< Copy of bMemoryOverlay.
+};
+ResourceLoader resourceLoader;			 //!< Creates the model's buffers and textures on a background context shared with the render thread's.
+TripleBuffer<FrameState> frameStates;	 //!< Hands each simulated frame to the render thread, which owns the OpenGL context.
+const int MAX_FRAME_WAIT_MS = 8;		 //!< Longest the simulation waits for the render thread to take a frame before handling input again.
+
+void registerStreamedModels(const char* listPath); //!< Registers the models listed in a file with the scene streamer.
+void captureGpuMemory(GpuMemoryReport& report, const std::string& modelFilePath); //!< Reports the video memory of the renderer and every resident model.
+void captureFrameState(FrameState& frame, GLfloat currentFrame); //!< Copies the camera, lights and user toggles into a frame's state.
+void setSceneUniforms(const Shader& shader, const FrameState& frame); //!< Sets the light, camera and user toggle uniforms shared by the scene shaders.
+void createPointLights();						//!< Fills pointLights with a ring of coloured lights around the model.
+void updatePointLights(GLfloat currentFrame);	//!< Moves the point lights along their orbits.
+void createInstanceTransforms(std::vector<glm::mat4>& transforms); //!< Lays out a grid of model instances behind the main model.
+
 //! A function to utalise the other classes to render a scene of model[s] on a loop while facilitating user input.
 int main()
 {
 	//Check that GLFW could initialise.
 	if (!glfwInit()) std::cout << "Error::GLFW could not initialize GLFW!" << std::endl;
 
-	//Initialise GLFW version and properties.
-	std::cout << "Start OpenGL core profile version 3.3" << std::endl;
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	//Initialise GLFW version and properties. Version 4.3 enables the GPU culling, otherwise fall back to 3.3.
+	std::cout << "Start OpenGL core profile version 4.3" << std::endl;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
 	//Create window.
-	GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "P2423910 Shaders Assignment", NULL, NULL);
+	GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+	if (!window)
+	{
+		std::cout << "Start OpenGL core profile version 3.3" << std::endl;
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+	}
 	if (!window) std::cout << "Error::GLFW could not create winddow!" << std::endl; //Check window was created successfully.
 
 	//Set GLFW's context the window and set its callbacks to functions.
 	glfwMakeContextCurrent(window); //Set window.
 
+	//Start the job system's workers. This thread owns the context while loading, then hands it to the render thread.
+	JobSystem& jobs = JobSystem::instance();
+
 	//Set callbacks to according functions.
 	glfwSetKeyCallback(window, key_callback);
 	glfwSetCursorPosCallback(window, mouse_move_callback);
@@ -108,9 +235,57 @@ int main()
 	//Load full file path from modelPath.
 	std::string modelFilePath;
 	std::getline(modelPath, modelFilePath);
-	if (!objectModel.loadModel(modelFilePath)) std::cout << "Error::could not load model from file path." << std::endl; //Check model was successfully loaded.
+
+	//Keep some textures after the models using them go, so streaming a model back in, or another model with the same images, doesn't upload them again.
+	TextureCache::instance().setRetainBudget(TEXTURE_RETAIN_BUDGET);
+	//Block compress model textures as they're imported, caching the results as DDS files.
+	TextureCache::instance().setCompression(true, TEXTURE_DDS_CACHE_PATH);
+
+	//Read models and their files from the packed archive when there is one.
+	if (std::ifstream(MODEL_ARCHIVE_PATH)) MappedIOSystem::mountArchive(MODEL_ARCHIVE_PATH);
+
+	//Load the model on the loader thread's shared context, so the window starts drawing straight away. Load it here if the loader couldn't start.
+	if (resourceLoader.setup(window)) objectModel.loadModelAsync(modelFilePath, resourceLoader);
+	else if (!objectModel.loadModel(modelFilePath)) std::cout << "Error::could not load model from file path." << std::endl; //Check model was successfully loaded.
+
+	//Register the models which are streamed in around the camera, when the loader is running.
+	if (resourceLoader.isRunning())
+	{
+		sceneStreamer.setup(resourceLoader, STREAM_LOAD_DISTANCE, STREAM_GPU_BUDGET, STREAM_CPU_BUDGET);
+		registerStreamedModels("streamedModels.txt");
+	}
 	//Load shaders.
 	Shader shader("resources/shaders/scene.vertex", "resources/shaders/scene.frag");
+	Shader gBufferShader("resources/shaders/scene.vertex", "resources/shaders/gbuffer.frag");
+	Shader deferredShader("resources/shaders/deferred.vertex", "resources/shaders/deferred.frag");
+
+	//Create the G-buffer and the empty vertex array the full-screen lighting pass is drawn with.
+	if (!gBuffer.setup(WINDOW_WIDTH, WINDOW_HEIGHT)) std::cout << "Error::could not create the G-buffer." << std::endl;
+	GLuint fullScreenVAO;
+	glGenVertexArrays(1, &fullScreenVAO);
+
+	//Create the sun's cascaded shadow maps and the shader the casters are drawn with.
+	Shader shadowDepthShader("resources/shaders/shadow_depth.vertex", "resources/shaders/shadow_depth.frag");
+	if (!cascadedShadows.setup(1024)) std::cout << "Error::could not create the cascaded shadow maps." << std::endl;
+	cascadedShadows.setLightDirection(sunDirection);
+	std::vector<ShadowCaster> shadowCasters;
+
+	//Create the main point light's shadow cube map, rendered in one layered pass through a geometry shader.
+	Shader pointShadowShader("resources/shaders/point_shadow.vertex", "resources/shaders/point_shadow.frag", "resources/shaders/point_shadow.geom");
+	if (!pointShadows.setup(512, 25.0f)) std::cout << "Error::could not create the point light shadow map." << std::endl;
+
+	//Allocate the CPU occlusion buffer at a quarter of the window's resolution on each axis.
+	occlusionBuffer.setup(WINDOW_WIDTH / 4, WINDOW_HEIGHT / 4);
+
+	//Create the GPU culled instance field and its compute shaders, when the context supports them.
+	Shader* hiZDownsampleShader = NULL;
+	Shader* hiZCullShader = NULL;
+	if (HiZOcclusion::isSupported())
+	{
+		hiZDownsampleShader = new Shader("resources/shaders/hiz_downsample.comp");
+		hiZCullShader = new Shader("resources/shaders/hiz_cull.comp");
+		if (!hiZOcclusion.setup(WINDOW_WIDTH, WINDOW_HEIGHT)) std::cout << "Error::could not create the Hi-Z pyramid." << std::endl;
+	}
 
 	//Enable depth test for 3D geometry.
 	glEnable(GL_DEPTH_TEST);
@@ -119,12 +294,204 @@ int main()
 	//Set window's clear colour to blue.
 	glClearColor(0.0f, 0.5f, 0.75f, 1.0f);
 
+	//Create the dynamic point lights.
+	createPointLights();
+
+	//The render thread takes over the context, drawing each frame the simulation publishes while this thread handles the next.
+	glfwMakeContextCurrent(NULL);
+	bool bLastRotate = bRotate; //Whether the last frame drawn rotated the model.
+	std::thread renderThread([&]()
+	{
+		glfwMakeContextCurrent(window);
+		jobs.setMainThread();
+		std::vector<CommandList> threadCommandLists; //Draws recorded by each job system thread.
+		CommandList drawList;						 //Every recorded draw, sorted for replay.
+		bool bInstancesCreated = false;				 //Whether the instance field has been laid out around the loaded model.
+		double nextOverlayTime = 0.0;				 //When the memory overlay is next updated.
+
+		//Draw frames until the simulation stops.
+		while (const FrameState* frame = frameStates.acquire())
+		{
+			//Clear window buffer.
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			//Run the OpenGL work queued by jobs.
+			jobs.pumpMainThreadQueue();
+
+			//The model appears once its background load finishes, which polling isReady completes, then the instance field is laid out from its size.
+			const bool bModelReady = objectModel.isReady();
+			if (!bInstancesCreated && hiZCullShader && bModelReady)
+			{
+				std::vector<glm::mat4> instanceTransforms;
+				createInstanceTransforms(instanceTransforms);
+				hiZOcclusion.setInstances(objectModel, instanceTransforms);
+				bInstancesCreated = true;
+			}
+
+			//Stream models in and out around the camera. Static shadow casters change with the resident models.
+			if (sceneStreamer.update(frame->viewPosition))
+			{
+				cascadedShadows.invalidateStaticCasters();
+				pointShadows.invalidateStaticCasters();
+			}
+
+			//Get the frame's projection/zoom and view.
+			const GLfloat aspect = (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
+			const glm::mat4& projection = frame->projection;
+			const glm::mat4& view = frame->view;
+
+			//Assign the point lights to the clusters of the camera's frustum.
+			if (frame->clusteredLights)
+			{
+				lightClusters.updateFrustum(frame->fieldOfView, aspect, frame->nearPlane, frame->farPlane);
+				lightClusters.assignLights(frame->pointLights, view);
+				lightClusters.upload();
+			}
+
+			//The model joins or leaves the cached shadow maps when it starts or stops rotating.
+			if (frame->rotate != bLastRotate)
+			{
+				cascadedShadows.invalidateStaticCasters();
+				pointShadows.invalidateStaticCasters();
+				bLastRotate = frame->rotate;
+			}
+
+			const glm::mat4& model = frame->model; //Rotation to apply to model mesh.
+			const Frustum cameraFrustum(projection * view); //Frustum the meshes are culled against.
+			const LodSelection lodSelection = { frame->viewPosition, frame->projectionScale, LOD_PIXEL_ERROR }; //Picks each mesh's level of detail.
+
+			//Rasterise the occluders on the CPU, which the meshes are then tested against before drawing.
+			if (frame->occlusionCulling)
+			{
+				occlusionBuffer.beginFrame(projection * view);
+				objectModel.addOccluders(occlusionBuffer, cameraFrustum, model);
+				occlusionBuffer.rasterise();
+			}
+			const OcclusionBuffer* occlusion = frame->occlusionCulling ? &occlusionBuffer : NULL; //Occluders the meshes are tested against.
+
+			//Record the model's draws across the job system's threads, then merge them into one sorted list for the scene pass to replay.
+			for (std::vector<CommandList>::iterator it = threadCommandLists.begin(); threadCommandLists.end() != it; ++it)
+			{
+				it->clear();
+			}
+			objectModel.record(threadCommandLists, cameraFrustum, model, frame->viewPosition, frame->meshLods ? &lodSelection : NULL, frame->meshletCulling, occlusion);
+			sceneStreamer.record(threadCommandLists, cameraFrustum, frame->viewPosition, frame->meshLods ? &lodSelection : NULL, frame->meshletCulling, occlusion);
+			CommandList::merge(threadCommandLists, drawList);
+
+			//Cull the instance field on the GPU against the pyramid built at the end of the last frame.
+			const bool bDrawInstances = frame->hiZInstances && bInstancesCreated;
+			if (bDrawInstances) hiZOcclusion.cull(*hiZCullShader, cameraFrustum);
+			else hiZOcclusion.invalidatePyramid();
+
+			//The model only counts as a static caster (which cached shadow maps keep) while it isn't rotating.
+			shadowCasters.clear();
+			shadowCasters.push_back(ShadowCaster(&objectModel, model, !frame->rotate));
+			const std::vector<StreamedModel>& streamedModels = sceneStreamer.getEntries();
+			for (std::vector<StreamedModel>::const_iterator it = streamedModels.begin(); streamedModels.end() != it; ++it)
+			{
+				if (it->isResident()) shadowCasters.push_back(ShadowCaster(it->model, it->transform, true));
+			}
+
+			//Render the sun's shadow cascades.
+			if (frame->sunShadows)
+			{
+				cascadedShadows.update(view, frame->fieldOfView, aspect, frame->nearPlane, frame->farPlane);
+				cascadedShadows.render(shadowDepthShader, shadowCasters);
+			}
+
+			//Render the main point light's shadow cube map.
+			if (frame->pointShadows)
+			{
+				pointShadows.setLightPosition(frame->lightPosition);
+				pointShadows.render(pointShadowShader, shadowCasters);
+			}
+
+			if (frame->deferredShading)
+			{
+				//Geometry pass: evaluate the parallax/normal mapped materials once per pixel into the G-buffer.
+				glDisable(GL_BLEND);
+				gBuffer.bindForGeometry();
+				gBufferShader.use();
+				setSceneUniforms(gBufferShader, *frame);
+				drawList.replay(gBufferShader);
+				if (bDrawInstances) hiZOcclusion.draw(gBufferShader);
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+				//Lighting pass: one full-screen pass which reads the G-buffer and the clustered light lists.
+				deferredShader.use();
+				setSceneUniforms(deferredShader, *frame);
+				glUniformMatrix4fv(glGetUniformLocation(deferredShader.programId, "inverseViewProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(projection * view)));
+				gBuffer.bindForLighting(deferredShader);
+				glUniform1i(glGetUniformLocation(deferredShader.programId, "clusteredLighting"), frame->clusteredLights);
+				if (frame->clusteredLights) lightClusters.bind(deferredShader, (GLfloat)WINDOW_WIDTH, (GLfloat)WINDOW_HEIGHT);
+				if (frame->sunShadows) cascadedShadows.bind(deferredShader);
+				if (frame->pointShadows) pointShadows.bind(deferredShader);
+
+				glDisable(GL_DEPTH_TEST);
+				glBindVertexArray(fullScreenVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+				glEnable(GL_DEPTH_TEST);
+				glEnable(GL_BLEND);
+				if (frame->clusteredLights) lightClusters.unbind();
+
+				//Copy the scene's depth to the window so anything drawn afterwards is still depth tested.
+				gBuffer.blitDepth(0);
+			}
+			else
+			{
+				//Use the shader set to shader.
+				shader.use();
+				setSceneUniforms(shader, *frame);
+
+				//Bind the clustered point lights.
+				glUniform1i(glGetUniformLocation(shader.programId, "clusteredLighting"), frame->clusteredLights);
+				if (frame->clusteredLights) lightClusters.bind(shader, (GLfloat)WINDOW_WIDTH, (GLfloat)WINDOW_HEIGHT);
+				if (frame->sunShadows) cascadedShadows.bind(shader);
+				if (frame->pointShadows) pointShadows.bind(shader);
+
+				//Draw the model.
+				drawList.replay(shader);
+				if (bDrawInstances) hiZOcclusion.draw(shader);
+				if (frame->clusteredLights) lightClusters.unbind();
+			}
+
+			//Reduce this frame's depth into the pyramid the next frame's instances are culled against.
+			if (bDrawInstances) hiZOcclusion.updatePyramid(*hiZDownsampleShader, projection * view);
+
+			//Bind Vertex Array.
+			glBindVertexArray(0);
+			//Set shader program.
+			glUseProgram(0);
+
+			//Swap window's buffers.
+			glfwSwapBuffers(window);
+
+			//Delete the objects released during this frame once the GPU has finished with it, and any earlier frames' which it has.
+			GpuResourceRegistry::instance().endFrame();
+
+			//Report the video memory when asked, and for the overlay a couple of times a second. The driver can only be queried here, where the context is.
+			bool bDumpMemory = bDumpGpuMemory.exchange(false);
+			if (bDumpMemory || (frame->memoryOverlay && glfwGetTime() >= nextOverlayTime))
+			{
+				GpuMemoryReport report;
+				captureGpuMemory(report, modelFilePath);
+				if (bDumpMemory && GpuMemoryTracker::dumpJson(GPU_MEMORY_DUMP_PATH, report)) std::cout << "Wrote video memory report to " << GPU_MEMORY_DUMP_PATH << std::endl;
+				if (frame->memoryOverlay)
+				{
+					std::lock_guard<std::mutex> lock(memoryOverlayMutex);
+					memoryOverlayText = GpuMemoryTracker::formatSummary(report);
+					nextOverlayTime = glfwGetTime() + MEMORY_OVERLAY_INTERVAL;
+				}
+			}
+		}
+		sceneStreamer.final();
+		glfwMakeContextCurrent(NULL);
+	});
+
 	//Start application loop to run while the window hasn't been closed.
+	std::string shownTitle = WINDOW_TITLE; //Title the window is showing, which only this thread may set.
 	while (!glfwWindowShouldClose(window))
 	{
-		//Clear window buffer.
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
 		//Set frame update data to new values.
 		GLfloat currentFrame = (GLfloat)glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
@@ -133,56 +500,59 @@ int main()
 		//Check for input.
 		glfwPollEvents(); 
 
-		//Get current projection/zoom and view from camera.
-		glm::mat4 projection = glm::perspective(glm::radians(camera.getZoom()), (GLfloat)(WINDOW_WIDTH / WINDOW_HEIGHT), 1.0f, 100.0f);
-		glm::mat4 view = camera.getViewMatrix(); 
-
-		//Use the shader set to shader.
-		shader.use();
-
-		//Get light uniform data locations from shader.
-		GLint lightAmbientLoc = glGetUniformLocation(shader.programId, "light.ambient");
-		GLint lightDiffuseLoc = glGetUniformLocation(shader.programId, "light.diffuse");
-		GLint lightSpecularLoc = glGetUniformLocation(shader.programId, "light.specular");
-		GLint lightPosLoc = glGetUniformLocation(shader.programId, "light.position");
-		//Set light uniform data to the shader program's uniforms.
-		glUniform3f(lightAmbientLoc, 0.3f, 0.3f, 0.3f);
-		glUniform3f(lightDiffuseLoc, 0.6f, 0.6f, 0.6f);
-		glUniform3f(lightSpecularLoc, 1.0f, 1.0f, 1.0f);
-		glUniform3f(lightPosLoc, lightSrcPosition.x, lightSrcPosition.y, lightSrcPosition.z);
-		
-		//Get camera's uniform data location from shader.
-		GLint viewPosLoc = glGetUniformLocation(shader.programId, "viewPos");
-		glUniform3f(viewPosLoc, camera.getPosition().x, camera.getPosition().y, camera.getPosition().z); //Set camera uniform data to the shader program's uniforms.
-		
-		//Get light positions' uniform's location.
-		lightPosLoc = glGetUniformLocation(shader.programId, "lightPos");
-		glUniform3f(lightPosLoc, lightSrcPosition.x, lightSrcPosition.y, lightSrcPosition.z); //Set light position uniform.
-		//Get and set data to camera projection and views' uniform locations.
-		glUniformMatrix4fv(glGetUniformLocation(shader.programId, "projection"), 1, GL_FALSE, glm::value_ptr(projection)); //Set camera projection uniform.
-		glUniformMatrix4fv(glGetUniformLocation(shader.programId, "view"), 1, GL_FALSE, glm::value_ptr(view));			   //Set camera view uniform.
-		
-		glm::mat4 model; //Rotation to apply to model mesh.
-		if (bRotate) model = glm::rotate(model, currentFrame -2, glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f))); //Rotate the model.
-
-		//Get and set user input data to the model and normal/parallax mappings' uniform locations.
-		glUniformMatrix4fv(glGetUniformLocation(shader.programId, "model"), 1, GL_FALSE, glm::value_ptr(model));
-		glUniform1i(glGetUniformLocation(shader.programId, "normalMapping"), bNormalMapping);
-		glUniform1i(glGetUniformLocation(shader.programId, "parallaxMapping"), bParallaxMapping);
-		glUniform1f(glGetUniformLocation(shader.programId, "heightScale"), fHeightScale);
-
-		//Draw the model.
-		objectModel.draw(shader);
-
-		//Bind Vertex Array.
-		glBindVertexArray(0);
-		//Set shader program.
-		glUseProgram(0);
-
-		//Swap window's buffers.
-		glfwSwapBuffers(window);
+		//Move the point lights along their orbits.
+		if (bClusteredLights) updatePointLights(currentFrame);
+
+		//Hand the frame to the render thread, then simulate the next while it draws, staying at most one frame ahead.
+		captureFrameState(frameStates.getWriteSlot(), currentFrame);
+		frameStates.publish();
+		frameStates.waitUntilTaken(std::chrono::milliseconds(MAX_FRAME_WAIT_MS));
+
+		//Show the render thread's latest memory summary as the overlay.
+		std::string title = WINDOW_TITLE;
+		if (bMemoryOverlay)
+		{
+			std::lock_guard<std::mutex> lock(memoryOverlayMutex);
+			if (!memoryOverlayText.empty()) title = memoryOverlayText;
+		}
+		if (title != shownTitle)
+		{
+			glfwSetWindowTitle(window, title.c_str());
+			shownTitle = title;
+		}
 	}
 
+	//Stop the render thread and take the context back to release the resources.
+	frameStates.stop();
+	renderThread.join();
+	glfwMakeContextCurrent(window);
+	jobs.setMainThread();
+
+	//Clear the light cluster buffers and G-buffer while the context still exists.
+	lightClusters.final();
+	gBuffer.final();
+	cascadedShadows.final();
+	pointShadows.final();
+	glDeleteVertexArrays(1, &fullScreenVAO);
+	if (hiZCullShader)
+	{
+		hiZOcclusion.final();
+		delete hiZDownsampleShader;
+		delete hiZCullShader;
+	}
+	resourceLoader.final();
+	objectModel = Model();
+	shader.final();
+	gBufferShader.final();
+	deferredShader.final();
+	shadowDepthShader.final();
+	pointShadowShader.final();
+	TextureCache::instance().evictUnreferenced();
+
+	//Everything has been released, so delete what's left and report anything which wasn't.
+	GpuResourceRegistry::instance().flush();
+	GpuResourceRegistry::instance().reportLeaks();
+
 	//Termintate GLFW when window closes.
 	glfwTerminate();
 	return 0;
@@ -214,6 +584,50 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 			bParallaxMapping = !bParallaxMapping;
 			std::cout << "Using Parallax Mapping " << (bParallaxMapping ? "True" : "False") << std::endl;
 			break;
+		case(GLFW_KEY_L):
+			bClusteredLights = !bClusteredLights;
+			std::cout << "Using Clustered Point Lights " << (bClusteredLights ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_G):
+			bDeferredShading = !bDeferredShading;
+			std::cout << "Using Deferred Shading " << (bDeferredShading ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_C):
+			bSunShadows = !bSunShadows;
+			std::cout << "Using Sun Light with Cascaded Shadows " << (bSunShadows ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_O):
+			bPointShadows = !bPointShadows;
+			std::cout << "Using Point Light Shadows " << (bPointShadows ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_M):
+			bMeshLods = !bMeshLods;
+			std::cout << "Using Mesh Levels of Detail " << (bMeshLods ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_K):
+			bMeshletCulling = !bMeshletCulling;
+			std::cout << "Using Meshlet Culling " << (bMeshletCulling ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_V):
+			bOcclusionCulling = !bOcclusionCulling;
+			std::cout << "Using Software Occlusion Culling " << (bOcclusionCulling ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_H):
+			if (!HiZOcclusion::isSupported())
+			{
+				std::cout << "GPU Hi-Z Culling requires OpenGL 4.3" << std::endl;
+				break;
+			}
+			bHiZInstances = !bHiZInstances;
+			std::cout << "Using GPU Hi-Z Culled Instance Field " << (bHiZInstances ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_B):
+			bMemoryOverlay = !bMemoryOverlay;
+			std::cout << "Showing Video Memory Overlay " << (bMemoryOverlay ? "True" : "False") << std::endl;
+			break;
+		case(GLFW_KEY_J):
+			bDumpGpuMemory = true;
+			break;
 		case(GLFW_KEY_SPACE):
 			bRotate = !bRotate;
 			std::cout << "Rotating " << (bRotate ? "True" : "False") << std::endl;
@@ -284,4 +698,176 @@ void mouse_move_callback(GLFWwindow* window, double xpos, double ypos)
 void mouse_scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	camera.handleMouseScroll(yoffset);
+}
+
+//! Sets the light, camera and user toggle uniforms which the forward, G-buffer and deferred lighting shaders share.
+/*!
+\param shader The shader program to set the uniforms of. Must be in use.
+\param frame The frame's camera, lights and user toggles.
+*/
+void setSceneUniforms(const Shader& shader, const FrameState& frame)
+{
+	//Get light uniform data locations from shader.
+	GLint lightAmbientLoc = glGetUniformLocation(shader.programId, "light.ambient");
+	GLint lightDiffuseLoc = glGetUniformLocation(shader.programId, "light.diffuse");
+	GLint lightSpecularLoc = glGetUniformLocation(shader.programId, "light.specular");
+	GLint lightPosLoc = glGetUniformLocation(shader.programId, "light.position");
+	//Set light uniform data to the shader program's uniforms.
+	glUniform3f(lightAmbientLoc, 0.3f, 0.3f, 0.3f);
+	glUniform3f(lightDiffuseLoc, 0.6f, 0.6f, 0.6f);
+	glUniform3f(lightSpecularLoc, 1.0f, 1.0f, 1.0f);
+	glUniform3f(lightPosLoc, frame.lightPosition.x, frame.lightPosition.y, frame.lightPosition.z);
+	
+	//Get camera's uniform data location from shader.
+	GLint viewPosLoc = glGetUniformLocation(shader.programId, "viewPos");
+	glUniform3f(viewPosLoc, frame.viewPosition.x, frame.viewPosition.y, frame.viewPosition.z); //Set camera uniform data to the shader program's uniforms.
+	
+	//Get light positions' uniform's location.
+	lightPosLoc = glGetUniformLocation(shader.programId, "lightPos");
+	glUniform3f(lightPosLoc, frame.lightPosition.x, frame.lightPosition.y, frame.lightPosition.z); //Set light position uniform.
+	//Get and set data to camera projection and views' uniform locations.
+	glUniformMatrix4fv(glGetUniformLocation(shader.programId, "projection"), 1, GL_FALSE, glm::value_ptr(frame.projection)); //Set camera projection uniform.
+	glUniformMatrix4fv(glGetUniformLocation(shader.programId, "view"), 1, GL_FALSE, glm::value_ptr(frame.view));			   //Set camera view uniform.
+
+	//Get and set user input data to the model and normal/parallax mappings' uniform locations.
+	glUniformMatrix4fv(glGetUniformLocation(shader.programId, "model"), 1, GL_FALSE, glm::value_ptr(frame.model));
+	glUniform1i(glGetUniformLocation(shader.programId, "normalMapping"), frame.normalMapping);
+	glUniform1i(glGetUniformLocation(shader.programId, "parallaxMapping"), frame.parallaxMapping);
+	glUniform1f(glGetUniformLocation(shader.programId, "heightScale"), fHeightScale);
+
+	//Set the sun light's toggle and colour.
+	glUniform1i(glGetUniformLocation(shader.programId, "sunLighting"), frame.sunShadows);
+	glUniform3f(glGetUniformLocation(shader.programId, "sunColour"), 0.5f, 0.45f, 0.4f);
+	glUniform1i(glGetUniformLocation(shader.programId, "pointShadows"), frame.pointShadows);
+
+	//Keep the buffer and shadow samplers on their own texture units even while their feature is off, as samplers of different types can't share a unit.
+	glUniform1i(glGetUniformLocation(shader.programId, "clusterLights"), LightClusterGrid::TEXTURE_UNIT_BASE);
+	glUniform1i(glGetUniformLocation(shader.programId, "clusterGrid"), LightClusterGrid::TEXTURE_UNIT_BASE + 1);
+	glUniform1i(glGetUniformLocation(shader.programId, "clusterIndices"), LightClusterGrid::TEXTURE_UNIT_BASE + 2);
+	glUniform1i(glGetUniformLocation(shader.programId, "shadowMap"), CascadedShadowMap::TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(shader.programId, "pointShadowMap"), PointShadowMap::TEXTURE_UNIT);
+}
+
+/*!
+\param frame Where to store the frame's state.
+\param currentFrame The application's current time, used as the model's rotation angle.
+*/
+void captureFrameState(FrameState& frame, GLfloat currentFrame)
+{
+	frame.projection = camera.getProjectionMatrix((GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT);
+	frame.view = camera.getViewMatrix();
+	frame.model = glm::mat4();
+	if (bRotate) frame.model = glm::rotate(frame.model, currentFrame - 2, glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f))); //Rotate the model.
+	frame.viewPosition = camera.getPosition();
+	frame.fieldOfView = glm::radians(camera.getZoom());
+	frame.nearPlane = camera.getNearPlane();
+	frame.farPlane = camera.getFarPlane();
+	frame.projectionScale = camera.getProjectionScale((GLfloat)WINDOW_HEIGHT);
+	frame.lightPosition = lightSrcPosition;
+	frame.pointLights = pointLights; //Reuses the slot's storage after the first few frames.
+	frame.normalMapping = bNormalMapping;
+	frame.parallaxMapping = bParallaxMapping;
+	frame.rotate = bRotate;
+	frame.clusteredLights = bClusteredLights;
+	frame.deferredShading = bDeferredShading;
+	frame.sunShadows = bSunShadows;
+	frame.pointShadows = bPointShadows;
+	frame.meshLods = bMeshLods;
+	frame.meshletCulling = bMeshletCulling;
+	frame.occlusionCulling = bOcclusionCulling;
+	frame.hiZInstances = bHiZInstances;
+	frame.memoryOverlay = bMemoryOverlay;
+}
+
+/*!
+\param listPath File listing one model per line as its path, world position and bounding radius, e.g. "models/rock.obj 0 0 -40 3".
+*/
+void registerStreamedModels(const char* listPath)
+{
+	std::ifstream list(listPath);
+	std::string line;
+	while (std::getline(list, line))
+	{
+		//Skip blank lines and comments.
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string path;
+		glm::vec3 position;
+		GLfloat radius = 0.0f;
+		if (!(fields >> path >> position.x >> position.y >> position.z >> radius))
+		{
+			std::cout << "Error::could not read streamed model line: " << line << std::endl;
+			continue;
+		}
+		sceneStreamer.addModel(path, glm::translate(glm::mat4(), position), BoundingBox(glm::vec3(-radius), glm::vec3(radius)));
+	}
+}
+
+/*!
+\param report Where to store the report.
+\param modelFilePath File the main model was loaded from.
+Must be called on the render thread, which owns the context and the streamed models.
+*/
+void captureGpuMemory(GpuMemoryReport& report, const std::string& modelFilePath)
+{
+	GpuMemoryTracker::capture(report, true);
+	GpuMemoryTracker::addModel(report, modelFilePath, objectModel);
+	const std::vector<StreamedModel>& streamedModels = sceneStreamer.getEntries();
+	for (std::vector<StreamedModel>::const_iterator it = streamedModels.begin(); streamedModels.end() != it; ++it)
+	{
+		if (it->model)
+		{
+			GpuMemoryTracker::addModel(report, it->path, *it->model);
+		}
+	}
+}
+
+void createPointLights()
+{
+	pointLights.clear();
+	pointLights.reserve(POINT_LIGHT_COUNT);
+	for (int i = 0; i < POINT_LIGHT_COUNT; ++i)
+	{
+		//Spread the lights over several rings of different heights, each with a hue that varies around the ring.
+		float fraction = (float)i / POINT_LIGHT_COUNT;
+		glm::vec3 colour(0.5f + 0.5f * sin(fraction * 6.2832f), 0.5f + 0.5f * sin(fraction * 6.2832f + 2.094f), 0.5f + 0.5f * sin(fraction * 6.2832f + 4.189f));
+		pointLights.push_back(PointLight(glm::vec3(0.0f), 0.75f, colour, 0.5f));
+	}
+	updatePointLights(0.0f);
+}
+
+/*!
+\param currentFrame The application's current time, used as the orbit angle.
+*/
+void updatePointLights(GLfloat currentFrame)
+{
+	const int RING_COUNT = 8;
+	JobSystem::instance().parallelFor(0, pointLights.size(), [currentFrame](size_t i)
+	{
+		int ring = (int)i % RING_COUNT;
+		float angle = (float)i / pointLights.size() * 6.2832f * RING_COUNT + currentFrame * (ring % 2 ? 0.5f : -0.5f);
+		float radius = 2.0f + 0.25f * ring;
+		pointLights[i].position = glm::vec3(radius * cos(angle), -1.0f + 0.4f * ring, radius * sin(angle));
+	}, 64);
+}
+
+/*!
+\param transforms Where to store the transformation of each instance.
+*/
+void createInstanceTransforms(std::vector<glm::mat4>& transforms)
+{
+	//Space the instances by the model's size, starting a row behind it.
+	const BoundingBox& bounds = objectModel.getBounds();
+	glm::vec3 size = bounds.isEmpty() ? glm::vec3(1.0f) : bounds.max - bounds.min;
+	float spacing = 1.5f * std::max(size.x, std::max(size.y, size.z));
+	transforms.resize(INSTANCE_GRID_SIZE * INSTANCE_GRID_SIZE);
+	JobSystem::instance().parallelFor(0, transforms.size(), [&transforms, spacing](size_t i)
+	{
+		int x = (int)i % INSTANCE_GRID_SIZE, z = (int)i / INSTANCE_GRID_SIZE;
+		glm::vec3 position((x - (INSTANCE_GRID_SIZE - 1) * 0.5f) * spacing, 0.0f, -(z + 1) * spacing);
+		transforms[i] = glm::translate(glm::mat4(), position);
+	}, 64);
 }
\ No newline at end of file